@@ -0,0 +1,72 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_ab_block.h
+ *
+ * @brief Checks of the accelerometer blocks stored in the AB flash
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#ifndef __USER_AB_BLOCK_H__
+#define __USER_AB_BLOCK_H__
+
+#include "common.h"
+
+/**
+ ****************************************************************************************
+ * @brief CRC-32 of a block as stored in flash
+ *
+ * Covers every field except the CRC itself and the trailing padding.
+ * All 0xFF (an erased page) never matches, so an unwritten page is also
+ * caught.
+ ****************************************************************************************
+ */
+uint32_t ab_block_crc(const accelBufferStruct *block);
+
+/**
+ ****************************************************************************************
+ * @brief pdTRUE if a block read from flash is intact
+ *
+ * Blocks written by 1.10.17 and earlier have no CRC (the field was
+ * padding), but may still be waiting to be sent after an update.  A
+ * block whose CRC doesn't match is accepted as one of those if its data
+ * sequence is below precrc_sequence and its fields are plausible.
+ *
+ * @param[in] block            block as read from flash
+ * @param[in] precrc_sequence  data sequence of the first block written
+ *                             with a CRC, 0 if there are no older blocks
+ ****************************************************************************************
+ */
+int ab_block_valid(const accelBufferStruct *block, ULONG precrc_sequence);
+
+#endif /* __USER_AB_BLOCK_H__ */
+
+/* EOF */
@@ -0,0 +1,124 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_ab_stage.h
+ *
+ * @brief Write-back staging of FIFO buffers in retention memory
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#ifndef __USER_AB_STAGE_H__
+#define __USER_AB_STAGE_H__
+
+#include "common.h"
+
+/*
+ * Half a sector's worth of FIFO buffers (eight pages), not a whole sector.
+ * The stage lives in the retention memory DATA region together with the
+ * rest of UserDataBuffer, and a whole sector of blocks (4 KB) is the size
+ * of that region by itself.  A sector is therefore written in two flushes.
+ */
+#define AB_STAGE_MAX_BLOCKS (AB_BLOCKS_PER_SECTOR / 2)
+
+/*
+ * The flash operations the stage uses.  The application passes its own
+ * (see AB_store_block() in neuralert.c); the host tests pass a simulated
+ * flash.
+ */
+typedef struct
+{
+	HANDLE (*open)(void);			//!< power up the SPI bus, NULL on failure
+	void (*close)(HANDLE spi);
+	int (*write_location)(void);	//!< next block index to write, < 0 on failure
+	int (*store)(HANDLE spi, accelBufferStruct *blocks, int num_blocks, int *did_an_erase);
+									//!< write blocks that fit in the rest of a page
+									//!< and advance the write location; TRUE if ok
+} abStageFlash;
+
+/*
+ * FIFO buffers waiting in retention memory to be written to flash.
+ *
+ * Retention memory survives sleep and a watchdog or software reset, but
+ * not a brown-out or power-on reset.  Buffers that were staged and not
+ * yet flushed when the battery browns out are lost - up to
+ * AB_STAGE_MAX_BLOCKS FIFO reads, about a minute of data.  The journal
+ * only protects a flush that is interrupted while retention memory stays
+ * up, or that fails part way through.  For that reason the application
+ * builds without AB_STAGE_WRITE_BACK by default.
+ */
+typedef struct
+{
+	int16_t count;					//!< # of FIFO buffers waiting in blocks
+	// Journal of a flush in progress, so that a flush that is interrupted
+	// or fails part way is finished on a later wake instead of losing the
+	// buffers
+	int16_t flushing;				//!< pdTRUE while blocks are being written
+	int16_t flushed;				//!< # of blocks already written
+	unsigned int flush_count;		//!< stats: # of flushes
+	unsigned int replay_count;		//!< stats: # of unfinished flushes finished later
+	accelBufferStruct blocks[AB_STAGE_MAX_BLOCKS];
+} abStage;
+
+/**
+ ****************************************************************************************
+ * @brief Write the staged FIFO buffers to flash
+ *
+ * The buffers go to consecutive flash locations with one SPI session.
+ * Buffers that share a page are written together, so each page is
+ * programmed once.  If a write doesn't go through, the flush stops there
+ * and the journal is left for the next call.
+ *
+ * @param[out] did_an_erase  pdTRUE if a sector was erased
+ *
+ * @return TRUE if every buffer was written
+ ****************************************************************************************
+ */
+int ab_stage_flush(abStage *stage, const abStageFlash *flash, int *did_an_erase);
+
+/**
+ ****************************************************************************************
+ * @brief Stage one FIFO buffer
+ *
+ * The buffer is written to flash, together with the others staged before
+ * it, once the stage reaches the end of the sector being written or is
+ * full.  Until then the flash isn't touched.
+ *
+ * @param[out] did_an_erase  pdTRUE if a sector was erased
+ *
+ * @return TRUE unless the buffer was lost or a flush that was due failed
+ ****************************************************************************************
+ */
+int ab_stage_block(abStage *stage, const abStageFlash *flash,
+		const accelBufferStruct *fifo_data, int *did_an_erase);
+
+#endif /* __USER_AB_STAGE_H__ */
+
+/* EOF */
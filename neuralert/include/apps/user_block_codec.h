@@ -0,0 +1,100 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_block_codec.h
+ *
+ * @brief Lossless compression of the accelerometer samples in a FIFO block
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#ifndef __USER_BLOCK_CODEC_H__
+#define __USER_BLOCK_CODEC_H__
+
+#include "common.h"
+
+/*
+ * Encoded block layout - the three axes one after the other, each as:
+ *
+ *   1 byte    first sample (int8)
+ *   1 byte    bit width w of the packed deltas (0 to 8)
+ *   n bytes   (num_samples - 1) deltas of w bits each, packed low order
+ *             bit first, padded with zero bits to a whole byte
+ *
+ * Each delta is the difference from the previous sample modulo 256,
+ * zigzag encoded (0 -> 0, -1 -> 1, 1 -> 2, -2 -> 3 ...) so that small
+ * changes of either sign need few bits.  The width is the smallest that
+ * holds every delta of the axis, so a still wrist costs a few bits per
+ * sample and a sudden movement never costs more than 8.
+ *
+ * The number of samples is not part of the encoding; it is carried
+ * alongside (for instance in the packet frame).
+ */
+#define BLOCK_CODEC_MAX_WIDTH			8
+
+// Worst case size of one encoded axis / block of num_samples samples
+#define BLOCK_CODEC_AXIS_MAX_SIZE(num_samples)	(2 + ((((num_samples) - 1) * BLOCK_CODEC_MAX_WIDTH) + 7) / 8)
+#define BLOCK_CODEC_MAX_SIZE(num_samples)		(3 * BLOCK_CODEC_AXIS_MAX_SIZE(num_samples))
+
+/**
+ ****************************************************************************************
+ * @brief Encode the X, Y and Z samples of a FIFO block
+ *
+ * The cost is two passes over each axis with no multiplication or
+ * division, so it is safe to use from the accelerometer read path.
+ *
+ * @param[in]  block	FIFO block (num_samples must be 1 to MAX_ACCEL_FIFO_SIZE)
+ * @param[out] out		buffer to receive the encoding
+ * @param[in]  out_max	size of the buffer
+ *
+ * @return int	number of bytes written, or -1 if the block is invalid
+ *              or the buffer is too small
+ ****************************************************************************************
+ */
+int block_codec_encode(const accelBufferStruct *block, UCHAR *out, int out_max);
+
+/**
+ ****************************************************************************************
+ * @brief Decode the X, Y and Z samples written by block_codec_encode()
+ *
+ * @param[in]  in			encoded block
+ * @param[in]  in_len		bytes available at in
+ * @param[in]  num_samples	number of samples in the block
+ * @param[out] x, y, z		receive num_samples samples each
+ *
+ * @return int	number of bytes consumed, or -1 if the encoding is invalid
+ ****************************************************************************************
+ */
+int block_codec_decode(const UCHAR *in, int in_len, int num_samples,
+					   int8_t *x, int8_t *y, int8_t *z);
+
+#endif /* __USER_BLOCK_CODEC_H__ */
+
+/* EOF */
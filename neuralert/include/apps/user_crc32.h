@@ -0,0 +1,66 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_crc32.h
+ *
+ * @brief CRC-32 used to check accelerometer blocks stored in flash
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#ifndef __USER_CRC32_H__
+#define __USER_CRC32_H__
+
+#include "common.h"
+
+/**
+ ****************************************************************************************
+ * @brief Continue a CRC-32 over len more bytes
+ *
+ * This is the common IEEE 802.3 CRC-32 (reflected polynomial 0xEDB88320,
+ * initial value and final XOR 0xFFFFFFFF), the same as zlib's crc32().
+ * The pre and post inversion is done inside, so a CRC is started by
+ * passing 0 and can be carried across several calls:
+ *
+ *     crc = crc32_update(0, first, first_len);
+ *     crc = crc32_update(crc, second, second_len);
+ *
+ * @param[in]  crc		CRC of the data so far (0 to start)
+ * @param[in]  data		bytes to add
+ * @param[in]  len		number of bytes to add
+ *
+ * @return uint32_t	CRC of everything so far
+ ****************************************************************************************
+ */
+uint32_t crc32_update(uint32_t crc, const UCHAR *data, int len);
+
+#endif /* __USER_CRC32_H__ */
+
+/* EOF */
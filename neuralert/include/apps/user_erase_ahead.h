@@ -0,0 +1,101 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_erase_ahead.h
+ *
+ * @brief Plans the flash erases done ahead of the AB write position
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#ifndef __USER_ERASE_AHEAD_H__
+#define __USER_ERASE_AHEAD_H__
+
+#include "common.h"
+
+// Refill once no more than this many sectors are left erased, so that
+// several sectors are erased together and the 32K/64K block erases can be
+// used where the alignment allows.
+#define AB_ERASE_AHEAD_LOW_WATER (AB_ERASE_AHEAD_SECTORS / 2)
+// Most erase operations done while the MQTT task waits for its connection
+#define AB_ERASE_AHEAD_MAX_OPS 4
+// How long the accelerometer task waits for an erase-ahead of the very
+// sector it needs next before erasing it itself (10 msec polls).  That
+// sector only ever gets a 4K erase (400 msec at most, W25Q64 data sheet),
+// so this leaves most of the ~2 second FIFO interrupt time for the rest
+// of the wake.
+#define AB_ERASE_AHEAD_WAIT_POLLS 50
+
+/**
+ ****************************************************************************************
+ * @brief Number of whole sectors known to be erased from sector_start up to
+ *        next_erase_position
+ *
+ * @return the number of sectors, or -1 if next_erase_position can't be
+ *         right (e.g. retention memory from firmware that didn't keep it)
+ ****************************************************************************************
+ */
+int ab_erased_sectors_from(int next_erase_position, int sector_start);
+
+/**
+ ****************************************************************************************
+ * @brief Pick the next erase to do ahead of the write position
+ *
+ * Nothing is planned while more than AB_ERASE_AHEAD_LOW_WATER sectors are
+ * erased ahead (on the first operation of a refill), once
+ * AB_ERASE_AHEAD_SECTORS are, or while the sector being written isn't
+ * erased.  Otherwise the erase starts at next_erase_position and is the
+ * largest aligned 64K, 32K or 4K erase that fits.  The sector right after
+ * the one being written always gets a 4K erase of its own, so the
+ * accelerometer task is never held up by a block erase.
+ *
+ * @param[in,out] next_erase_position  reset to the sector after the write
+ *                                     position if it can't be right
+ * @param[in]     write_index          next block to write
+ * @param[in]     first_op             pdTRUE for the first erase of a refill
+ * @param[out]    num_sectors          sectors to erase
+ *
+ * @return the block the erase starts at, or -1 if nothing needs erasing
+ ****************************************************************************************
+ */
+int ab_erase_ahead_next(AB_INDEX_TYPE *next_erase_position, int write_index,
+		int first_op, int *num_sectors);
+
+/**
+ ****************************************************************************************
+ * @brief pdTRUE if the sector starting at block sector_start is one of the
+ *        num_sectors sectors from block start
+ ****************************************************************************************
+ */
+int ab_erase_range_covers(int start, int num_sectors, int sector_start);
+
+#endif /* __USER_ERASE_AHEAD_H__ */
+
+/* EOF */
@@ -0,0 +1,95 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_json_packet.h
+ *
+ * @brief Composes the JSON accelerometer packet
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#ifndef __USER_JSON_PACKET_H__
+#define __USER_JSON_PACKET_H__
+
+#include "common.h"
+#include "user_json_writer.h"
+#include "user_packet_encoder.h"
+
+/*
+ * Worst case packet size: the fixed fields (including the 128 character
+ * timesync string) plus, for every sample, three "-128 " values and a
+ * timestamp of up to 12 digits and a space.
+ */
+#define JSON_PACKET_OVERHEAD_MAX_SIZE	640
+#define JSON_SAMPLE_MAX_SIZE			((3 * 5) + 13)
+#define JSON_PACKET_MAX_SIZE(num_samples)	(JSON_PACKET_OVERHEAD_MAX_SIZE \
+											 + ((num_samples) * JSON_SAMPLE_MAX_SIZE))
+
+/**
+ ****************************************************************************************
+ * @brief Compose one JSON packet from a run of FIFO blocks
+ *
+ * The packet level fields come from meta (battery_cv, fault_count,
+ * free_heap, wifi_connect_msec and connect_msec go in the "meta" object).
+ * The sample timestamps are interpolated over each block as
+ * calculate_timestamp_for_sample() does.
+ *
+ * @param[out] out			buffer to receive the packet
+ * @param[in]  out_max		size of the buffer, including the terminator
+ * @param[in]  meta			packet level information
+ * @param[in]  blocks		FIFO blocks, oldest first
+ * @param[in]  num_blocks	number of blocks
+ *
+ * @return length of the packet, or -1 if it didn't fit
+ ****************************************************************************************
+ */
+int json_packet_compose(char *out, int out_max, const packetMetaStruct *meta,
+		const accelBufferStruct *blocks, int num_blocks);
+
+/**
+ ****************************************************************************************
+ * @brief Format the local time part of the "timesync" field
+ *
+ * Gives e.g. "2023.01.17 12:53:55 (GMT +0:00)", as "%s (GMT %+02d:%02d)"
+ * of the hours and remaining seconds of the time zone offset did.
+ *
+ * @param[out] out			buffer to receive the string
+ * @param[in]  out_max		size of the buffer, including the terminator
+ * @param[in]  date_time	local date and time, "%Y.%m.%d %H:%M:%S"
+ * @param[in]  tzoff		time zone offset in seconds (da16x_Tzoff())
+ *
+ * @return pdTRUE if the string fit
+ ****************************************************************************************
+ */
+int json_packet_timesync_str(char *out, int out_max, const char *date_time, int tzoff);
+
+#endif /* __USER_JSON_PACKET_H__ */
+
+/* EOF */
@@ -0,0 +1,92 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_json_writer.h
+ *
+ * @brief Bounded append-cursor text writer used to compose MQTT JSON payloads
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#ifndef __USER_JSON_WRITER_H__
+#define __USER_JSON_WRITER_H__
+
+#include "common.h"
+
+// Buffer sizes (including terminator) for the time string helpers
+#define TIME64_STRING_MAX_LEN			20
+#define TIME64_MSEC_STRING_MAX_LEN		40
+
+/*
+ * Append cursor over a caller supplied character buffer.
+ * The buffer is always kept NUL terminated.  Once an append
+ * doesn't fit, the writer stops appending and remembers the
+ * overflow so the caller only needs to check once at the end.
+ */
+typedef struct
+{
+	char *buf;			//!< start of the buffer
+	int len;			//!< characters written so far (excluding terminator)
+	int max;			//!< size of the buffer (including terminator)
+	int overflow;		//!< pdTRUE if anything was dropped
+} jsonWriter;
+
+void json_writer_init(jsonWriter *writer, char *buf, int max);
+void json_put_char(jsonWriter *writer, char c);
+void json_put_str(jsonWriter *writer, const char *str);
+void json_put_int(jsonWriter *writer, long value);
+void json_put_uint_padded(jsonWriter *writer, unsigned long value, int min_digits);
+void json_put_int64(jsonWriter *writer, long long value);
+void json_put_time64(jsonWriter *writer, __time64_t value);
+void json_writer_advance(jsonWriter *writer, int count);
+
+/**
+ ****************************************************************************************
+ * @brief Number of characters written so far
+ ****************************************************************************************
+ */
+static inline int json_writer_len(jsonWriter *writer)
+{
+	return writer->len;
+}
+
+/**
+ ****************************************************************************************
+ * @brief pdTRUE if everything appended so far fit in the buffer
+ ****************************************************************************************
+ */
+static inline int json_writer_ok(jsonWriter *writer)
+{
+	return (writer->overflow ? pdFALSE : pdTRUE);
+}
+
+#endif /* __USER_JSON_WRITER_H__ */
+
+/* EOF */
@@ -0,0 +1,216 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_log.h
+ *
+ * @brief Console logging with compile-time levels and deferred formatting
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#ifndef __USER_LOG_H__
+#define __USER_LOG_H__
+
+#include "common.h"
+
+#define ULOG_LEVEL_NONE					0
+#define ULOG_LEVEL_ERROR				1
+#define ULOG_LEVEL_WARN					2
+#define ULOG_LEVEL_INFO					3
+#define ULOG_LEVEL_DEBUG				4
+
+#ifndef ULOG_DEFAULT_LEVEL
+#define ULOG_DEFAULT_LEVEL				ULOG_LEVEL_INFO
+#endif
+
+/*
+ * A module that wants more or less than the default defines
+ * ULOG_MODULE_LEVEL before including this header.  Messages above the
+ * module level are compiled out, arguments and all.
+ *
+ * Everything the application prints goes through these macros except:
+ * - console command replies (user_command.c, trace_dump()), which are
+ *   what the operator asked for and so print at any level
+ * - this module's own output, which is the log itself
+ * - the SDK's sample callbacks (user_apps.c, user_gpio_handle.c,
+ *   user_host_interface.c, user_nvram_cmd_table.c), kept as the SDK
+ *   ships them; they print on Wi-Fi events and configuration, not on
+ *   the accelerometer wake path
+ * - code inside #if 0 in neuralert.c, which isn't built
+ */
+#ifndef ULOG_MODULE_LEVEL
+#define ULOG_MODULE_LEVEL				ULOG_DEFAULT_LEVEL
+#endif
+
+/*
+ * With ULOG_DEFERRED set, info and debug messages are not formatted
+ * when they happen.  Only the address of the format string, the time
+ * and up to four 32-bit arguments are stored in retention memory, and
+ * ulog_flush() prints them later, when the UART time doesn't matter.
+ *
+ * Deferred messages therefore take at most four arguments, each of
+ * which must be an integer or a pointer to a string that is still
+ * there when the message is printed (a literal, not a local buffer).
+ * Messages that don't fit that use ULOG_I_NOW/ULOG_D_NOW, which have
+ * the same levels but always print straight away, as do errors and
+ * warnings.
+ *
+ * The stored addresses only mean something to the firmware that stored
+ * them, so the ring records a hash of the build (ULOG_BUILD_ID) and
+ * ulog_init() starts it over when a different build finds it.  Off by
+ * default: a flushed message arrives out of order with everything
+ * printed straight away.
+ */
+#ifndef ULOG_DEFERRED
+#define ULOG_DEFERRED					0
+#endif
+
+// Identifies the build whose format strings are in the ring.  The default
+// changes whenever user_log.c is compiled, so release images should be
+// built clean, or define this as something unique to the image (the git
+// revision, say).
+#ifndef ULOG_BUILD_ID
+#define ULOG_BUILD_ID					USER_VERSION_STRING " " __DATE__ " " __TIME__
+#endif
+
+#define USER_RTM_LOG_TAG				"uLog"
+#define ULOG_RING_MAGIC					0x554C4732		// "ULG2"
+// Number of deferred messages kept (a power of two)
+#define ULOG_RING_SIZE					32
+
+typedef struct
+{
+	const char *fmt;				//!< format string, in flash
+	uint32_t msec;					//!< low 32 bits of msec since power on
+	uint32_t args[4];				//!< arguments, as passed
+} ulogRecord;
+
+typedef struct
+{
+	uint32_t magic;					//!< ULOG_RING_MAGIC once initialized
+	uint32_t build;					//!< hash of ULOG_BUILD_ID of the firmware that stored the messages
+	uint32_t next;					//!< number of messages ever stored
+	uint32_t flushed;				//!< number of messages already printed
+	ulogRecord rec[ULOG_RING_SIZE];
+} ulogRing;
+
+#ifndef APRINTF_E
+#define APRINTF_E						PRINTF
+#endif
+
+// Number of arguments after the format (0 to 4)
+#define ULOG_NARGS(...)					ULOG_NARGS_(0, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+#define ULOG_NARGS_(_0, _1, _2, _3, _4, N, ...)	N
+#define ULOG_CAT(a, b)					ULOG_CAT_(a, b)
+#define ULOG_CAT_(a, b)					a##b
+
+// More than four arguments is a compile error in deferred mode
+#define ULOG_DEFER(fmt, ...)			ULOG_CAT(ULOG_DEFER_, ULOG_NARGS(__VA_ARGS__))(fmt, ##__VA_ARGS__)
+#define ULOG_DEFER_0(fmt)				ulog_deferred(fmt, 0, 0, 0, 0)
+#define ULOG_DEFER_1(fmt, a)			ulog_deferred(fmt, (uint32_t)(a), 0, 0, 0)
+#define ULOG_DEFER_2(fmt, a, b)			ulog_deferred(fmt, (uint32_t)(a), (uint32_t)(b), 0, 0)
+#define ULOG_DEFER_3(fmt, a, b, c)		ulog_deferred(fmt, (uint32_t)(a), (uint32_t)(b), (uint32_t)(c), 0)
+#define ULOG_DEFER_4(fmt, a, b, c, d)	ulog_deferred(fmt, (uint32_t)(a), (uint32_t)(b), (uint32_t)(c), (uint32_t)(d))
+
+#if (ULOG_MODULE_LEVEL >= ULOG_LEVEL_ERROR)
+#define ULOG_E(...)						APRINTF_E(__VA_ARGS__)
+#else
+#define ULOG_E(...)
+#endif
+
+#if (ULOG_MODULE_LEVEL >= ULOG_LEVEL_WARN)
+#define ULOG_W(...)						PRINTF(__VA_ARGS__)
+#else
+#define ULOG_W(...)
+#endif
+
+#if (ULOG_MODULE_LEVEL >= ULOG_LEVEL_INFO) && ULOG_DEFERRED
+#define ULOG_I(fmt, ...)				ULOG_DEFER(fmt, ##__VA_ARGS__)
+#elif (ULOG_MODULE_LEVEL >= ULOG_LEVEL_INFO)
+#define ULOG_I(...)						PRINTF(__VA_ARGS__)
+#else
+#define ULOG_I(...)
+#endif
+
+#if (ULOG_MODULE_LEVEL >= ULOG_LEVEL_INFO)
+#define ULOG_I_NOW(...)					PRINTF(__VA_ARGS__)
+#else
+#define ULOG_I_NOW(...)
+#endif
+
+#if (ULOG_MODULE_LEVEL >= ULOG_LEVEL_DEBUG) && ULOG_DEFERRED
+#define ULOG_D(fmt, ...)				ULOG_DEFER(fmt, ##__VA_ARGS__)
+#elif (ULOG_MODULE_LEVEL >= ULOG_LEVEL_DEBUG)
+#define ULOG_D(...)						PRINTF(__VA_ARGS__)
+#else
+#define ULOG_D(...)
+#endif
+
+#if (ULOG_MODULE_LEVEL >= ULOG_LEVEL_DEBUG)
+#define ULOG_D_NOW(...)					PRINTF(__VA_ARGS__)
+#else
+#define ULOG_D_NOW(...)
+#endif
+
+/**
+ ****************************************************************************************
+ * @brief Find (or create) the deferred message ring in retention memory
+ *
+ * Must be called after every wake, once retention memory is available.
+ * Until then deferred messages are printed straight away.  A ring left
+ * by a different build is emptied.
+ ****************************************************************************************
+ */
+void ulog_init(void);
+
+/**
+ ****************************************************************************************
+ * @brief Store a message to be printed by ulog_flush() (use ULOG_I/ULOG_D)
+ ****************************************************************************************
+ */
+void ulog_deferred(const char *fmt, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+
+/**
+ ****************************************************************************************
+ * @brief Print the deferred messages not printed yet, oldest first
+ ****************************************************************************************
+ */
+void ulog_flush(void);
+
+/**
+ ****************************************************************************************
+ * @brief Discard every deferred message
+ ****************************************************************************************
+ */
+void ulog_clear(void);
+
+#endif /* __USER_LOG_H__ */
+
+/* EOF */
@@ -0,0 +1,135 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_mqtt_publish.h
+ *
+ * @brief Publishes packets over MQTT and collects their PUBACKs
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#ifndef __USER_MQTT_PUBLISH_H__
+#define __USER_MQTT_PUBLISH_H__
+
+#include "common.h"
+#include "queue.h"
+
+// How long to poll when the MQTT client refuses a publish because it still
+// has a message inflight (-2), e.g. while its own inflight count catches
+// up with a PUBACK or while it retransmits an earlier message
+#define MQTT_PUBLISH_BUSY_POLL_MS		20
+
+/*
+ * Called once for every packet the broker has accepted (at once for QOS 0)
+ */
+typedef void (*mqttDeliveredFunc)(packetDataStruct *packet);
+
+/*
+ * The SDK MQTT client accepts a new QOS 1 PUBLISH only when it has no
+ * message inflight, so at most one packet is ever waiting for its PUBACK.
+ * The gain over a plain send-and-wait is that the next packet is read and
+ * composed while the PUBACK of the previous one is on its way.
+ */
+typedef struct
+{
+	QueueHandle_t puback_queue;		//!< message IDs from the publish callback
+	mqttDeliveredFunc delivered;	//!< see mqttDeliveredFunc
+	TickType_t timeout;				//!< how long to wait for a PUBACK
+
+	// The packet waiting for its PUBACK, if inflight
+	int inflight;
+	int mid;						//!< MQTT message ID of the PUBLISH
+	int sequence;					//!< packet sequence within the transmission
+	packetDataStruct packet;		//!< flash blocks carried by the packet
+	TickType_t sent_tick;			//!< when the packet was published
+
+	// Statistics for the current transmission
+	int packets_delivered;
+	int samples_delivered;
+	int busy_retries;				//!< publishes refused with -2 and retried
+	ULONG puback_msec_total;
+} mqttPublisher;
+
+/**
+ ****************************************************************************************
+ * @brief Set up a publisher
+ *
+ * @param[in] puback_queue  queue of int message IDs filled by the publish callback
+ * @param[in] delivered     called for every packet the broker accepts
+ * @param[in] timeout_msec  how long to wait for a PUBACK (and for the client
+ *                          to accept a publish) before giving up
+ ****************************************************************************************
+ */
+void mqtt_publisher_init(mqttPublisher *publisher, QueueHandle_t puback_queue,
+		mqttDeliveredFunc delivered, int timeout_msec);
+
+/**
+ ****************************************************************************************
+ * @brief Start a new transmission
+ *
+ * Clears the statistics, forgets a packet still inflight and discards any
+ * PUBACK still queued.  A packet that was never acknowledged still has its
+ * bits set in the transmit map, so it will simply be sent again.
+ ****************************************************************************************
+ */
+void mqtt_publisher_reset(mqttPublisher *publisher);
+
+/**
+ ****************************************************************************************
+ * @brief Publish a composed packet
+ *
+ * With QOS 1 this first waits for the PUBACK of the previous packet.  The
+ * client copies the payload, so it can be reused as soon as this returns.
+ *
+ * @return 0 on success, -2 on timeout, -1 on error
+ ****************************************************************************************
+ */
+int mqtt_publisher_send(mqttPublisher *publisher, char *payload,
+		packetDataStruct *packet, int sequence, int qos);
+
+/**
+ ****************************************************************************************
+ * @brief Wait for the PUBACK of the packet inflight, if any
+ *
+ * @return 0 on success, -2 on timeout, -1 on error
+ ****************************************************************************************
+ */
+int mqtt_publisher_wait(mqttPublisher *publisher);
+
+/**
+ ****************************************************************************************
+ * @brief Take any PUBACK that has already arrived, without waiting
+ ****************************************************************************************
+ */
+void mqtt_publisher_collect(mqttPublisher *publisher);
+
+#endif /* __USER_MQTT_PUBLISH_H__ */
+
+/* EOF */
@@ -48,6 +48,14 @@
 /// NVRAM name for int-based run flag
 #define NVRAM_CONFIG_RUN_FLAG           "RUN_FLAG"
 
+/// NVRAM names of the upload scheduler tunables (see user_upload_scheduler.h)
+#define NVRAM_CONFIG_UPLOAD_MIN_FIFOS       "UPLOAD_MIN_FIFOS"
+#define NVRAM_CONFIG_UPLOAD_MAX_FIFOS       "UPLOAD_MAX_FIFOS"
+#define NVRAM_CONFIG_UPLOAD_BACKOFF         "UPLOAD_BACKOFF"
+#define NVRAM_CONFIG_UPLOAD_SLOW_CONNECT    "UPLOAD_SLOW_CONN_MS"
+#define NVRAM_CONFIG_UPLOAD_LOW_BATTERY     "UPLOAD_LOW_BAT_CV"
+#define NVRAM_CONFIG_UPLOAD_URGENT_HEADROOM "UPLOAD_URGENT_BLOCKS"
+
 /// NVRAM string value structure
 typedef struct _user_conf_str {
     /// Parameter name (DA16X_USER_CONF_STR)
@@ -234,6 +242,13 @@ typedef enum {
 #endif //(__SUPPORT_OTA__)
 
     DA16X_CONF_INT_RUN_FLAG,
+
+    DA16X_CONF_INT_UPLOAD_MIN_FIFOS,
+    DA16X_CONF_INT_UPLOAD_MAX_FIFOS,
+    DA16X_CONF_INT_UPLOAD_BACKOFF,
+    DA16X_CONF_INT_UPLOAD_SLOW_CONNECT,
+    DA16X_CONF_INT_UPLOAD_LOW_BATTERY,
+    DA16X_CONF_INT_UPLOAD_URGENT_HEADROOM,
     DA16X_CONF_INT_FINAL_MAX
 } DA16X_USER_CONF_INT;
 
@@ -0,0 +1,195 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_packet_encoder.h
+ *
+ * @brief Compact binary encoding of accelerometer packets for MQTT transmission
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#ifndef __USER_PACKET_ENCODER_H__
+#define __USER_PACKET_ENCODER_H__
+
+#include "common.h"
+#include "user_block_codec.h"
+
+/*
+ * Binary packet frame (all multi-byte fixed fields little endian)
+ *
+ *   offset  size  field
+ *   0       2     magic 'N' 'B'
+ *   2       1     frame version (PACKET_FRAME_VERSION)
+ *   3       1     flags (reserved, 0)
+ *   4       2     body length in bytes (everything after this field)
+ *   6       ...   body:
+ *                   varint   transmission number ("trans")
+ *                   varint   sequence within transmission ("seq")
+ *                   2        battery voltage in centivolts ("bat")
+ *                   1        fault count ("count")
+ *                   varint   free heap ("mem")
+ *                   varint   msec from upload start to Wi-Fi up ("wifi")
+ *                   varint   msec from upload start to broker connected ("conn")
+ *                   1+n      device id (length prefixed)
+ *                   1+n      firmware version (length prefixed)
+ *                   1+n      timesync local time string (length prefixed)
+ *                   varint   timesync msec since power on
+ *                   varint   sample count
+ *                   varint   block count
+ *                 each block:
+ *                   1        number of samples in the block
+ *                   varint   accelTime_prev of the block (msec since power on);
+ *                            for every block after the first, zigzag encoded
+ *                            as the difference from the previous block's
+ *                            accelTime
+ *                   varint   zigzag encoded accelTime - accelTime_prev
+ *                   ...      X, Y, Z samples (see user_block_codec.h)
+ *
+ * Varints are unsigned LEB128 (7 bits per byte, low order group first).
+ * The counts come before the blocks, so the frame can be produced while
+ * the blocks are still being read.
+ * The sample timestamps are not sent individually: the receiver spreads
+ * the samples of a block evenly over accelTime_prev..accelTime exactly
+ * as calculate_timestamp_for_sample() does for the JSON packet, so the
+ * timestamps it recovers are identical.
+ */
+#define PACKET_FRAME_MAGIC_0			'N'
+#define PACKET_FRAME_MAGIC_1			'B'
+#define PACKET_FRAME_VERSION			3
+#define PACKET_FRAME_PREAMBLE_SIZE		6
+
+#define PACKET_VARINT_MAX_SIZE			10	// 64-bit value, 7 bits per byte
+#define PACKET_STRING_MAX_LEN			127	// longest string field (timesync)
+
+// Worst case size of everything up to and including the block count
+#define PACKET_FRAME_HEADER_MAX_SIZE	(PACKET_FRAME_PREAMBLE_SIZE				\
+										 + (7 * PACKET_VARINT_MAX_SIZE) + 3		\
+										 + (3 * (1 + PACKET_STRING_MAX_LEN))	\
+										 + PACKET_VARINT_MAX_SIZE)
+// Worst case size of one encoded block
+#define PACKET_FRAME_BLOCK_MAX_SIZE		(1 + (2 * PACKET_VARINT_MAX_SIZE)		\
+										 + BLOCK_CODEC_MAX_SIZE(MAX_ACCEL_FIFO_SIZE))
+// Worst case size of a frame holding num_blocks blocks
+#define PACKET_FRAME_MAX_SIZE(num_blocks)	\
+		(PACKET_FRAME_HEADER_MAX_SIZE + ((num_blocks) * PACKET_FRAME_BLOCK_MAX_SIZE))
+
+// Number of characters (without terminator) to base64 encode len bytes
+#define PACKET_BASE64_SIZE(len)			(4 * (((len) + 2) / 3))
+
+/*
+ * Packet level information that accompanies the samples
+ * (the binary equivalent of the JSON "meta" and top level fields)
+ */
+typedef struct
+{
+	const char *device_id;			//!< Device ID (lower half of the MAC)
+	const char *version;			//!< Firmware version string
+	const char *timesync_str;		//!< Local time at last timesync
+	__time64_t timesync_msec;		//!< Msec since power on at last timesync
+	int msg_number;					//!< Transmission number
+	int sequence;					//!< Packet sequence within transmission
+	uint16_t battery_cv;			//!< Battery voltage in centivolts
+	uint8_t fault_count;			//!< Fault count
+	uint32_t free_heap;				//!< Free heap at time of packet
+	uint32_t wifi_connect_msec;		//!< Upload start to Wi-Fi up
+	uint32_t connect_msec;			//!< Upload start to broker connected
+} packetMetaStruct;
+
+/*
+ * Incremental frame encoder.  Blocks are handed to the encoder one at a
+ * time as they are read, so the caller never needs a table of all the
+ * blocks in the packet.  Once the output buffer fills, further writes
+ * are discarded and packet_encode_end() reports the failure.
+ */
+typedef struct
+{
+	UCHAR *buf;						//!< frame being built
+	int len;						//!< bytes written so far
+	int max;						//!< size of the frame buffer
+	int overflow;					//!< pdTRUE if anything was dropped
+	int samples;					//!< samples encoded so far
+	int blocks;						//!< blocks encoded so far
+	__time64_t prev_time;			//!< accelTime of the previous block
+} packetEncoder;
+
+/**
+ ****************************************************************************************
+ * @brief Start a binary frame and write the packet level information
+ *
+ * @param[out] enc			encoder state
+ * @param[out] frame		buffer to receive the frame
+ * @param[in]  frame_max	size of the frame buffer
+ * @param[in]  meta			packet level information
+ * @param[in]  count		number of samples that will follow
+ * @param[in]  num_blocks	number of blocks that will follow
+ ****************************************************************************************
+ */
+void packet_encode_begin(packetEncoder *enc, UCHAR *frame, int frame_max,
+						 const packetMetaStruct *meta, int count, int num_blocks);
+
+/**
+ ****************************************************************************************
+ * @brief Append one FIFO block to the frame
+ ****************************************************************************************
+ */
+void packet_encode_block(packetEncoder *enc, const accelBufferStruct *block);
+
+/**
+ ****************************************************************************************
+ * @brief Finish the frame
+ *
+ * @param[in]  enc		encoder state
+ * @param[in]  count		number of samples announced in packet_encode_begin()
+ * @param[in]  num_blocks	number of blocks announced in packet_encode_begin()
+ *
+ * @return int	length of the frame in bytes, or -1 if it didn't fit or the
+ *              number of samples or blocks doesn't match the announcement
+ ****************************************************************************************
+ */
+int packet_encode_end(packetEncoder *enc, int count, int num_blocks);
+
+/**
+ ****************************************************************************************
+ * @brief Base64 encode a buffer (standard alphabet, padded)
+ *
+ * @param[out] dst		destination string, NUL terminated on success
+ * @param[in]  dst_max	size of the destination including the terminator
+ * @param[in]  src		bytes to encode
+ * @param[in]  src_len	number of bytes to encode
+ *
+ * @return int	number of characters written (excluding the terminator),
+ *              or -1 if the destination is too small
+ ****************************************************************************************
+ */
+int packet_base64_encode(char *dst, int dst_max, const UCHAR *src, int src_len);
+
+#endif /* __USER_PACKET_ENCODER_H__ */
+
+/* EOF */
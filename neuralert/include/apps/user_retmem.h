@@ -40,10 +40,15 @@
 #ifndef USER_MAIN_INCLUDE_USER_RETMEM_H_
 #define USER_MAIN_INCLUDE_USER_RETMEM_H_
 
+#include "user_retmem_layout.h"
+
 /**
  ****************************************************************************************
  * @brief Initialize User Retention Memory
  *
+ * Clears it on a power-on reset.  On a wake nothing needs recovering,
+ * apart from converting what firmware that allocated by name left.
+ *
  * @return void.
  ****************************************************************************************
  */
@@ -60,49 +65,57 @@ void user_retmem_deinit(void);
 
 /**
  ****************************************************************************************
- * @brief User Retention Memory Allocation
+ * @brief Get a region, creating it if it isn't there
  *
- * @Param[in] name 		 	a name of the memory
- * @Param[in] memory_ptr	a pointer of the memory
- * @Param[in] memory_size 	a size of the memory
+ * A region that was never created, or that was created by firmware with
+ * a different layout, version or size, is cleared to zero and marked as
+ * created with the current ones.
  *
- * @return unsigned int 	0 or error code
+ * @Param[in] region 		region id (see user_retmem_layout.h)
+ * @Param[in] size			size of the contents, at most the region capacity
+ * @Param[out] created		pdTRUE if the region was started over (may be NULL)
+ *
+ * @return void *		 	the contents, or NULL if size doesn't fit
  ****************************************************************************************
  */
-unsigned int user_retmmem_allocate(char *name,
-								   void **memory_ptr,
-								   unsigned long memory_size);
+void *user_retmem_attach(userRetmemRegion region, unsigned int size, int *created);
 
 /**
  ****************************************************************************************
- * @brief User Retention Memory Release
+ * @brief Get a region without creating it
  *
- * @Param[in] name 		 	a name of the memory
+ * @Param[in] region 		region id (see user_retmem_layout.h)
+ * @Param[in] size			size of the contents
  *
- * @return unsigned int 	0 or error code
+ * @return void *		 	the contents, or NULL unless the region was created
+ *							by this layout with this size
  ****************************************************************************************
  */
-unsigned int user_retmmem_release(char *name);
+void *user_retmem_find(userRetmemRegion region, unsigned int size);
 
 /**
  ****************************************************************************************
- * @brief Get the pointer of the User Retention Memory
+ * @brief Get what firmware that allocated by name left for a region
+ *
+ * The first wake after updating from such firmware moves each allocation
+ * whose name matches a region into that region, unconverted.  The owner
+ * converts it before calling user_retmem_attach(), which clears it.
  *
- * @Param[in] name 		 	a name of the memory
- * @Param[in] memory_ptr	a pointer of the memory
+ * @Param[in] region 		region id (see user_retmem_layout.h)
+ * @Param[out] data			the old contents
  *
- * @return unsigned int 	the size of the memory
+ * @return unsigned int 	size of the old contents, 0 if there are none
  ****************************************************************************************
  */
-unsigned int user_retmmem_get(char *name, unsigned char **data);
+unsigned int user_retmem_legacy_get(userRetmemRegion region, unsigned char **data);
 
 /**
  ****************************************************************************************
- * @brief Print out the status of the User Retention Memory
+ * @brief Print out the layout and the state of each region
  *
  * @return void.
  ****************************************************************************************
  */
-void user_retmmem_info_get(void);
+void user_retmem_info(void);
 
 #endif /* USER_MAIN_INCLUDE_USER_RETMEM_H_ */
@@ -0,0 +1,120 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_retmem_layout.h
+ *
+ * @brief Compile time layout of the user retention memory
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+
+#ifndef __USER_RETMEM_LAYOUT_H__
+#define __USER_RETMEM_LAYOUT_H__
+
+#include "common.h"
+#include "user_trace.h"
+#include "user_log.h"
+
+/*
+ * Every region the application keeps in retention memory, in the order
+ * they are laid out:
+ *
+ *   X(id, name, capacity, version)
+ *
+ *   id			region id passed to user_retmem_attach() and friends
+ *   name		printed by user_retmem_info(), and the name the region had
+ *				when retention memory was allocated by name (see
+ *				user_retmem_legacy_get())
+ *   capacity	bytes reserved for the contents
+ *   version	bump when the contents change in a way their size doesn't show
+ *
+ * Offsets are fixed at compile time, so finding a region on wake is an
+ * addition.  Each region starts with a userRetmemHeader recording the
+ * version and size it was created with and a CRC over those and the
+ * region's place in the table.  Firmware with a different layout (a
+ * region moved, resized or versioned) therefore sees a mismatch and
+ * starts the region over rather than reading it with the wrong layout.
+ *
+ * Add new regions at the end: growing a region moves everything after it.
+ */
+#define USER_RETMEM_REGIONS(X)																\
+	X(USER_RETMEM_DATA,		USER_RTM_DATA_TAG,		USER_RETMEM_DATA_CAPACITY,		1)		\
+	X(USER_RETMEM_TRACE,	USER_RTM_TRACE_TAG,		sizeof(traceRing),				1)		\
+	X(USER_RETMEM_LOG,		USER_RTM_LOG_TAG,		sizeof(ulogRing),				1)		\
+	X(USER_RETMEM_SYS_CTRL,	USER_RTM_SYS_CTRL_TAG,	USER_RETMEM_SYS_CTRL_CAPACITY,	1)
+
+#define USER_RTM_DATA_TAG				"uRtmData"
+#define USER_RTM_SYS_CTRL_TAG			"sys_ctrl"
+
+// UserDataBuffer (neuralert.c) is about 3.5KB; the rest is room to grow
+// without moving the regions after it
+#define USER_RETMEM_DATA_CAPACITY		4096
+// struct system_control_t (system_start.c)
+#define USER_RETMEM_SYS_CTRL_CAPACITY	8
+
+#define USER_RETMEM_MAGIC				0x52544D31		// "RTM1"
+// Version of a region carried over from firmware that allocated by name
+#define USER_RETMEM_LEGACY_VERSION		0
+
+// Regions start on 8 byte boundaries
+#define USER_RETMEM_ALIGN(size)			(((size) + 7) & ~7)
+
+typedef struct
+{
+	uint32_t magic;					//!< USER_RETMEM_MAGIC
+	uint16_t version;				//!< version the contents were created with
+	uint16_t reserved;
+	uint32_t size;					//!< size the contents were created with
+	uint32_t check;					//!< CRC-32 of the above and the region's place
+} userRetmemHeader;
+
+#define USER_RETMEM_REGION_ID(id, name, capacity, version)		id,
+typedef enum
+{
+	USER_RETMEM_REGIONS(USER_RETMEM_REGION_ID)
+	USER_RETMEM_REGION_COUNT
+} userRetmemRegion;
+
+/*
+ * The whole layout as a structure, so that the compiler works out the
+ * offsets.  Only used through offsetof() and sizeof().
+ */
+#define USER_RETMEM_REGION_SLOT(id, name, capacity, version)	\
+	userRetmemHeader id##_header;								\
+	UCHAR id##_body[USER_RETMEM_ALIGN(capacity)];
+typedef struct
+{
+	USER_RETMEM_REGIONS(USER_RETMEM_REGION_SLOT)
+} userRetmemLayout;
+
+#endif /* __USER_RETMEM_LAYOUT_H__ */
+
+/* EOF */
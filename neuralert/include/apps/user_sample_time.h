@@ -0,0 +1,111 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_sample_time.h
+ *
+ * @brief Timestamps of the individual samples of a FIFO block
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+
+#ifndef __USER_SAMPLE_TIME_H__
+#define __USER_SAMPLE_TIME_H__
+
+#include "common.h"
+
+/*
+ * The samples of a block are spread evenly over accelTime_prev..accelTime.
+ * Sample i (0 based) of n gets
+ *
+ *   (prev * 1000 + ((time - prev) * 1000 * (i + 1)) / n + 500) / 1000
+ *
+ * i.e. the interpolated time in usec, rounded to the nearest msec.
+ *
+ * calculate_timestamp_for_sample() works this out for one sample, with
+ * two 64-bit multiplies and two 64-bit divides - library calls on this
+ * core.  The stepper below divides once per block and then produces the
+ * timestamps of the block in order with additions: the usec step is kept
+ * as a quotient and a remainder over n, and the running time as msec and
+ * usec, carrying as the remainders fill up.  The results are identical.
+ */
+typedef struct
+{
+	__time64_t msec;				//!< running time, whole msec (rounding included)
+	int usec;						//!< running time, usec part (0 to 999)
+	__time64_t step_msec;			//!< (time - prev) * 1000 / n, msec part
+	int step_usec;					//!< ... usec part
+	int step_rem;					//!< ... remainder over n
+	int rem;						//!< running remainder over n
+	int num_samples;				//!< n
+	int exact;						//!< pdFALSE to fall back on the per-sample calculation
+	int next;						//!< index of the next sample
+	__time64_t time;				//!< block time, for the fallback
+	__time64_t time_prev;			//!< previous block time, for the fallback
+} sampleTimeStepper;
+
+/**
+ ****************************************************************************************
+ * @brief Calculate the timestamp of one sample of a FIFO block
+ *
+ * @param[in]  FIFO_ts				timestamp of the block (when it was read)
+ * @param[in]  FIFO_ts_prev			timestamp of the previous block
+ * @param[in]  offset				position of the sample in the block
+ * @param[in]  FIFO_samples			number of samples in the block
+ * @param[out] adjusted_timestamp	timestamp of the sample
+ ****************************************************************************************
+ */
+void calculate_timestamp_for_sample(__time64_t *FIFO_ts, __time64_t *FIFO_ts_prev, int offset, int FIFO_samples, __time64_t *adjusted_timestamp);
+
+/**
+ ****************************************************************************************
+ * @brief Start on the timestamps of a block
+ *
+ * @param[out] stepper		stepper state
+ * @param[in]  time			timestamp of the block (accelTime)
+ * @param[in]  time_prev	timestamp of the previous block (accelTime_prev)
+ * @param[in]  num_samples	number of samples in the block
+ ****************************************************************************************
+ */
+void sample_time_begin(sampleTimeStepper *stepper, __time64_t time, __time64_t time_prev, int num_samples);
+
+/**
+ ****************************************************************************************
+ * @brief Timestamp of the next sample of the block
+ *
+ * The first call gives the timestamp of sample 0.  Call at most
+ * num_samples times per sample_time_begin().
+ ****************************************************************************************
+ */
+__time64_t sample_time_next(sampleTimeStepper *stepper);
+
+#endif /* __USER_SAMPLE_TIME_H__ */
+
+/* EOF */
@@ -0,0 +1,131 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_trace.h
+ *
+ * @brief Binary event trace kept in retention memory
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#ifndef __USER_TRACE_H__
+#define __USER_TRACE_H__
+
+#include "common.h"
+
+// Set to 0 to compile every TRACE_EVENT() out
+#define USER_TRACE_ENABLED				1
+
+#define USER_RTM_TRACE_TAG				"uTrace"
+#define TRACE_RING_MAGIC				0x54524331		// "TRC1"
+// Number of records kept (a power of two)
+#define TRACE_RING_SIZE					64
+
+/*
+ * Trace event ids.  These are what the dump prints and what
+ * tools/trace_decode.py expects, so only ever add to the end.
+ */
+#define TRACE_EV_BOOT					1	// power on reset
+#define TRACE_EV_WAKE					2	// arg0: wakeup mode
+#define TRACE_EV_SLEEP					3	// arg1: msec awake
+#define TRACE_EV_FIFO_DRAIN				4	// arg0: samples read, arg1: FIFO read #
+#define TRACE_EV_FLASH_WRITE_START		5	// arg1: flash address
+#define TRACE_EV_FLASH_WRITE_END		6	// arg0: pdTRUE if written
+#define TRACE_EV_FLASH_ERASE_START		7	// arg0: sectors, arg1: flash address
+#define TRACE_EV_FLASH_ERASE_END		8	// arg0: pdTRUE if erased
+#define TRACE_EV_UPLOAD_START			9
+#define TRACE_EV_WIFI_UP				10	// arg1: msec since upload start
+#define TRACE_EV_MQTT_CONNECT			11	// arg1: msec since upload start
+#define TRACE_EV_PUBLISH				12	// arg0: sequence
+#define TRACE_EV_PUBACK					13	// arg1: message id
+#define TRACE_EV_UPLOAD_END				14	// radio being shut down
+#define TRACE_EV_COUNT					15
+
+/*
+ * One trace record.  The time is the low 32 bits of the msec since
+ * power on, which wraps after about 49 days; the decoder unwraps it.
+ */
+typedef struct
+{
+	uint32_t msec;					//!< time of the event
+	uint16_t event;					//!< TRACE_EV_*
+	uint16_t arg0;					//!< event specific
+	uint32_t arg1;					//!< event specific
+} traceRecord;
+
+typedef struct
+{
+	uint32_t magic;					//!< TRACE_RING_MAGIC once initialized
+	uint32_t next;					//!< number of records ever written
+	traceRecord rec[TRACE_RING_SIZE];
+} traceRing;
+
+#if USER_TRACE_ENABLED
+#define TRACE_EVENT(event, arg0, arg1)	trace_event((event), (uint16_t)(arg0), (uint32_t)(arg1))
+#else
+#define TRACE_EVENT(event, arg0, arg1)
+#endif
+
+/**
+ ****************************************************************************************
+ * @brief Find (or create) the trace ring in retention memory
+ *
+ * Must be called after every wake, once retention memory is available,
+ * since the pointer to the ring doesn't survive sleep.
+ ****************************************************************************************
+ */
+void trace_init(void);
+
+/**
+ ****************************************************************************************
+ * @brief Append a record to the ring, overwriting the oldest
+ *
+ * Cheap enough to call from any task; does nothing until trace_init().
+ ****************************************************************************************
+ */
+void trace_event(uint16_t event, uint16_t arg0, uint32_t arg1);
+
+/**
+ ****************************************************************************************
+ * @brief Print the ring, oldest record first, for tools/trace_decode.py
+ ****************************************************************************************
+ */
+void trace_dump(void);
+
+/**
+ ****************************************************************************************
+ * @brief Discard every record in the ring
+ ****************************************************************************************
+ */
+void trace_clear(void);
+
+#endif /* __USER_TRACE_H__ */
+
+/* EOF */
@@ -0,0 +1,176 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_transmit_map.h
+ *
+ * @brief Index over the accelerometer buffer (AB) transmit map
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+
+#ifndef __USER_TRANSMIT_MAP_H__
+#define __USER_TRANSMIT_MAP_H__
+
+#include "common.h"
+
+/*
+ * The transmit map (pUserData->AB_transmit_map) has one bit per AB
+ * block, set while the block holds data that hasn't been acknowledged by
+ * the broker.  Next to it, in ordinary RAM, this module keeps a summary
+ * with one bit per map word that is set while the word is non-zero.
+ * Searches use the summary to step over empty stretches of the map a
+ * whole summary word at a time instead of block by block.
+ *
+ * The summary is not kept in retention memory.  ab_map_rebuild() makes
+ * it again from the map after every boot, and after the map has been
+ * written directly.
+ *
+ * The map has a single producer and a single consumer: the accelerometer
+ * task sets the bit of each block it writes and the MQTT task clears the
+ * bits of the blocks the broker has acknowledged, and of the blocks it is
+ * about to erase ahead of the write position.  Nothing here locks or
+ * waits.  Each map and summary word is changed with an atomic
+ * read-modify-write, so the two tasks can work on bits of the same word
+ * at the same time.  ab_map_set() sets the block bit before the summary
+ * bit, and a clear that empties a word looks at the word again after
+ * clearing its summary bit.  Between them this keeps the summary bit of
+ * every non-empty word set.  The summary bit of an empty word may be left
+ * set for a while, which only costs a search a look at that word.
+ *
+ * A search or count running while the other task changes the map sees
+ * each word as it was at some point during the search.  A block set
+ * during a search may be missed until the next one, and a block is
+ * never reported after its bit has been cleared.
+ */
+
+// Summary words needed for one bit per map word
+#define AB_MAP_SUMMARY_SIZE		((AB_TRANSMIT_MAP_SIZE + 31) / 32)
+
+/*
+ * The transmit map up to 1.10.17 had one bit per AB page but used only
+ * 4 bits of each word: page p was bit p % 4 of word p / 4.
+ */
+#define AB_LEGACY_MAP_POS_PER_WORD		sizeof(_AB_transmit_map_t)
+#define AB_LEGACY_TRANSMIT_MAP_SIZE		(AB_FLASH_MAX_PAGES / AB_LEGACY_MAP_POS_PER_WORD + 1)
+
+/*
+ * Word sized loads and stores of the AB positions shared by the
+ * accelerometer and MQTT tasks.  The store makes everything written
+ * before it visible to a task that loads the new value: a write position
+ * is only published after the map bit of the block it passes.
+ */
+#define AB_POSITION_LOAD(ptr)			__atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define AB_POSITION_STORE(ptr, value)	__atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+
+/**
+ ****************************************************************************************
+ * @brief Make the summary from the map
+ *
+ * Call after every boot, once retention memory is available, and after
+ * writing the map directly (e.g. when initializing it), before either task
+ * uses the map.
+ ****************************************************************************************
+ */
+void ab_map_rebuild(const _AB_transmit_map_t *map);
+
+/**
+ ****************************************************************************************
+ * @brief Mark a block as waiting for transmission
+ ****************************************************************************************
+ */
+void ab_map_set(_AB_transmit_map_t *map, int pos);
+
+/**
+ ****************************************************************************************
+ * @brief pdTRUE if a block is waiting for transmission
+ ****************************************************************************************
+ */
+int ab_map_test(const _AB_transmit_map_t *map, int pos);
+
+/**
+ ****************************************************************************************
+ * @brief Clear blocks first .. last (inclusive, first <= last)
+ *
+ * @return the number of those blocks that were waiting for transmission
+ ****************************************************************************************
+ */
+int ab_map_clear_range(_AB_transmit_map_t *map, int first, int last);
+
+/**
+ ****************************************************************************************
+ * @brief Find the nearest block waiting for transmission at or below start
+ *
+ * Searches downwards from start, wrapping from block 0 to the last block
+ * (the direction the transmit task works through the AB), looking at no
+ * more than count blocks.
+ *
+ * @return the block number, or -1 if none of the count blocks is set
+ ****************************************************************************************
+ */
+int ab_map_find_prev(const _AB_transmit_map_t *map, int start, int count);
+
+/**
+ ****************************************************************************************
+ * @brief Length of the run of blocks waiting for transmission at and below start
+ *
+ * Counts consecutive set blocks downwards from start, wrapping from block 0
+ * to the last block, looking at no more than count blocks.
+ *
+ * @return the number of blocks in the run (0 if start itself isn't set)
+ ****************************************************************************************
+ */
+int ab_map_run_prev(const _AB_transmit_map_t *map, int start, int count);
+
+/**
+ ****************************************************************************************
+ * @brief Number of blocks waiting for transmission
+ ****************************************************************************************
+ */
+int ab_map_count(const _AB_transmit_map_t *map);
+
+/**
+ ****************************************************************************************
+ * @brief Set the blocks of the pages waiting in a 1.10.17 transmit map
+ *
+ * That firmware stored one block per page, in the first slot, so page p
+ * becomes block p * AB_BLOCKS_PER_PAGE.  Call ab_map_rebuild() afterwards.
+ *
+ * @param[in,out] map         cleared map to receive the pages
+ * @param[in]     legacy_map  AB_LEGACY_TRANSMIT_MAP_SIZE words of old map
+ *
+ * @return number of pages that were waiting to be sent
+ ****************************************************************************************
+ */
+int ab_map_convert_legacy(_AB_transmit_map_t *map, const _AB_transmit_map_t *legacy_map);
+
+#endif /* __USER_TRANSMIT_MAP_H__ */
+
+/* EOF */
@@ -0,0 +1,119 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_upload_scheduler.h
+ *
+ * @brief Decides when the accelerometer task starts an upload
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#ifndef __USER_UPLOAD_SCHEDULER_H__
+#define __USER_UPLOAD_SCHEDULER_H__
+
+#include "common.h"
+
+// Defaults - these reproduce the original fixed FAST/SLOW triggers
+#define UPLOAD_DEFAULT_MIN_FIFOS			16		// 32 seconds
+#define UPLOAD_DEFAULT_MAX_FIFOS			80		// about 2.5 minutes
+#define UPLOAD_DEFAULT_BACKOFF_AFTER		10
+#define UPLOAD_DEFAULT_SLOW_CONNECT_MSEC	15000
+#define UPLOAD_DEFAULT_LOW_BATTERY_CV		0		// disabled
+#define UPLOAD_DEFAULT_URGENT_HEADROOM		(AB_ERASE_AHEAD_SECTORS * AB_BLOCKS_PER_SECTOR)	// ~17 minutes
+
+// Backoff doublings allowed while the unsent data is close to being
+// overwritten (see upload_scheduler_interval())
+#define UPLOAD_URGENT_BACKOFF_DOUBLINGS		1
+
+// Longest interval accepted (about 9 hours)
+#define UPLOAD_MAX_INTERVAL_FIFOS			16384
+
+/*
+ * Tunables, read from NVRAM at power on (see user_nvram_cmd_table.c).
+ * Intervals are in FIFO reads, about 2 seconds each
+ * (AXL_FIFO_INTERRUPT_THRESHOLD samples at 14 Hz).
+ */
+typedef struct
+{
+	int min_fifos;				//!< interval on a healthy link
+	int max_fifos;				//!< longest interval (backoff limit, low battery)
+	int backoff_after;			//!< failed attempts before the interval starts doubling
+	int slow_connect_msec;		//!< connect time above which uploads are batched more
+	int low_battery_cv;			//!< battery (centivolts) below which uploads are
+								//!< stretched to max_fifos; 0 disables
+	int urgent_headroom;		//!< free blocks below which min_fifos is used regardless
+} uploadSchedulerConfig;
+
+/*
+ * What the scheduler knows about the device when it is asked
+ */
+typedef struct
+{
+	int fifos_since_upload;		//!< FIFO reads since the last upload was started
+	int failed_attempts;		//!< upload attempts since the last delivered packet
+	int pending_blocks;			//!< blocks waiting for transmission
+	int headroom_blocks;		//!< blocks that can be written before unsent data is lost
+	int last_connect_msec;		//!< time the last successful connect took (0 = unknown)
+	int battery_cv;				//!< last battery reading in centivolts (0 = unknown)
+} uploadSchedulerState;
+
+/**
+ ****************************************************************************************
+ * @brief Fill in the built-in tunables
+ ****************************************************************************************
+ */
+void upload_scheduler_defaults(uploadSchedulerConfig *config);
+
+/**
+ ****************************************************************************************
+ * @brief Bring tunables read from NVRAM back into a usable range
+ ****************************************************************************************
+ */
+void upload_scheduler_sanitize(uploadSchedulerConfig *config);
+
+/**
+ ****************************************************************************************
+ * @brief Number of FIFO reads to wait between uploads in the given state
+ ****************************************************************************************
+ */
+int upload_scheduler_interval(const uploadSchedulerConfig *config, const uploadSchedulerState *state);
+
+/**
+ ****************************************************************************************
+ * @brief Decide whether to start an upload now
+ *
+ * @return pdTRUE if an upload should be started, pdFALSE otherwise
+ ****************************************************************************************
+ */
+int upload_scheduler_due(const uploadSchedulerConfig *config, const uploadSchedulerState *state);
+
+#endif /* __USER_UPLOAD_SCHEDULER_H__ */
+
+/* EOF */
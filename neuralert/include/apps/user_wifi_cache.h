@@ -0,0 +1,88 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_wifi_cache.h
+ *
+ * @brief Remembers the access point of the last Wi-Fi connection
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#ifndef __USER_WIFI_CACHE_H__
+#define __USER_WIFI_CACHE_H__
+
+#include "common.h"
+
+#define WIFI_CACHE_BSSID_LEN			6
+#define WIFI_CACHE_IP_STR_LEN			16		// "255.255.255.255" + NUL
+// Longest supplicant command built from the cache
+#define WIFI_CACHE_COMMAND_MAX_LEN		48
+
+/*
+ * The access point and channel of the last successful connection, kept
+ * in retention memory.  The next upload asks the supplicant for that
+ * BSSID on that channel only, instead of scanning every channel.
+ */
+typedef struct
+{
+	int16_t valid;							//!< pdTRUE once a connection has been recorded
+	int16_t fast_failures;					//!< consecutive fast connects that didn't complete
+	UCHAR bssid[WIFI_CACHE_BSSID_LEN];		//!< access point
+	int freq_mhz;							//!< its channel
+	char ip_address[WIFI_CACHE_IP_STR_LEN];	//!< address leased on that connection
+} wifiConnectCache;
+
+/**
+ ****************************************************************************************
+ * @brief Record the connection described by the supplicant "status" reply
+ *
+ * @param[in]  status	reply text, one key=value per line
+ * @param[out] cache	updated only if the BSSID and frequency were found
+ *
+ * @return pdTRUE if the cache was updated, pdFALSE otherwise
+ ****************************************************************************************
+ */
+int wifi_cache_parse_status(const char *status, wifiConnectCache *cache);
+
+/**
+ ****************************************************************************************
+ * @brief Build the supplicant commands that restrict network 0 to the
+ *        cached access point, or that remove the restriction
+ *
+ * @param[in]  cache		cached connection, or NULL to remove the restriction
+ * @param[out] bssid_cmd	"set_network 0 bssid ..." (WIFI_CACHE_COMMAND_MAX_LEN)
+ * @param[out] freq_cmd		"set_network 0 scan_freq ..." (WIFI_CACHE_COMMAND_MAX_LEN)
+ ****************************************************************************************
+ */
+void wifi_cache_commands(const wifiConnectCache *cache, char *bssid_cmd, char *freq_cmd);
+
+#endif /* __USER_WIFI_CACHE_H__ */
+
+/* EOF */
@@ -276,6 +276,18 @@ typedef struct{
 
 #define MC3672_TEST		0x71
 
+/* STATUS_1 (0x08) FIFO flags */
+#define MC36XX_STATUS_1_FIFO_EMPTY		0x10
+#define MC36XX_STATUS_1_FIFO_FULL		0x20
+#define MC36XX_STATUS_1_FIFO_THRESH		0x40
+
+/* FEATURE_C_2 (0x0E) - FIFO burst read: the register pointer wraps from
+ * ZOUT_MSB back to XOUT_LSB and the next FIFO sample is presented */
+#define MC36XX_FEATURE_C_2_FIFO_BURST	0x02
+
+#define MC36XX_FIFO_SIZE				32		// samples
+#define MC36XX_FIFO_SAMPLE_BYTES		6		// XOUT_LSB .. ZOUT_MSB
+
 
 
 
@@ -113,6 +113,19 @@ int readStatReg1(HANDLE spi, uint8_t *flashStatus);
 int readStatReg2(HANDLE spi, uint8_t *flashStatus);
 int readStatReg3(HANDLE spi, uint8_t *flashStatus);
 
+/*
+ * Erase sizes for flash_erase_begin()
+ */
+#define W25QXX_ERASE_4K		0
+#define W25QXX_ERASE_32K	1
+#define W25QXX_ERASE_64K	2
+#define W25QXX_ERASE_KINDS	3
+
+int flash_erase_begin(HANDLE handler, UINT8 kind, UINT32 address);
+int flash_erase_poll(HANDLE handler);
+int flash_erase_wait(HANDLE handler);
+UINT32 flash_erase_poll_count(void);
+
 int eraseSector_4K(HANDLE handler, UINT32 address);
 int eraseBlock_32K(HANDLE handler, UINT32 address);
 int eraseBlock_64K(HANDLE handler, UINT32 address);
@@ -127,6 +140,8 @@ int resetChip(HANDLE handler);
 
 int pageWrite(HANDLE handler, UINT32 address, UINT8 *tx_buf, UINT32 tx_len);
 int pageRead(HANDLE handler, UINT32 address, UINT8 *rx_buf, UINT32 rx_len);
+int pageReadRange(HANDLE handler, UINT32 address, UINT8 *rx_buf, UINT32 rx_len);
+UINT32 flash_erase_suspend_count(void);
 
 /**
  * @brief Structure to describe a SPI flash chip connected to the system.
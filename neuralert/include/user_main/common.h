@@ -342,6 +342,13 @@ typedef struct
 	// of data capture
 	ULONG  data_sequence;					// sequence number increases each read
 
+	// CRC-32 of the block (everything from data_sequence through Zvalue
+	// except this field), set when the block is written to flash.
+	// Readers use it to tell a good block from an erased page or a
+	// corrupted read.  It sits in what used to be the padding before
+	// accelTime so none of the other fields moved.
+	uint32_t crc;							// see AB_block_crc()
+
 	// The timestamp is intended to be the time at which the actual
 	// accelerometer interrupt occurred, as best as we can capture.
 	// The interrupt should occur when the accelerometer reaches the
@@ -430,9 +437,31 @@ typedef struct packetDataStruct
 // So, every 16 pages we have to pause and erase the next sector where
 // we will write.
 #define AB_PAGES_PER_SECTOR 16
+// Each page holds two FIFO buffer structures ("blocks") in fixed size
+// slots, so a page is filled by two writes, or by one when two staged
+// blocks are written together.  Positions in the buffer (the write
+// position, the transmit map, erase positions) count blocks, not pages:
+// block n is slot n % AB_BLOCKS_PER_PAGE of page n / AB_BLOCKS_PER_PAGE,
+// which makes consecutive blocks consecutive in flash.  A slot that
+// hasn't been written reads as all 0xFF and fails the block CRC.
+#define AB_BLOCK_SIZE 128
+#define AB_BLOCKS_PER_PAGE (AB_FLASH_PAGE_SIZE / AB_BLOCK_SIZE)
+#define AB_BLOCKS_PER_SECTOR (AB_PAGES_PER_SECTOR * AB_BLOCKS_PER_PAGE)
+// A FIFO buffer structure has to fit in its slot
+typedef char AB_block_fits_slot[(sizeof(accelBufferStruct) <= AB_BLOCK_SIZE) ? 1 : -1];
+// Block erases cover 8 or 16 sectors and must be aligned to their size
+#define AB_FLASH_BLOCK_32K_SIZE 0x8000
+#define AB_FLASH_BLOCK_64K_SIZE 0x10000
+// Sectors kept erased in front of the sector being written, so the
+// accelerometer task doesn't have to erase on its wake path.  The erasing
+// is done while the MQTT task waits for its connection (see AB_erase_ahead()).
+#define AB_ERASE_AHEAD_SECTORS 16
 // When transmitting, we don't want to run into the erase procedure.
-// So we have a safety gap -- set to twice the erase size (in 10.3, about 4 seconds).
-#define AB_TRANSMIT_SAFETY_GAP (2*AB_PAGES_PER_SECTOR)
+// So we have a safety gap -- the erased-ahead sectors plus twice the erase
+// size (in 10.3 the gap was just the two sectors, about 4 seconds).
+// Together that's the 288 page (576 block) guard zone included in
+// AB_FLASH_MAX_PAGES.
+#define AB_TRANSMIT_SAFETY_GAP ((AB_ERASE_AHEAD_SECTORS + 2) * AB_BLOCKS_PER_SECTOR)
 
 // The accelerometer buffer region is designed to hold 2 hours of
 // data, with one FIFO buffer structure per sector.
@@ -458,16 +487,67 @@ typedef struct packetDataStruct
 // So, for development, this will let us observe all behaviors
 //#define AB_FLASH_MAX_PAGES 640
 
+// With two blocks per page the 3600 pages hold about 4 hours of data
+// (7200 blocks) and the guard zone is 576 blocks
+#define AB_FLASH_MAX_BLOCKS (AB_FLASH_MAX_PAGES * AB_BLOCKS_PER_PAGE)
+// Flash address of the block at position pos
+#define AB_BLOCK_ADDRESS(pos) ((ULONG)AB_FLASH_BEGIN_ADDRESS + ((ULONG)AB_BLOCK_SIZE * (ULONG)(pos)))
+
+// # of times the write function will attempt the write/verify cycle
+// This includes the first try and subsequent retries
+#define AB_WRITE_MAX_ATTEMPTS 4
+// # of bytes read back from the start of a page to check that a write
+// took.  This covers the CRC, sequence number and timestamp; the CRC
+// catches anything else when the block is read for transmission.
+// Set to 0 to rely on the write status alone.
+#define AB_WRITE_VERIFY_BYTES 16
+// # of bytes read back from the start of an erased sector to check
+// that the erase took
+#define AB_ERASE_VERIFY_BYTES 16
+// # of times the erase sector function will attempt the erase/verify cycle
+// ***NOTE*** there are two costs to multiple attempts.  The first is time.
+// As of 9/12/22 it was taking 40-60 msec per all to the erase function.
+// We need to stay inside the ~2 second AXL interrupt cycle so that we're
+// ready when the next interrupt occurs
+// The second cost is power.  The erase function uses a lot of power and
+// so many erases will use more battery.
+// When doing stress testing 9/11/22 to 9/13/22 we observed it taking as
+// many as 5 attempts
+// For instance, after running about 25 hours, we had these stats:
+//  Total sector erase attempts             : 2712
+//  Total times an erase retry was needed   : 2697
+//  Total times succeeded on try 1          : 8
+//  Total times succeeded on try 2          : 2659
+//  Total times succeeded on try 3          : 30
+//  Total times succeeded on try 4          : 7
+//  Total times succeeded on try 5          : 8
+// Although we need to figure out how to make this work on the first
+// try, for the first release, we increase max attempts so that the
+// software doesn't hang over 5 days for the customer
+// On 9/13/22 the erase attempt was happening around 220 msec after wakeup
+// and taking about 100 msec per erase/read cycle.  Soso in the worst
+// case, 7 x 100 = 700 msec, which is still only about half the entire
+// AXL FIFO interrupt time.
+#define AB_ERASE_MAX_ATTEMPTS 3
+
 typedef uint32_t _AB_transmit_map_t;
 
-#define AB_TRANSMIT_MAP_SIZE (AB_FLASH_MAX_PAGES / sizeof(_AB_transmit_map_t) + 1)
+// Number of AB blocks tracked by each word of the transmit map
+// (one bit per block, 7776 blocks take 243 words = 972 bytes).
+// Up to 1.10.17 the map used only 4 bits of each word; see
+// ab_map_convert_legacy() for how that layout is converted, and
+// user_rtm_take_over_legacy() for when.
+#define AB_MAP_POS_PER_WORD		(sizeof(_AB_transmit_map_t) * 8)
+
+#define AB_TRANSMIT_MAP_SIZE ((AB_FLASH_MAX_BLOCKS + AB_MAP_POS_PER_WORD - 1) / AB_MAP_POS_PER_WORD)
 
 
 // Macros for manipulating buffer bits
-#define POS_TO_BIT(pos)						(1 << (pos % sizeof(_AB_transmit_map_t)))
-#define SET_AB_POS(src, pos)				(src[pos / sizeof(_AB_transmit_map_t)] |= POS_TO_BIT(pos))
-#define CLR_AB_POS(src, pos)				(src[pos / sizeof(_AB_transmit_map_t)] &= (~POS_TO_BIT(pos)))
-#define POS_AB_SET(src, pos)				((src[pos / sizeof(_AB_transmit_map_t)] & POS_TO_BIT(pos)) == POS_TO_BIT(pos))
+#define POS_TO_WORD(pos)					((pos) / AB_MAP_POS_PER_WORD)
+#define POS_TO_BIT(pos)						((_AB_transmit_map_t)1 << ((pos) % AB_MAP_POS_PER_WORD))
+#define SET_AB_POS(src, pos)				(src[POS_TO_WORD(pos)] |= POS_TO_BIT(pos))
+#define CLR_AB_POS(src, pos)				(src[POS_TO_WORD(pos)] &= (~POS_TO_BIT(pos)))
+#define POS_AB_SET(src, pos)				((src[POS_TO_WORD(pos)] & POS_TO_BIT(pos)) == POS_TO_BIT(pos))
 
 
 #define FLASH_NO_ERROR 0
@@ -508,6 +588,23 @@ typedef uint32_t _AB_transmit_map_t;
 // 15-minute warning or 3 x 144
 #define AB_FLASH_WARNING_THRESHOLD 432
 
+// How many accelerometer FIFO blocks to send in each JSON packet
+// (This is arbitrary but limited by the max MQTT packet size)
+// The larger this value, the fewer JSON packets need to be sent
+// and the shorter the MQTT transmission cycle will be.
+// In Stage6c, Step 6 development, the following times were observed:
+// (With an inter-packet
+// delay of 2 seconds and total post_transmission delays of 3 seconds.)
+// Packet size 10 (14 packets) took 47 seconds
+// Packet size 20 (7 packets) took 31 seconds (JSON packet ~= 10000 bytes)
+// Packet size 30 (5 packets) took 28 seconds (JSON packet ~= 15000 bytes)
+// Make sure the JSON message buffer is big enough!
+// Note that during testing it was discovered that 30 block packets
+// were causing errors in the MQTT publish client.  We didn't try anything
+// between 20 and 30, so a little larger might be possible.
+// #define FIFO_BLOCKS_PER_PACKET 24 // used in 1.9
+#define FIFO_BLOCKS_PER_PACKET 5 // Smaller numbers work better, used in 1.10
+
 //typedef struct
 //{
 //	int8_t AB_initialized_flag;			// if buffer mgt has been initialized
@@ -534,6 +631,7 @@ extern int i2cRead(int addr, uint8_t *data, int length);
 void mc3672Init(void);
 //void accel_callback();
 void clear_intstate(uint8_t* state);
+int mc36xx_read_fifo(int8_t *x, int8_t *y, int8_t *z, int max_samples);
 void time64_string (UCHAR *timestamp_str, __time64_t *timestamp);
 
 /*
@@ -37,7 +37,7 @@
 #define APPS_INCLUDE_USER_VERSION_H_
 
 #define USER_SOFTWARE_PART_NUMBER_STRING "9079-0400-0001"
-#define USER_VERSION_STRING "1.10.17"
+#define USER_VERSION_STRING "1.10.18"
 
 #endif /* APPS_INCLUDE_COMMON_H_ */
 
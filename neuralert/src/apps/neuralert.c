@@ -54,12 +54,28 @@
 #include "user_nvram_cmd_table.h"
 #include "util_api.h"
 #include "limits.h"
+#include <stddef.h>
 //#include "spi_flash/spi_flash.h"
 //#include "spi_flash.h"
 #include "W25QXX.h"
 #include "Mc363x.h"
 #include "adc.h"
 #include "common.h"
+#include "user_packet_encoder.h"
+#include "user_json_writer.h"
+#include "user_json_packet.h"
+#include "user_mqtt_publish.h"
+#include "user_upload_scheduler.h"
+#include "user_wifi_cache.h"
+#include "user_trace.h"
+// Wake path messages are info/debug, see user_log.h
+#define ULOG_MODULE_LEVEL		ULOG_LEVEL_INFO
+#include "user_log.h"
+#include "user_transmit_map.h"
+#include "user_ab_block.h"
+#include "user_ab_stage.h"
+#include "user_erase_ahead.h"
+#include "user_sample_time.h"
 // FreeRTOSConfig included for info about tick timing
 #include "app_common_util.h"
 
@@ -190,7 +206,12 @@ extern void user_start_MQTT_client();
 
 
 /* Retention Memory */
-#define USER_RTM_DATA_TAG						"uRtmData"
+// Retention memory allocations were rounded up to this size
+#define USER_RTM_ALIGN(size)					(((size) + 7) & ~7)
+// The user log fields that followed the transmit map in that layout
+#define USER_RTM_LOG_FIELDS_SIZE				(offsetof(UserDataBuffer, oldest_log_entry_position)	\
+												 + sizeof(AB_INDEX_TYPE)								\
+												 - offsetof(UserDataBuffer, user_holding_log_initialized))
 //#define USER_RTM_DATA_LEN						sizeof(accelBufferStruct)
 // Retention memory is 48KB, so if the accel buffer structure is about 120 bytes,
 // we can hold 256 buffers in about 30k.  So this is about 7,680 samples @14Hz,
@@ -209,34 +230,17 @@ extern void user_start_MQTT_client();
  * Accelerometer buffer (AB) setup
  */
 
-// # of times the write function will attempt the write/verify cycle
-// This includes the first try and subsequent retries
-#define AB_WRITE_MAX_ATTEMPTS 4
-// # of times the erase sector function will attempt the erase/verify cycle
-// ***NOTE*** there are two costs to multiple attempts.  The first is time.
-// As of 9/12/22 it was taking 40-60 msec per all to the erase function.
-// We need to stay inside the ~2 second AXL interrupt cycle so that we're
-// ready when the next interrupt occurs
-// The second cost is power.  The erase function uses a lot of power and
-// so many erases will use more battery.
-// When doing stress testing 9/11/22 to 9/13/22 we observed it taking as
-// many as 5 attempts
-// For instance, after running about 25 hours, we had these stats:
-//  Total sector erase attempts             : 2712
-//  Total times an erase retry was needed   : 2697
-//  Total times succeeded on try 1          : 8
-//  Total times succeeded on try 2          : 2659
-//  Total times succeeded on try 3          : 30
-//  Total times succeeded on try 4          : 7
-//  Total times succeeded on try 5          : 8
-// Although we need to figure out how to make this work on the first
-// try, for the first release, we increase max attempts so that the
-// software doesn't hang over 5 days for the customer
-// On 9/13/22 the erase attempt was happening around 220 msec after wakeup
-// and taking about 100 msec per erase/read cycle.  Soso in the worst
-// case, 7 x 100 = 700 msec, which is still only about half the entire
-// AXL FIFO interrupt time.
-#define AB_ERASE_MAX_ATTEMPTS 3
+// The write/erase retry and verify settings are in common.h
+// Write-back staging: FIFO buffers are collected in retention memory
+// and written to flash together when the current sector is full (or
+// just before a transmission), so the flash is only powered up and
+// written once per half sector instead of on every accelerometer wake.
+// Staged buffers are lost on a brown-out or power-on reset (see
+// user_ab_stage.h for the limits), while a buffer written on every
+// wake is not, so this stays off until the stage is journaled to flash.
+// Define to stage the FIFO buffers.
+// #define AB_STAGE_WRITE_BACK
+// The erase-ahead tunables (see AB_erase_ahead()) are in user_erase_ahead.h
 /*
  * MQTT transmission setup
  * See spreadsheet for this calculation
@@ -269,6 +273,15 @@ extern void user_start_MQTT_client();
 // This has been implemented as a software watchdog -- hints the change in name
 #define WATCHDOG_TIMEOUT_SECONDS 30
 
+// A fast connect (straight to the access point and channel of the last
+// connection) normally completes in well under a second.  If it hasn't
+// completed in this time the access point has probably moved or gone,
+// so fall back to a full scan for the rest of the watchdog time.
+#define WIFI_FAST_CONNECT_TIMEOUT_SECONDS 5
+// Stop trying fast connects after this many in a row have fallen back.
+// The next full connect records a fresh access point and starts over.
+#define WIFI_FAST_CONNECT_MAX_FAILURES 2
+
 // How long to wait for the software watchdog to shutdown.
 #define WATCHDOG_STOP_TIMEOUT_SECONDS 5
 
@@ -322,9 +335,9 @@ extern void user_start_MQTT_client();
 // So 40 minutes = 8 intervals = 144 * 8 = 1152 FIFO buffers per interval
 //#define MAX_FIFO_BUFFERS_PER_TRANSMIT_INTERVAL 288
 // #define MAX_FIFO_BUFFERS_PER_TRANSMIT_INTERVAL 1152
-// JW: We want to send all the data out. So we are deprecating this term and using AB_FLASH_MAX_PAGES
+// JW: We want to send all the data out. So we are deprecating this term and using AB_FLASH_MAX_BLOCKS
 // this represents the entire buffer
-#define MAX_FIFO_BUFFERS_PER_TRANSMIT_INTERVAL AB_FLASH_MAX_PAGES
+#define MAX_FIFO_BUFFERS_PER_TRANSMIT_INTERVAL AB_FLASH_MAX_BLOCKS
 
 // Trigger value for the accelerometer to start MQTT transmission
 //  64 ~= 2 minutes
@@ -339,8 +352,10 @@ extern void user_start_MQTT_client();
 // erases the next flash sector before it starts the MQTT task
 // That means that the MQTT task will have 16 AXL interrupt times to
 // operate in before the next erase sector time
-#define MQTT_TRANSMIT_TRIGGER_FIFO_BUFFERS_FAST 16 // 1 minute (assuming 7 Hz AXL sampling rate)
-#define MQTT_TRANSMIT_TRIGGER_FIFO_BUFFERS_SLOW 80 // 5 minutes (assuming 7 Hz AXL sampling rate)
+// The trigger is now chosen by the upload scheduler (user_upload_scheduler.c)
+// between UPLOAD_MIN_FIFOS (default 16, 1 minute) and UPLOAD_MAX_FIFOS
+// (default 80, 5 minutes), both settable in NVRAM.  The defaults keep to
+// multiples of 16 for the reason above.
 //#define MQTT_TRANSMIT_TRIGGER_FIFO_BUFFERS 64
 // 144 = 9 x 16 and just about 5 minutes at 29 samples / FIFO
 //#define MQTT_TRANSMIT_TRIGGER_FIFO_BUFFERS 144 // Use this for production
@@ -353,35 +368,30 @@ extern void user_start_MQTT_client();
 // process within approximately 12 seconds.
 #define MQTT_FIRST_TRANSMIT_TRIGGER_FIFO_BUFFERS 3
 
-// This value is for switching between fast and slow transmit intervals.  When the number of unsuccessful
-// transmissions is less than this value, the fast mode will be used.  Otherwise, the slow mode.
-#define MQTT_TRANSMIT_TRIGGER_FIFO_BUFFERS_TEST 10 // about 10 fast attempts before we revert to slow
-
 // This is how long to wait for MQTT to stop before shutting the wifi down
 // regardless of whether MQTT has cleanly exited.
 #define MQTT_STOP_TIMEOUT_SECONDS 3
 
-// How many accelerometer FIFO blocks to send in each JSON packet
-// (This is arbitrary but limited by the max MQTT packet size)
-// The larger this value, the fewer JSON packets need to be sent
-// and the shorter the MQTT transmission cycle will be.
-// In Stage6c, Step 6 development, the following times were observed:
-// (With an inter-packet
-// delay of 2 seconds and total post_transmission delays of 3 seconds.)
-// Packet size 10 (14 packets) took 47 seconds
-// Packet size 20 (7 packets) took 31 seconds (JSON packet ~= 10000 bytes)
-// Packet size 30 (5 packets) took 28 seconds (JSON packet ~= 15000 bytes)
-// Make sure the JSON message buffer is big enough!
-// Note that during testing it was discovered that 30 block packets
-// were causing errors in the MQTT publish client.  We didn't try anything
-// between 20 and 30, so a little larger might be possible.
-// #define FIFO_BLOCKS_PER_PACKET 24 // used in 1.9
-#define FIFO_BLOCKS_PER_PACKET 5 // Smaller numbers work better, used in 1.10
+// FIFO_BLOCKS_PER_PACKET (blocks per packet) is in common.h
 
 // How many actual samples to be sent in each JSON packet
 // # samples in the Accel FIFO times blocks per JSON packet
 // The most individual samples we'll transmit in one JSON packet
 #define MAX_SAMPLES_PER_PACKET	(FIFO_BLOCKS_PER_PACKET * SAMPLES_PER_FIFO)
+
+// Payload format used for accelerometer packets.
+// JSON is the original human readable format.
+// BINARY is the compact frame described in user_packet_encoder.h, carried
+// base64 encoded in a small JSON envelope ("bin") because the MQTT client
+// publish API takes a NUL terminated string.  With the samples compressed
+// by the block codec it is roughly a sixth the size of the JSON packet,
+// which directly shortens radio-on time.
+// If a binary frame can't be built the packet falls back to JSON.
+// The backend must understand the binary frame before selecting it.
+#define MQTT_PAYLOAD_FORMAT_JSON	0
+#define MQTT_PAYLOAD_FORMAT_BINARY	1
+#define MQTT_PAYLOAD_FORMAT			MQTT_PAYLOAD_FORMAT_JSON
+
 // How long to wait for the PUBACK from the broker before giving up
 // when sending MQTT message with QOS 1 or 2
 // (Note that in SDK call, timeout is in 10s of milliseconds)
@@ -391,6 +401,11 @@ extern void user_start_MQTT_client();
 // mqtt_client_send_message_with_qos(...) in sub_client.c
 // In that function, the QoS uses 10s of ticks each loop (not 10s of milliseconds)
 #define MQTT_QOS_TIMEOUT_MS 2000 // 1000 sometimes misses a PUBACK
+// Room for PUBACK notifications between the MQTT client task and the
+// transmit task.  Only one packet is inflight at a time (the SDK client
+// refuses a new QOS 1 publish until the last one is acknowledged), the
+// rest is for late PUBACKs of retransmitted messages.
+#define MQTT_PUBACK_QUEUE_LENGTH 4
 // How long to wait for the MQTT client to subscribe to topics prior to giving up
 // If we can't subscribe (for whatever reason) it is going to be really hard to
 // publish.
@@ -688,6 +703,47 @@ typedef struct _userData {
 	AB_INDEX_TYPE next_log_entry_write_position;
 	AB_INDEX_TYPE oldest_log_entry_position;
 
+#ifdef AB_STAGE_WRITE_BACK
+	// *****************************************************
+	// Write-back staging of FIFO buffers (see AB_stage_block())
+	// *****************************************************
+	abStage AB_stage;
+#endif
+
+	// *****************************************************
+	// Erase-ahead of the accelerometer buffer (see AB_erase_ahead())
+	// *****************************************************
+	// First page (sector aligned) after the write position that isn't
+	// known to be erased.  Everything from the start of the sector being
+	// written up to here is erased.
+	AB_INDEX_TYPE next_AB_erase_position;
+	unsigned int erase_ahead_count;		// # of sectors erased ahead of the write position
+	unsigned int erase_inline_count;	// # of sectors the write path had to erase itself
+	unsigned int erase_ahead_dropped;	// # of unsent blocks erased by erase-ahead
+
+	// Data sequence of the first block written with a CRC when the data
+	// was taken over from 1.10.17 or earlier (see
+	// user_rtm_convert_transmit_map()), 0 otherwise.  Older blocks still
+	// waiting to be sent have no CRC (see ab_block_valid()).
+	ULONG AB_precrc_sequence;
+
+	// *****************************************************
+	// Upload scheduling (see user_upload_scheduler.c)
+	// *****************************************************
+	uploadSchedulerConfig upload_config;	// tunables, read from NVRAM at power on
+	__time64_t MQTT_tx_start_msec;		// when the current upload was started
+	int MQTT_last_connect_msec;			// how long the last successful connect took
+	int MQTT_last_battery_cv;			// battery voltage in the last packet
+
+	// *****************************************************
+	// Wi-Fi fast reconnect (see user_wifi_cache.c)
+	// *****************************************************
+	wifiConnectCache wifi_cache;		// access point of the last connection
+	int16_t wifi_fast_connect_active;	// pdTRUE while restricted to the cached AP
+	int wifi_last_connect_msec;			// upload start to Wi-Fi up, last connection
+	unsigned int wifi_fast_connects;	// # of connections made the fast way
+	unsigned int wifi_fast_fallbacks;	// # of fast connects that fell back to a scan
+
 #if 0
 	// User logging holding area
 	// circular buffer with pointers as above
@@ -695,6 +751,8 @@ typedef struct _userData {
 #endif
 
 } UserDataBuffer;
+// It has to fit in its retention memory region (see user_retmem_layout.h)
+typedef char UserDataBuffer_fits_region[(sizeof(UserDataBuffer) <= USER_RETMEM_DATA_CAPACITY) ? 1 : -1];
 #endif
 
 /* Process event type */
@@ -715,6 +773,7 @@ static UINT32 processLists = 0;					// bitmap of active processes
 static TaskHandle_t xTask = NULL;
 static TaskHandle_t user_MQTT_task_handle = NULL;  // task handle of the user MQTT transmit task
 static TaskHandle_t user_MQTT_stop_task_handle = NULL;  // task handle of the user MQTT stop task
+static TaskHandle_t user_packet_reader_task_handle = NULL; // task handle of the packet reader task
 static TaskHandle_t user_watchdog_task_handle = NULL; // task handle of the user watchdog task
 
 /*
@@ -748,8 +807,11 @@ static UINT8 isAccelerometerTimeout = pdFALSE;	// pdTRUE when missed interrupt d
 
 /*
  * Semaphore to coordinate between the accelerometer main task and
- * the MQTT transmit task.  This is used to provide exclusive access
- * to the AB management area so we don't accidentally overlap each other
+ * the MQTT transmit task over the erase-ahead of the AB (the erase
+ * position and the sector being erased).  The write and transmit
+ * positions and the transmit map don't need it: the accelerometer task
+ * is their only producer and the MQTT task their only consumer, and they
+ * are updated with atomic word operations (see user_transmit_map.h).
  */
 SemaphoreHandle_t AB_semaphore = NULL;
 /*
@@ -769,14 +831,55 @@ SemaphoreHandle_t user_log_semaphore = NULL;
  * This is used so we don't accidentally execute simultaneous read/writes
  */
 SemaphoreHandle_t Stats_semaphore = NULL;
+/*
+ * Message IDs of acknowledged PUBLISH messages, passed from the MQTT
+ * client's publish callback to the transmit task
+ */
+QueueHandle_t MQTT_puback_queue = NULL;
+/*
+ * Sectors the MQTT task is erasing ahead of the accelerometer task: the
+ * first block of the erase, or INVALID_AB_ADDRESS, and how many sectors
+ * it covers.  Protected by AB_semaphore.
+ */
+static AB_INDEX_TYPE AB_erase_ahead_reserved = INVALID_AB_ADDRESS;
+static int AB_erase_ahead_reserved_sectors = 0;
+
+/*
+ * The packet waiting for its PUBACK and the delivery statistics of the
+ * current transmission.  Used by the transmission task only.
+ */
+static mqttPublisher MQTT_publisher;
 
 
 /*
- * Temporary storage for accelerometer samples to be transmitted
- * Created at transmit time from the stored FIFO structures
+ * Packet buffers.  Each holds the FIFO blocks making up one packet, read
+ * from flash by assemble_packet_data().  Samples and their timestamps
+ * are generated from these blocks while the payload is being encoded,
+ * so there is no per-sample staging table (that table alone used to
+ * be 16 bytes for every sample in the packet).
+ *
+ * There are two buffers so the packet reader task can read the next
+ * packet out of flash while the transmit task is publishing the current
+ * one.  Buffer indexes are passed between the two tasks through
+ * packet_free_queue (empty buffers, for the reader) and
+ * packet_ready_queue (filled buffers, for the transmit task).
  */
-// static int num_xmit_samples = 0;
-static accelDataStruct accelXmitData[MAX_SAMPLES_PER_PACKET];
+#define PACKET_BUFFERS		2
+// Longest the transmit task waits for the reader to produce a packet
+#define PACKET_READER_TIMEOUT_MS	5000
+
+static accelBufferStruct packetBlocks[PACKET_BUFFERS][FIFO_BLOCKS_PER_PACKET];
+// Block slots read by AB_read_blocks(), before they are unpacked into
+// packetBlocks (newest first)
+#define AB_READ_BLOCKS_MAX	FIFO_BLOCKS_PER_PACKET
+static UCHAR AB_read_slots[AB_READ_BLOCKS_MAX * AB_BLOCK_SIZE];
+// Blocks read for transmission whose CRC didn't match (since boot)
+static UINT32 AB_crc_fail_count = 0;
+static packetDataStruct packetBufferData[PACKET_BUFFERS];
+QueueHandle_t packet_free_queue = NULL;
+QueueHandle_t packet_ready_queue = NULL;
+static int packet_reader_start_block;		// where the reader starts in AB
+static volatile int packet_reader_stop = pdFALSE;	// asks the reader to exit
 
 /*
  * Temporary storage to hold all the FIFO blocks to be transmitted
@@ -789,10 +892,29 @@ static int num_trans_blocks = 0;
 static accelBufferStruct transmission_table[MAX_FIFO_BUFFERS_PER_TRANSMIT_INTERVAL];
 #endif
 /*
- * Area in which to compose JSON packet
- * see spreadsheet for sizing
+ * Area in which to compose the MQTT payload.
+ * This used to be a fixed 20000 bytes.  It is now sized from the
+ * worst case payload for FIFO_BLOCKS_PER_PACKET blocks, so raising
+ * the packet size only costs the RAM it actually needs.
+ *
+ * For the JSON worst case see JSON_PACKET_MAX_SIZE() in user_json_packet.h.
+ */
+
+/*
+ * When sending binary packets, the raw frame is built in the tail of
+ * mqttMessage and base64 encoded into the head, so no extra buffer is
+ * needed.  The two regions must not overlap.
  */
-#define MAX_JSON_STRING_SIZE 20000
+#define BINARY_FRAME_MAX_SIZE		PACKET_FRAME_MAX_SIZE(FIFO_BLOCKS_PER_PACKET)
+#define BINARY_ENVELOPE_MAX_SIZE	128
+#define BINARY_PACKET_MAX_SIZE		(BINARY_ENVELOPE_MAX_SIZE + PACKET_BASE64_SIZE(BINARY_FRAME_MAX_SIZE) \
+									 + BINARY_FRAME_MAX_SIZE)
+
+#if (MQTT_PAYLOAD_FORMAT == MQTT_PAYLOAD_FORMAT_BINARY) && (BINARY_PACKET_MAX_SIZE > JSON_PACKET_MAX_SIZE(MAX_SAMPLES_PER_PACKET))
+#define MAX_JSON_STRING_SIZE		BINARY_PACKET_MAX_SIZE
+#else
+#define MAX_JSON_STRING_SIZE		JSON_PACKET_MAX_SIZE(MAX_SAMPLES_PER_PACKET)
+#endif
 char mqttMessage[MAX_JSON_STRING_SIZE];
 
 
@@ -849,16 +971,30 @@ static int user_process_connect_ap(void);
 //static int check_connection_status(void);
 static void user_create_MQTT_task(void);
 static void user_create_MQTT_stop_task(void);
-static int user_mqtt_send_message(void);
+static int user_mqtt_publish_packet(packetDataStruct *packet, int sequence);
+static void mqtt_packet_delivered(packetDataStruct *packet);
+static int packet_reader_start(int start_block);
+static void packet_reader_stop_wait(void);
 void user_mqtt_connection_complete_event(void);
 static UCHAR user_process_check_wifi_conn(void);
-static int check_AB_transmit_location(int, int);
+static void user_wifi_restrict_to_cache(int use_cache);
+void user_wifi_fast_connect_fallback(void);
+static int find_AB_transmit_location(int location, int max_run, int *run_length, int *stop_location);
+static int count_AB_transmit_locations(void);
 static int clear_AB_transmit_location(int, int);
 static int get_AB_write_location(void);
 static int get_AB_transmit_location(void);
 //static int update_AB_transmit_location(int new_location);
 static int update_AB_write_location(void);
 static int AB_read_block(HANDLE SPI, UINT32 blockaddress, accelBufferStruct *FIFOdata);
+static int AB_read_blocks(HANDLE SPI, int last_block, int num_blocks, accelBufferStruct *FIFOdata);
+#ifdef AB_STAGE_WRITE_BACK
+static int AB_stage_flush(int *did_an_erase);
+static int AB_stage_block(accelBufferStruct *pFIFOdata, int *did_an_erase);
+#endif
+static int user_erase_flash_sector(HANDLE SPI, ULONG SectorEraseAddr, int num_sectors);
+static int AB_erase_ahead(HANDLE SPI, int max_ops);
+static void user_process_erase_ahead(int max_ops);
 static int flash_write_block(HANDLE SPI, int blockaddress, UCHAR *pagedata, int num_bytes);
 static int get_holding_log_next_write_location(void);
 static int get_holding_log_oldest_location(void);
@@ -1217,17 +1353,26 @@ void my_app_mqtt_msg_cb(const char *buf, int len, const char *topic)
 void user_mqtt_pub_cb(int mid)
 {
     pUserData->MQTT_last_message_id = mid; // store the last message id
-
-    PRINTF ("MQTT PUB CALBACK, clearing inflight!\n");
-
-    // See user_mqtt_client_send_message_with_qos for what we're doing here.
-    pUserData->MQTT_inflight = 0; // clear the inflight variable
+    TRACE_EVENT(TRACE_EV_PUBACK, 0, mid);
+
+    ULOG_D("MQTT PUB CALLBACK, mid %d\n", mid);
+
+    // Hand the message ID to the transmit task, which owns the packet
+    // inflight (see user_mqtt_publish.c).  Never block the MQTT client
+    // task here.
+    if (MQTT_puback_queue != NULL)
+    {
+        if (xQueueSend(MQTT_puback_queue, &mid, 0) != pdPASS)
+        {
+            ULOG_W("\n Neuralert: [%s] PUBACK queue full, mid %d dropped", __func__, mid);
+        }
+    }
     vTaskDelay(1);
 }
 
 void user_mqtt_conn_cb(void)
 {
-	PRINTF("\n\nMQTT CONNECTED!!!!!!!!!!!!!!!!!\n\n");
+	ULOG_I("\n\nMQTT CONNECTED!!!!!!!!!!!!!!!!!\n\n");
 	// Now that the mqtt connection is established, we can create our MQTT transmission task
 	//vTaskDelay(10);
 	user_create_MQTT_task();
@@ -1656,7 +1801,7 @@ static void user_log_event(const UCHAR *event_message)
  */
 int user_factory_reset_btn_onetouch(void)
 {
-	PRINTF("\n\n**** Factory Reset Button One Touch ***\n\n");
+	ULOG_I("\n\n**** Factory Reset Button One Touch ***\n\n");
 	return pdTRUE;
 }
 
@@ -1804,7 +1949,7 @@ void user_rtc_wakeup_key_event_triggered(void)
  */
 void user_wifi_connection_completed(void)
 {
-	PRINTF("\n**Neuralert: [%s] do we care about this any more?\n", __func__); // FRSDEBUG
+	ULOG_D("\n**Neuralert: [%s] do we care about this any more?\n", __func__); // FRSDEBUG
 
 	user_wifi_connection_complete_event();
 }
@@ -1949,7 +2094,7 @@ static int user_process_MQTT_wait_for_connection(int max_ms)
 		// delay until mqtt is connected
 		if (!mqtt_client_check_conn())
 		{
-			PRINTF("\r\n [%s] No MQTT Session ...\r\n", __func__);
+			ULOG_W("\r\n [%s] No MQTT Session ...\r\n", __func__);
 #if defined(__RUNTIME_CALCULATION__) && defined(XIP_CACHE_BOOT)
 	printf_with_run_time("===user_process_MQTT_wait_for_connection waiting");
 #endif
@@ -1977,22 +2122,137 @@ static int user_process_MQTT_wait_for_connection(int max_ms)
 
 /**
  *******************************************************************************
- * @brief send one JSON packet from the intermediate samples buffer
+ * @brief Fill in the packet level information of a packet
+ *******************************************************************************
+ */
+static void fill_packet_meta(packetMetaStruct *meta, int msg_number, int sequence)
+{
+	meta->device_id = pUserData->Device_ID;
+	meta->version = USER_VERSION_STRING;
+	meta->timesync_str = pUserData->MQTT_timesync_current_time_str;
+	meta->timesync_msec = pUserData->MQTT_timesync_timestamptime_msec;
+	meta->msg_number = msg_number;
+	meta->sequence = sequence;
+	// Battery voltage in centivolts
+	meta->battery_cv = (uint16_t)(get_battery_voltage() * 100);
+	pUserData->MQTT_last_battery_cv = meta->battery_cv;
+	meta->fault_count = get_fault_count();
+	meta->free_heap = xPortGetFreeHeapSize();
+	meta->wifi_connect_msec = (uint32_t)pUserData->wifi_last_connect_msec;
+	meta->connect_msec = (uint32_t)pUserData->MQTT_last_connect_msec;
+}
+
+/**
+ *******************************************************************************
+ * @brief Compose one JSON packet in mqttMessage from the packet blocks
  *
- * typedef struct
+ * See json_packet_compose() for the format.
+ *
+ * @return pdTRUE if the packet fit in mqttMessage, pdFALSE otherwise
+ *******************************************************************************
+ */
+static int compose_json_packet(accelBufferStruct *blocks, int num_blocks, int msg_number, int sequence)
+{
+	packetMetaStruct meta;
+
+	fill_packet_meta(&meta, msg_number, sequence);
+
+	// Sanity check in case some future person expands message
+	// without increasing buffer size
+	if (json_packet_compose(mqttMessage, MAX_JSON_STRING_SIZE, &meta, blocks, num_blocks) < 0)
 	{
-		int16_t Xvalue;					//!< X-Value * 1000
-		int16_t Yvalue;					//!< Y-Value * 1000
-		int16_t Zvalue;					//!< Z-Value * 1000
-		__time64_t accelTime;               //!< time when accelleromter data taken
-	} accelDataStruct;
+		ULOG_E("\nNeuralert: [%s] JSON packet size too big with limit %d", __func__, (int)MAX_JSON_STRING_SIZE);
+		return pdFALSE;
+	}
+
+	return pdTRUE;
+}
+
+#if (MQTT_PAYLOAD_FORMAT == MQTT_PAYLOAD_FORMAT_BINARY)
+/**
+ *******************************************************************************
+ * @brief Compose one binary packet in mqttMessage from the packet blocks
+ *
+ * The frame (see user_packet_encoder.h) is written into the tail of
+ * mqttMessage and then base64 encoded into a minimal JSON envelope at
+ * the head of the buffer.
+ *
+ * @return pdTRUE if the packet was composed, pdFALSE otherwise
+ *******************************************************************************
+ */
+static int compose_binary_packet(accelBufferStruct *blocks, int num_blocks, int count, int msg_number, int sequence)
+{
+	UCHAR *frame = (UCHAR *)&mqttMessage[MAX_JSON_STRING_SIZE - BINARY_FRAME_MAX_SIZE];
+	packetMetaStruct meta;
+	packetEncoder enc;
+	jsonWriter json;
+	int b;
+	int frame_len;
+	int envelope_len;
+	int encoded_len;
+
+	fill_packet_meta(&meta, msg_number, sequence);
+
+	packet_encode_begin(&enc, frame, BINARY_FRAME_MAX_SIZE, &meta, count, num_blocks);
+	for (b = 0; b < num_blocks; b++)
+	{
+		packet_encode_block(&enc, &blocks[b]);
+	}
+	frame_len = packet_encode_end(&enc, count, num_blocks);
+	if (frame_len < 0)
+	{
+		return pdFALSE;
+	}
+
+	json_writer_init(&json, mqttMessage, MAX_JSON_STRING_SIZE - BINARY_FRAME_MAX_SIZE);
+	json_put_str(&json, "{\"state\":{\"reported\":{\"id\":\"");
+	json_put_str(&json, pUserData->Device_ID);
+	json_put_str(&json, "\",\"fmt\":");
+	json_put_int(&json, PACKET_FRAME_VERSION);
+	json_put_str(&json, ",\"bin\":\"");
+	if (!json_writer_ok(&json))
+	{
+		return pdFALSE;
+	}
+	envelope_len = json_writer_len(&json);
+
+	encoded_len = packet_base64_encode(&mqttMessage[envelope_len],
+			(MAX_JSON_STRING_SIZE - BINARY_FRAME_MAX_SIZE) - envelope_len,
+			frame, frame_len);
+	if (encoded_len < 0)
+	{
+		return pdFALSE;
+	}
+
+	json_writer_advance(&json, encoded_len);
+	json_put_str(&json, "\"}}}");
+	if (!json_writer_ok(&json))
+	{
+		return pdFALSE;
+	}
+
+	ULOG_D("\n Neuralert: [%s] %d samples, frame %d bytes", __func__, count, frame_len);
+
+	return pdTRUE;
+}
+#endif // MQTT_PAYLOAD_FORMAT_BINARY
+
+
+/**
+ *******************************************************************************
+ * @brief send one JSON packet from the packet blocks
  *
+ *   buffer		- index of the packet buffer holding the blocks of the packet
+ *   pData		- packet description returned by assemble_packet_data()
  *
+ * Returns once the packet has been published.  With QOS 1 the PUBACK
+ * is collected later (see user_mqtt_publish.c), so a return of 0
+ * does not yet mean the broker has the packet.
  *
  *******************************************************************************
  */
 
-int send_json_packet (int startAdd, packetDataStruct pData, int msg_number, int sequence)
+int send_json_packet (int buffer, packetDataStruct pData, int msg_number, int sequence)
 {
 
 	int count = pData.num_samples;
@@ -2000,62 +2260,15 @@ int send_json_packet (int startAdd, packetDataStruct pData, int msg_number, int
 	int return_status = 0;
 	int transmit_status = 0;
 	int packet_len;
-	static int mqttCount = 0;
-	int status=0, statusCheck, i;
-	unsigned char str[50],str2[20];		// temp working strings for assembling
-	unsigned char rawdata[8];
-	int16_t Xvalue;
-	int16_t Yvalue;
-	int16_t Zvalue;
-//	int type;
-	long timezone;
-#ifdef __TIME64__
-	__time64_t now;
-	__time64_t nowSec;
-#else
-	time_t now;
-#endif /* __TIME64__ */
-	struct tm *ts;
-	char buf[80], nowStr[20];
-	uint32_t data;
-	/*
-	 * Battery voltage
-	 */
-	uint16_t adcData;
-	float adcDataFloat;
-	unsigned char fault_count;
-
-	uint16_t write_data;
+	int packet_composed;
+	unsigned long long compose_start_clk;
+	ULONG compose_usec;
+	int statusCheck;
 
 
 	/* WLAN0 */
 #ifndef SILENT
-	PRINTF("WLAN0 - %s\n", macstr);
-#endif
-
-#ifdef __TIME64__
-	da16x_time64_msec(NULL, &now);
-	da16x_time64_sec(NULL, &nowSec);
-	uint64_t num1 = ((now/1000000) * 1000000);
-	uint64_t num2 = now - num1;
-	uint32_t num3 = num2;
-//	PRINTF("now %lld - %lld %lld %ld\r\n",now/1000000,num1, num2, num3);
-	sprintf(nowStr,"%ld",now/1000000);
-//	PRINTF("%s\r\n",nowStr);
-	sprintf(str2,"%06ld",num3);
-//	PRINTF("%s\r\n",str2);
-	strcat(nowStr,str2);
-//	PRINTF("nows; %s\r\n",nowStr);
-//	PRINTF("now %lld %lu %lu\r\n",now, (uint32_t)(now >> 32), (uint32_t)(now & 0xFFFFFFFF));
-//	PRINTF("now %llX %08lX %08lX\r\n",now, (uint32_t)(now >> 32), (uint32_t)(now & 0xFFFFFFFF));
-		ts = (struct tm *)da16x_localtime64(&nowSec);
-#else
-		now = da16x_time32(NULL);
-		ts = da16x_localtime32(&now);
-#endif /* __TIME64__ */
-		da16x_strftime(buf, sizeof (buf), "%Y.%m.%d %H:%M:%S", ts);
-#ifndef SILENT
-//		PRINTF("- Current Time : %s (GMT %+02d:%02d)\n",   buf,   da16x_Tzoff() / 3600,   da16x_Tzoff() % 3600);
+	ULOG_D_NOW("WLAN0 - %s\n", macstr);
 #endif
 
 	/*
@@ -2064,205 +2277,34 @@ int send_json_packet (int startAdd, packetDataStruct pData, int msg_number, int
 	statusCheck = mqtt_client_check_conn();
 	if (!statusCheck)
 	{
-		PRINTF("\nNeuralert: [%s] MQTT connection down - aborting", __func__);
+		ULOG_W("\nNeuralert: [%s] MQTT connection down - aborting", __func__);
 		return -1;
 	}
 
-	/*
-	 * JSON preamble
-	 */
-	strcpy(mqttMessage,"{\r\n\t\"state\":\r\n\t{\r\n\t\t\"reported\":\r\n\t\t{\r\n");
-	/*
-	 * MAC address of device - stored in retention memory
-	 * during the bootup event
-	 */
-	sprintf(str,"\t\t\t\"id\": \"%s\",\r\n",pUserData->Device_ID);
-	strcat(mqttMessage,str);
-
-
-	/* New timesync field added 1/26/23 per ECO approved by Neuralert
-	 * Format:
-	 *
-	 *	The current first JSON packet has this format:
-	 *	{ "state": { "reported": { "id": "EB345A", "meta": {},
-	 *	"bat": 140,
-	 *	"accX": [6 6 6 6 6 6 6 6 6 6 6 6 5 6 6 6 6 6 6 6 5 6 6 6 6 6 6 6 6 6 6 6 6 6 6 6 5 6 6 6 6 6 6 6 6 6 6 6 6 6 6 6 6
-	 *
-	 *	This change will add the following field between the “seq” field and the “bat” field:
-	 *
-	 *	"timesync": "2023.01.17 12:53:55 (GMT 00:00) 0656741",
-	 *
-	 *	where the data consists of the current date and time in “local” time, as configured when WIFI is set up.  The last field (0656741) is an internal timestamp in milliseconds since power-on that corresponds to the current local time.  This will make it possible to align timestamps from different devices.
-	 *
-	 *	Note that the “current” local date and time is that returned from an SNTP server on the Internet and is subject to internet lag and internal processing times.
-	 *
-	 */
-	time64_string(buf, &pUserData->MQTT_timesync_timestamptime_msec);
-	sprintf(str,"\t\t\t\"timesync\": \"%s %s\",\r\n",
-			pUserData->MQTT_timesync_current_time_str, buf);
-	strcat(mqttMessage,str);
-
-	/* get battery value */
-	adcDataFloat = get_battery_voltage();
-	//	    PRINTF("Current ADC Value: %d\n",(uint16_t)(adcDataFloat * 100));
-	// Battery voltage in centivolts
-	sprintf(str,"\t\t\t\"bat\": %d,\r\n",(uint16_t)(adcDataFloat * 100));
-	strcat(mqttMessage,str);
-
-	// META FIELD DEFINITIONS HERE
-	// Meta data field -- a json for whatever we want.
-	strcat(mqttMessage,"\t\t\t\"meta\":\r\n\t\t\t{\r\n");
-	/*
-	* Meta - Firmware Version
-	*/
-	sprintf(str,"\t\t\t\t\"ver\": \"%s\",\r\n", USER_VERSION_STRING);
-	strcat(mqttMessage, str);
-	/*
-	 * Meta - Transmission sequence #
-	 */
-	sprintf(str,"\t\t\t\t\"trans\": %d,\r\n", msg_number);
-	strcat(mqttMessage, str);
-	/*
-	 * Meta - Message sequence this transmission
-	 */
-	sprintf(str,"\t\t\t\t\"seq\": %d,\r\n", sequence);
-	strcat(mqttMessage, str);
-	/*
-	* Meta - Battery value this transmission
-	*/
-	sprintf(str,"\t\t\t\t\"bat\": %d,\r\n",(uint16_t)(adcDataFloat * 100));
-	strcat(mqttMessage, str);
-
-	/*
-	* Meta - Fault count at this transmission
-	*/
-	fault_count = get_fault_count();
-	sprintf(str,"\t\t\t\t\"count\": %d,\r\n", (uint16_t)fault_count);
-	strcat(mqttMessage, str);
-#if 0
-	/*
-	 * Meta - flash error code for packet
-	 */
-	sprintf(str,"\t\t\t\t\"errF\": %d,\r\n", pData.flash_error);
-	strcat(mqttMessage, str);
-	/*
-	 * Meta - nvram error code for packet
-	 */
-	sprintf(str,"\t\t\t\t\"errR\": %d,\r\n", pData.nvram_error);
-	strcat(mqttMessage, str);
-#endif
-	/*
-	 * Meta - Remaining free heap size (to monitor for significant leaks)
-	 */
-	sprintf(str,"\t\t\t\t\"mem\": %d\r\n", xPortGetFreeHeapSize());
-	strcat(mqttMessage, str);
-
-	// End meta data field (close bracket)
-	strcat(mqttMessage,"\t\t\t},\r\n");
-
-
-
-//	PRINTF(">> JSON preamble: %s\n", mqttMessage); // FRSDEBUG
-
-//		packet_len = strlen(mqttMessage);
-//		PRINTF("\n**Neuralert: send_json_packet: %d length before accel values\n", packet_len); // FRSDEBUG
-
-	/*
-	 *  Accelerometer X values
-	 */
-	sprintf(str,"\t\t\t\"accX\": [");
-	strcat(mqttMessage,str);
-	for(i=0;i<count;i++)
+	packet_composed = pdFALSE;
+	compose_start_clk = RTC_GET_COUNTER();
+#if (MQTT_PAYLOAD_FORMAT == MQTT_PAYLOAD_FORMAT_BINARY)
+	packet_composed = compose_binary_packet(packetBlocks[buffer], pData.num_blocks, count, msg_number, sequence);
+	if (packet_composed != pdTRUE)
 	{
-		Xvalue = accelXmitData[startAdd + i].Xvalue;
-		sprintf(str,"%d ",Xvalue);
-		strcat(mqttMessage,str);
+		ULOG_W("\n Neuralert: [%s] binary packet %d:%d failed, sending JSON", __func__, msg_number, sequence);
 	}
-	sprintf(str,"],\r\n");
-	strcat(mqttMessage,str);
-
-	packet_len = strlen(mqttMessage);
-//		PRINTF("\n**Neuralert: send_json_packet: %d length with X accel values\n", packet_len); // FRSDEBUG
-
-	/*
-	 *  Accelerometer Y values
-	 */
-	sprintf(str,"\t\t\t\"accY\": [");
-	strcat(mqttMessage,str);
-	for(i=0;i<count;i++)
+#endif
+	if (packet_composed != pdTRUE)
 	{
-		Yvalue = accelXmitData[startAdd + i].Yvalue;
-		sprintf(str,"%d ",Yvalue);
-		strcat(mqttMessage,str);
+		packet_composed = compose_json_packet(packetBlocks[buffer], pData.num_blocks, msg_number, sequence);
 	}
-	sprintf(str,"],\r\n");
-	strcat(mqttMessage,str);
-
-	packet_len = strlen(mqttMessage);
-//		PRINTF("\n**Neuralert: send_json_packet: %d length with X&Y accel values\n", packet_len); // FRSDEBUG
+	compose_usec = (ULONG)CLK2US(RTC_GET_COUNTER() - compose_start_clk);
 
-	/*
-	 *  Accelerometer Z values
-	 */
-	sprintf(str,"\t\t\t\"accZ\": [");
-	strcat(mqttMessage,str);
-	for(i=0;i<count;i++)
+	if (packet_composed != pdTRUE)
 	{
-		Zvalue = accelXmitData[startAdd + i].Zvalue;
-		sprintf(str,"%d ",Zvalue);
-		strcat(mqttMessage,str);
+		// Don't publish a truncated packet
+		return -1;
 	}
-	sprintf(str,"],\r\n");
-	strcat(mqttMessage,str);
-
-	packet_len = strlen(mqttMessage);
-//		PRINTF("\n**Neuralert: send_json_packet: %d length with X&Y&Z accel values\n", packet_len); // FRSDEBUG
-
-	/*
-	 *  Timestamps
-	 */
-	sprintf(str,"\t\t\t\"ts\": [");
-	strcat(mqttMessage,str);
-	// Note - as of 9/2/22 timestamps are in milliseconds,
-	// measured from the time the device was booted.
-	// So the largest expected timestamp will be at 5 days:
-	// 5 days x 24 hours x 60 minutes x 60 seconds x 1000 milliseconds
-	// = 432,000,000 msec
-	// which will transmit as 432000000
-	for(i=0;i<count;i++)
-	{
-		now = accelXmitData[startAdd + i].accelTime;
-		// Break the timestamp into millions and remainder
-		// to be able to use sprintf, which doesn't handle
-		// 64-bit numbers.
-		uint64_t num1 = ((now/1000000) * 1000000);
-		uint64_t num2 = now - num1;
-		uint32_t num3 = num2;
-		sprintf(nowStr,"%03ld",now/1000000); //JW: I changed this so all times are formatted the same (9 digits)
-		//sprintf(nowStr,"%ld",now/1000000);
-		sprintf(str2,"%06ld ",num3);
-		strcat(nowStr,str2);
-		strcat(mqttMessage,nowStr);
-	}
-	sprintf(str,"]\r\n");
-	strcat(mqttMessage,str);
-
-	packet_len = strlen(mqttMessage);
-//		PRINTF("\n**Neuralert: send_json_packet: %d length with all accel values\n", packet_len); // FRSDEBUG
-
-	/*
-	 * Closing braces
-	 */
-	strcat(mqttMessage,"\r\n\t\t}\r\n\t}\r\n}\r\n");
 
 	packet_len = strlen(mqttMessage);
-	PRINTF(">>send_json_packet: %d total message length\n", packet_len); // FRSDEBUG
-	// Sanity check in case some future person expands message
-	// without increasing buffer size
-	if (packet_len > MAX_JSON_STRING_SIZE)
-	{
-		PRINTF("\nNeuralert: [%s] JSON packet size too big: %d with limit %d", __func__, packet_len, (int)MAX_JSON_STRING_SIZE);
-	}
+	ULOG_D(">>send_json_packet: %d total message length, composed in %lu usec\n",
+			packet_len, compose_usec); // FRSDEBUG
 
 	// Transmit with publish topic from NVRAM
 //		transmit_status = mqtt_client_send_message(NULL, mqttMessage);
@@ -2274,15 +2316,16 @@ int send_json_packet (int startAdd, packetDataStruct pData, int msg_number, int
 
 	//transmit_status = 	mqtt_client_send_message_with_qos(NULL, mqttMessage, 100);
 
-	transmit_status = user_mqtt_send_message();
+	transmit_status = user_mqtt_publish_packet(&pData, sequence);
 
 	if(transmit_status == 0)
 	{
-		PRINTF("\n Neuralert: [%s], transmit %d:%d successful", __func__, msg_number, sequence);
+		ULOG_D("\n Neuralert: [%s], transmit %d:%d successful (%d inflight)", __func__,
+				msg_number, sequence, MQTT_publisher.inflight);
 	}
 	else
 	{
-		PRINTF("\n Neuralert: [%s] transmit %d:%d unsuccessful", __func__, msg_number, sequence);
+		ULOG_W("\n Neuralert: [%s] transmit %d:%d unsuccessful", __func__, msg_number, sequence);
 	}
 
 	return_status = transmit_status;
@@ -2293,33 +2336,6 @@ int send_json_packet (int startAdd, packetDataStruct pData, int msg_number, int
 	return return_status;
 }
 
-/**
- *******************************************************************************
- * @brief Helper function to create a printable string from a long long
- *        because printf doesn't handle long longs
- *        Format is just digits.  No commas or anything.
- *******************************************************************************
- */
-void time64_string (UCHAR *timestamp_str, __time64_t *timestamp)
-{
-	__time64_t timestamp_copy;
-	char nowStr[20];
-	char str2[20];
-
-	// split into high order and lower order pieces
-	timestamp_copy = *timestamp;
-	uint64_t num1 = ((timestamp_copy/1000000) * 1000000);	// millions
-	uint64_t num2 = timestamp_copy - num1;
-	uint32_t num3 = num2;
-
-	sprintf(nowStr,"%03ld",(uint32_t)(timestamp_copy/1000000));
-	sprintf(str2,"%06ld",num3);
-	strcat(nowStr,str2);
-	strcpy(timestamp_str,nowStr);
-
-	return;
-}
-
 /**
  *******************************************************************************
  * @brief Helper function to create a printable string from a long long
@@ -2328,7 +2344,7 @@ void time64_string (UCHAR *timestamp_str, __time64_t *timestamp)
  */
 void time64_msec_string (UCHAR *time_str, __time64_t *time_msec)
 {
-
+	jsonWriter str;
 	ULONG time_milliseconds;
 	ULONG time_seconds;
 	ULONG time_minutes;
@@ -2346,13 +2362,17 @@ void time64_msec_string (UCHAR *time_str, __time64_t *time_msec)
 	time_minutes = time_minutes % (ULONG)60;
 	time_hours = time_hours % (ULONG)24;
 
-	sprintf(time_str,
-			"%u Days plus %02u:%02u:%02u.%03u",
-		time_days,
-		time_hours,
-		time_minutes,
-		time_seconds,
-		time_milliseconds);
+	// "%u Days plus %02u:%02u:%02u.%03u"
+	json_writer_init(&str, (char *)time_str, TIME64_MSEC_STRING_MAX_LEN);
+	json_put_uint_padded(&str, time_days, 1);
+	json_put_str(&str, " Days plus ");
+	json_put_uint_padded(&str, time_hours, 2);
+	json_put_char(&str, ':');
+	json_put_uint_padded(&str, time_minutes, 2);
+	json_put_char(&str, ':');
+	json_put_uint_padded(&str, time_seconds, 2);
+	json_put_char(&str, '.');
+	json_put_uint_padded(&str, time_milliseconds, 3);
 }
 
 /**
@@ -2377,10 +2397,10 @@ void time64_seconds_string (UCHAR *time_str, __time64_t *time_msec)
 	// so - for instance, 849 becomes 899 becomes .8
 	//                and 850 becomes 900 becomes .9
 
-	PRINTF(" [time64_seconds_string] intermediate msec: %lu", time_milliseconds);
+	ULOG_D(" [time64_seconds_string] intermediate msec: %lu", time_milliseconds);
 
 	time_tenths = time_milliseconds + (ULONG)50;
-	PRINTF(" [time64_seconds_string] intermediate tenths before division: %lu", time_tenths);
+	ULOG_D(" [time64_seconds_string] intermediate tenths before division: %lu", time_tenths);
 	time_tenths = time_tenths / (ULONG)100;
 
 	sprintf(time_str,
@@ -2391,56 +2411,6 @@ void time64_seconds_string (UCHAR *time_str, __time64_t *time_msec)
 }
 
 
-
-
-/**
- *******************************************************************************
- * @brief calculate the timestamp for all a sample read from the accelerometer FIFO
- *      by using it's relative position in the buffer.
- *
- *   FIFO_ts 			- is the timestamp assigned to the FIFO buffer when it was read
- *   FIFO_ts_prev		- is the timestamp assigned to the previous FIFO buffer when it was read
- *   offset         	- is the position in the FIFO
- *   FIFO_samples		- is the total number of samples in the FIFO
- *   adjusted_timestamp - is the calculated timestamp to be assigned to the sample
- *                    		with this offset
- *
- *******************************************************************************
- */
-void calculate_timestamp_for_sample(__time64_t *FIFO_ts, __time64_t *FIFO_ts_prev, int offset, int FIFO_samples, __time64_t *adjusted_timestamp)
-{
-	__time64_t scaled_timestamp;	// times 1000 for more precise math
-	__time64_t scaled_timestamp_prev; // times 1000 for more precise math
-	__time64_t scaled_offsettime;	// the time offset of this sample * 1000
-	__time64_t adjusted_scaled_timestamp;
-	__time64_t rounded_offsettime;
-	__time64_t inter_sample_period_usec;	// Amount we adjust for each sample in the block
-
-	char input_str[20];
-	char output_str[20];
-	char scaled_time_str[20];
-	char scaled_offset_str[20];
-	char offset_str[20];
-
-	scaled_timestamp = *FIFO_ts;
-	scaled_timestamp = scaled_timestamp * (__time64_t)1000;
-
-	scaled_timestamp_prev = *FIFO_ts_prev;
-	scaled_timestamp_prev = scaled_timestamp_prev * (__time64_t)1000;
-
-	scaled_offsettime = ((scaled_timestamp - scaled_timestamp_prev) * (__time64_t)(offset + 1)) / (__time64_t)FIFO_samples;
-
-	// offset time * 1000
-	adjusted_scaled_timestamp = scaled_timestamp_prev + scaled_offsettime;
-	// back to msec.  We round by adding 500 usec before dividing
-	rounded_offsettime = (adjusted_scaled_timestamp + (__time64_t)500)
-			                  / (__time64_t)1000;
-
-	*adjusted_timestamp = rounded_offsettime;
-	return;
-}
-
-
 //JW: This is the old way of calculating the timestamps using calibration and interpolation
 // This chunk of code can be removed in a future release.
 #if 0
@@ -2521,65 +2491,45 @@ void calculate_timestamp_for_sample(__time64_t *FIFO_timestamp, int offset, __ti
  *returns number of pages between loc and next write position
  *******************************************************************************
  */
-static int get_AB_buffer_gap(int loc)
+static int AB_buffer_gap(int loc, int write_loc)
 {
-	int write_loc;
-
-	write_loc = get_AB_write_location();
-
 	if (loc >= write_loc){
 		return loc - write_loc;
 	}
 	else{
-		return AB_FLASH_MAX_PAGES - (write_loc - loc);
+		return AB_FLASH_MAX_BLOCKS - (write_loc - loc);
 	}
 }
 
 
 /**
  *******************************************************************************
- * @brief create a table of accelerometer data for transmission in one packet
+ * @brief collect the flash blocks for transmission in one packet
  *
- * typedef struct
-	{
-		int16_t Xvalue;					//!< X-Value * 1000
-		int16_t Yvalue;					//!< Y-Value * 1000
-		int16_t Zvalue;					//!< Z-Value * 1000
-		__time64_t accelTime;           //!< time when accelerometer data taken
-	} accelDataStruct;
+ * The blocks are read into blocks[0 .. num_blocks-1].  The samples
+ * and their timestamps are produced from the blocks when the packet is
+ * composed, so no per-sample table is kept.
  *
- *returns -1 if an error
- *returns number of samples in data array otherwise
+ * returns the description of the packet; num_samples is the total number
+ * of samples in the blocks that were read
  *******************************************************************************
  */
-static packetDataStruct assemble_packet_data (int start_block)
+static packetDataStruct assemble_packet_data (int start_block, accelBufferStruct *blocks)
 {
 	int blocknumber;		// 0-based block index in Flash
-	int check_bit_flag;
-	int transmit_flag;
-	unsigned int buffer_gap;
+	int transmit_location;
+	int search_end;
 	ULONG blockaddr;			// physical address in flash
 	int done = pdFALSE;
-	__time64_t block_timestamp;
-	__time64_t block_timestamp_prev;
-	__time64_t sample_timestamp;
-	ULONG sample_timestamp_offset;
-	int block_samples;
-	//int timesource;
-	int timeoffset;
-	accelBufferStruct FIFOblock;
-
+	accelBufferStruct *pFIFOblock;
+	int run_length;			// consecutive waiting blocks found
+	int run_start;			// packet slot the run was read into
+	int run_read_ok;		// pdTRUE if the run came back from flash
+	int block_ok;
 	int i;
-	int retry_count;
-	int timeoffsetindex;   	// +- position from where timestamp is assigned
-	__time64_t inter_sample_period_usec;	// Amount we adjust for each sample in the block
 
 	packetDataStruct packet_data;
 
-	char scaled_time_str[20];
-
-	char block_timestamp_str[20];
-	char sample_timestamp_str[20];
 	HANDLE SPI = NULL;
 
 	// Initialize output
@@ -2593,12 +2543,12 @@ static packetDataStruct assemble_packet_data (int start_block)
 	packet_data.flash_error = FLASH_NO_ERROR;
 
 
-	PRINTF("\n Neuralert: [%s] assembling packet data starting at %d", __func__, start_block);
+	ULOG_D("\n Neuralert: [%s] assembling packet data starting at %d", __func__, start_block);
 
 	SPI = flash_open(SPI_MASTER_CLK, SPI_MASTER_CS);
 	if (SPI == NULL)
 	{
-		PRINTF("\n Neuralert: [%s] MAJOR SPI ERROR: Unable to open SPI bus handle", __func__);
+		ULOG_E("\n Neuralert: [%s] MAJOR SPI ERROR: Unable to open SPI bus handle", __func__);
 		packet_data.flash_error = FLASH_OPEN_ERROR;
 		return packet_data;
 	}
@@ -2608,121 +2558,101 @@ static packetDataStruct assemble_packet_data (int start_block)
 	// If we're only sending one block, then start_block will be
 	// equal to end_block
 	blocknumber = start_block;
-	check_bit_flag = 1; // always start with the check_bit_flag set to 1
 	while (!done)
 	{
-		// Check if the next write is too close for comfort
-		buffer_gap = (unsigned int) get_AB_buffer_gap(blocknumber);
-		if (buffer_gap <= AB_TRANSMIT_SAFETY_GAP){
+		// Find the next block waiting for transmission.  This stops
+		// short of the next write if it's too close for comfort.
+		transmit_location = find_AB_transmit_location(blocknumber,
+								FIFO_BLOCKS_PER_PACKET - packet_data.num_blocks,
+								&run_length, &search_end);
+		if (transmit_location == -1)
+		{
+			// nothing more to send
+			blocknumber = search_end;
 			packet_data.done_flag = pdTRUE;
-			done = pdTRUE;
 			break;
 		}
+		blocknumber = transmit_location;
 
-		// check if the next sizeof(_AB_transmit_map_t) bits in the transmit queue are zeros
-		// this is done by confirming we are in a new sizeof(_AB_transmit_map_t) chunk of data
-		// the easiest way to do this is to check whether one position higher was the last element
-		// in a chunk of data.  This is because we are traversing the queue in reverse.
-		if ((((blocknumber + 1) % sizeof(_AB_transmit_map_t)) == 0)
-				&& (buffer_gap >= AB_TRANSMIT_SAFETY_GAP + sizeof(_AB_transmit_map_t)))
+		// The blocks from blocknumber down are ready for transmission.
+		// Consecutive blocks are consecutive in flash, so the whole
+		// run is read with one flash command, straight into the next free
+		// slots of the packet table.  A slot is only kept if the block's
+		// CRC checks out.
+		run_start = packet_data.num_blocks;
+		run_read_ok = AB_read_blocks(SPI, blocknumber, run_length, &blocks[run_start]);
+		if (!run_read_ok)
 		{
-			check_bit_flag = check_AB_transmit_location(blocknumber / sizeof(_AB_transmit_map_t), pdFALSE);
-			if (check_bit_flag == -1){
-				packet_data.nvram_error = pdTRUE;
-			}
+			ULOG_E("\n Neuralert: [%s] unable to read %d blocks from %d\n", __func__, run_length, blocknumber);
+			packet_data.flash_error = FLASH_READ_ERROR;
 		}
 
-		if (check_bit_flag == 0) // the next sizeof(_AB_transmit_map_t) bits are zero
-		{
-			blocknumber = blocknumber - sizeof(_AB_transmit_map_t);
-			if (blocknumber < 0) {
-				blocknumber = blocknumber + AB_FLASH_MAX_PAGES;
-			}
-			check_bit_flag = 1; // set this flag to one -- to force a check next round
-		}
-		else // check_bit_flag == 1
+		for (i = 0; i < run_length; i++)
 		{
-			transmit_flag = check_AB_transmit_location(blocknumber, pdTRUE);
-			if (transmit_flag == -1)
+			pFIFOblock = &blocks[packet_data.num_blocks];
+			if (pFIFOblock != &blocks[run_start + i])
 			{
-				// there was an error in reading the transmit map
-				packet_data.nvram_error = pdTRUE;
+				// Close up the gap left by a block that wasn't real
+				*pFIFOblock = blocks[run_start + i];
 			}
-			else if (transmit_flag == 1)
-			{
-				// The current blocknumber is ready for transmission, Read the block from Flash
-				// For each block, assemble the XYZ data and assign a timestamp
-				// based on the block timestamp and the samples relation to
-				// when that timestamp was taken
-				// Calculate address of next sector to write
-				blockaddr = (ULONG)AB_FLASH_BEGIN_ADDRESS +
-						((ULONG)AB_FLASH_PAGE_SIZE * (ULONG)blocknumber);
-				for (retry_count = 0; retry_count < 3; retry_count++)
-				{
-					if (!AB_read_block(SPI, blockaddr, &FIFOblock))
-					{
-						PRINTF("\n Neuralert: [%s] unable to read block %d addr: %x\n", __func__, blocknumber, blockaddr);
-						packet_data.flash_error = FLASH_READ_ERROR;
-					}
-
-					if(FIFOblock.num_samples > 0)
-					{
-						break;
-					}
 
-				}
-				if (retry_count > 0)
+			block_ok = run_read_ok && ab_block_valid(pFIFOblock, pUserData->AB_precrc_sequence);
+			if (!block_ok)
+			{
+				// Read a bad block once more on its own.  If the CRC
+				// still doesn't match, it's the stored block that's bad
+				// rather than the read, and reading again won't help.
+				if (run_read_ok)
 				{
-					PRINTF(" assemble_packet_data: retried read %d times", retry_count);
+					AB_crc_fail_count++;
 				}
-
-				// Only process FIFOblock if the data is real -- otherwise, skip block and proceed.
-				if (FIFOblock.num_samples > 0)
+				blockaddr = AB_BLOCK_ADDRESS(blocknumber);
+				if (!AB_read_block(SPI, blockaddr, pFIFOblock))
 				{
-					// add the samples to the transmit array
-					packet_data.num_blocks++;
-					block_timestamp = FIFOblock.accelTime;
-					block_timestamp_prev = FIFOblock.accelTime_prev;
-					block_samples = FIFOblock.num_samples;
-					time64_string (block_timestamp_str, &block_timestamp);
-					for (i=0; i<FIFOblock.num_samples; i++)
-					{
-						accelXmitData[packet_data.num_samples].Xvalue = FIFOblock.Xvalue[i];
-						accelXmitData[packet_data.num_samples].Yvalue = FIFOblock.Yvalue[i];
-						accelXmitData[packet_data.num_samples].Zvalue = FIFOblock.Zvalue[i];
-						calculate_timestamp_for_sample(&block_timestamp, &block_timestamp_prev,
-								i, block_samples, &sample_timestamp);
-						accelXmitData[packet_data.num_samples].accelTime = sample_timestamp;
-						packet_data.num_samples++;
-					}
-
-					if (packet_data.num_blocks == FIFO_BLOCKS_PER_PACKET)
-					{
-						done = pdTRUE;
-					}
+					ULOG_E("\n Neuralert: [%s] unable to read block %d addr: %x\n", __func__, blocknumber, blockaddr);
+					packet_data.flash_error = FLASH_READ_ERROR;
 				}
 				else
 				{
-					packet_data.flash_error = FLASH_DATA_ERROR;
+					block_ok = ab_block_valid(pFIFOblock, pUserData->AB_precrc_sequence);
+					ULOG_D(" assemble_packet_data: block %d re-read %s\n", blocknumber,
+							block_ok ? "ok" : "failed CRC");
 				}
-			} // else if (transmit_flag == 1)
+			}
+
+			// Only process FIFOblock if the data is real -- otherwise, skip block and proceed.
+			if (block_ok)
+			{
+				// add the block to the packet -- the samples and their
+				// timestamps are generated from it when the packet is encoded
+				packet_data.num_blocks++;
+				packet_data.num_samples += pFIFOblock->num_samples;
+			}
+			else
+			{
+				packet_data.flash_error = FLASH_DATA_ERROR;
+			}
 
 			// step to next block -- during transmission, we go backwards
 			blocknumber--;
 			if (blocknumber < 0) {
-				blocknumber = blocknumber + AB_FLASH_MAX_PAGES;
+				blocknumber = blocknumber + AB_FLASH_MAX_BLOCKS;
 			}
+		}
 
-		} // check_bit_flag == 1
+		if (packet_data.num_blocks == FIFO_BLOCKS_PER_PACKET)
+		{
+			done = pdTRUE;
+		}
 
 	} // while loop for processing data
 
 	flash_close(SPI);
 
 	packet_data.next_start_block = blocknumber;
-	packet_data.end_block = (blocknumber + 1) % AB_FLASH_MAX_PAGES; // Since blocknumber is now the next block
+	packet_data.end_block = (blocknumber + 1) % AB_FLASH_MAX_BLOCKS; // Since blocknumber is now the next block
 
-	PRINTF("**Assemble packet data: %d samples assembled from %d blocks\n",
+	ULOG_D("**Assemble packet data: %d samples assembled from %d blocks\n",
 			packet_data.num_samples, packet_data.num_blocks);
 
 	return packet_data;
@@ -2955,13 +2885,13 @@ static int user_process_connect_to_ap_and_wait(int max_wait_seconds)
 
 
 
-	PRINTF("**Neuralert: %s\n", __func__); // FRSDEBUG
+	ULOG_D("**Neuralert: %s\n", __func__); // FRSDEBUG
 #if defined(__RUNTIME_CALCULATION__) && defined(XIP_CACHE_BOOT)
 	printf_with_run_time("===Enter connect_to_ap_and_wait");
 #endif
 
 	if (user_process_check_wifi_conn() == pdTRUE) {
-		PRINTF("**Neuralert: user_process_connect_to_ap() already connected\n"); // FRSDEBUG
+		ULOG_D("**Neuralert: user_process_connect_to_ap() already connected\n"); // FRSDEBUG
 
 		/* Connection is already established */
 //		user_wifi_connection_complete_event();
@@ -2969,21 +2899,21 @@ static int user_process_connect_to_ap_and_wait(int max_wait_seconds)
 	}
 
 	// use the internal command line interface to initiate the connect
-	PRINTF("**Neuralert: user_process_connect_to_ap() attempting connection\n"); // FRSDEBUG
+	ULOG_D("**Neuralert: user_process_connect_to_ap() attempting connection\n"); // FRSDEBUG
 #if defined(__RUNTIME_CALCULATION__) && defined(XIP_CACHE_BOOT)
 	printf_with_run_time("===start of connection attempt");
 #endif
 
 	ret = da16x_cli_reply("select_network 0", NULL, value_str);
 	if (ret < 0 || strcmp(value_str, "FAIL") == 0) {
-		PRINTF(" [%s] Failed connect to AP (da16x_cli_reply) 0x%x %s\n", __func__, ret, value_str);
+		ULOG_E(" [%s] Failed connect to AP (da16x_cli_reply) 0x%x %s\n", __func__, ret, value_str);
 
 		ret = -1;
 		return ret;
 	}
 
 	// Wait an initial time since we know it will take a little time
-	PRINTF(" [%s] Start initial check delay %d\n", __func__, INITIAL_CHECK_INTERVAL_MSEC);
+	ULOG_D(" [%s] Start initial check delay %d\n", __func__, INITIAL_CHECK_INTERVAL_MSEC);
 	vTaskDelay(pdMS_TO_TICKS(INITIAL_CHECK_INTERVAL_MSEC));
 
 	// Wait for connection with timeout
@@ -2993,7 +2923,7 @@ static int user_process_connect_to_ap_and_wait(int max_wait_seconds)
 	do {
 		vTaskDelay(pdMS_TO_TICKS(CHECK_INTERVAL_MSEC));
 
-		PRINTF(" [%s] Checking WIFI\n", __func__);
+		ULOG_D(" [%s] Checking WIFI\n", __func__);
 
 		cur_time_ticks = xTaskGetTickCount();
 		if (cur_time_ticks >= start_time_ticks) {
@@ -3001,7 +2931,7 @@ static int user_process_connect_to_ap_and_wait(int max_wait_seconds)
 		} else {
 			elapsed_time_ticks =  (((unsigned int) 0xFFFFFFFF) - start_time_ticks) + cur_time_ticks;
 		}
-		PRINTF(" [%s] elapsed time %d ticks (max %d ticks )\n", __func__, elapsed_time_ticks, max_wait_TICKS);
+		ULOG_D(" [%s] elapsed time %d ticks (max %d ticks )\n", __func__, elapsed_time_ticks, max_wait_TICKS);
 
 		connected = user_process_check_wifi_conn();
 
@@ -3039,7 +2969,7 @@ int parseDownlink(char *buf, int len)
 	char commands[4][90];
 	char *argvTmp[4] = {&commands[0][0], &commands[1][0], &commands[2][0], &commands[3][0]};
 
-	PRINTF("parseDownlink %s %d\n",buf,len);
+	ULOG_D_NOW("parseDownlink %s %d\n",buf,len);
 
 	// Scan for "message:" keyword
 	// overruns buffer if first keyword > 19
@@ -3057,7 +2987,7 @@ int parseDownlink(char *buf, int len)
 	}
 	if(strcmp(str1,"message") != 0)
 	{
-		PRINTF("Neuralert: [%s] message keyword missing in downlink command! %s", __func__, str1);
+		ULOG_W("Neuralert: [%s] message keyword missing in downlink command! %s", __func__, str1);
 		return (FALSE);
 	}
 
@@ -3084,10 +3014,10 @@ int parseDownlink(char *buf, int len)
 	commands[j][k] = '\0';
 	argc++;
 
-	PRINTF("\n\nDownlink command(s) received: %d\r\n",argc);
+	ULOG_I("\n\nDownlink command(s) received: %d\r\n",argc);
 	for(i=0;i<argc;i++)
 	{
-		PRINTF("   i: %d %s\r\n",i,&commands[i][0]);
+		ULOG_I_NOW("   i: %d %s\r\n",i,&commands[i][0]);
 //		if(i < 4)
 //			PRINTF("i: %d %s\r\n",i,argvTmp[i]);
 	}
@@ -3097,11 +3027,11 @@ int parseDownlink(char *buf, int len)
 		if(argc < 2)
 		{
 
-			PRINTF("\n Neuralert: [%s] terminate command received without device identifier", __func__);
+			ULOG_W("\n Neuralert: [%s] terminate command received without device identifier", __func__);
 		}
 		else if (strcmp(pUserData->Device_ID, &commands[1][0]) != 0)
 		{
-			PRINTF("\n Neuralert: [%s] terminate command with wrong device identifier: %s", __func__,
+			ULOG_W("\n Neuralert: [%s] terminate command with wrong device identifier: %s", __func__,
 					&commands[1][0]);
 		}
 		else
@@ -3148,7 +3078,7 @@ int parseDownlink(char *buf, int len)
 static void user_mqtt_msg_cb (const char *buf, int len, const char *topic)
 {
 	MQTT_DBG_PRINT("\n  user_mqtt_msg_cb called %s %d topic: %s\r\n\n",buf, len, topic);
-	PRINTF("\n Neuralert: [%s] Downlink command received", __func__);
+	ULOG_I("\n Neuralert: [%s] Downlink command received", __func__);
 	parseDownlink((char *)buf, len);
 }
 
@@ -3167,6 +3097,7 @@ static void user_mqtt_msg_cb (const char *buf, int len, const char *topic)
 
 void user_terminate_transmit(void)
 {
+	TRACE_EVENT(TRACE_EV_UPLOAD_END, 0, 0);
 
 #if defined(__RUNTIME_CALCULATION__) && defined(XIP_CACHE_BOOT)
 	printf_with_run_time("\n===user_terminate_transmit called"); // This might be causing a fault
@@ -3195,7 +3126,7 @@ void user_terminate_transmit(void)
 	UCHAR value_str[128];
     int ret = da16x_cli_reply("disconnect", NULL, value_str);
 	while (ret < 0 || strcmp(value_str, "FAIL") == 0) {
-		PRINTF(" [%s] Failed disconnect from AP 0x%x\n  %s\n", __func__, ret, value_str);
+		ULOG_E(" [%s] Failed disconnect from AP 0x%x\n  %s\n", __func__, ret, value_str);
 		vTaskDelay(pdMS_TO_TICKS(10));
 		ret = da16x_cli_reply("disconnect", NULL, value_str);
 	}
@@ -3236,7 +3167,7 @@ static UCHAR user_process_check_wifi_conn(void)
 
 	status = (char *)pvPortMalloc(USER_CONNECT_STATUS_REPLY_SIZE);
 	if (status == NULL) {
-		PRINTF("%s(%d): failed to allocate memory\n", __func__, __LINE__);
+		ULOG_E("%s(%d): failed to allocate memory\n", __func__, __LINE__);
 		return pdFALSE;
 	}
 
@@ -3262,7 +3193,7 @@ static int user_wifi_chk_connection(int timeout)
 
             wait_cnt++;
             if (wait_cnt == timeout) {
-                PRINTF("wifi connection timeout!, check your configuration \r\n");
+                ULOG_W("wifi connection timeout!, check your configuration \r\n");
                 return pdFALSE;
             }
         } else {
@@ -3284,7 +3215,7 @@ static int user_mqtt_chk_connection(int timeout)
 
             wait_cnt++;
             if (wait_cnt == timeout) {
-                PRINTF("mqtt connection timeout!, check your configuration \r\n");
+                ULOG_W("mqtt connection timeout!, check your configuration \r\n");
                 return pdFALSE;
             }
         } else {
@@ -3297,81 +3228,74 @@ static int user_mqtt_chk_connection(int timeout)
 
 /**
  *******************************************************************************
- * @brief A application-level version MQTT send message for qos
- * This function is a application-level implementation of:
- * mqtt_client_send_message_with_qos in sub_client.c
- * the version in sub_client.c has a race condition w.r.t. inflight messages.
- * Specifically, in SDK 3.2.8.1 (and earlier) the while loop exit condition would
- * be checked prior to the inflight messages variable being incremented.  Renesas
- * was contacted and the recommendation was to implement an application-level
- * solution using the mqtt_slient_set_pub_cb.  Consequently, to user this function
- * the pUserData->MQTT_inflight variable must be set to zero in the pub_cb function
- * *******************************************************************************
+ * @brief Release the flash blocks of a packet in the transmit map
+ *******************************************************************************
  */
-static int user_mqtt_client_send_message_with_qos(char *top, char *publish, ULONG timeout)
+static void clear_packet_transmit_map(packetDataStruct *packet)
 {
-	int status;
-	int qos;
-	da16x_get_config_int(DA16X_CONF_INT_MQTT_QOS, &qos);
-
-	if (pUserData->MQTT_inflight > 0){
-		return -1; // A message is supposedly inflight
-	}
-
-	pUserData->MQTT_inflight = 1;
-	status = mqtt_pub_send_msg(top, publish);
-
-	if (!status && qos >= 1)
+	if (packet->start_block > packet->end_block)
 	{
-		while (timeout--)
+		// clear from "end" to "start" (because LIMO works backwards through the map)
+		if (!clear_AB_transmit_location(packet->end_block, packet->start_block))
 		{
-			if (pUserData->MQTT_inflight == 0)
-			{
-				return 0;
-			}
-
-			vTaskDelay(10);
+			ULOG_E("MQTT: transmit map failed to update\n");
 		}
 
-		// a timeout has occurred.  clear the inflight variable and exit.
-		// we're going to kill the MQTT client next which will kill the actual inflight message
-		pUserData->MQTT_inflight = 0;
-		return -2;			/* timeout */
-	}
-	else if (!status && qos == 0)
-	{
-		pUserData->MQTT_inflight = 0;
-		return 0;
 	}
-	else
+	else // there was a "wrap" in the buffer
 	{
-		pUserData->MQTT_inflight = 0; // clear inflight, we'll kill the client next anyway
-		return -1;		/* error */
+		// clear from "0" to "start" and from "end" to AB_FLASH_MAX_BLOCKS-1
+		if (!clear_AB_transmit_location(0, packet->start_block))
+		{
+			ULOG_E("MQTT: transmit map failed to update\n");
+		}
+		if (!clear_AB_transmit_location(packet->end_block, AB_FLASH_MAX_BLOCKS-1))
+		{
+			ULOG_E("MQTT: transmit map failed to update\n");
+		}
 	}
 }
 
+/**
+ *******************************************************************************
+ * @brief Account for a packet the broker has accepted
+ *
+ * Only now is it safe to clear its blocks from the transmit map.
+ *******************************************************************************
+ */
+static void mqtt_packet_delivered(packetDataStruct *packet)
+{
+	clear_MQTT_stat(&(pUserData->MQTT_attempts_since_tx_success));
+	CLR_BIT(processLists, USER_PROCESS_BOOTUP); //JW: we have succeeded in a transmission (bootup complete), so clear the bootup state bit.
+	notify_user_LED(); // notify the led
 
+	// Clear the transmission map corresponding to blocks in the packet
+	clear_packet_transmit_map(packet);
 
+	increment_MQTT_stat(&(pUserData->MQTT_stats_packets_sent));
+}
 
 /**
  *******************************************************************************
- * @brief Task to manage sending MQTT messages
+ * @brief Publish the packet composed in mqttMessage
+ *
+ * See user_mqtt_publish.c.  With QOS 1 this waits for the PUBACK of the
+ * previous packet, not of this one.
+ *
+ * Returns 0 on success, -2 on timeout, -1 on error
  *******************************************************************************
  */
-static int user_mqtt_send_message(void)
+static int user_mqtt_publish_packet(packetDataStruct *packet, int sequence)
 {
-	int transmit_status = 0;
+	int status;
+	int qos;
 
-	unsigned long timeout_qos = 0;
-	timeout_qos = (unsigned long) (pdMS_TO_TICKS(MQTT_QOS_TIMEOUT_MS) / 10);
-	PRINTF("\n>>timeout qos: %lu \n", timeout_qos);
+	da16x_get_config_int(DA16X_CONF_INT_MQTT_QOS, &qos);
 
-	// note, don't call mqtt_client_send_message_with_qos in sub_client.c
-	// there is a race condition in that function.  We use the following which
-	// is an application-level implementation using callbacks
-	transmit_status = user_mqtt_client_send_message_with_qos(NULL, mqttMessage, timeout_qos);
+	status = mqtt_publisher_send(&MQTT_publisher, mqttMessage, packet, sequence, qos);
+	pUserData->MQTT_inflight = MQTT_publisher.inflight;
 
-	return transmit_status;
+	return status;
 }
 
 
@@ -3396,7 +3320,7 @@ static int user_mqtt_send_message(void)
  */
 static void user_process_MQTT_stop(void* arg)
 {
-	PRINTF (">>>>>> Forcibly Stopping MQTT Client <<<<<<<<");
+	ULOG_W(">>>>>> Forcibly Stopping MQTT Client <<<<<<<<");
     if (mqtt_client_is_running() == TRUE) {
         mqtt_client_force_stop();
         mqtt_client_stop();
@@ -3405,7 +3329,7 @@ static void user_process_MQTT_stop(void* arg)
     CLR_BIT(processLists, USER_PROCESS_MQTT_STOP);
     vTaskDelay(1);
 
-    PRINTF (">>>>>> MQTT Client Stopped <<<<<<<<");
+    ULOG_I(">>>>>> MQTT Client Stopped <<<<<<<<");
 
     user_MQTT_stop_task_handle = NULL;
     vTaskDelete(NULL);
@@ -3434,16 +3358,27 @@ static void user_process_watchdog(void* arg)
 	sys_wdog_id = da16x_sys_watchdog_register(pdFALSE);
 
 	int timeout = WATCHDOG_TIMEOUT_SECONDS * 10;
+	int fast_timeout = WIFI_FAST_CONNECT_TIMEOUT_SECONDS * 10;
 	while (BIT_SET(processLists, USER_PROCESS_WATCHDOG) && timeout > 0)
 	{
 		vTaskDelay(pdMS_TO_TICKS(100)); // 100 ms delay
 		timeout--;
 		da16x_sys_watchdog_notify(sys_wdog_id);
+
+		// A fast connect that is taking too long falls back to a full scan
+		if (fast_timeout > 0)
+		{
+			fast_timeout--;
+			if (fast_timeout == 0)
+			{
+				user_wifi_fast_connect_fallback();
+			}
+		}
 	}
 
 	// The Process bit should have been cleared in user_process_send_MQTT_data()
 	if (BIT_SET(processLists, USER_PROCESS_WATCHDOG)){
-		PRINTF ("\n*** WIFI and MQTT Connection Watchdog Timeout ***\n");
+		ULOG_W("\n*** WIFI and MQTT Connection Watchdog Timeout ***\n");
 		increment_MQTT_stat(&(pUserData->MQTT_stats_connect_fails));
 		da16x_sys_watchdog_notify(sys_wdog_id);
 		da16x_sys_watchdog_suspend(sys_wdog_id);
@@ -3451,7 +3386,7 @@ static void user_process_watchdog(void* arg)
 		da16x_sys_watchdog_notify_and_resume(sys_wdog_id);
 	}
 
-	PRINTF ("\n>>> Stopping Watchdog Task <<<\n");
+	ULOG_D("\n>>> Stopping Watchdog Task <<<\n");
 	CLR_BIT(processLists, USER_PROCESS_WATCHDOG);
 	CLR_BIT(processLists, USER_PROCESS_WATCHDOG_STOP);
 
@@ -3476,7 +3411,7 @@ static int user_process_start_watchdog()
 {
 
 	if (user_watchdog_task_handle != NULL){
-		PRINTF("\n Neuralert: [%s] Watchdog task already running -- Not starting transmission", __func__);
+		ULOG_W("\n Neuralert: [%s] Watchdog task already running -- Not starting transmission", __func__);
 		return -2; //TODO: remove hard coding
 	}
 
@@ -3493,12 +3428,12 @@ static int user_process_start_watchdog()
 
 	if (create_status == pdPASS)
 	{
-		PRINTF("\n Neuralert: [%s] Watchdog task created\n", __func__);
+		ULOG_D("\n Neuralert: [%s] Watchdog task created\n", __func__);
 		return 0; // TODO: remove hardcoding
 	}
 	else
 	{
-		PRINTF("\n Neuralert: [%s] Watchdog task failed to create -- Not starting transmission", __func__);
+		ULOG_E("\n Neuralert: [%s] Watchdog task failed to create -- Not starting transmission", __func__);
 		return -1; // TODO: remove hardcoding
 	}
 
@@ -3576,6 +3511,137 @@ void user_retry_transmit(void)
 
 
 
+/**
+ *******************************************************************************
+ * @brief Task to read packets out of the AB flash region ahead of the
+ * transmit task
+ *
+ * Takes an empty packet buffer, fills it with assemble_packet_data() and
+ * hands it to the transmit task, so the SPI flash reads for the next
+ * packet overlap the network send of the current one.  The reader exits
+ * after passing on the last packet (no more data, or an error) or when
+ * asked to stop.  AB_read_blocks() takes Flash_semaphore for every read
+ * and assemble_packet_data() stops AB_TRANSMIT_SAFETY_GAP blocks short of
+ * the accelerometer writer, exactly as when reading inline.
+ *******************************************************************************
+ */
+static void user_process_read_packets(void* arg)
+{
+	int buffer;
+	int next_start_block = packet_reader_start_block;
+	packetDataStruct *packet;
+
+	while (packet_reader_stop == pdFALSE)
+	{
+		if (xQueueReceive(packet_free_queue, &buffer, pdMS_TO_TICKS(100)) != pdPASS)
+		{
+			continue;
+		}
+		if (packet_reader_stop == pdTRUE)
+		{
+			break;
+		}
+
+		packet = &packetBufferData[buffer];
+		*packet = assemble_packet_data(next_start_block, packetBlocks[buffer]);
+		next_start_block = packet->next_start_block;
+
+		// There is always room: only PACKET_BUFFERS indexes exist
+		xQueueSend(packet_ready_queue, &buffer, 0);
+
+		if ((packet->num_samples <= 0) || (packet->done_flag == pdTRUE))
+		{
+			break;		// nothing more to read this transmission
+		}
+	}
+
+	user_packet_reader_task_handle = NULL;
+	vTaskDelete(NULL);
+}
+
+/**
+ *******************************************************************************
+ * @brief Start the packet reader task at start_block with all packet
+ * buffers empty
+ *
+ * A reader left over from a previous transmission (see
+ * packet_reader_stop_wait) would still fill buffers and post them to the
+ * queues, so no new reader is started until it has exited.
+ *
+ * Returns pdTRUE if the task was started
+ *******************************************************************************
+ */
+static int packet_reader_start(int start_block)
+{
+	int buffer;
+	BaseType_t create_status;
+
+	if ((packet_free_queue == NULL) || (packet_ready_queue == NULL))
+	{
+		return pdFALSE;
+	}
+	if (user_packet_reader_task_handle != NULL)
+	{
+		ULOG_W("\n Neuralert: [%s] previous packet reader still running", __func__);
+		return pdFALSE;
+	}
+
+	xQueueReset(packet_free_queue);
+	xQueueReset(packet_ready_queue);
+	for (buffer = 0; buffer < PACKET_BUFFERS; buffer++)
+	{
+		xQueueSend(packet_free_queue, &buffer, 0);
+	}
+
+	packet_reader_start_block = start_block;
+	packet_reader_stop = pdFALSE;
+
+	create_status = xTaskCreate(
+			user_process_read_packets,
+			"USER_PKT_RD",				// Task name
+			(2*1024),					// flash reads and logging only
+			( void * ) NULL,  			// no parameter to pass
+			(OS_TASK_PRIORITY_USER + 2),	// same as the MQTT transmit task
+			&user_packet_reader_task_handle);	// save the task handle
+
+	if (create_status != pdPASS)
+	{
+		user_packet_reader_task_handle = NULL;
+		ULOG_E("\n Neuralert: [%s] Unable to create packet reader task", __func__);
+		return pdFALSE;
+	}
+
+	return pdTRUE;
+}
+
+/**
+ *******************************************************************************
+ * @brief Ask the packet reader task to exit and wait until it has
+ *
+ * The reader finishes the packet it is reading (if any) first, so this
+ * waits at most one packet read plus its 100 msec poll.  If it still
+ * hasn't exited by then it is left to finish rather than deleted, since
+ * it may be holding Flash_semaphore.  It still sees packet_reader_stop,
+ * and packet_reader_start() won't start another reader until it is gone.
+ *******************************************************************************
+ */
+static void packet_reader_stop_wait(void)
+{
+	int timeout = PACKET_READER_TIMEOUT_MS / 10;
+
+	packet_reader_stop = pdTRUE;
+	while ((user_packet_reader_task_handle != NULL) && (timeout > 0))
+	{
+		vTaskDelay(pdMS_TO_TICKS(10));
+		timeout--;
+	}
+	if (user_packet_reader_task_handle != NULL)
+	{
+		ULOG_W("\n Neuralert: [%s] packet reader did not exit", __func__);
+	}
+}
+
+
 /**
  *******************************************************************************
  * @brief Task to transmit the next group of FIFO buffers that have been stored
@@ -3589,7 +3655,7 @@ static void user_process_send_MQTT_data(void* arg)
 	char reply[128] = {0, }; // JW: was 128 not 32
 	//int clear_to_transmit = FALSE; //JW: This is now dead thanks to callbacks
 	int samples_to_send;
-	int send_start_addr;
+	int packet_buffer;				// packet buffer being transmitted
 	int msg_sequence;
 	int whole_packets_to_send;
 	int last_packet_size;
@@ -3618,11 +3684,12 @@ static void user_process_send_MQTT_data(void* arg)
 	packetDataStruct packet_data;	// struct to capture packet meta data.
 
 	// stats
-	int packets_sent = 0;		// actually sent during this transmission interval
+	int packets_sent = 0;		// actually acknowledged during this transmission interval
 	//int blocks_sent = 0;
 	int samples_sent = 0;
 
 	int drop_data_skip_to_loc;		// start location of where we will transmit after dropping data
+	__time64_t connected_msec;		// when MQTT became usable
 
 	int sys_wdog_id = -1;			// watchdog
 
@@ -3655,6 +3722,12 @@ static void user_process_send_MQTT_data(void* arg)
 	// kill the transmission cycle.
 	int timeout = MQTT_SUB_TIMEOUT_SECONDS * 10;
 	da16x_sys_watchdog_notify(sys_wdog_id);
+
+	// Use the wait to erase flash ahead of the accelerometer task, so
+	// it doesn't have to erase on its own wake path
+	user_process_erase_ahead(AB_ERASE_AHEAD_MAX_OPS);
+	da16x_sys_watchdog_notify(sys_wdog_id);
+
 	while (!mqtt_client_check_conn() && timeout > 0){
 		vTaskDelay(pdMS_TO_TICKS(100));
 		timeout--;
@@ -3664,6 +3737,13 @@ static void user_process_send_MQTT_data(void* arg)
 		goto end_of_task;
 	}
 
+	// How long it took from deciding to upload until MQTT was usable.
+	// The upload scheduler batches more data per upload when this is long.
+	user_time64_msec_since_poweron(&connected_msec);
+	pUserData->MQTT_last_connect_msec = (int)(connected_msec - pUserData->MQTT_tx_start_msec);
+	TRACE_EVENT(TRACE_EV_MQTT_CONNECT, 0, pUserData->MQTT_last_connect_msec);
+	ULOG_I("\n Neuralert: [%s] connected in %d msec", __func__, pUserData->MQTT_last_connect_msec);
+
 
 
 	// JW: This is being deprecated now.  Wifi is now started in user_start_data_tx
@@ -3696,7 +3776,7 @@ static void user_process_send_MQTT_data(void* arg)
 	// Mark our start time
 	user_time64_msec_since_poweron(&user_MQTT_start_msec);
 	time64_string(elapsed_sec_string, &user_MQTT_start_msec);
-	PRINTF("\n ===== MQTT start milliseconds %s\n\n", elapsed_sec_string);
+	ULOG_I_NOW("\n ===== MQTT start milliseconds %s\n\n", elapsed_sec_string);
 
 	log_current_time("MQTT connection attempt. ");
 
@@ -3717,9 +3797,9 @@ static void user_process_send_MQTT_data(void* arg)
 	// or something else has gone wrong
 	if (	(transmit_start_loc == INVALID_AB_ADDRESS)
 			|| (transmit_start_loc < 0)
-			|| (transmit_start_loc >= AB_FLASH_MAX_PAGES))
+			|| (transmit_start_loc >= AB_FLASH_MAX_BLOCKS))
 	{
-		PRINTF("\n Neuralert: [%s] MQTT task found invalid transmit start location: %d", __func__, transmit_start_loc);
+		ULOG_E("\n Neuralert: [%s] MQTT task found invalid transmit start location: %d", __func__, transmit_start_loc);
 		//set_sole_system_state(USER_STATE_INTERNAL_ERROR); JW: deprecated 10.4 -- no reason to tell the patient
 		goto end_of_task;
 	}
@@ -3731,10 +3811,11 @@ static void user_process_send_MQTT_data(void* arg)
 	{
 		// AXL just wrapped around so our last position is the last
 		// place in memory.
-		transmit_start_loc += AB_FLASH_MAX_PAGES;
+		transmit_start_loc += AB_FLASH_MAX_BLOCKS;
 	}
 
-	PRINTF("\n\n******  MQTT transmit starting at %d ******\n", transmit_start_loc);
+	ULOG_I("\n\n******  MQTT transmit starting at %d, %d blocks pending ******\n",
+			transmit_start_loc, count_AB_transmit_locations());
 
 
 
@@ -3925,7 +4006,8 @@ static void user_process_send_MQTT_data(void* arg)
 	// Our transmit extent was calculated above
 	msg_sequence = 0;
 	++pUserData->MQTT_message_number;  // Increment transmission #
-	pUserData->MQTT_inflight = 0; // This is a new transmission, clear any lingering inflight issues
+	mqtt_publisher_reset(&MQTT_publisher); // This is a new transmission, clear any lingering inflight issues
+	pUserData->MQTT_inflight = 0;
 
 	//JW: the old FIFO way worked as if the flash was static during transmission,
 	// the new LIMO way doesn't make this assumption (and is more robust).  Thus,
@@ -3952,6 +4034,12 @@ static void user_process_send_MQTT_data(void* arg)
 	vTaskDelay(1);
 	request_stop_transmit = pdFALSE;
 	packet_count = 0;
+
+	// Packets are read out of flash by the packet reader task
+	if (!packet_reader_start(transmit_start_loc))
+	{
+		request_stop_transmit = pdTRUE;
+	}
 	//JW: the while statement below used the number of blocks to exit -- this is no longer the case
 	//while (	(num_blocks_left_to_send > 0)
 	//		&& (pdFALSE == request_stop_transmit) )
@@ -3996,10 +4084,21 @@ static void user_process_send_MQTT_data(void* arg)
 #endif //JW: deprecated 10.3
 
 
-		// assemble the packet into the user data
-		packet_data = assemble_packet_data(packet_data.next_start_block);
+		// take the next packet assembled by the packet reader task
+		da16x_sys_watchdog_notify(sys_wdog_id);
+		da16x_sys_watchdog_suspend(sys_wdog_id);
+		if (xQueueReceive(packet_ready_queue, &packet_buffer,
+				pdMS_TO_TICKS(PACKET_READER_TIMEOUT_MS)) != pdPASS)
+		{
+			da16x_sys_watchdog_notify_and_resume(sys_wdog_id);
+			ULOG_E("\n Neuralert: [%s] MQTT transmit: no packet from reader - aborting", __func__);
+			request_stop_transmit = pdTRUE;
+			break;
+		}
+		da16x_sys_watchdog_notify_and_resume(sys_wdog_id);
+		packet_data = packetBufferData[packet_buffer];
 
-		PRINTF("\n**MQTT packet %d:  Start: %d End: %d num blocks: %d\n",
+		ULOG_D("\n**MQTT packet %d:  Start: %d End: %d num blocks: %d\n",
 				packet_count, packet_data.start_block, packet_data.end_block,
 				packet_data.num_blocks);
 
@@ -4008,7 +4107,7 @@ static void user_process_send_MQTT_data(void* arg)
 
 		if (packet_data.num_samples < 0)
 		{
-			PRINTF("\n Neuralert: [%s] MQTT transmit: error returned from assemble_packet_data - aborting", __func__);
+			ULOG_E("\n Neuralert: [%s] MQTT transmit: error returned from assemble_packet_data - aborting", __func__);
 			request_stop_transmit = pdTRUE;
 		}
 		else if (packet_data.num_samples == 0)
@@ -4018,51 +4117,17 @@ static void user_process_send_MQTT_data(void* arg)
 		else
 		{
 			msg_sequence++;
-			send_start_addr = 0;
 			//JW: The following line user_set_mid_sent(...) is now deprecated -- to be removed
 			//user_set_mid_sent(pUserData->MQTT_last_message_id); // Probably could/should do this once when creating the MQTT client
 			da16x_sys_watchdog_notify(sys_wdog_id);
 			da16x_sys_watchdog_suspend(sys_wdog_id);
-			status = send_json_packet (send_start_addr, packet_data,
+			status = send_json_packet (packet_buffer, packet_data,
 					pUserData->MQTT_message_number, msg_sequence);
 			da16x_sys_watchdog_notify_and_resume(sys_wdog_id);
 			if(status == 0) //Tranmission successful!
 			{
-				clear_MQTT_stat(&(pUserData->MQTT_attempts_since_tx_success));
-				CLR_BIT(processLists, USER_PROCESS_BOOTUP); //JW: we have succeeded in a transmission (bootup complete), so clear the bootup state bit.
-				notify_user_LED(); // notify the led
-
-				// Clear the transmission map corresponding to blocks in the packet
-				if (packet_data.start_block > packet_data.end_block)
-				{
-					// clear from "end" to "start" (because LIMO works backwards through the map)
-					if (!clear_AB_transmit_location(packet_data.end_block, packet_data.start_block))
-					{
-						PRINTF("MQTT: transmit map failed to update\n");
-					}
-
-				}
-				else // there was a "wrap" in the buffer
-				{
-					// clear from "0" to "start" and from "end" to AB_MAX_FLASH_PAGES-1
-					if (!clear_AB_transmit_location(0, packet_data.start_block))
-					{
-						PRINTF("MQTT: transmit map failed to update\n");
-					}
-					if (!clear_AB_transmit_location(packet_data.end_block, AB_FLASH_MAX_PAGES-1))
-					{
-						PRINTF("MQTT: transmit map failed to update\n");
-					}
-				}
-
-				// Do stats
-
-				increment_MQTT_stat(&(pUserData->MQTT_stats_packets_sent));
-				packets_sent++;		// Total packets sent this interval
-				//blocks_sent += packet_data.num_blocks; //JW: deprecated 10.4
-				samples_sent += packet_data.num_samples;
-//						PRINTF("**Neuralert: send_data: transmit %d:%d successful\n",
-//								pUserData->MQTT_message_number, msg_sequence); // FRSDEBUG
+				// The packet is published.  Its blocks are released from
+				// the transmit map when the PUBACK arrives (mqtt_packet_delivered)
 #if defined(__RUNTIME_CALCULATION__) && defined(XIP_CACHE_BOOT)
 	printf_with_run_time("===JSON packet sent");
 #endif
@@ -4109,7 +4174,7 @@ static void user_process_send_MQTT_data(void* arg)
 
 			}
 			else if (pUserData->MQTT_tx_attempts_remaining > 0){
-				PRINTF("\n Neuralert: [%s] MQTT transmission %d:%d failed. Remaining attempts %d. Retry Transmission",
+				ULOG_W("\n Neuralert: [%s] MQTT transmission %d:%d failed. Remaining attempts %d. Retry Transmission",
 						__func__, pUserData->MQTT_message_number, msg_sequence, pUserData->MQTT_tx_attempts_remaining);
 				pUserData->MQTT_tx_attempts_remaining--;
 				request_stop_transmit = pdTRUE; // must set to true to exit loop
@@ -4118,7 +4183,7 @@ static void user_process_send_MQTT_data(void* arg)
 			}
 			else
 			{
-				PRINTF("\nNeuralert: [%s] MQTT transmission %d:%d failed. Remaining attempts %d. Ending Transmission",
+				ULOG_W("\nNeuralert: [%s] MQTT transmission %d:%d failed. Remaining attempts %d. Ending Transmission",
 						__func__, pUserData->MQTT_message_number, msg_sequence, pUserData->MQTT_tx_attempts_remaining);
 				request_stop_transmit = pdTRUE;
 			}
@@ -4126,6 +4191,10 @@ static void user_process_send_MQTT_data(void* arg)
 
 		} // num_samples > 0
 
+		// The payload has been handed to the MQTT client, so the
+		// reader can refill this buffer
+		xQueueSend(packet_free_queue, &packet_buffer, 0);
+
 
 		//PRINTF("\n Packet data flag = %d\n", packet_data.done_flag);
 
@@ -4148,6 +4217,46 @@ static void user_process_send_MQTT_data(void* arg)
 
 	} // while we have stuff to transmit
 
+	packet_reader_stop_wait();
+
+
+	// Collect the PUBACKs for the packets still inflight
+	if(!request_stop_transmit)
+	{
+		da16x_sys_watchdog_notify(sys_wdog_id);
+		da16x_sys_watchdog_suspend(sys_wdog_id);
+		status = mqtt_publisher_wait(&MQTT_publisher);
+		da16x_sys_watchdog_notify_and_resume(sys_wdog_id);
+		if (status != 0)
+		{
+			request_stop_transmit = pdTRUE;
+			if (pUserData->MQTT_tx_attempts_remaining > 0)
+			{
+				ULOG_W("\n Neuralert: [%s] MQTT transmission %d: last packet unacknowledged. Remaining attempts %d. Retry Transmission",
+						__func__, pUserData->MQTT_message_number, pUserData->MQTT_tx_attempts_remaining);
+				pUserData->MQTT_tx_attempts_remaining--;
+				request_retry_transmit = pdTRUE;
+				increment_MQTT_stat(&(pUserData->MQTT_stats_retry_attempts));
+			}
+			else
+			{
+				ULOG_W("\nNeuralert: [%s] MQTT transmission %d: last packet unacknowledged. Remaining attempts %d. Ending Transmission",
+						__func__, pUserData->MQTT_message_number, pUserData->MQTT_tx_attempts_remaining);
+			}
+		}
+	}
+	else
+	{
+		// Keep credit for a PUBACK that arrived before the failure
+		mqtt_publisher_collect(&MQTT_publisher);
+	}
+	pUserData->MQTT_inflight = MQTT_publisher.inflight;
+
+	packets_sent = MQTT_publisher.packets_delivered;
+	samples_sent = MQTT_publisher.samples_delivered;
+	ULOG_I("\n Neuralert: [%s] %d packets acknowledged, %d busy retries, avg PUBACK %lu msec",
+			__func__, packets_sent, MQTT_publisher.busy_retries,
+			(packets_sent > 0) ? (MQTT_publisher.puback_msec_total / (ULONG)packets_sent) : 0UL);
 
 	if(!request_stop_transmit)
 	{
@@ -4165,7 +4274,7 @@ static void user_process_send_MQTT_data(void* arg)
 #endif // TO BE REMOVED -- DEPRECATED
 
 		increment_MQTT_stat(&(pUserData->MQTT_stats_transmit_success));
-		PRINTF("\n Neuralert: [%s] MQTT transmission %d complete.  %d samples in %d JSON packets",
+		ULOG_I("\n Neuralert: [%s] MQTT transmission %d complete.  %d samples in %d JSON packets",
 				__func__, pUserData->MQTT_message_number, samples_sent, packets_sent);
 	}
 
@@ -4261,7 +4370,7 @@ end_of_task:
 void user_process_wifi_conn()
 {
 	if (!BIT_SET(processLists, USER_PROCESS_MQTT_TRANSMIT)){
-		PRINTF(">>>>>>> MQTT transmit task already in progress <<<<<<<<<\n");
+		ULOG_W(">>>>>>> MQTT transmit task already in progress <<<<<<<<<\n");
 		return;
 	}
 }
@@ -4269,65 +4378,169 @@ void user_process_wifi_conn()
 
 /**
  *******************************************************************************
- *  user_start_MQTT_client: start the MQTT client
+ * @brief Restrict network 0 to the access point and channel of the last
+ * connection, or remove the restriction so the supplicant scans every
+ * channel for any access point with the configured SSID.
  *******************************************************************************
  */
-void user_start_MQTT_client()
+static void user_wifi_restrict_to_cache(int use_cache)
 {
-	// TODO: add a check for wifi connection here.
-
-
-	// MQTT client is affected by the network state.  Since the network should be up at this point,
-	// we have two scenarios:
-	// 1) client is already running -- in which case we go straight to creating the transmit task
-	// 2) the client is not running -- in which case we start the client and process the request on a callback.
-	if (mqtt_client_check_conn()){
-		PRINTF("\n**Neuralert: MQTT client already started"); // FRSDEBUG
-		//user_mqtt_connection_complete_event(); // If client is started, start the transmisson
-		//user_create_MQTT_task(); // If client is started, start the transmit -- this is handled differently now.
-	} else {
-		int status = 0;
-		status = mqtt_client_start(); // starts the MQTT client
+	char bssid_cmd[WIFI_CACHE_COMMAND_MAX_LEN];
+	char freq_cmd[WIFI_CACHE_COMMAND_MAX_LEN];
+	char value_str[128] = {0, };
 
-		if(status == 0)
-		{
-			PRINTF("\n**Neuralert: MQTT client start success -- waiting for connection"); // FRSDEBUG
-		}
-		else
-		{
-			PRINTF("\n**Neuralert: MQTT client start failed\n"); // FRSDEBUG
-		}
+	if (use_cache)
+	{
+		wifi_cache_commands(&pUserData->wifi_cache, bssid_cmd, freq_cmd);
+	}
+	else
+	{
+		wifi_cache_commands(NULL, bssid_cmd, freq_cmd);
 	}
 
-	return;
+	da16x_cli_reply(bssid_cmd, NULL, value_str);
+	da16x_cli_reply(freq_cmd, NULL, value_str);
+	pUserData->wifi_fast_connect_active = (int16_t)use_cache;
 }
 
 
 /**
  *******************************************************************************
- *@brief  user_start_data_tx: start up the wifi and create a software watchdog
- *This function is intended to be the entry point for our transmission task
- *The first thing that will happen is it turns on the radio and network connection
- *The sequence of events will be:
- *		start radio and wifi
- *		on wifi connection callback -> start MQTT client (in user_apps.c)
- *		on MQTT connection callback -> start the transmission task
- *		once transmission is completed-> start the terminate transmission task
- *
- *Since there are many ways that bringing the wifi up can hang, we start a
- *separate task that monitors for a process bit.  This process bit will be set
- *in the start transmission task.
+ * @brief Called if a fast connect fails or takes too long: remove the
+ * restriction to the cached access point and connect again with a full
+ * scan.  Does nothing if the connection in progress isn't a fast one.
  *******************************************************************************
  */
-static void user_start_data_tx(){
-
-	// Specifically, let the other tasks know that the watchdog is turning on,
-	// so we don't sleep
-	SET_BIT(processLists, USER_PROCESS_WATCHDOG);
+void user_wifi_fast_connect_fallback(void)
+{
+	char value_str[128] = {0, };
 
-	int ret = 0;
-	ret = user_process_start_watchdog();
-	if (ret != 0)
+	if (!pUserData->wifi_fast_connect_active)
+	{
+		return;
+	}
+
+	ULOG_W("\n Neuralert: [%s] fast connect to cached AP failed -- scanning\n", __func__);
+	if (pUserData->wifi_cache.fast_failures < WIFI_FAST_CONNECT_MAX_FAILURES)
+	{
+		pUserData->wifi_cache.fast_failures++;
+	}
+	increment_MQTT_stat(&(pUserData->wifi_fast_fallbacks));
+
+	user_wifi_restrict_to_cache(pdFALSE);
+	da16x_cli_reply("select_network 0", NULL, value_str);
+}
+
+
+/**
+ *******************************************************************************
+ * @brief Wi-Fi is up: note how long it took and remember the access point
+ * and channel for the next upload.
+ *******************************************************************************
+ */
+static void user_wifi_record_connection(void)
+{
+	__time64_t now_msec;
+	char *status;
+
+	user_time64_msec_since_poweron(&now_msec);
+	pUserData->wifi_last_connect_msec = (int)(now_msec - pUserData->MQTT_tx_start_msec);
+	TRACE_EVENT(TRACE_EV_WIFI_UP, 0, pUserData->wifi_last_connect_msec);
+
+	if (pUserData->wifi_fast_connect_active)
+	{
+		increment_MQTT_stat(&(pUserData->wifi_fast_connects));
+		pUserData->wifi_fast_connect_active = pdFALSE;
+	}
+	pUserData->wifi_cache.fast_failures = 0;
+
+	ULOG_I_NOW("\n Neuralert: [%s] Wi-Fi up in %d msec", __func__, pUserData->wifi_last_connect_msec);
+
+	status = (char *)pvPortMalloc(USER_CONNECT_STATUS_REPLY_SIZE);
+	if (status == NULL) {
+		ULOG_E("%s(%d): failed to allocate memory\n", __func__, __LINE__);
+		return;
+	}
+
+	memset(status, 0, USER_CONNECT_STATUS_REPLY_SIZE);
+	da16x_cli_reply("status", NULL, status);
+	if (wifi_cache_parse_status(status, &pUserData->wifi_cache) == pdTRUE)
+	{
+		ULOG_I_NOW(" (AP on %d MHz, %s)", pUserData->wifi_cache.freq_mhz,
+				pUserData->wifi_cache.ip_address);
+	}
+
+	vPortFree(status);
+}
+
+
+/**
+ *******************************************************************************
+ *  user_start_MQTT_client: start the MQTT client
+ *******************************************************************************
+ */
+void user_start_MQTT_client()
+{
+	// TODO: add a check for wifi connection here.
+
+	user_wifi_record_connection();
+
+
+	// MQTT client is affected by the network state.  Since the network should be up at this point,
+	// we have two scenarios:
+	// 1) client is already running -- in which case we go straight to creating the transmit task
+	// 2) the client is not running -- in which case we start the client and process the request on a callback.
+	if (mqtt_client_check_conn()){
+		ULOG_D("\n**Neuralert: MQTT client already started"); // FRSDEBUG
+		//user_mqtt_connection_complete_event(); // If client is started, start the transmisson
+		//user_create_MQTT_task(); // If client is started, start the transmit -- this is handled differently now.
+	} else {
+		int status = 0;
+		status = mqtt_client_start(); // starts the MQTT client
+
+		if(status == 0)
+		{
+			ULOG_D("\n**Neuralert: MQTT client start success -- waiting for connection"); // FRSDEBUG
+		}
+		else
+		{
+			ULOG_E("\n**Neuralert: MQTT client start failed\n"); // FRSDEBUG
+		}
+	}
+
+	return;
+}
+
+
+/**
+ *******************************************************************************
+ *@brief  user_start_data_tx: start up the wifi and create a software watchdog
+ *This function is intended to be the entry point for our transmission task
+ *The first thing that will happen is it turns on the radio and network connection
+ *The sequence of events will be:
+ *		start radio and wifi
+ *		on wifi connection callback -> start MQTT client (in user_apps.c)
+ *		on MQTT connection callback -> start the transmission task
+ *		once transmission is completed-> start the terminate transmission task
+ *
+ *Since there are many ways that bringing the wifi up can hang, we start a
+ *separate task that monitors for a process bit.  This process bit will be set
+ *in the start transmission task.
+ *******************************************************************************
+ */
+static void user_start_data_tx(){
+
+	// Specifically, let the other tasks know that the watchdog is turning on,
+	// so we don't sleep
+	SET_BIT(processLists, USER_PROCESS_WATCHDOG);
+
+	// Start of the connect time measured for the upload scheduler
+	user_time64_msec_since_poweron(&pUserData->MQTT_tx_start_msec);
+	TRACE_EVENT(TRACE_EV_UPLOAD_START, 0, 0);
+
+	int ret = 0;
+	ret = user_process_start_watchdog();
+	if (ret != 0)
 	{
 		user_terminate_transmit(); // Something bad happened with the watchdog setup -- stop transmission
 		return;
@@ -4348,10 +4561,15 @@ static void user_start_data_tx(){
 	pUserData->MQTT_tx_attempts_remaining = MQTT_MAX_ATTEMPTS_PER_TX;
 
 
-	PRINTF("\n ===== Starting WIFI =====\n\n");
+	ULOG_I("\n ===== Starting WIFI =====\n\n");
 	// Start the RF section power up
 	wifi_cs_rf_cntrl(FALSE);
 
+	// Go straight to the access point of the last connection if we have
+	// one and it hasn't been letting us down.  Otherwise scan as usual.
+	user_wifi_restrict_to_cache(pUserData->wifi_cache.valid
+			&& (pUserData->wifi_cache.fast_failures < WIFI_FAST_CONNECT_MAX_FAILURES));
+
 	// JW: switched this to system_control_wlan_enable in 1.10.16
 	char value_str[128] = {0, };
 	ret = da16x_cli_reply("select_network 0", NULL, value_str);
@@ -4374,7 +4592,7 @@ static void user_create_MQTT_stop_task()
 {
 
 	if (!BIT_SET(processLists, USER_PROCESS_MQTT_STOP)){
-		PRINTF(">>>>>>> MQTT stop not requested <<<<<<<<<\n");
+		ULOG_D(">>>>>>> MQTT stop not requested <<<<<<<<<\n");
 		return;
 	}
 
@@ -4394,11 +4612,11 @@ static void user_create_MQTT_stop_task()
 
 	if (create_status == pdPASS)
 	{
-		PRINTF("\n Neuralert: [%s] MQTT stop task created", __func__);
+		ULOG_D("\n Neuralert: [%s] MQTT stop task created", __func__);
 	}
 	else
 	{
-		PRINTF("\n Neuralert: [%s] MQTT stop task failed to created", __func__);
+		ULOG_E("\n Neuralert: [%s] MQTT stop task failed to created", __func__);
 	}
 
 	return;
@@ -4417,7 +4635,7 @@ static void user_create_MQTT_task()
 {
 
 	if (!BIT_SET(processLists, USER_PROCESS_MQTT_TRANSMIT)){
-		PRINTF(">>>>>>> MQTT transmit task already in progress <<<<<<<<<\n");
+		ULOG_W(">>>>>>> MQTT transmit task already in progress <<<<<<<<<\n");
 		return;
 	}
 
@@ -4451,11 +4669,11 @@ static void user_create_MQTT_task()
 
 	if (create_status == pdPASS)
 	{
-		PRINTF("\n Neuralert: [%s] MQTT transmit task created", __func__);
+		ULOG_D("\n Neuralert: [%s] MQTT transmit task created", __func__);
 	}
 	else
 	{
-		PRINTF("\n Neuralert: [%s] MQTT transmit task failed to create", __func__);
+		ULOG_E("\n Neuralert: [%s] MQTT transmit task failed to create", __func__);
 	}
 
 	return;
@@ -4495,10 +4713,10 @@ static int user_process_connect_ap(void)
 
 	
 
-	PRINTF("\n**Neuralert: %s\n", __func__); // FRSDEBUG
+	ULOG_D("\n**Neuralert: %s\n", __func__); // FRSDEBUG
 
 	if (user_process_check_wifi_conn() == pdTRUE) {
-		PRINTF("\n**Neuralert: user_process_connect_ap() already connected\n"); // FRSDEBUG
+		ULOG_D("\n**Neuralert: user_process_connect_ap() already connected\n"); // FRSDEBUG
 
 		/* Connection is already established */
 //		user_wifi_connection_complete_event();
@@ -4506,13 +4724,13 @@ static int user_process_connect_ap(void)
 	}
 
 	// use the internal command line interface to connect
-	PRINTF("\n**Neuralert: user_process_connect_ap() attempting connection\n"); // FRSDEBUG
+	ULOG_D("\n**Neuralert: user_process_connect_ap() attempting connection\n"); // FRSDEBUG
 
 	//JW: changed this to system_control_wlan_enable(TRUE) in 1.10.16
 	char value_str[128] = {0, };
 	ret = da16x_cli_reply("select_network 0", NULL, value_str);
 	if (ret < 0 || strcmp(value_str, "FAIL") == 0) {
-		PRINTF(" [%s] Failed connect to AP 0x%x\n", __func__, ret, value_str);
+		ULOG_E(" [%s] Failed connect to AP 0x%x\n", __func__, ret, value_str);
 	}
 
 	//system_control_wlan_enable(TRUE);
@@ -4556,13 +4774,13 @@ static void user_process_timer_event(void)
 static int user_process_disable_auto_connection(void)
 {
 	int ret, netProfileUse;
-	PRINTF("\n**Neuralert: %s\n", __func__); // FRSDEBUG
+	ULOG_D("\n**Neuralert: %s\n", __func__); // FRSDEBUG
 
 	/* To skip automatic network connection. It will be effected when boot-up. */
 	ret = da16x_get_config_int(DA16X_CONF_INT_STA_PROF_DISABLED, &netProfileUse);
 	if (ret != CC_SUCCESS || netProfileUse == pdFALSE) {
 		ret = da16x_set_config_int(DA16X_CONF_INT_STA_PROF_DISABLED, pdTRUE);
-		PRINTF("\n****** Disabling automatic network connection\n\n");
+		ULOG_I("\n****** Disabling automatic network connection\n\n");
 		/* It's just to give some delay before going to sleep mode.
 		 *  it will be called only once.
 		 */
@@ -4645,7 +4863,7 @@ static int user_process_initialize_user_log(void)
 	ULONG SectorEraseAddr;
 	HANDLE SPI = NULL;		// Local SPI bus handle for this activity
 
-	PRINTF(">>>Initializing user log in flash\n");
+	ULOG_I(">>>Initializing user log in flash\n");
 	vTaskDelay(pdMS_TO_TICKS(100));
 
 #if 0 //JW: logging deprecated 1.10.16
@@ -4670,7 +4888,7 @@ static int user_process_initialize_user_log(void)
 	SPI = flash_open(SPI_MASTER_CLK, SPI_MASTER_CS);
 	if (SPI == NULL)
 	{
-		PRINTF("\n\n********* Initialize user log SPI flash open error *********\n");
+		ULOG_E("\n\n********* Initialize user log SPI flash open error *********\n");
 		init_status = FALSE;
 	}
 
@@ -4721,7 +4939,7 @@ static int user_process_initialize_user_log(void)
 
 	if(!erase_status)
 	{
-		PRINTF("\n\n********* User log SPI erase error *********\n");
+		ULOG_E("\n\n********* User log SPI erase error *********\n");
 		init_status = FALSE;
 	}
 
@@ -4825,13 +5043,12 @@ static void W25Q64_display_status_registers(HANDLE handler, char *text)
  *
  * Data is stored in a structure that holds the data read during
  * one FIFO read event.
- * Because the external flash memory is written with a "Page write"
- * command, each FIFO storage structure starts on a 256-byte page
- * boundary.
- * As of this writing, the FIFO storage structure is less than 256 bytes
- * so each write is to the next page boundary.
+ * The external flash memory is written with a "Page write" command.
+ * The FIFO storage structure fits in 128 bytes, so each 256-byte page
+ * holds two of them in fixed slots (see AB_BLOCK_SIZE) and each write
+ * is to the next slot.
  * Additionally, the flash must be erased before it can be written.
- * The smallest erase function is a 4096 byte sector (16 pages)
+ * The smallest erase function is a 4096 byte sector (16 pages, 32 slots)
  *
  * See document "Neuralert accelerometer data buffer design" for
  * details of this design
@@ -4873,7 +5090,7 @@ static int user_process_initialize_AB(void)
 	SPI = flash_open(SPI_MASTER_CLK, SPI_MASTER_CS);
 	if (SPI == NULL)
 	{
-		PRINTF("\n\n********* SPI initalization error *********\n");
+		ULOG_E("\n\n********* SPI initalization error *********\n");
 		init_status = FALSE;
 	}
 //	vTaskDelay(1);
@@ -4883,7 +5100,7 @@ static int user_process_initialize_AB(void)
 
 	if (!spi_status)
 	{
-		PRINTF("\n\n********* SPI initalization error *********\n");
+		ULOG_E("\n\n********* SPI initalization error *********\n");
 		init_status = FALSE;
 	}
 
@@ -4903,11 +5120,11 @@ static int user_process_initialize_AB(void)
 	{
 		pUserData->AB_transmit_map[i] = 0;
 	}
+	ab_map_rebuild(pUserData->AB_transmit_map);
 
 	// Erase the first sector where the first data will be written
-	SectorEraseAddr = (ULONG)AB_FLASH_BEGIN_ADDRESS +
-				((ULONG)AB_FLASH_PAGE_SIZE * (ULONG)pUserData->next_AB_write_position);
-	PRINTF("  Erasing first Sector Location: %x \n",SectorEraseAddr);
+	SectorEraseAddr = AB_BLOCK_ADDRESS(pUserData->next_AB_write_position);
+	ULOG_D("  Erasing first Sector Location: %x \n",SectorEraseAddr);
 //	Printf("  Erasing Chip  \n");
 
 #if defined(__RUNTIME_CALCULATION__) && defined(XIP_CACHE_BOOT)
@@ -4926,9 +5143,19 @@ static int user_process_initialize_AB(void)
 
 	if(!erase_status)
 	{
-		PRINTF("\n\n********* SPI erase error *********\n");
+		ULOG_E("\n\n********* SPI erase error *********\n");
 		init_status = FALSE;
 	}
+	pUserData->next_AB_erase_position = AB_BLOCKS_PER_SECTOR;
+	pUserData->erase_ahead_count = 0;
+	pUserData->erase_inline_count = 0;
+	pUserData->erase_ahead_dropped = 0;
+
+	// We're awake for the bootup anyway, so fill the erase-ahead now
+	if (init_status == TRUE)
+	{
+		AB_erase_ahead(SPI, AB_ERASE_AHEAD_SECTORS);
+	}
 
 	if (init_status == TRUE)
 	{
@@ -4969,13 +5196,12 @@ static int user_process_initialize_AB(void)
  *
  * Data is stored in a structure that holds the data read during
  * one FIFO read event.
- * Because the external flash memory is written with a "Page write"
- * command, each FIFO storage structure starts on a 256-byte page
- * boundary.
- * As of this writing, the FIFO storage structure is less than 256 bytes
- * so each write is to the next page boundary.
+ * The external flash memory is written with a "Page write" command.
+ * The FIFO storage structure fits in 128 bytes, so each 256-byte page
+ * holds two of them in fixed slots (see AB_BLOCK_SIZE) and each write
+ * is to the next slot.
  * Additionally, the flash must be erased before it can be written.
- * The smallest erase function is a 4096 byte sector (16 pages)
+ * The smallest erase function is a 4096 byte sector (16 pages, 32 slots)
  *
  * See document "Neuralert accelerometer data buffer design" for
  * details of this design
@@ -5005,7 +5231,7 @@ static int user_process_clear_AB(void)
 	SPIhandle = flash_open(SPI_MASTER_CLK, SPI_MASTER_CS);
 	if (SPIhandle == NULL)
 	{
-		PRINTF("\n\n********* user_process_clear_AB: unable to obtain SPI handle *********\n");
+		ULOG_E("\n\n********* user_process_clear_AB: unable to obtain SPI handle *********\n");
 		clear_status = FALSE;
 	}
 //	vTaskDelay(1);
@@ -5015,7 +5241,7 @@ static int user_process_clear_AB(void)
 
 	if (!spi_status)
 	{
-		PRINTF("\n\n********* user_process_clear_AB: SPI initalization error *********\n");
+		ULOG_E("\n\n********* user_process_clear_AB: SPI initalization error *********\n");
 		clear_status = FALSE;
 	}
 
@@ -5035,9 +5261,9 @@ static int user_process_clear_AB(void)
 #endif
 
 	// As of 9/29/22, there are 3888 pages
-	// 3888 pages / 16 sectors per page = 243 4k sectors
-	max_sectors = AB_FLASH_MAX_PAGES / 16;
-	PRINTF("\n Neuralert: [%s] Shutting down - erasing %d sectors", __func__, max_sectors);
+	// 3888 pages / 16 pages per sector = 243 4k sectors
+	max_sectors = AB_FLASH_MAX_PAGES / AB_PAGES_PER_SECTOR;
+	ULOG_I("\n Neuralert: [%s] Shutting down - erasing %d sectors", __func__, max_sectors);
 	for(	next_AB_clear_position = 0;
 			next_AB_clear_position < max_sectors;
 			next_AB_clear_position++)
@@ -5046,21 +5272,21 @@ static int user_process_clear_AB(void)
 		// Calculate sector address
 		SectorEraseAddr = (ULONG)AB_FLASH_BEGIN_ADDRESS +
 				((ULONG)AB_FLASH_SECTOR_SIZE * (ULONG)next_AB_clear_position);
-		PRINTF("  Erasing sector %d: %x \n",sectors_erased, SectorEraseAddr);
+		ULOG_D("  Erasing sector %d: %x \n",sectors_erased, SectorEraseAddr);
 
 		// observed times for erasing are about 40-50 msec
 		erase_status = eraseSector_4K(SPIhandle, SectorEraseAddr);
 //		vTaskDelay(pdMS_TO_TICKS(50));
 		if(!erase_status)
 		{
-			PRINTF("\n********* user_process_clear_AB: SPI erase error *********\n");
+			ULOG_E("\n********* user_process_clear_AB: SPI erase error *********\n");
 			clear_status = FALSE;
 		}
 	} // FOR LOOP
 #if defined(__RUNTIME_CALCULATION__) && defined(XIP_CACHE_BOOT)
 	printf_with_run_time("== Finished clearing data buffering area");
 #endif
-	PRINTF("Neuralert: [%s] Finished clearing data buffering area", __func__);
+	ULOG_I("Neuralert: [%s] Finished clearing data buffering area", __func__);
 	spi_status = flash_close(SPIhandle);
 	return clear_status;
 
@@ -5098,12 +5324,12 @@ static int get_log_store_location(void)
 		}
 		else
 		{
-			PRINTF("\n ***archive_one_log_entry: Unable to obtain log semaphore\n");
+			ULOG_E("\n ***archive_one_log_entry: Unable to obtain log semaphore\n");
 		}
 	}
 	else
 	{
-		PRINTF("\n ***archive_one_log_entry: semaphore not initialized!\n");
+		ULOG_E("\n ***archive_one_log_entry: semaphore not initialized!\n");
 	}
 
 	return return_value;
@@ -5138,12 +5364,12 @@ static int get_log_oldest_location(void)
 		}
 		else
 		{
-			PRINTF("\n ***Unable to obtain user log semaphore\n");
+			ULOG_E("\n ***Unable to obtain user log semaphore\n");
 		}
 	}
 	else
 	{
-		PRINTF("\n ***user log semaphore not initialized!\n");
+		ULOG_E("\n ***user log semaphore not initialized!\n");
 	}
 
 	return return_value;
@@ -5179,12 +5405,12 @@ static int get_holding_log_next_write_location(void)
 		}
 		else
 		{
-			PRINTF("\n ***Unable to obtain user log semaphore\n");
+			ULOG_E("\n ***Unable to obtain user log semaphore\n");
 		}
 	}
 	else
 	{
-		PRINTF("\n ***user log semaphore not initialized!\n");
+		ULOG_E("\n ***user log semaphore not initialized!\n");
 	}
 
 	return return_value;
@@ -5220,12 +5446,12 @@ static int get_holding_log_oldest_location(void)
 		}
 		else
 		{
-			PRINTF("\n ***Unable to obtain user log semaphore\n");
+			ULOG_E("\n ***Unable to obtain user log semaphore\n");
 		}
 	}
 	else
 	{
-		PRINTF("\n ***user log semaphore not initialized!\n");
+		ULOG_E("\n ***user log semaphore not initialized!\n");
 	}
 
 	return return_value;
@@ -5263,12 +5489,12 @@ static int update_holding_log_oldest_location(int new_location)
 		}
 		else
 		{
-			PRINTF("\n ***Unable to obtain user log semaphore\n");
+			ULOG_E("\n ***Unable to obtain user log semaphore\n");
 		}
 	}
 	else
 	{
-		PRINTF("\n ***user log semaphore not initialized!\n");
+		ULOG_E("\n ***user log semaphore not initialized!\n");
 	}
 
 	return return_value;
@@ -5294,7 +5520,7 @@ static int update_log_oldest_location(int new_location)
 			available wait 10 ticks to see if it becomes free. */
 		if( xSemaphoreTake( user_log_semaphore, ( TickType_t ) 10 ) == pdTRUE )
 		{
-			PRINTF("****** update_log_oldest_location: new value %d ******\n", new_location);
+			ULOG_D("****** update_log_oldest_location: new value %d ******\n", new_location);
 			/* We were able to obtain the semaphore and can now access the
 				shared resource. */
 			pUserData->oldest_log_entry_position = new_location;;
@@ -5306,12 +5532,12 @@ static int update_log_oldest_location(int new_location)
 		}
 		else
 		{
-			PRINTF("\n ***Unable to obtain user log semaphore\n");
+			ULOG_E("\n ***Unable to obtain user log semaphore\n");
 		}
 	}
 	else
 	{
-		PRINTF("\n ***user log semaphore not initialized!\n");
+		ULOG_E("\n ***user log semaphore not initialized!\n");
 	}
 
 	return return_value;
@@ -5348,12 +5574,12 @@ static int update_log_store_location(int new_location)
 		}
 		else
 		{
-			PRINTF("\n ***Unable to obtain user log semaphore\n");
+			ULOG_E("\n ***Unable to obtain user log semaphore\n");
 		}
 	}
 	else
 	{
-		PRINTF("\n ***user log semaphore not initialized!\n");
+		ULOG_E("\n ***user log semaphore not initialized!\n");
 	}
 
 	return return_value;
@@ -5362,210 +5588,130 @@ static int update_log_store_location(int new_location)
 
 /**
  *******************************************************************************
- * @brief Process to retrieve the accelerometer buffer management
- * next-write location, making sure it's done with exclusive access
- *  Returns -1 if unable to gain exclusive access
- *  returns the AB next write position otherwise
+ * @brief Retrieve the accelerometer buffer management next-write location
+ *
+ * Only the accelerometer task moves the write position, and every block
+ * before it has its transmit map bit set by the time it moves, so this
+ * needs no lock and can't fail.
+ *  returns the AB next write position
  *
  *******************************************************************************
  */
 static int get_AB_write_location(void)
 {
-	int return_value = -1;
-
-	if(AB_semaphore != NULL )
-	{
-		/* See if we can obtain the semaphore.  If the semaphore is not
-	        available wait 10 ticks to see if it becomes free. */
-		if( xSemaphoreTake( AB_semaphore, ( TickType_t ) 10 ) == pdTRUE )
-		{
-			/* We were able to obtain the semaphore and can now access the
-	            shared resource. */
-			return_value = pUserData->next_AB_write_position;
-
-			/* We have finished accessing the shared resource.  Release the
-	            semaphore. */
-			xSemaphoreGive( AB_semaphore );
-		}
-		else
-		{
-			PRINTF("\n ***Unable to obtain AB semaphore\n");
-		}
-	}
-	else
-	{
-		PRINTF("\n ***AB semaphore not initialized!\n");
-
-	}
-
-	return return_value;
-
+	return AB_POSITION_LOAD(&pUserData->next_AB_write_position);
 }
 
 /**
  *******************************************************************************
- * @brief Process to check the accelerometer buffer management
- * transmit map location, making sure it's done with exclusive access
- *  bit_flag identifies whether to check by bit, or the AB_transmit_map type (uint32_t)
- *  Returns -1 if unable to gain exclusive access
- *  returns whether any bit in the range otherwise (0 or 1)
+ * @brief Find the next accelerometer buffer block waiting for transmission
+ *
+ * Only the MQTT task searches and clears the map, and the accelerometer
+ * task only sets bits behind the write position, so this needs no lock
+ * and can't fail for lack of one.  Searches backwards (the direction of transmission) from location,
+ * stopping AB_TRANSMIT_SAFETY_GAP blocks short of the next write position.
+ * The write position is read once; blocks the accelerometer task writes
+ * during the search are ahead of it and are found by the next search.
+ *
+ *  Returns -1 if no block is waiting; *stop_location is then where the
+ *     search ended (the place to resume from later)
+ *  returns the block number otherwise, and in *run_length how many
+ *     blocks from there down (at most max_run) are all waiting, so
+ *     they can be read from flash in one go
  *******************************************************************************
  */
-static int check_AB_transmit_location(int location, int bit_flag)
+static int find_AB_transmit_location(int location, int max_run, int *run_length, int *stop_location)
 {
 	int return_value = -1;
+	int write_loc;
+	int search_count;
+	int skipped;
 
-	if(AB_semaphore != NULL )
+	*stop_location = location;
+	*run_length = 0;
+
+	write_loc = get_AB_write_location();
+
+	// Number of blocks we're allowed to look at
+	search_count = AB_buffer_gap(location, write_loc) - AB_TRANSMIT_SAFETY_GAP;
+	if (search_count > 0)
 	{
-		/* See if we can obtain the semaphore.  If the semaphore is not
-			available wait 10 ticks to see if it becomes free. */
-		if( xSemaphoreTake( AB_semaphore, ( TickType_t ) 10 ) == pdTRUE )
+		return_value = ab_map_find_prev(pUserData->AB_transmit_map, location, search_count);
+		*stop_location = (write_loc + AB_TRANSMIT_SAFETY_GAP) % AB_FLASH_MAX_BLOCKS;
+		if (return_value >= 0)
 		{
-
-			if (bit_flag == pdTRUE){
-				// query whether the current location is set for transmission
-				if (POS_AB_SET(pUserData->AB_transmit_map, location))
-				{
-					return_value = 1;
-				}
-				else
-				{
-					return_value = 0;
-				}
+			// The run can't go past the end of the search either
+			skipped = location - return_value;
+			if (skipped < 0)
+			{
+				skipped += AB_FLASH_MAX_BLOCKS;
 			}
-			else if (bit_flag == pdFALSE)
+			if (max_run > (search_count - skipped))
 			{
-				if (pUserData->AB_transmit_map[location] == 0)
-				{
-					return_value = 0;
-				}
-				else
-				{
-					return_value = 1;
-				}
-
+				max_run = search_count - skipped;
 			}
-
-
-			/* We have finished accessing the shared resource.  Release the
-				semaphore. */
-			xSemaphoreGive( AB_semaphore );
-		}
-		else
-		{
-			PRINTF("\n ***Unable to obtain AB semaphore\n");
+			*run_length = ab_map_run_prev(pUserData->AB_transmit_map, return_value, max_run);
 		}
 	}
-	else
-	{
-		PRINTF("\n ***AB semaphore not initialized!\n");
-	}
 
 	return return_value;
 }
 
 
-
-
 /**
  *******************************************************************************
- * @brief Process to retrieve the accelerometer buffer management
- * next-transmit location, making sure it's done with exclusive access
- *  Returns -1 if unable to gain exclusie access
- *  returns the AB next write position otherwise
- *
+ * @brief Count the accelerometer buffer blocks waiting for transmission
+ *  returns the number of blocks (as of some moment during the count)
  *******************************************************************************
  */
-static int get_AB_transmit_location(void)
+static int count_AB_transmit_locations(void)
 {
-	int return_value = -1;
+	return ab_map_count(pUserData->AB_transmit_map);
+}
 
-	if(AB_semaphore != NULL )
-	{
-		/* See if we can obtain the semaphore.  If the semaphore is not
-	        available wait 10 ticks to see if it becomes free. */
-		if( xSemaphoreTake( AB_semaphore, ( TickType_t ) 10 ) == pdTRUE )
-		{
-			/* We were able to obtain the semaphore and can now access the
-	            shared resource. */
-			return_value = pUserData->next_AB_transmit_position;
 
-			/* We have finished accessing the shared resource.  Release the
-	            semaphore. */
-			xSemaphoreGive( AB_semaphore );
-		}
-		else
-		{
-			PRINTF("\n ***Unable to obtain AB semaphore\n");
-		}
-	}
-	else
-	{
-		PRINTF("\n ***AB semaphore not initialized!\n");
-	}
 
-	return return_value;
 
+/**
+ *******************************************************************************
+ * @brief Retrieve the accelerometer buffer management next-transmit location
+ *  returns the AB next transmit position
+ *
+ *******************************************************************************
+ */
+static int get_AB_transmit_location(void)
+{
+	return AB_POSITION_LOAD(&pUserData->next_AB_transmit_position);
 }
 
 
 /**
  *******************************************************************************
- * @brief Process to check the accelerometer buffer management
- * transmit map location, making sure it's done with exclusive access
- *  Returns -1 if unable to gain exclusive access
- *  returns value of transmit bit otherwise (0 or 1)
+ * @brief Clear the transmit map from start_location to end_location
+ *
+ * Only the MQTT task clears bits, and ab_map_clear_range() doesn't lock,
+ * so this always succeeds.
+ *  returns TRUE
  *******************************************************************************
  */
 static int clear_AB_transmit_location(int start_location, int end_location)
 {
-	int return_value = pdFALSE;
-
-	if(AB_semaphore != NULL )
-	{
-		/* See if we can obtain the semaphore.  If the semaphore is not
-			available wait 10 ticks to see if it becomes free. */
-		if( xSemaphoreTake( AB_semaphore, ( TickType_t ) 10 ) == pdTRUE )
-		{
-
-			// clear transmit map from start to end
-			for (int i=start_location; i<=end_location; i++)
-			{
-				CLR_AB_POS(pUserData->AB_transmit_map, i);
-			}
-
-			/* We have finished accessing the shared resource.  Release the
-				semaphore. */
-			xSemaphoreGive( AB_semaphore );
-			return_value = pdTRUE;
-		}
-		else
-		{
-			PRINTF("\n ***Unable to obtain AB semaphore\n");
-		}
-	}
-	else
-	{
-		PRINTF("\n ***AB semaphore not initialized!\n");
-	}
+	// clear transmit map from start to end
+	ab_map_clear_range(pUserData->AB_transmit_map, start_location, end_location);
 
-	return return_value;
+	return pdTRUE;
 }
 
 
 
 /**
  *******************************************************************************
- * @brief Process to update the accelerometer buffer management
- * next-transmit location, making sure it's done with exclusive access
- *  Returns FALSE if unable to gain exclusive access
- *  returns TRUE otherwise
+ * @brief Update the accelerometer buffer management next-transmit location
+ *  returns TRUE
  *******************************************************************************
  */
 static int update_AB_transmit_location(int new_location)
 {
-	int return_value = pdFALSE;
-
 	// NOTE! this doesn't check to see if the MQTT task is running or
 	// not.  It is expected that this function will be called under
 	// the following circumstances:
@@ -5576,50 +5722,28 @@ static int update_AB_transmit_location(int new_location)
 	//      be updating at that  point.
 	//   3. (TBD) If the AXL task catches up to the MQTT task because
 	//      the MQTT task has been unable to transmit
-	if(AB_semaphore != NULL )
-	{
-		/* See if we can obtain the semaphore.  If the semaphore is not
-			available wait 10 ticks to see if it becomes free. */
-		if( xSemaphoreTake( AB_semaphore, ( TickType_t ) 10 ) == pdTRUE )
-		{
-	//		PRINTF("****** update_AB_transmit_location: new value %d ******\n", new_location);
-			/* We were able to obtain the semaphore and can now access the
-				shared resource. */
-			pUserData->next_AB_transmit_position = new_location;
-
-			/* We have finished accessing the shared resource.  Release the
-				semaphore. */
-			xSemaphoreGive( AB_semaphore );
-			return_value = pdTRUE;
-		}
-		else
-		{
-			PRINTF("\n ***Unable to obtain AB semaphore\n");
-		}
-	}
-	else
-	{
-		PRINTF("\n ***AB semaphore not initialized!\n");
-	}
-
-	return return_value;
+	AB_POSITION_STORE(&pUserData->next_AB_transmit_position, new_location);
 
+	return pdTRUE;
 }
 
 
 
 /**
  *******************************************************************************
- * @brief Process to update the accelerometer buffer management
- * next-write location, making sure it's done with exclusive access
- *  Returns FALSE if unable to gain exclusive access
- *  returns TRUE otherwise
+ * @brief Mark the block at the write position as waiting for transmission
+ * and move the write position on
+ *
+ * Called only by the accelerometer task.  The map bit is set before the
+ * new write position is published, so the MQTT task never sees a write
+ * position that has passed a block it can't find in the map.
+ *  returns TRUE
  *
  *******************************************************************************
  */
 static int update_AB_write_location(void)
 {
-	int return_value = pdFALSE;
+	int write_position;
 
 	// NOTE! this doesn't check to see if the MQTT task is running or
 	// not.  It is expected that this function will be called under
@@ -5634,39 +5758,16 @@ static int update_AB_write_location(void)
 	//    4. (TBD) MQTT task is transmitting data where we plan to
 	//       write or erase.  VERY IMPORTANT THAT WE DON"T LET THIS HAPPEWN
 
-	if(AB_semaphore != NULL )
-	{
-		/* See if we can obtain the semaphore.  If the semaphore is not
-			available wait 10 ticks to see if it becomes free. */
-		if( xSemaphoreTake( AB_semaphore, ( TickType_t ) 10 ) == pdTRUE )
-		{
-//			PRINTF("===update_AB_write_location: new value %d\n", new_location);
-			/* We were able to obtain the semaphore and can now access the
-				shared resource. */
-
-			// Indicate the current write position is ready for transmission
-			SET_AB_POS(pUserData->AB_transmit_map, pUserData->next_AB_write_position);
-
-			// Increment the write position
-			pUserData->next_AB_write_position = ((pUserData->next_AB_write_position + 1) % AB_FLASH_MAX_PAGES);
+	write_position = pUserData->next_AB_write_position;
 
-			/* We have finished accessing the shared resource.  Release the
-				semaphore. */
-			xSemaphoreGive( AB_semaphore );
-			return_value = pdTRUE;
-		}
-		else
-		{
-			PRINTF("\n ***Unable to obtain AB semaphore\n");
-		}
-	}
-	else
-	{
-		PRINTF("\n ***AB semaphore not initialized!\n");
-	}
+	// Indicate the current write position is ready for transmission
+	ab_map_set(pUserData->AB_transmit_map, write_position);
 
-	return return_value;
+	// Increment the write position
+	AB_POSITION_STORE(&pUserData->next_AB_write_position,
+			(write_position + 1) % AB_FLASH_MAX_BLOCKS);
 
+	return pdTRUE;
 }
 
 
@@ -5803,7 +5904,6 @@ static int flash_read_page_data(HANDLE SPI, UINT32 pageaddress, UCHAR *Pagedata,
 }
 
 
-
 /**
  *******************************************************************************
  * @brief Process to retrieve one block from the accelerometer buffer
@@ -5829,7 +5929,7 @@ static int AB_read_block(HANDLE SPI, UINT32 blockaddress, accelBufferStruct *FIF
 			spi_status = pageRead(SPI, blockaddress, (UINT8 *)FIFOdata, sizeof(accelBufferStruct));
 
 			if(spi_status < 0){
-				PRINTF("  ***** AB_read_block error reading block 0x%x\n", blockaddress);
+				ULOG_E("  ***** AB_read_block error reading block 0x%x\n", blockaddress);
 				return_value = pdFALSE;
 			}
 			else
@@ -5843,18 +5943,113 @@ static int AB_read_block(HANDLE SPI, UINT32 blockaddress, accelBufferStruct *FIF
 		}
 		else
 		{
-			PRINTF("\n ***AB_read_block: Unable to obtain Flash semaphore\n");
+			ULOG_E("\n ***AB_read_block: Unable to obtain Flash semaphore\n");
 		}
 	}
 	else
 	{
-		PRINTF("\n ***AB_read_block: semaphore not initialized!\n");
+		ULOG_E("\n ***AB_read_block: semaphore not initialized!\n");
 	}
 
 	return return_value;
 
 }
 
+/**
+ *******************************************************************************
+ * @brief Process to retrieve several consecutive blocks from the
+ * accelerometer buffer memory (flash) with one flash read
+ *
+ *  Reads the num_blocks blocks ending at last_block and returns them
+ *  newest first (FIFOdata[0] is last_block), the order in which the
+ *  transmit task works through the buffer.  If the blocks wrap around
+ *  the end of the buffer region it takes two reads, otherwise one.
+ *  Either way the flash semaphore is only taken once.
+ *
+ *  Returns pdFALSE if unable to read
+ *  Returns pdTRUE and the FIFO buffers if able to read
+ *******************************************************************************
+ */
+static int AB_read_blocks(HANDLE SPI, int last_block, int num_blocks, accelBufferStruct *FIFOdata)
+{
+	int return_value = pdFALSE;
+	int spi_status;
+	int first_block;
+	int wrapped_blocks;		// blocks at the top of the region, if we wrap
+	int i;
+
+	if ((num_blocks <= 0) || (num_blocks > AB_READ_BLOCKS_MAX))
+	{
+		ULOG_E("\n ***AB_read_blocks: bad block count %d\n", num_blocks);
+		return pdFALSE;
+	}
+
+	// AB_read_slots holds the blocks in ascending order from first_block
+	first_block = last_block - num_blocks + 1;
+	wrapped_blocks = 0;
+	if (first_block < 0)
+	{
+		wrapped_blocks = -first_block;
+		first_block += AB_FLASH_MAX_BLOCKS;
+	}
+
+	if(Flash_semaphore != NULL )
+	{
+		/* See if we can obtain the semaphore.  If the semaphore is not
+	        available wait 10 ticks to see if it becomes free. */
+		if( xSemaphoreTake( Flash_semaphore, ( TickType_t ) 10 ) == pdTRUE )
+		{
+			if (wrapped_blocks > 0)
+			{
+				// The top of the region, then from the bottom up to last_block
+				spi_status = pageReadRange(SPI, AB_BLOCK_ADDRESS(first_block),
+						AB_read_slots, AB_BLOCK_SIZE * wrapped_blocks);
+				if (spi_status >= 0)
+				{
+					spi_status = pageReadRange(SPI, AB_BLOCK_ADDRESS(0),
+							&AB_read_slots[AB_BLOCK_SIZE * wrapped_blocks],
+							AB_BLOCK_SIZE * (num_blocks - wrapped_blocks));
+				}
+			}
+			else
+			{
+				spi_status = pageReadRange(SPI, AB_BLOCK_ADDRESS(first_block),
+						AB_read_slots, AB_BLOCK_SIZE * num_blocks);
+			}
+
+			if(spi_status < 0){
+				ULOG_E("  ***** AB_read_blocks error reading %d blocks ending at %d\n",
+						num_blocks, last_block);
+				return_value = pdFALSE;
+			}
+			else
+			{
+				for (i = 0; i < num_blocks; i++)
+				{
+					memcpy(&FIFOdata[i],
+						   &AB_read_slots[AB_BLOCK_SIZE * (num_blocks - 1 - i)],
+						   sizeof(accelBufferStruct));
+				}
+				return_value = pdTRUE;
+			}
+
+			/* We have finished accessing the shared resource.  Release the
+	            semaphore. */
+			xSemaphoreGive( Flash_semaphore );
+		}
+		else
+		{
+			ULOG_E("\n ***AB_read_blocks: Unable to obtain Flash semaphore\n");
+		}
+	}
+	else
+	{
+		ULOG_E("\n ***AB_read_blocks: semaphore not initialized!\n");
+	}
+
+	return return_value;
+}
+
 /**
  *******************************************************************************
  * @brief Process to write data to one page of the external data flash memory
@@ -5877,7 +6072,9 @@ static int flash_write_block(HANDLE SPI, int blockaddress, UCHAR *pagedata, int
 			/* We were able to obtain the semaphore and can now access the
 	            shared resource. */
 			// Now write the block
+			TRACE_EVENT(TRACE_EV_FLASH_WRITE_START, 0, blockaddress);
 			spi_status = pageWrite(SPI, blockaddress, (UINT8 *)pagedata, num_bytes);
+			TRACE_EVENT(TRACE_EV_FLASH_WRITE_END, (spi_status >= 0), 0);
 			if(spi_status < 0)
 			{
 				Printf(" **flash_write_block: Flash Write error\n"); //Fault error indication here
@@ -5909,16 +6106,36 @@ static int flash_write_block(HANDLE SPI, int blockaddress, UCHAR *pagedata, int
 
 /**
  *******************************************************************************
- * @brief Process to write one block to the accelerometer buffer
+ * @brief Process to write consecutive blocks to the accelerometer buffer
  * memory (flash)
+ *
+ *  The blocks go into consecutive slots starting at blockaddress and
+ *  must all be in the same page, so they take one page program.
+ *  Slot padding is left at 0xFF (unprogrammed).
+ *
  *  Returns pdFALSE if unable to write
  *  Returns pdTRUE if able to write
  *******************************************************************************
  */
-static int AB_write_block(HANDLE SPI, int blockaddress, accelBufferStruct *FIFOdata)
+static int AB_write_block(HANDLE SPI, int blockaddress, accelBufferStruct *FIFOdata, int num_blocks)
 {
 	int return_value = pdFALSE;
 	int spi_status;
+	UCHAR slots[AB_BLOCKS_PER_PAGE * AB_BLOCK_SIZE];
+	int i;
+
+	if ((num_blocks <= 0)
+		|| (((blockaddress % AB_FLASH_PAGE_SIZE) + (num_blocks * AB_BLOCK_SIZE)) > AB_FLASH_PAGE_SIZE))
+	{
+		ULOG_E("\n ***AB_write_block: %d blocks don't fit the page at %x\n", num_blocks, blockaddress);
+		return pdFALSE;
+	}
+
+	memset(slots, 0xFF, sizeof(slots));
+	for (i = 0; i < num_blocks; i++)
+	{
+		memcpy(&slots[i * AB_BLOCK_SIZE], &FIFOdata[i], sizeof(accelBufferStruct));
+	}
 
 	if(Flash_semaphore != NULL )
 	{
@@ -5929,10 +6146,12 @@ static int AB_write_block(HANDLE SPI, int blockaddress, accelBufferStruct *FIFOd
 			/* We were able to obtain the semaphore and can now access the
 	            shared resource. */
 			// Now write the block
-			spi_status = pageWrite(SPI, blockaddress, (UINT8 *)FIFOdata, sizeof(accelBufferStruct));
+			TRACE_EVENT(TRACE_EV_FLASH_WRITE_START, 0, blockaddress);
+			spi_status = pageWrite(SPI, blockaddress, (UINT8 *)slots, num_blocks * AB_BLOCK_SIZE);
+			TRACE_EVENT(TRACE_EV_FLASH_WRITE_END, (spi_status >= 0), 0);
 			if(spi_status < 0)
 			{
-				PRINTF(" **AB_write_block: Flash Write error\n"); //Fault error indication here
+				ULOG_E(" **AB_write_block: Flash Write error\n"); //Fault error indication here
 				return_value = pdFALSE;
 			}
 			else
@@ -5947,12 +6166,12 @@ static int AB_write_block(HANDLE SPI, int blockaddress, accelBufferStruct *FIFOd
 		}
 		else
 		{
-			PRINTF("\n ***AB_write_block: Unable to obtain Flash semaphore\n");
+			ULOG_E("\n ***AB_write_block: Unable to obtain Flash semaphore\n");
 		}
 	}
 	else
 	{
-		PRINTF("\n ***AB_write_block: semaphore not initialized!\n");
+		ULOG_E("\n ***AB_write_block: semaphore not initialized!\n");
 	}
 
 	return return_value;
@@ -5974,7 +6193,7 @@ static int AB_write_block(HANDLE SPI, int blockaddress, accelBufferStruct *FIFOd
  *  such as overnight. FRS
  *******************************************************************************
  */
-static int user_erase_flash_sector(HANDLE SPI, ULONG SectorEraseAddr)
+static int user_erase_flash_sector(HANDLE SPI, ULONG SectorEraseAddr, int num_sectors)
 {
 
 //	ULONG SectorEraseAddr;
@@ -5984,7 +6203,7 @@ static int user_erase_flash_sector(HANDLE SPI, ULONG SectorEraseAddr)
 	int erase_status;
 	UINT32 erase_mismatch_count;
 //	accelBufferStruct checkFIFO;	// copy for readback check
-	UCHAR FIFObytes[256];				// pointer used to access bytes of fifo
+	UCHAR check_bytes[AB_ERASE_VERIFY_BYTES];	// start of the sector, read back
 //	int write_index;
 	int retry_count;
 	int fault_happened;
@@ -5994,14 +6213,13 @@ static int user_erase_flash_sector(HANDLE SPI, ULONG SectorEraseAddr)
 	// Our return status starts at ok until a problem occurs
 	erase_status = TRUE;
 
-	PRINTF("-------------------------------\n");
-	PRINTF(" Erase sector location: %x\n", SectorEraseAddr);
-	PRINTF("-------------------------------\n");
+	ULOG_D(" Erase sector location: %x (%d sectors)\n", SectorEraseAddr, num_sectors);
 
 	fault_happened = 1;
 	retry_count = 0;
 	erase_mismatch_count = 0;
 	pUserData->erase_attempts++;  // total sectors we tried to erase
+	TRACE_EVENT(TRACE_EV_FLASH_ERASE_START, num_sectors, SectorEraseAddr);
 
 	// Note - as of 9/10/22 the erase sector was taking about 50 milliseconds
 	// We have to be careful not to overrun the accelerometer interrupt here
@@ -6032,14 +6250,25 @@ static int user_erase_flash_sector(HANDLE SPI, ULONG SectorEraseAddr)
 			printf_with_run_time("======= about to erase sector");
 #endif
 
-		erase_status = eraseSector_4K(SPI, (UINT32)SectorEraseAddr);
+		if (num_sectors == (AB_FLASH_BLOCK_64K_SIZE / AB_FLASH_SECTOR_SIZE))
+		{
+			erase_status = eraseBlock_64K(SPI, (UINT32)SectorEraseAddr);
+		}
+		else if (num_sectors == (AB_FLASH_BLOCK_32K_SIZE / AB_FLASH_SECTOR_SIZE))
+		{
+			erase_status = eraseBlock_32K(SPI, (UINT32)SectorEraseAddr);
+		}
+		else
+		{
+			erase_status = eraseSector_4K(SPI, (UINT32)SectorEraseAddr);
+		}
 
 #if defined(__RUNTIME_CALCULATION__) && defined(XIP_CACHE_BOOT)
 		printf_with_run_time("======= done erasing sector");
 #endif
 		if(!erase_status)
 		{
-			PRINTF("\n\n********* eraseSector_4K returned error *********\n");
+			ULOG_E("\n\n********* flash erase of %d sectors returned error *********\n", num_sectors);
 		}
 //		else
 //		{
@@ -6069,30 +6298,38 @@ static int user_erase_flash_sector(HANDLE SPI, ULONG SectorEraseAddr)
 //		{
 #endif
 
-			if (pdFALSE == AB_read_block(SPI, (UINT32)SectorEraseAddr, (accelBufferStruct *)FIFObytes))
-			{
-				PRINTF("  Flash readback error: %x\n", SectorEraseAddr); //Fault error indication here
-				erase_status = FALSE;
-			}
-//			flash_close(MYSPI);
-
-
+			// The erase waits for the flash to finish, so an error status
+			// means it didn't; otherwise a few bytes are enough to show
+			// the sector took the erase
 			// Note that the issue could be the read rather than the write
 			// A read of all zeroes seems to be a read error while
 			// a read of non-zero data seems to indicate an erase malfunction
 			erase_mismatch_count = 0;
-			for(int i = 0; i <= 10; i++)
+			if (!erase_status)
+			{
+				erase_mismatch_count++;
+			}
+			else if (pdFALSE == flash_read_page_data(SPI, (UINT32)SectorEraseAddr, check_bytes, AB_ERASE_VERIFY_BYTES))
+			{
+				ULOG_E("  Flash readback error: %x\n", SectorEraseAddr); //Fault error indication here
+				erase_status = FALSE;
+				erase_mismatch_count++;
+			}
+			else
 			{
-				if(FIFObytes[i] != 0xFF)
+				for(int i = 0; i < AB_ERASE_VERIFY_BYTES; i++)
 				{
-					PRINTF("  *** ERASE FAILED byte %d  %x\n", i, FIFObytes[i]);
-					erase_mismatch_count++;
+					if(check_bytes[i] != 0xFF)
+					{
+						ULOG_E("  *** ERASE FAILED byte %d  %x\n", i, check_bytes[i]);
+						erase_mismatch_count++;
+					}
 				}
 			}
 
 			if(erase_mismatch_count > 0)
 			{
-				PRINTF("  ERASE FLASH MISMATCH COUNT: %d\n\n", erase_mismatch_count);
+				ULOG_E("  ERASE FLASH MISMATCH COUNT: %d\n\n", erase_mismatch_count);
 				faultFlag = 1;
 				erase_mismatch_count = 0;
 				vTaskDelay(pdMS_TO_TICKS(10));
@@ -6101,7 +6338,7 @@ static int user_erase_flash_sector(HANDLE SPI, ULONG SectorEraseAddr)
 			}
 			else
 			{
-				PRINTF(" Flash erase & verification successful\n");
+				ULOG_D(" Flash erase & verification successful\n");
 				faultFlag = 0;
 //				flash_close(MYSPI);
 				erase_confirmed = pdTRUE;
@@ -6125,6 +6362,7 @@ end_of_task:
 
 //	flash_close(SPI);  // See comments about SPI closing above
 
+	TRACE_EVENT(TRACE_EV_FLASH_ERASE_END, erase_status, 0);
 	return erase_status;
 }
 
@@ -6375,7 +6613,7 @@ static int user_write_log_to_flash(USERLOG_ENTRY *pLogData, int *did_an_erase)
 
 		pUserData->log_erase_attempts++;
 
-		erase_status = user_erase_flash_sector(SPI, SectorEraseAddr);
+		erase_status = user_erase_flash_sector(SPI, SectorEraseAddr, 1);
 #if 0
 #if defined(__RUNTIME_CALCULATION__) && defined(XIP_CACHE_BOOT)
 			printf_with_run_time("======= about to erase sector");
@@ -6402,15 +6640,226 @@ end_of_task:
 
 /**
  *******************************************************************************
- * @brief Process for writing data to external data Flash
- * One FIFO buffer structure is written to the next available
- * flash location.
+ * @brief Make sure the sector the write position just moved into is erased
+ *
+ * Called by the accelerometer task when a write fills a sector.  Usually
+ * the sector was erased ahead of time by AB_erase_ahead() and this returns
+ * straight away.  If the MQTT task is erasing it right now, we wait for
+ * that to finish, for up to AB_ERASE_AHEAD_WAIT_POLLS polls.  The sector
+ * right after the one being written only ever gets a 4K erase, so the
+ * wait is bounded by that erase and stays well inside the time until the
+ * next FIFO interrupt.  Otherwise (erase-ahead fell behind, failed or took
+ * too long) the sector is erased here, as was always done before
+ * erase-ahead.
+ *
+ *  Returns TRUE if the sector is ready for writing
+ *******************************************************************************
+ */
+static int AB_prepare_sector(HANDLE SPI, int sector_start, int *did_an_erase)
+{
+	int erased_sectors = 0;
+	int in_flight;
+	int polls = AB_ERASE_AHEAD_WAIT_POLLS;
+	int erase_status;
+	ULONG SectorEraseAddr;
+
+	for (;;)
+	{
+		if (xSemaphoreTake(AB_semaphore, (TickType_t) 10) != pdTRUE)
+		{
+			ULOG_E("\n ***Unable to obtain AB semaphore\n");
+			erased_sectors = 0;
+			break;
+		}
+		erased_sectors = ab_erased_sectors_from(pUserData->next_AB_erase_position, sector_start);
+		in_flight = ab_erase_range_covers(AB_erase_ahead_reserved,
+						AB_erase_ahead_reserved_sectors, sector_start);
+		xSemaphoreGive(AB_semaphore);
+
+		if ((erased_sectors > 0) || !in_flight || (polls-- <= 0))
+		{
+			break;
+		}
+		vTaskDelay(pdMS_TO_TICKS(10));
+	}
+
+	if (erased_sectors > 0)
+	{
+		ULOG_D("  Sector filled. Next sector already erased (%d ahead)\n",
+				erased_sectors - 1);
+		return TRUE;
+	}
+
+	*did_an_erase = pdTRUE;
+	pUserData->erase_inline_count++;
+	SectorEraseAddr = AB_BLOCK_ADDRESS(sector_start);
+	ULOG_D("  Sector filled. Location: %x Erasing next sector\n",
+				SectorEraseAddr);
+
+	erase_status = user_erase_flash_sector(SPI, SectorEraseAddr, 1);
+
+	if (xSemaphoreTake(AB_semaphore, (TickType_t) 10) == pdTRUE)
+	{
+		if (ab_erased_sectors_from(pUserData->next_AB_erase_position, sector_start) <= 0)
+		{
+			pUserData->next_AB_erase_position = (sector_start + AB_BLOCKS_PER_SECTOR)
+													% AB_FLASH_MAX_BLOCKS;
+		}
+		xSemaphoreGive(AB_semaphore);
+	}
+	else
+	{
+		ULOG_E("\n ***Unable to obtain AB semaphore\n");
+	}
+
+	return erase_status;
+}
+
+/**
+ *******************************************************************************
+ * @brief Erase sectors in front of the sector being written
+ *
+ * Keeps up to AB_ERASE_AHEAD_SECTORS sectors erased ahead of the write
+ * position so the accelerometer task rarely has to erase (see
+ * AB_prepare_sector()).  Nothing is done until the erased sectors drop to
+ * AB_ERASE_AHEAD_LOW_WATER; the refill then uses a 64K or 32K block erase
+ * wherever an aligned block fits, and 4K sector erases elsewhere (see
+ * ab_erase_ahead_next()).
+ *
+ * The pages erased here are the oldest in the buffer.  They are inside
+ * AB_TRANSMIT_SAFETY_GAP, so the MQTT task never reads them, but if the
+ * buffer filled up before they were sent their transmit map bits are
+ * still set.  Those are cleared first and counted in erase_ahead_dropped.
+ *
+ * The sectors of each erase are reserved in AB_erase_ahead_reserved and
+ * AB_erase_ahead_reserved_sectors while they are being erased, so the
+ * accelerometer task doesn't write into them meanwhile.
+ *
+ *  Returns the number of sectors erased
+ *******************************************************************************
+ */
+static int AB_erase_ahead(HANDLE SPI, int max_ops)
+{
+	int write_index = 0;
+	int erase_pos;
+	int num_sectors;
+	int total = 0;
+	int ops;
+	int erase_status;
+	int dropped;
+	ULONG EraseAddr;
+
+	for (ops = 0; ops < max_ops; ops++)
+	{
+		if (xSemaphoreTake(AB_semaphore, (TickType_t) 10) != pdTRUE)
+		{
+			ULOG_E("\n ***Unable to obtain AB semaphore\n");
+			break;
+		}
+
+		write_index = get_AB_write_location();
+		erase_pos = ab_erase_ahead_next(&pUserData->next_AB_erase_position, write_index,
+										(ops == 0), &num_sectors);
+		if (erase_pos < 0)
+		{
+			xSemaphoreGive(AB_semaphore);
+			break;
+		}
+
+		AB_erase_ahead_reserved = erase_pos;
+		AB_erase_ahead_reserved_sectors = num_sectors;
+		xSemaphoreGive(AB_semaphore);
+
+		// Blocks still waiting for transmission in there are lost.  Only
+		// this task clears map bits, and the accelerometer task won't set
+		// any in the reserved sectors until they are erased.
+		dropped = ab_map_clear_range(pUserData->AB_transmit_map, erase_pos,
+						erase_pos + (num_sectors * AB_BLOCKS_PER_SECTOR) - 1);
+		if (dropped > 0)
+		{
+			pUserData->erase_ahead_dropped += dropped;
+			ULOG_W("\n Neuralert: [%s] %d unsent blocks erased at %d\n",
+					__func__, dropped, erase_pos);
+		}
+
+		EraseAddr = AB_BLOCK_ADDRESS(erase_pos);
+		erase_status = user_erase_flash_sector(SPI, EraseAddr, num_sectors);
+
+		if (xSemaphoreTake(AB_semaphore, portMAX_DELAY) == pdTRUE)
+		{
+			if (erase_status && (pUserData->next_AB_erase_position == erase_pos))
+			{
+				pUserData->next_AB_erase_position = (erase_pos + (num_sectors * AB_BLOCKS_PER_SECTOR))
+														% AB_FLASH_MAX_BLOCKS;
+			}
+			AB_erase_ahead_reserved = INVALID_AB_ADDRESS;
+			AB_erase_ahead_reserved_sectors = 0;
+			xSemaphoreGive(AB_semaphore);
+		}
+
+		if (!erase_status)
+		{
+			ULOG_E("\n Neuralert: [%s] erase-ahead failed at %x", __func__, EraseAddr);
+			break;
+		}
+		total += num_sectors;
+		pUserData->erase_ahead_count += num_sectors;
+	}
+
+	if (total > 0)
+	{
+		ULOG_I("\n Neuralert: [%s] erased %d sectors ahead of write position %d\n",
+				__func__, total, write_index);
+	}
+
+	return total;
+}
+
+/**
+ *******************************************************************************
+ * @brief Erase ahead of the write position with a handle of our own
+ *******************************************************************************
+ */
+static void user_process_erase_ahead(int max_ops)
+{
+	HANDLE SPI = NULL;
+
+	SPI = flash_open(SPI_MASTER_CLK, SPI_MASTER_CS);
+	if (SPI == NULL)
+	{
+		ULOG_E("\nNeuralert: [%s] MAJOR SPI ERROR: Unable to open SPI bus handle", __func__);
+		return;
+	}
+
+	AB_erase_ahead(SPI, max_ops);
+
+	flash_close(SPI);
+}
+
+/*
+ * Number of block slots from position pos to the end of its page,
+ * i.e. how many blocks starting at pos one page program can take
+ */
+static int AB_page_slots_left(int pos)
+{
+	return AB_BLOCKS_PER_PAGE - (pos % AB_BLOCKS_PER_PAGE);
+}
+
+/**
+ *******************************************************************************
+ * @brief Write FIFO buffer structures to the next available
+ * flash locations, using an SPI handle the caller has opened.
+ * If that fills the sector, the next sector is erased.
  * See document "Neuralert accelerometer data buffer design" for
  * details of this design
  *
+ * num_blocks consecutive buffers from pFIFOdata are written with one
+ * page program, so they must fit in what's left of the page at the
+ * write position (see AB_page_slots_left()).
+ *
  *******************************************************************************
  */
-static int user_process_write_to_flash(accelBufferStruct *pFIFOdata, int *did_an_erase)
+static int AB_store_block(HANDLE SPI, accelBufferStruct *pFIFOdata, int num_blocks, int *did_an_erase)
 {
 
 	ULONG NextWriteAddr;
@@ -6421,12 +6870,14 @@ static int user_process_write_to_flash(accelBufferStruct *pFIFOdata, int *did_an
 	int write_status;
 	UINT32 i2c_status;
 	UINT32 write_fail_count;
-	accelBufferStruct checkFIFO;	// copy for readback check
+#if AB_WRITE_VERIFY_BYTES > 0
+	UCHAR check_bytes[AB_WRITE_VERIFY_BYTES];	// start of the page, read back
+#endif
 	int write_index;
 	int transmit_index;
 	int retry_count;
 	int fault_happened;
-	HANDLE SPI = NULL;
+	int i;
 
 #if defined(__RUNTIME_CALCULATION__) && defined(XIP_CACHE_BOOT)
 	printf_with_run_time("======= writing FIFO buff to flash");
@@ -6445,37 +6896,37 @@ static int user_process_write_to_flash(accelBufferStruct *pFIFOdata, int *did_an
 	// accelerometer buffer region in flash
 	// Upon entry to this function it should always point to a valid
 	// write location
-	// Writes are done to 256-byte pages and so are on addresses that
-	// are multiples of 0x100
+	// Writes are done to 128-byte slots, two to a 256-byte page, and
+	// so are on addresses that are multiples of 0x80
 	write_index = get_AB_write_location();
 	if (write_index < 0)
 	{
-		PRINTF("\n Neuralert [%s] Unable to get AB write location", __func__);
+		ULOG_E("\n Neuralert [%s] Unable to get AB write location", __func__);
 		return FALSE;
 	}
 //	Printf("==Next AB store location: %d\n", write_index);
+	if ((num_blocks <= 0) || (num_blocks > AB_page_slots_left(write_index)))
+	{
+		ULOG_E("\n Neuralert [%s] %d blocks don't fit at location %d", __func__, num_blocks, write_index);
+		return FALSE;
+	}
 
 	// Calculate address of next sector to write
-	NextWriteAddr = (ULONG)AB_FLASH_BEGIN_ADDRESS +
-			((ULONG)AB_FLASH_PAGE_SIZE * (ULONG)write_index);
-	PRINTF("-------------------------------\n");
-	PRINTF(" Next location to write: %d\n",write_index);
-	PRINTF(" Flash Write ADDR: 0x%X\r\n", NextWriteAddr);
-	PRINTF(" Data sequence # : %d\n", pFIFOdata->data_sequence);
-	PRINTF(" Number samples  : %d\n", pFIFOdata->num_samples);
+	NextWriteAddr = AB_BLOCK_ADDRESS(write_index);
+	ULOG_D(" Next location to write: %d (%d blocks) ADDR: 0x%X sequence # %d\n",
+			write_index, num_blocks, NextWriteAddr, pFIFOdata->data_sequence);
 	//PRINTF(" Timestamp sample: %d\n", pFIFOdata->timestamp_sample); //JW: Deprecated -- can be removed
-	PRINTF("-------------------------------\n");
-
-	fault_happened = 1;
-	retry_count = 0;
 
-	SPI = flash_open(SPI_MASTER_CLK, SPI_MASTER_CS);
-	if (SPI == NULL)
+	// The CRC lets readers check the whole block, so the write itself
+	// only needs a light check below
+	for (i = 0; i < num_blocks; i++)
 	{
-		PRINTF("\nNeuralert: [%s] MAJOR SPI ERROR: Unable to open SPI bus handle", __func__);
-		fault_happened = 1;
+		pFIFOdata[i].crc = ab_block_crc(&pFIFOdata[i]);
 	}
 
+	fault_happened = 1;
+	retry_count = 0;
+
 	for(rerunCount = 0; rerunCount < AB_WRITE_MAX_ATTEMPTS; rerunCount++)
 	{
 		retry_count++;
@@ -6494,9 +6945,12 @@ static int user_process_write_to_flash(accelBufferStruct *pFIFOdata, int *did_an
 		{
 //			PRINTF(" user_process_write_to_flash (1): SPI handle: %x\n", SPI);
 
-			if(!AB_write_block(SPI, NextWriteAddr, pFIFOdata))
+			// The write waits for the program to finish, so a good
+			// status means the flash took the page
+			if(!AB_write_block(SPI, NextWriteAddr, pFIFOdata, num_blocks))
 			{
-				PRINTF("\n Neuralert: [%s] Flash Write error %x", __func__, NextWriteAddr); //Fault error indication here
+				ULOG_E("\n Neuralert: [%s] Flash Write error %x", __func__, NextWriteAddr); //Fault error indication here
+				write_fail_count++;
 			}
 			else
 			{
@@ -6507,33 +6961,31 @@ static int user_process_write_to_flash(accelBufferStruct *pFIFOdata, int *did_an
 			printf_with_run_time("======= done writing FIFO to flash");
 #endif
 
-			// Now read it back and see if it's the same
-			if (pdFALSE == AB_read_block(SPI, NextWriteAddr, &checkFIFO))
-			{
-				PRINTF("  Flash readback error: %x\n", NextWriteAddr); //Fault error indication here
-				write_status = FALSE;
-			}
-
-			// Read back what we just wrote and make sure it took
+#if AB_WRITE_VERIFY_BYTES > 0
+			// Read back the start of the page and make sure it took.
 			// Note - as of 8/20/22, the WIFI and MQTT activity in other
-			// tasks seems to interfere with the SPI bus.  As of this
-			// writing it seems that we catch the mistake and correct it
-			// on the first retry.
-			for(int i = 0; i <= receivedFIFO.num_samples - 1; i++)
+			// tasks seems to interfere with the SPI bus.  A write garbled
+			// that way shows up here; anything subtler is caught by the
+			// CRC when the block is read for transmission.
+			if (write_fail_count == 0)
 			{
-					if((receivedFIFO.Xvalue[i] != checkFIFO.Xvalue[i])
-							|| (receivedFIFO.Yvalue[i] != checkFIFO.Yvalue[i])
-							|| (receivedFIFO.Zvalue[i] != checkFIFO.Zvalue[i]))
-					{
-						PRINTF("RECEIVED: %d     X: %d Y: %d Z: %d\r\n", i, receivedFIFO.Xvalue[i], receivedFIFO.Yvalue[i], receivedFIFO.Zvalue[i]);
-						PRINTF("CHECK:    %d     X: %d Y: %d Z: %d\r\n", i, checkFIFO.Xvalue[i], checkFIFO.Yvalue[i], checkFIFO.Zvalue[i]);
-						write_fail_count++;
-					}
-			} // for each sample in FIFO compare buffer
+				if (pdFALSE == flash_read_page_data(SPI, NextWriteAddr, check_bytes, AB_WRITE_VERIFY_BYTES))
+				{
+					ULOG_E("  Flash readback error: %x\n", NextWriteAddr); //Fault error indication here
+					write_status = FALSE;
+					write_fail_count++;
+				}
+				else if (memcmp(check_bytes, pFIFOdata, AB_WRITE_VERIFY_BYTES) != 0)
+				{
+					ULOG_E("  Flash readback mismatch: %x\n", NextWriteAddr);
+					write_fail_count++;
+				}
+			}
+#endif
 
 			if(write_fail_count > 0)
 			{
-				PRINTF("SPI FLASH ERROR COUNT: %d\n\n", write_fail_count);
+				ULOG_E("SPI FLASH ERROR COUNT: %d\n\n", write_fail_count);
 				faultFlag = 1;
 				write_fail_count = 0;
 				vTaskDelay(pdMS_TO_TICKS(30));
@@ -6569,7 +7021,7 @@ static int user_process_write_to_flash(accelBufferStruct *pFIFOdata, int *did_an
 
 	if(faultFlag != 0)
 	{
-		PRINTF("\n Neuralert: [%s] FIFO DATA WRITE FAILURE - SKIPPING POINTER UPDATE", __func__);
+		ULOG_E("\n Neuralert: [%s] FIFO DATA WRITE FAILURE - SKIPPING POINTER UPDATE", __func__);
 		goto end_of_task;
 	}
 
@@ -6645,35 +7097,34 @@ static int user_process_write_to_flash(accelBufferStruct *pFIFOdata, int *did_an
 #endif
 
 	//if(!update_AB_write_location(write_index)) //JW: to be deleted
-	if(!update_AB_write_location())
+	for (i = 0; i < num_blocks; i++)
 	{
-		PRINTF("\n Neuralert: [%s] Unable to set AB write location", __func__);
+		if(!update_AB_write_location())
+		{
+			ULOG_E("\n Neuralert: [%s] Unable to set AB write location", __func__);
 //			goto end_of_task;
-	}
-	else
-	{
-//		Printf(" === Writing to flash next write location updated: %d\n", write_index);
+		}
+		else
+		{
+//			Printf(" === Writing to flash next write location updated: %d\n", write_index);
+		}
 	}
 
 	// Increament the write index -- this is only for erasing flash below,
-	// so no risk of it affecting the actual AB write location
-	write_index = ((write_index+1) % AB_FLASH_MAX_PAGES);
+	// so no risk of it affecting the actual AB write location.
+	// The blocks were all in one page, so only the last can have
+	// filled a sector.
+	write_index = ((write_index + num_blocks) % AB_FLASH_MAX_BLOCKS);
 
 	//	vTaskDelay(pdMS_TO_TICKS(50));
 
-	// If the next page we're going to write to is the start of a
-	// new sector, we have to erase it to be ready
-	if(	((write_index % AB_PAGES_PER_SECTOR) == 0)
+	// If the next block we're going to write to is the start of a
+	// new sector, it has to be erased to be ready.  Normally that
+	// was done ahead of time and there's nothing to do here.
+	if(	((write_index % AB_BLOCKS_PER_SECTOR) == 0)
 		|| (write_index == 0))
 	{
-		*did_an_erase = pdTRUE;
-		// Calculate address of next sector to write
-		SectorEraseAddr = (ULONG)AB_FLASH_BEGIN_ADDRESS +
-					((ULONG)AB_FLASH_PAGE_SIZE * (ULONG)write_index);
-		PRINTF("  Sector filled. Location: %x Erasing next sector\n",
-					SectorEraseAddr);
-
-		erase_status = user_erase_flash_sector(SPI, SectorEraseAddr);
+		erase_status = AB_prepare_sector(SPI, write_index, did_an_erase);
 #if 0
 #if defined(__RUNTIME_CALCULATION__) && defined(XIP_CACHE_BOOT)
 			printf_with_run_time("======= about to erase sector");
@@ -6687,16 +7138,88 @@ static int user_process_write_to_flash(accelBufferStruct *pFIFOdata, int *did_an
 #endif
 		if(!erase_status)
 		{
-			PRINTF("\n Neuralert: [%s] SPI erase error", __func__);
+			ULOG_E("\n Neuralert: [%s] SPI erase error", __func__);
 			write_status = FALSE;
 		}
 	} // if need to erase next sector
 
 end_of_task:
-	flash_close(SPI);  // See comments about SPI closing above
 	return write_status;
 }
 
+#ifndef AB_STAGE_WRITE_BACK
+/**
+ *******************************************************************************
+ * @brief Process for writing data to external data Flash
+ * One FIFO buffer structure is written to the next available
+ * flash location.
+ *
+ *******************************************************************************
+ */
+static int user_process_write_to_flash(accelBufferStruct *pFIFOdata, int *did_an_erase)
+{
+	int write_status;
+	HANDLE SPI = NULL;
+
+	*did_an_erase = pdFALSE;
+
+	SPI = flash_open(SPI_MASTER_CLK, SPI_MASTER_CS);
+	if (SPI == NULL)
+	{
+		ULOG_E("\nNeuralert: [%s] MAJOR SPI ERROR: Unable to open SPI bus handle", __func__);
+		return FALSE;
+	}
+
+	write_status = AB_store_block(SPI, pFIFOdata, 1, did_an_erase);
+
+	flash_close(SPI);  // See comments about SPI closing in AB_store_block()
+	return write_status;
+}
+#else
+static HANDLE AB_stage_open(void)
+{
+	return flash_open(SPI_MASTER_CLK, SPI_MASTER_CS);
+}
+
+static void AB_stage_close(HANDLE SPI)
+{
+	flash_close(SPI);  // See comments about SPI closing in AB_store_block()
+}
+
+// The flash operations used by the write-back stage (see user_ab_stage.c)
+static const abStageFlash AB_stage_flash =
+{
+	AB_stage_open,
+	AB_stage_close,
+	get_AB_write_location,
+	AB_store_block
+};
+
+/**
+ *******************************************************************************
+ * @brief Write the FIFO buffers staged in retention memory to flash
+ *
+ * Returns TRUE if every buffer was written
+ *******************************************************************************
+ */
+static int AB_stage_flush(int *did_an_erase)
+{
+	return ab_stage_flush(&pUserData->AB_stage, &AB_stage_flash, did_an_erase);
+}
+
+/**
+ *******************************************************************************
+ * @brief Stage one FIFO buffer in retention memory
+ *
+ * Returns TRUE unless the buffer was lost or a flush that was due failed
+ *******************************************************************************
+ */
+static int AB_stage_block(accelBufferStruct *pFIFOdata, int *did_an_erase)
+{
+	return ab_stage_block(&pUserData->AB_stage, &AB_stage_flash, pFIFOdata, did_an_erase);
+}
+#endif
+
 /**
  *******************************************************************************
  * @brief Write the current "wall clock" time to the user log in flash
@@ -6720,12 +7243,12 @@ int timelen;
 	len = strlen(PrefixString);
 	if ((len > 0) + (timelen + len < USERLOG_STRING_MAX_LEN))
 	{
-		PRINTF("\n Neuralert: [%s] %s Current Time : %s (GMT %+02d:%02d)",
+		ULOG_I_NOW("\n Neuralert: [%s] %s Current Time : %s (GMT %+02d:%02d)",
 				__func__, PrefixString, buf,   da16x_Tzoff() / 3600,   da16x_Tzoff() % 3600);
 	}
 	else
 	{
-		PRINTF("\n Neuralert: [%s] Current Time : %s (GMT %+02d:%02d)",
+		ULOG_I_NOW("\n Neuralert: [%s] Current Time : %s (GMT %+02d:%02d)",
 				__func__, buf,   da16x_Tzoff() / 3600,   da16x_Tzoff() % 3600);
 	}
 
@@ -6855,7 +7378,7 @@ static void timesync_snapshot(void)
 
 struct tm *ts;
 char buf[USERLOG_STRING_MAX_LEN];
-char timestamp_string[20];
+char timestamp_string[TIME64_STRING_MAX_LEN];
 __time64_t cur_msec;
 __time64_t cur_sec;
 
@@ -6891,14 +7414,13 @@ __time64_t cur_sec;
 	da16x_strftime(buf, sizeof (buf), "%Y.%m.%d %H:%M:%S", ts);
 	// And add time zone offset in case they configured this when
 	// provisioning the device.
-	sprintf(pUserData->MQTT_timesync_current_time_str,
-			"%s (GMT %+02d:%02d)",
-				buf,   da16x_Tzoff() / 3600,   da16x_Tzoff() % 3600);
+	json_packet_timesync_str(pUserData->MQTT_timesync_current_time_str,
+			sizeof(pUserData->MQTT_timesync_current_time_str), buf, da16x_Tzoff());
 
-	PRINTF("\n **** Time sync established ***\n");
+	ULOG_I("\n **** Time sync established ***\n");
 	time64_string (timestamp_string, &pUserData->MQTT_timesync_timestamptime_msec);
 
-	PRINTF("  Timestamp: %s  Local time: %s\n\n", timestamp_string,
+	ULOG_I_NOW("  Timestamp: %s  Local time: %s\n\n", timestamp_string,
 			pUserData->MQTT_timesync_current_time_str);
 
 	return;
@@ -7455,19 +7977,134 @@ static void determine_timestamp(__time64_t *returned_timestamp, int num_samples)
 #endif
 
 
-end_of_func:
+end_of_func:
+
+	// clear our reasons for activity flags
+	isPowerOnBoot = pdFALSE;
+	isAccelerometerWakeup = pdFALSE;
+	isAccelerometerInterrupt = pdFALSE;
+	isAccelerometerTimeout = pdFALSE;
+
+	*returned_timestamp = timestamp_selected;
+
+	return;
+}
+#endif // TO BE REMOVED -- DEPRECATED
+
+
+/**
+ *******************************************************************************
+ * @brief Print the running statistics
+ *
+ * These only change slowly, so rather than costing UART time on every
+ * wake they are printed once per upload, while the radio is on anyway.
+ *******************************************************************************
+ */
+static void user_print_stats(void)
+{
+	int i;
+	int max_display;		// temp to figure out last active "try" position
+
+	ULOG_I_NOW(" Total FIFO blocks read since power on   : %d\n", pUserData->ACCEL_read_count);
+	if(pUserData->write_fault_count > 0)
+	{
+		ULOG_I_NOW(" Total FIFO write failures since power on: %d\n", pUserData->write_fault_count);
+	}
+	if(pUserData->write_retry_count > 0)
+	{
+		ULOG_I_NOW(" Total times a write retry was needed    : %d\n", pUserData->write_retry_count);
+	}
+	ULOG_I_NOW(" Total missed accelerometer interrupts   : %d\n", pUserData->ACCEL_missed_interrupts);
+	max_display = AB_WRITE_MAX_ATTEMPTS - 1;
+	while (max_display > 0 &&
+			 pUserData->write_attempt_events[max_display] == 0)
+	{
+		max_display--;
+	}
+//	for (i=0; i<AB_WRITE_MAX_ATTEMPTS; i++)
+	if(max_display > 0)
+	{
+		for (i=0; i<=max_display; i++)
+		{
+			ULOG_I_NOW(" Total times succeeded on try %d          : %d\n", (i+1), pUserData->write_attempt_events[i]);
+		}
+	}
+		ULOG_I_NOW(" Total sector erase events               : %d\n", pUserData->erase_attempts);
+		ULOG_I_NOW(" Total sectors erased ahead              : %d\n", pUserData->erase_ahead_count);
+		ULOG_I_NOW(" Total sectors erased on the write path  : %d\n", pUserData->erase_inline_count);
+		ULOG_I_NOW(" Unsent blocks erased ahead              : %d\n", pUserData->erase_ahead_dropped);
+		ULOG_I_NOW(" Erase suspends for reads/writes (boot)  : %d\n", flash_erase_suspend_count());
+		ULOG_I_NOW(" Erase completion polls (boot)           : %d\n", flash_erase_poll_count());
+		ULOG_I_NOW(" Blocks failing CRC on read (boot)       : %d\n", AB_crc_fail_count);
+#ifdef AB_STAGE_WRITE_BACK
+		ULOG_I_NOW(" Total staged flash flushes              : %d\n", pUserData->AB_stage.flush_count);
+	if(pUserData->AB_stage.replay_count > 0)
+	{
+		ULOG_I_NOW(" Total unfinished flushes finished later : %d\n", pUserData->AB_stage.replay_count);
+	}
+#endif
+	if(pUserData->erase_retry_count > 0)
+	{
+		ULOG_I_NOW(" Total times an erase retry was needed   : %d\n", pUserData->erase_retry_count);
+	}
+		max_display = AB_ERASE_MAX_ATTEMPTS - 1;
+	while (max_display > 0 &&
+			 pUserData->erase_attempt_events[max_display] == 0)
+	{
+		max_display--;
+	}
+//	for (i=0; i<AB_ERASE_MAX_ATTEMPTS; i++)
+	if(max_display > 0)
+	{
+		for (i=0; i<=max_display; i++)
+		{
+			ULOG_I_NOW(" Total times succeeded on try %d          : %d\n", (i+1), pUserData->erase_attempt_events[i]);
+		}
+	}
+
+	ULOG_I_NOW(" ----------------------------------------\n");
+	if(Stats_semaphore != NULL )
+	{
+		/* See if we can obtain the semaphore.  If the semaphore is not
+	        available wait 10 ticks to see if it becomes free. */
+		if( xSemaphoreTake( Stats_semaphore, ( TickType_t ) 10 ) == pdTRUE )
+		{
+			/* We were able to obtain the semaphore and can now access the
+	            shared resource. */
+
+				ULOG_I_NOW(" Total MQTT connect attempts             : %d\n", pUserData->MQTT_stats_connect_attempts);
+				ULOG_I_NOW(" Total MQTT connect fails                : %d\n", pUserData->MQTT_stats_connect_fails);
+				ULOG_I_NOW(" Total MQTT packets sent                 : %d\n", pUserData->MQTT_stats_packets_sent);
+				ULOG_I_NOW(" Total MQTT retry attempts               : %d\n", pUserData->MQTT_stats_retry_attempts);
+				ULOG_I_NOW(" Total MQTT transmit success             : %d\n", pUserData->MQTT_stats_transmit_success);
+				ULOG_I_NOW(" MQTT tx attempts since tx success       : %d\n", pUserData->MQTT_attempts_since_tx_success);
+				ULOG_I_NOW(" MQTT last connect time (msec)           : %d\n", pUserData->MQTT_last_connect_msec);
+				ULOG_I_NOW(" Wi-Fi last connect time (msec)          : %d\n", pUserData->wifi_last_connect_msec);
+				ULOG_I_NOW(" Wi-Fi fast connects / fallbacks         : %d / %d\n",
+						pUserData->wifi_fast_connects, pUserData->wifi_fast_fallbacks);
+				if(pUserData->MQTT_dropped_data_events > 0)
+				{
+					ULOG_I_NOW(" Total times transmit buffer wrapped     : %d\n", pUserData->MQTT_dropped_data_events);
+				}
 
-	// clear our reasons for activity flags
-	isPowerOnBoot = pdFALSE;
-	isAccelerometerWakeup = pdFALSE;
-	isAccelerometerInterrupt = pdFALSE;
-	isAccelerometerTimeout = pdFALSE;
+			/* We have finished accessing the shared resource.  Release the
+	            semaphore. */
+			xSemaphoreGive( Stats_semaphore );
+		}
+		else
+		{
+			Printf("\n ***print stats: Unable to obtain Stats semaphore\n");
+		}
+	}
+	else
+	{
+		Printf("\n ***print stats: Stats semaphore not initialized!\n");
+	}
 
-	*returned_timestamp = timestamp_selected;
 
-	return;
+	ULOG_I_NOW(" ----------------------------------------\n");
 }
-#endif // TO BE REMOVED -- DEPRECATED
+
 
 /**
  *******************************************************************************
@@ -7482,14 +8119,11 @@ end_of_func:
  */
 static int user_process_read_data(void)
 {
-	signed char rawdata[8];
-	unsigned char fiforeg[2];
 	int dataptr;
 	int i;
-	INT32 readstatus;
 	int storestatus;
-	int I2Cstatus;
-	unsigned int trigger_value;
+	uploadSchedulerState schedule;
+	int upload_due;
 	UINT32 erase_fail_count, write_fail_count;
 	uint8_t ISR_reason;
 	__time64_t assigned_timestamp;		// timestamp to assign to FIFO reading
@@ -7512,13 +8146,6 @@ static int user_process_read_data(void)
 	// filling the data structure that we store each
 	// interrupt
 
-	// Read status register with FIFO content info
-	fiforeg[0] = MC36XX_REG_STATUS_1;
-	I2Cstatus = i2cRead(MC3672_ADDR, fiforeg, 1);
-
-	//TODO check I2Cstatus return value
-//	PRINTF(" FIFO status 0X%x\r\n", fiforeg[0]);
-
 	pUserData->FIFO_reads_this_power_cycle++;
 
 
@@ -7534,25 +8161,10 @@ static int user_process_read_data(void)
 	// Note that even though the FIFO interrupt threshold is something
 	// like 30, there is a delay before we get to this point and we
 	// are quite likely to read extra samples.
-	dataptr = 0;
-	while(((fiforeg[0] & 16) != 16) && (dataptr < MAX_ACCEL_FIFO_SIZE))
-	{
-		rawdata[0] = MC36XX_REG_XOUT_LSB; 	//Word Address to Write Data. 2 Bytes.
-		readstatus = i2cRead(MC3672_ADDR, rawdata, 6);
-
-		receivedFIFO.Xvalue[dataptr] = (/*((unsigned short)rawdata[1] << 8)*/ + rawdata[0]);
-		receivedFIFO.Yvalue[dataptr] = (/*((unsigned short)rawdata[3] << 8)*/ + rawdata[2]);
-		receivedFIFO.Zvalue[dataptr] = (/*((unsigned short)rawdata[5] << 8)*/ + rawdata[4]);
-		dataptr++;
-
-//		PRINTF("%d     X: %d Y: %d Z: %d\r\n", dataptr, receivedFIFO.Xvalue[dataptr], receivedFIFO.Yvalue[dataptr], receivedFIFO.Zvalue[dataptr]);
-
-		// Reread status register with FIFO content info
-		fiforeg[0] = MC36XX_REG_STATUS_1;
-		readstatus = i2cRead(MC3672_ADDR, fiforeg, 1);
-		//TODO check I2Cstatus return value
-		//PRINTF("FIFO STAT %d: 	%d\r\n", dataptr, fiforeg[0]);
-	}
+	// The driver bursts the samples it knows are there in one I2C
+	// transfer and decodes them straight into the FIFO block.
+	dataptr = mc36xx_read_fifo(receivedFIFO.Xvalue, receivedFIFO.Yvalue,
+								receivedFIFO.Zvalue, MAX_ACCEL_FIFO_SIZE);
 
 	// The buffer has been read, now we need to assign a timestamp.
 	// JW: we are just going to log the RTC time counter register
@@ -7567,6 +8179,7 @@ static int user_process_read_data(void)
 	// Set an ever-increasing sequence number
 	pUserData->ACCEL_read_count++;  // Increment FIFO read #
 	receivedFIFO.data_sequence = pUserData->ACCEL_read_count;
+	TRACE_EVENT(TRACE_EV_FIFO_DRAIN, dataptr, pUserData->ACCEL_read_count);
 	receivedFIFO.accelTime = assigned_timestamp;
 	receivedFIFO.accelTime_prev = pUserData->last_FIFO_read_time_ms;
 
@@ -7574,7 +8187,7 @@ static int user_process_read_data(void)
 	// this simplifies how timestamps are calculated and won't affect algorithm performance.
 	// 71429 is the number of usec for 14 Hz sampling, so we'll use 71 here.
 	if (pUserData->last_FIFO_read_time_ms == 0){
-		PRINTF ("THIS SHOULD NOT HAPPEN");
+		ULOG_E("THIS SHOULD NOT HAPPEN");
 	} // TODO: JW: Confirm this isn't called, then delete
 
 	//TODO: add sanity check to ensure time isn't negative, etc.  Probably should move this
@@ -7582,8 +8195,6 @@ static int user_process_read_data(void)
 
 	ms_since_last_read = assigned_timestamp - pUserData->last_FIFO_read_time_ms;
 	pUserData->last_FIFO_read_time_ms = assigned_timestamp;
-	PRINTF(" >>Milliseconds since last AXL read: %u\n",
-			ms_since_last_read);
 
 #if 0
 	//JW: The following chunk of code (and comments) is for time stamping.
@@ -7639,7 +8250,7 @@ static int user_process_read_data(void)
 //#endif
 
 //	PRINTF(" FIFO read sequence %d\n", pUserData->ACCEL_read_count);
-	PRINTF(" FIFO samples read: %d\n", dataptr);
+	ULOG_D(" FIFO samples read: %d, %u msec since last AXL read\n", dataptr, ms_since_last_read);
 
 #if 0
 	for(i=0; i<dataptr; i++)
@@ -7658,99 +8269,21 @@ static int user_process_read_data(void)
 	//    to get into a permanent fail loop if a previous
 	//    erase function failed.
 	// *****************************************************
+#ifdef AB_STAGE_WRITE_BACK
+	storestatus = AB_stage_block(&receivedFIFO, &erase_happened);
+#else
 	storestatus = user_process_write_to_flash(&receivedFIFO, &erase_happened);
+#endif
 	if(storestatus != TRUE)
 	{
-		APRINTF_E("\n***** UNABLE TO WRITE DATA TO FLASH *****\n");
-		APRINTF_E("\n***** FAULT COUNT: %d *****\n", pUserData->write_fault_count);
+		ULOG_E("\n***** UNABLE TO WRITE DATA TO FLASH *****\n");
+		ULOG_E("\n***** FAULT COUNT: %d *****\n", pUserData->write_fault_count);
 	}
 	if(erase_happened)
 	{
-		PRINTF(" Erase sector happened\n");
-	}
-
-	PRINTF(" Total FIFO blocks read since power on   : %d\n", pUserData->ACCEL_read_count);
-	if(pUserData->write_fault_count > 0)
-	{
-		PRINTF(" Total FIFO write failures since power on: %d\n", pUserData->write_fault_count);
-	}
-	if(pUserData->write_retry_count > 0)
-	{
-		PRINTF(" Total times a write retry was needed    : %d\n", pUserData->write_retry_count);
-	}
-	PRINTF(" Total missed accelerometer interrupts   : %d\n", pUserData->ACCEL_missed_interrupts);
-	max_display = AB_WRITE_MAX_ATTEMPTS - 1;
-	while (max_display > 0 &&
-			 pUserData->write_attempt_events[max_display] == 0)
-	{
-		max_display--;
-	}
-//	for (i=0; i<AB_WRITE_MAX_ATTEMPTS; i++)
-	if(max_display > 0)
-	{
-		for (i=0; i<=max_display; i++)
-		{
-			PRINTF(" Total times succeeded on try %d          : %d\n", (i+1), pUserData->write_attempt_events[i]);
-		}
-	}
-		PRINTF(" Total sector erase events               : %d\n", pUserData->erase_attempts);
-	if(pUserData->erase_retry_count > 0)
-	{
-		PRINTF(" Total times an erase retry was needed   : %d\n", pUserData->erase_retry_count);
-	}
-		max_display = AB_ERASE_MAX_ATTEMPTS - 1;
-	while (max_display > 0 &&
-			 pUserData->erase_attempt_events[max_display] == 0)
-	{
-		max_display--;
-	}
-//	for (i=0; i<AB_ERASE_MAX_ATTEMPTS; i++)
-	if(max_display > 0)
-	{
-		for (i=0; i<=max_display; i++)
-		{
-			PRINTF(" Total times succeeded on try %d          : %d\n", (i+1), pUserData->erase_attempt_events[i]);
-		}
-	}
-
-	PRINTF(" ----------------------------------------\n");
-	if(Stats_semaphore != NULL )
-	{
-		/* See if we can obtain the semaphore.  If the semaphore is not
-	        available wait 10 ticks to see if it becomes free. */
-		if( xSemaphoreTake( Stats_semaphore, ( TickType_t ) 10 ) == pdTRUE )
-		{
-			/* We were able to obtain the semaphore and can now access the
-	            shared resource. */
-
-				PRINTF(" Total MQTT connect attempts             : %d\n", pUserData->MQTT_stats_connect_attempts);
-				PRINTF(" Total MQTT connect fails                : %d\n", pUserData->MQTT_stats_connect_fails);
-				PRINTF(" Total MQTT packets sent                 : %d\n", pUserData->MQTT_stats_packets_sent);
-				PRINTF(" Total MQTT retry attempts               : %d\n", pUserData->MQTT_stats_retry_attempts);
-				PRINTF(" Total MQTT transmit success             : %d\n", pUserData->MQTT_stats_transmit_success);
-				PRINTF(" MQTT tx attempts since tx success       : %d\n", pUserData->MQTT_attempts_since_tx_success);
-				if(pUserData->MQTT_dropped_data_events > 0)
-				{
-					PRINTF(" Total times transmit buffer wrapped     : %d\n", pUserData->MQTT_dropped_data_events);
-				}
-
-			/* We have finished accessing the shared resource.  Release the
-	            semaphore. */
-			xSemaphoreGive( Stats_semaphore );
-		}
-		else
-		{
-			Printf("\n ***print stats: Unable to obtain Stats semaphore\n");
-		}
-	}
-	else
-	{
-		Printf("\n ***print stats: Stats semaphore not initialized!\n");
+		ULOG_D(" Erase sector happened\n");
 	}
 
-
-	PRINTF(" ----------------------------------------\n");
-
 #if 0 //JW: logging deprecated in 1.10.16
 	PRINTF(" Total log entries since power on        : %d\n", pUserData->total_log_entries);
 	if(pUserData->log_write_fault_count > 0)
@@ -7813,16 +8346,40 @@ static int user_process_read_data(void)
 	// accumulated since the last transmission
 	++pUserData->ACCEL_transmit_trigger;  // Increment FIFO stored
 
-	// Determine the mqtt transmit trigger
-	if (pUserData->MQTT_attempts_since_tx_success <= MQTT_TRANSMIT_TRIGGER_FIFO_BUFFERS_TEST) {
-		trigger_value = MQTT_TRANSMIT_TRIGGER_FIFO_BUFFERS_FAST;
-	} else {
-		trigger_value = MQTT_TRANSMIT_TRIGGER_FIFO_BUFFERS_SLOW;
+	// Ask the upload scheduler.  Nothing it looks at can make the
+	// interval shorter than min_fifos, so the transmit map is only
+	// counted once we're at least that far along.
+	schedule.fifos_since_upload = pUserData->ACCEL_transmit_trigger;
+	schedule.failed_attempts = pUserData->MQTT_attempts_since_tx_success;
+	schedule.last_connect_msec = pUserData->MQTT_last_connect_msec;
+	schedule.battery_cv = pUserData->MQTT_last_battery_cv;
+	schedule.pending_blocks = 1;
+	schedule.headroom_blocks = AB_FLASH_MAX_BLOCKS;
+	upload_due = pdFALSE;
+	if (schedule.fifos_since_upload >= pUserData->upload_config.min_fifos)
+	{
+		schedule.pending_blocks = count_AB_transmit_locations();
+		if (schedule.pending_blocks < 0)
+		{
+			// Couldn't look - assume there is something to send
+			schedule.pending_blocks = 1;
+		}
+		else
+		{
+#ifdef AB_STAGE_WRITE_BACK
+			// Staged blocks go to flash just before the upload starts
+			schedule.pending_blocks += pUserData->AB_stage.count - pUserData->AB_stage.flushed;
+#endif
+			schedule.headroom_blocks = AB_FLASH_MAX_BLOCKS - AB_TRANSMIT_SAFETY_GAP
+					- schedule.pending_blocks;
+		}
+		upload_due = upload_scheduler_due(&pUserData->upload_config, &schedule);
 	}
-	PRINTF(" ACCEL transmit trigger: %d of %d\n",
-			pUserData->ACCEL_transmit_trigger, trigger_value);
+	ULOG_D(" ACCEL transmit trigger: %d of %d\n",
+			pUserData->ACCEL_transmit_trigger,
+			upload_scheduler_interval(&pUserData->upload_config, &schedule));
 	//mqtt_started = pdFALSE;
-	if(pUserData->ACCEL_transmit_trigger >= trigger_value)
+	if(upload_due)
 	{
 
 		// increment MQTT attempt since tx success counter (we're going to try a transmission)
@@ -7833,7 +8390,7 @@ static int user_process_read_data(void)
 		{
 			if (!check_tx_progress())
 			{
-				PRINTF("\n Neuralert: [%s] MQTT task still active and not making progress. Stopping transmission.",
+				ULOG_W("\n Neuralert: [%s] MQTT task still active and not making progress. Stopping transmission.",
 					__func__);
 				user_terminate_transmit();
 			}
@@ -7841,9 +8398,21 @@ static int user_process_read_data(void)
 		}
 		else
 		{
+#ifdef AB_STAGE_WRITE_BACK
+			// Put everything we have in flash where the MQTT task can see it
+			if (AB_stage_flush(&erase_happened) != TRUE)
+			{
+				ULOG_E("\n***** UNABLE TO WRITE DATA TO FLASH *****\n");
+			}
+#endif
 			// Send the event that will start the MQTT transmit task
 			increment_MQTT_stat(&(pUserData->MQTT_stats_connect_attempts));
 			user_start_data_tx();
+
+			// Wi-Fi is coming up and we'll be awake for a while, so
+			// this is the time to catch up on the console
+			ulog_flush();
+			user_print_stats();
 		}
 
 		// Reset our transmit trigger counter
@@ -7943,12 +8512,12 @@ uint8_t ISR_reason;
 	// the main loop, so doing it here.
 	user_time64_msec_since_poweron(&(pUserData->last_FIFO_read_time_ms));
 
-	PRINTF("\n------>FIFO buffer emptied %d samples\n", i);
+	ULOG_D("\n------>FIFO buffer emptied %d samples\n", i);
 
 	//Enable RTC ISR - NJ 6/30/2022
 	// Note that in original SDK this interrupt was enabled earlier.
 	// See function config_ext_wakeup_resource();
-	PRINTF("\n------>%s enabling accelerometer interrupt\n", __func__); // FRSDEBUG
+	ULOG_D("\n------>%s enabling accelerometer interrupt\n", __func__); // FRSDEBUG
 
 	// Clear any accelerometer interrupt that might be pending
 	clear_intstate(&ISR_reason);
@@ -7962,10 +8531,38 @@ uint8_t ISR_reason;
 	printf_with_run_time("End AXL init");
 	#endif
 
-	PRINTF("\n Neuralert: [%s] Accelerometer initialized", __func__);
+	ULOG_I("\n Neuralert: [%s] Accelerometer initialized", __func__);
 
 	return;
 }
+
+/**
+ *******************************************************************************
+ * @brief Read the upload scheduler tunables from NVRAM
+ *
+ * Values that were never written come back as the defaults in
+ * user_nvram_cmd_table.c.  They are read once at power on and kept in
+ * retention memory, so a change takes effect at the next power cycle.
+ *******************************************************************************
+ */
+static void user_load_upload_config(uploadSchedulerConfig *config)
+{
+	upload_scheduler_defaults(config);
+
+	user_get_int(DA16X_CONF_INT_UPLOAD_MIN_FIFOS, &config->min_fifos);
+	user_get_int(DA16X_CONF_INT_UPLOAD_MAX_FIFOS, &config->max_fifos);
+	user_get_int(DA16X_CONF_INT_UPLOAD_BACKOFF, &config->backoff_after);
+	user_get_int(DA16X_CONF_INT_UPLOAD_SLOW_CONNECT, &config->slow_connect_msec);
+	user_get_int(DA16X_CONF_INT_UPLOAD_LOW_BATTERY, &config->low_battery_cv);
+	user_get_int(DA16X_CONF_INT_UPLOAD_URGENT_HEADROOM, &config->urgent_headroom);
+	upload_scheduler_sanitize(config);
+
+	ULOG_I_NOW("\n Neuralert: [%s] upload every %d-%d FIFOs, backoff after %d, slow connect %d msec,"
+			" low battery %d cV, urgent headroom %d blocks", __func__,
+			config->min_fifos, config->max_fifos, config->backoff_after,
+			config->slow_connect_msec, config->low_battery_cv, config->urgent_headroom);
+}
+
 /**
  *******************************************************************************
  * @brief Process for boot-up event
@@ -7980,8 +8577,9 @@ static int user_process_bootup_event(void)
 	int MACaddrtype = 0;
 	UCHAR time_string[20];
 
-	PRINTF("\n********** Neuralert bootup event ***********\n");
+	ULOG_I_NOW("\n********** Neuralert bootup event ***********\n");
 //	PRINTF("**Neuralert: %s\n", __func__); // FRSDEBUG
+	TRACE_EVENT(TRACE_EV_BOOT, 0, 0);
 
 #if defined(__RUNTIME_CALCULATION__) && defined(XIP_CACHE_BOOT)
 printf_with_run_time("Starting boot event process");
@@ -7999,10 +8597,10 @@ printf_with_run_time("Starting boot event process");
 // very soon after hardware initialization.  This is just to understand
 // what the RTC clock says that early in the process.
 	time64_string (time_string, &user_raw_launch_time_msec);
-	PRINTF("\n Neuralert: [%s] Bootup event: time snapshot from main() %s ms", __func__, time_string);
-	PRINTF("\n Software part number  :    %s", USER_SOFTWARE_PART_NUMBER_STRING);
-	PRINTF("\n Software version      :    %s", USER_VERSION_STRING);
-	PRINTF("\n Software build time   : %s %s", __DATE__ , __TIME__ );
+	ULOG_I_NOW("\n Neuralert: [%s] Bootup event: time snapshot from main() %s ms", __func__, time_string);
+	ULOG_I_NOW("\n Software part number  :    %s", USER_SOFTWARE_PART_NUMBER_STRING);
+	ULOG_I_NOW("\n Software version      :    %s", USER_VERSION_STRING);
+	ULOG_I_NOW("\n Software build time   : %s %s", __DATE__ , __TIME__ );
 
 	// Enable WIFI on initial bootup.  This allows us to find out if
 	// WIFI is available, if we want to.
@@ -8014,12 +8612,12 @@ printf_with_run_time("Starting boot event process");
 	ret = da16x_get_config_int(DA16X_CONF_INT_STA_PROF_DISABLED, &netProfileUse);
 	if (ret != CC_SUCCESS || netProfileUse == pdFALSE)
 	{
-		PRINTF("\n **** NETWORK AUTO-START IS ENABLED ****\n");
+		ULOG_I_NOW("\n **** NETWORK AUTO-START IS ENABLED ****\n");
 	}
 	else
 	{
-		PRINTF("\n **** NETWORK AUTO-START IS DISABLED ****\n");
-		PRINTF("     Attempting manual connection for bootup\n");
+		ULOG_I_NOW("\n **** NETWORK AUTO-START IS DISABLED ****\n");
+		ULOG_I_NOW("     Attempting manual connection for bootup\n");
 		/* Try to make connection manually. */
 		ret = user_process_connect_ap();
 	}
@@ -8037,9 +8635,9 @@ printf_with_run_time("Starting boot event process");
 	// a WIFI connection is available and whether we can connect to the broker.
 	// If we're unable to connect, then we should let the user know via
 	// the LEDs
-	PRINTF("\n...Delay for reset and stabilization...\n\n");
+	ULOG_D("\n...Delay for reset and stabilization...\n\n");
 	vTaskDelay(pdMS_TO_TICKS(10000));
-	PRINTF("\n...End stabilization delay...\n\n");
+	ULOG_D("\n...End stabilization delay...\n\n");
 	
 
 #if 0
@@ -8099,11 +8697,11 @@ printf_with_run_time("Starting boot event process");
 	MACaddr[3] = macstr[13];
 	MACaddr[4] = macstr[15];
 	MACaddr[5] = macstr[16];
-	PRINTF(" MAC address - %s (type: %d)\n", macstr, MACaddrtype);
+	ULOG_I_NOW(" MAC address - %s (type: %d)\n", macstr, MACaddrtype);
 	vTaskDelay(10); // Delay needed here to let the print statement finish before strcpy is called next.
 
 	strcpy (pUserData->Device_ID, MACaddr);
-	PRINTF(" Unique device ID: %s\n", MACaddr);
+	ULOG_I_NOW(" Unique device ID: %s\n", MACaddr);
 
 
 	// Just in case the autoconnect got turned on, make sure it is off
@@ -8111,10 +8709,23 @@ printf_with_run_time("Starting boot event process");
 
 	// Initialize the accelerometer buffer external flash
 	user_process_initialize_AB();
-	PRINTF("\n Neuralert: [%s] Accelerometer flash buffering initialized", __func__);
+	ULOG_I("\n Neuralert: [%s] Accelerometer flash buffering initialized", __func__);
 
 	pUserData->ACCEL_missed_interrupts = 0;
-	pUserData->ACCEL_transmit_trigger = MQTT_TRANSMIT_TRIGGER_FIFO_BUFFERS_FAST - MQTT_FIRST_TRANSMIT_TRIGGER_FIFO_BUFFERS;
+	user_load_upload_config(&pUserData->upload_config);
+	pUserData->ACCEL_transmit_trigger = 0;
+	if (pUserData->upload_config.min_fifos > MQTT_FIRST_TRANSMIT_TRIGGER_FIFO_BUFFERS)
+	{
+		pUserData->ACCEL_transmit_trigger = pUserData->upload_config.min_fifos
+				- MQTT_FIRST_TRANSMIT_TRIGGER_FIFO_BUFFERS;
+	}
+	pUserData->MQTT_last_connect_msec = 0;
+	pUserData->MQTT_last_battery_cv = 0;
+	memset(&pUserData->wifi_cache, 0, sizeof(pUserData->wifi_cache));
+	pUserData->wifi_fast_connect_active = pdFALSE;
+	pUserData->wifi_last_connect_msec = 0;
+	clear_MQTT_stat(&(pUserData->wifi_fast_connects));
+	clear_MQTT_stat(&(pUserData->wifi_fast_fallbacks));
 
 // JW: AXL calibration is deprecated
 #if 0
@@ -8182,14 +8793,12 @@ static UCHAR user_process_event(UINT32 event)
 {
 	__time64_t awake_time;
 	__time64_t current_msec_since_boot;
-	UCHAR time_string[20];
 
 	user_time64_msec_since_poweron(&current_msec_since_boot);
 	awake_time = current_msec_since_boot - pUserData->last_sleep_msec;
-	time64_string (time_string, &awake_time);
 	//			time64_string (time_string, &pUserData->last_sleep_msec);
 
-	PRINTF("%s: Event: [%d]\n", __func__, event);
+	ULOG_D("%s: Event: [%d]\n", __func__, event);
 
 
 	// Power-on boot
@@ -8211,7 +8820,7 @@ static UCHAR user_process_event(UINT32 event)
 
 	// Wakened from low-power sleep by accelerometer interrupt
 	if (event & USER_WAKEUP_BY_RTCKEY_EVENT) {
-		PRINTF("**%s: Wake by RTCKEY event\n", __func__); // FRSDEBUG
+		ULOG_D("**%s: Wake by RTCKEY event\n", __func__); // FRSDEBUG
 
 		isAccelerometerWakeup = pdTRUE;	// tell accelerometer why it's awake
 
@@ -8230,7 +8839,7 @@ static UCHAR user_process_event(UINT32 event)
 
 	// This event occurs when we detect a missed accelerometer interrupt (FIFO at threshold)
 	if (event & USER_MISSED_RTCKEY_EVENT) {
-		PRINTF("** %s RTCKEY in TIMER event\n", __func__); // FRSDEBUG
+		ULOG_D("** %s RTCKEY in TIMER event\n", __func__); // FRSDEBUG
 
 		// Accelerometer interrupt while we're transmitting
 		// Read the data
@@ -8242,7 +8851,7 @@ static UCHAR user_process_event(UINT32 event)
 
 	if (event & USER_SLEEP_READY_EVENT) {
 
-		PRINTF("  USER_SLEEP_READY_EVENT: processLists: 0x%x\n",processLists);
+		ULOG_D("  USER_SLEEP_READY_EVENT: processLists: 0x%x\n",processLists);
 
 #if defined(__RUNTIME_CALCULATION__) && defined(XIP_CACHE_BOOT)
 	printf_with_run_time("===USER SLEEP READY EVENT");
@@ -8250,12 +8859,13 @@ static UCHAR user_process_event(UINT32 event)
 
 		if (processLists == 0) {
 
-			PRINTF("Entering sleep1. msec since last sleep %s \n\n", time_string);
+			ULOG_D("Entering sleep1. msec since last sleep %u \n\n", (uint32_t)awake_time);
 			vTaskDelay(3);
 
 			// Get relative time since power on from the RTC time counter register
 			user_time64_msec_since_poweron(&pUserData->last_sleep_msec);
 			//			PRINTF("\n*** Milliseconds since boot now: %u\n", nowrawmsec);
+			TRACE_EVENT(TRACE_EV_SLEEP, 0, awake_time);
 
 			// t\Turn off LEDs to save power while doing sleep/wake cycle
 			// Note the expectation is that only alerts will show
@@ -8270,7 +8880,7 @@ static UCHAR user_process_event(UINT32 event)
 		{
 			user_time64_msec_since_poweron(&current_msec_since_boot);
 			awake_time = current_msec_since_boot - pUserData->last_sleep_msec;
-			PRINTF("%s: Unable to sleep. Awake %u msec\n", __func__, awake_time);
+			ULOG_W("%s: Unable to sleep. Awake %u msec\n", __func__, (uint32_t)awake_time);
 		}
 	}
 
@@ -8305,7 +8915,7 @@ void neuralert_mqtt_msg_cb(const char *buf, int len, const char *topic)
     DA16X_UNUSED_ARG(buf);
     DA16X_UNUSED_ARG(topic);
 
-    PRINTF("\n**Neuralert: %s \n", __func__); // FRSDEBUG
+    ULOG_D("\n**Neuralert: %s \n", __func__); // FRSDEBUG
     //BaseType_t ret;
 
     //PRINTF(CYAN_COLOR "[MQTT_SAMPLE] Msg Recv: Topic=%s, Msg=%s \n" CLEAR_COLOR, topic, buf);
@@ -8325,20 +8935,20 @@ void neuralert_mqtt_msg_cb(const char *buf, int len, const char *topic)
 
 void neuralert_mqtt_pub_cb(int mid)
 {
-	PRINTF("\n**Neuralert: %s \n", __func__); // FRSDEBUG
+	ULOG_D("\n**Neuralert: %s \n", __func__); // FRSDEBUG
 	DA16X_UNUSED_ARG(mid);
     //xEventGroupSetBits(my_app_event_group, EVT_PUB_COMPLETE);
 }
 
 void neuralert_mqtt_conn_cb(void)
 {
-	PRINTF("\n**Neuralert: %s \n", __func__); // FRSDEBUG
+	ULOG_D("\n**Neuralert: %s \n", __func__); // FRSDEBUG
     //topic_count = 0;
 }
 
 void neuralert_mqtt_sub_cb(void)
 {
-	PRINTF("\n**Neuralert: %s \n", __func__); // FRSDEBUG
+	ULOG_D("\n**Neuralert: %s \n", __func__); // FRSDEBUG
 	//topic_count++;
     //if (dpm_mode_is_enabled() && topic_count == mqtt_client_get_topic_count()) {
     //    my_app_send_to_q(NAME_JOB_MQTT_PERIODIC_PUB_RTC_REGI, NULL, APP_MSG_REGI_RTC, NULL);
@@ -8347,6 +8957,141 @@ void neuralert_mqtt_sub_cb(void)
 }
 
 
+/**
+ ****************************************************************************************
+ * @brief Retention memory size of UserDataBuffer with the 1.10.17 transmit map
+ *        (same fields, but AB_LEGACY_TRANSMIT_MAP_SIZE words of map)
+ ****************************************************************************************
+ */
+static unsigned int user_rtm_legacy_size(void)
+{
+	return USER_RTM_ALIGN(offsetof(UserDataBuffer, AB_transmit_map)
+			+ (AB_LEGACY_TRANSMIT_MAP_SIZE * sizeof(_AB_transmit_map_t))
+			+ USER_RTM_LOG_FIELDS_SIZE);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Convert user data left by 1.10.17 and earlier to the dense
+ *        transmit map layout
+ *
+ * The old map used 4 bits per word, so it was eight times larger and
+ * everything after it sat at a different offset.  A device updated over
+ * the air wakes with that layout in retention memory and would otherwise
+ * lose track of the data it hasn't sent yet.
+ *
+ * The fields before the map are copied unchanged, each pending page is
+ * moved to the dense map (see ab_map_convert_legacy()) and the fields
+ * after the map are copied from their old offset.
+ *
+ * That firmware stored one block per page, in the first slot, so the AB
+ * positions are scaled to count blocks.  The erase-ahead position didn't
+ * exist yet and is marked as unknown.  Its blocks have no CRC, so the
+ * data sequence the next FIFO read will get is recorded: every block
+ * below it may be one of those.
+ *
+ * @param[out] converted	zeroed buffer to receive the converted data
+ * @param[in]  legacy		the old data
+ *
+ * @return number of pages that were waiting to be sent
+ ****************************************************************************************
+ */
+static int user_rtm_convert_transmit_map(UserDataBuffer *converted, const UCHAR *legacy)
+{
+	size_t tail_offset;
+	int pending;
+
+	// Everything up to the map is unchanged, apart from the
+	// positions counting pages rather than blocks
+	memcpy(converted, legacy, offsetof(UserDataBuffer, AB_transmit_map));
+	converted->next_AB_write_position *= AB_BLOCKS_PER_PAGE;
+	if (converted->next_AB_transmit_position != INVALID_AB_ADDRESS)
+	{
+		converted->next_AB_transmit_position *= AB_BLOCKS_PER_PAGE;
+	}
+
+	pending = ab_map_convert_legacy(converted->AB_transmit_map,
+			(const _AB_transmit_map_t *)(legacy + offsetof(UserDataBuffer, AB_transmit_map)));
+
+	// Everything after the map moved down
+	tail_offset = offsetof(UserDataBuffer, AB_transmit_map)
+					+ (AB_LEGACY_TRANSMIT_MAP_SIZE * sizeof(_AB_transmit_map_t));
+	memcpy(&converted->user_holding_log_initialized, legacy + tail_offset,
+			USER_RTM_LOG_FIELDS_SIZE);
+	converted->next_AB_erase_position = INVALID_AB_ADDRESS;
+	converted->AB_precrc_sequence = converted->ACCEL_read_count + 1;
+
+	return pending;
+}
+
+/**
+ ****************************************************************************************
+ * @brief Take over the user data left by firmware that allocated retention
+ *        memory by name
+ *
+ * user_retmem_init() has already moved it into the USER_RETMEM_DATA
+ * region, unconverted.  Data with the current layout is kept as it is and
+ * data with the 1.10.17 layout is converted; anything else is dropped.
+ *
+ * @return pdTRUE if pUserData now points to the data,
+ *         pdFALSE if the caller must start over with a zeroed buffer
+ ****************************************************************************************
+ */
+static int user_rtm_take_over_legacy(void)
+{
+	UserDataBuffer *converted;
+	UCHAR *legacy;
+	unsigned int size;
+	int pending = 0;
+
+	size = user_retmem_legacy_get(USER_RETMEM_DATA, &legacy);
+	if (size == 0)
+	{
+		return pdFALSE;
+	}
+	if ((USER_RTM_ALIGN(size) != USER_RTM_ALIGN(sizeof(UserDataBuffer)))
+		&& (USER_RTM_ALIGN(size) != user_rtm_legacy_size()))
+	{
+		ULOG_W("\n**Neuralert: %s retention memory size %d, expected %d\n",
+				__func__, size, sizeof(UserDataBuffer));
+		return pdFALSE;
+	}
+
+	// The region is cleared when it is attached, so work on a copy
+	converted = (UserDataBuffer *)pvPortMalloc(sizeof(UserDataBuffer));
+	if (converted == NULL)
+	{
+		ULOG_E("\n Neuralert [%s]: no memory to convert retention memory\n", __func__);
+		return pdFALSE;
+	}
+	memset(converted, 0, sizeof(UserDataBuffer));
+
+	if (USER_RTM_ALIGN(size) == USER_RTM_ALIGN(sizeof(UserDataBuffer)))
+	{
+		memcpy(converted, legacy, (size < sizeof(UserDataBuffer)) ? size : sizeof(UserDataBuffer));
+	}
+	else
+	{
+		pending = user_rtm_convert_transmit_map(converted, legacy);
+	}
+
+	pUserData = (UserDataBuffer *)user_retmem_attach(USER_RETMEM_DATA, sizeof(UserDataBuffer), NULL);
+	if (pUserData == NULL)
+	{
+		ULOG_E("\n Neuralert [%s]: No retention memory for the user data\n", __func__);
+		vPortFree(converted);
+		return pdFALSE;
+	}
+	memcpy(pUserData, converted, sizeof(UserDataBuffer));
+	vPortFree(converted);
+
+	ULOG_I("\n**Neuralert: %s took over retention memory, %d pages converted\n",
+			__func__, pending);
+
+	return pdTRUE;
+}
+
+
 /**
  ****************************************************************************************
  * @brief Initialize the user task
@@ -8372,30 +9117,35 @@ static void user_init(void)
  	pResultStr = read_nvram_string(NVR_KEY_SSID_0);
 	if (runMode == SYSMODE_STA_ONLY && strlen(pResultStr))
 	{
-		int result = 0;
 		UINT32 wakeUpMode;
 
 		wakeUpMode = da16x_boot_get_wakeupmode();
-		PRINTF("%s: Boot type: 0x%X (%d)\n", __func__, wakeUpMode, wakeUpMode);
 
 #ifdef CFG_USE_RETMEM_WITHOUT_DPM
-		/* Create the user retention memory and Initialize. */
-		result = user_retmmem_get(USER_RTM_DATA_TAG, (UCHAR **)&pUserData);
-		if (result == 0) {
-			PRINTF("\n**Neuralert: %s allocating retention memory\n", __func__); // FRSDEBUG
-			// created a memory for the user data
-			result = user_retmmem_allocate(USER_RTM_DATA_TAG, (void**)&pUserData, sizeof(UserDataBuffer));
-			if (result == 0) {
-				memset(pUserData, 0, sizeof(UserDataBuffer));
-			} else {
-				PRINTF("\n Neuralert [%s]: Failed to allocate retention memory", __func__);
+		/* Find the user data in retention memory - a fixed offset */
+		pUserData = (UserDataBuffer *)user_retmem_find(USER_RETMEM_DATA, sizeof(UserDataBuffer));
+		if ((pUserData == NULL) && (user_rtm_take_over_legacy() != pdTRUE))
+		{
+			// Power-on reset, or left by firmware with a different layout:
+			// the region is started over, zeroed
+			ULOG_D("\n**Neuralert: %s initializing retention memory\n", __func__); // FRSDEBUG
+			pUserData = (UserDataBuffer *)user_retmem_attach(USER_RETMEM_DATA, sizeof(UserDataBuffer), NULL);
+			if (pUserData == NULL)
+			{
+				ULOG_E("\n Neuralert [%s]: No retention memory for the user data", __func__);
 			}
 		}
-		else
+
+		// The transmit map summary isn't retained through sleep
+		if (pUserData != NULL)
 		{
-//			PRINTF("\n**Neuralert: %s retention memory retrieved\n", __func__); // FRSDEBUG
-//			PRINTF("** Next MQTT message number: %d\n", pUserData->MQTT_message_number);
+			ab_map_rebuild(pUserData->AB_transmit_map);
 		}
+
+		trace_init();
+		TRACE_EVENT(TRACE_EV_WAKE, wakeUpMode, 0);
+		ulog_init();
+		ULOG_D("%s: Boot type: 0x%X (%d)\n", __func__, wakeUpMode, wakeUpMode);
 #endif
 
 		/*
@@ -8405,7 +9155,7 @@ static void user_init(void)
 		AB_semaphore = xSemaphoreCreateMutex();
 		if (AB_semaphore == NULL)
 		{
-			PRINTF("\n Neuralert: [%s] Error creating AB semaphore", __func__);
+			ULOG_E("\n Neuralert: [%s] Error creating AB semaphore", __func__);
 		}
 		else
 		{
@@ -8419,7 +9169,7 @@ static void user_init(void)
 		Flash_semaphore = xSemaphoreCreateMutex();
 		if (Flash_semaphore == NULL)
 		{
-			PRINTF("\n Neuralert: [%s] Error creating Flash semaphore", __func__);
+			ULOG_E("\n Neuralert: [%s] Error creating Flash semaphore", __func__);
 		}
 		else
 		{
@@ -8450,13 +9200,36 @@ static void user_init(void)
 		Stats_semaphore = xSemaphoreCreateMutex();
 		if (Stats_semaphore == NULL)
 		{
-			PRINTF("\n Neuralert: [%s] Error creating stats semaphore", __func__);
+			ULOG_E("\n Neuralert: [%s] Error creating stats semaphore", __func__);
 		}
 		else
 		{
 //			PRINTF("\n****** stats semaphore created *****\n");
 		}
 
+		/*
+		 * Create the queue that carries PUBACK message IDs from the MQTT
+		 * client's publish callback to the transmission task
+		 */
+		MQTT_puback_queue = xQueueCreate(MQTT_PUBACK_QUEUE_LENGTH, sizeof(int));
+		if (MQTT_puback_queue == NULL)
+		{
+			ULOG_E("\n Neuralert: [%s] Error creating PUBACK queue", __func__);
+		}
+		mqtt_publisher_init(&MQTT_publisher, MQTT_puback_queue,
+				mqtt_packet_delivered, MQTT_QOS_TIMEOUT_MS);
+
+		/*
+		 * Create the queues that pass packet buffers between the packet
+		 * reader task and the transmission task
+		 */
+		packet_free_queue = xQueueCreate(PACKET_BUFFERS, sizeof(int));
+		packet_ready_queue = xQueueCreate(PACKET_BUFFERS, sizeof(int));
+		if ((packet_free_queue == NULL) || (packet_ready_queue == NULL))
+		{
+			ULOG_E("\n Neuralert: [%s] Error creating packet buffer queues", __func__);
+		}
+
 
 		// Initialize the FIFO interrupt cycle statistics
 		pUserData->FIFO_reads_this_power_cycle = 0;
@@ -8654,6 +9427,8 @@ void tcp_client_sleep2_sample(void *param)
 	int MACaddrtype;
 	float adcDataFloat;
 	int sys_wdog_id = -1;
+	UINT32 wakeUpMode;
+	int woke_from_sleep;
 
 	//sys_wdog_id = da16x_sys_watchdog_register(pdFALSE);
 
@@ -8666,12 +9441,23 @@ void tcp_client_sleep2_sample(void *param)
 	/* Get our task handle */
 	xTask = xTaskGetCurrentTaskHandle();
 
+	/*
+	 * This task starts on every wake.  The banner only changes when the
+	 * firmware does, so only print it when we weren't woken from sleep
+	 * by the accelerometer.
+	 */
+	wakeUpMode = da16x_boot_get_wakeupmode();
+	woke_from_sleep = (wakeUpMode == WAKEUP_SOURCE_EXT_SIGNAL)
+					  || (wakeUpMode == WAKEUP_EXT_SIG_WITH_RETENTION);
 
-	PRINTF("\n\n===========>Starting tcp_client_sleep2_sample\r\n");
-	PRINTF(" Software part number  :    %s\n", USER_SOFTWARE_PART_NUMBER_STRING);
-	PRINTF(" Software version      :    %s\n", USER_VERSION_STRING);
-	PRINTF(" Software build time   : %s %s\n", __DATE__ , __TIME__ );
-	PRINTF(" User data size        : %u bytes\n", sizeof(UserDataBuffer));
+	if (!woke_from_sleep)
+	{
+		ULOG_I_NOW("\n\n===========>Starting tcp_client_sleep2_sample\r\n");
+		ULOG_I_NOW(" Software part number  :    %s\n", USER_SOFTWARE_PART_NUMBER_STRING);
+		ULOG_I_NOW(" Software version      :    %s\n", USER_VERSION_STRING);
+		ULOG_I_NOW(" Software build time   : %s %s\n", __DATE__ , __TIME__ );
+		ULOG_I_NOW(" User data size        : %u bytes\n", sizeof(UserDataBuffer));
+	}
 
 	/*
 	 * Start the LED timer
@@ -8692,11 +9478,11 @@ void tcp_client_sleep2_sample(void *param)
 	 */
 
 	user_get_int(DA16X_CONF_INT_RUN_FLAG, &storedRunFlag);
-	PRINTF("===========>NVRam runFlag: [%i]\r\n",storedRunFlag);
+	ULOG_D("===========>NVRam runFlag: [%i]\r\n",storedRunFlag);
 
 	if (storedRunFlag < 0) {
 		// This *should* be impossible, due to the additional logic for retrieving the config
-		PRINTF("Run flag set to impossible value\n");
+		ULOG_W("Run flag set to impossible value\n");
 	} else {
 		// We have made sure the value isn't negative, so copy it over to the global flag
 		runFlag = storedRunFlag;
@@ -8710,7 +9496,7 @@ void tcp_client_sleep2_sample(void *param)
 
 		// Allow time for console to settle
 		vTaskDelay(pdMS_TO_TICKS(100));
-		PRINTF("\n\n******** Waiting for run flag to be set ********\n\n"); 	}
+		ULOG_I_NOW("\n\n******** Waiting for run flag to be set ********\n\n"); 	}
 		while (TRUE)
 		{
 			if(runFlag )
@@ -8737,13 +9523,17 @@ void tcp_client_sleep2_sample(void *param)
 	 * set up, see if we know our device ID yet.  (Happens during
 	 * the initial boot event)
 	 */
-	if (strlen(pUserData->Device_ID) > 0)
+	if (woke_from_sleep)
 	{
-		PRINTF(" Unique device ID      : %s\n", pUserData->Device_ID);
+		// Already reported when we powered on
+	}
+	else if (strlen(pUserData->Device_ID) > 0)
+	{
+		ULOG_I_NOW(" Unique device ID      : %s\n", pUserData->Device_ID);
 	}
 	else
 	{
-		PRINTF(" Unique device ID not acquired yet\n");
+		ULOG_I_NOW(" Unique device ID not acquired yet\n");
 	}
 
 
@@ -8755,8 +9545,10 @@ void tcp_client_sleep2_sample(void *param)
 	 *
 	 */
 	adcDataFloat = get_battery_voltage();
-	PRINTF(" User data size        : %u bytes\n", sizeof(UserDataBuffer));
-    PRINTF(" Battery reading       : %d\n",(uint16_t)(adcDataFloat * 100));
+	if (!woke_from_sleep)
+	{
+		ULOG_I_NOW(" Battery reading       : %d\n",(uint16_t)(adcDataFloat * 100));
+	}
 
     // JW: we do not want the wrist bands to make a decision to shut down.
     // They will die as they are exhausted, but not before. This might lead to
@@ -8790,7 +9582,7 @@ void tcp_client_sleep2_sample(void *param)
 	/*
 	 * Event loop - this is the main engine of the application
 	 */
-	PRINTF("==Event loop:[");
+	ULOG_D_NOW("==Event loop:[");
 	while (quit == FALSE)
 	{
 		/* Block and wait for a notification.
@@ -8807,12 +9599,12 @@ void tcp_client_sleep2_sample(void *param)
 //								portMAX_DELAY);     /* Block indefinitely. */
 
 		//PRINTF("%s: NotifiedValue: 0x%X\n", __func__, ulNotifiedValue);
-		PRINTF(".");   // Show [.......] for wait loop
+		ULOG_D_NOW(".");   // Show [.......] for wait loop
 		// See if we've been notified of an event or just timed out
 		if (ulNotifiedValue != 0)
 		{
 			/* Process events */
-			PRINTF("]\n");
+			ULOG_D_NOW("]\n");
 
 			// If we've received a terminate downlink command, exit
 			// the message processing loop and effectively shut down.
@@ -8833,8 +9625,7 @@ void tcp_client_sleep2_sample(void *param)
 				// in RTC ticks
 				user_AXL_poll_detect_RTC_clock = RTC_GET_COUNTER();
 				pUserData->ACCEL_missed_interrupts++;
-				PRINTF("]\n");
-				PRINTF("%s: AXL FIFO at threshold! [%x]\n", __func__, fiforeg[0]);
+				ULOG_W("%s: AXL FIFO at threshold! [%x]\n", __func__, fiforeg[0]);
 				if (xTask) {
 					xTaskNotifyIndexed(xTask, 0, USER_MISSED_RTCKEY_EVENT, eSetBits);
 					isAccelerometerTimeout = pdTRUE;	// remember why we are reading accelerometer				}
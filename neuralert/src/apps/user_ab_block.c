@@ -0,0 +1,100 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_ab_block.c
+ *
+ * @brief Checks of the accelerometer blocks stored in the AB flash
+ *
+ * Every block carries a CRC-32, set when it is written, which readers use
+ * to tell a good block from an erased page or a corrupted read instead of
+ * reading every write back.
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "user_crc32.h"
+#include "user_ab_block.h"
+
+
+/**
+ *******************************************************************************
+ * @brief CRC-32 of a block as stored in flash
+ *******************************************************************************
+ */
+uint32_t ab_block_crc(const accelBufferStruct *block)
+{
+	uint32_t crc;
+
+	crc = crc32_update(0, (const UCHAR *)&block->data_sequence,
+			sizeof(block->data_sequence));
+	crc = crc32_update(crc, (const UCHAR *)&block->accelTime,
+			(const UCHAR *)&block->Zvalue[MAX_ACCEL_FIFO_SIZE]
+			- (const UCHAR *)&block->accelTime);
+
+	return crc;
+}
+
+/*
+ * What the readers checked before blocks had a CRC (num_samples > 0),
+ * plus what else a real FIFO read always has.  Only blocks from before
+ * the update qualify, so a corrupted new block is still rejected.
+ */
+static int ab_block_plausible(const accelBufferStruct *block, ULONG precrc_sequence)
+{
+	return ((block->data_sequence != 0)
+			&& (block->data_sequence < precrc_sequence)
+			&& (block->accelTime > 0)
+			&& (block->accelTime_prev <= block->accelTime)) ? pdTRUE : pdFALSE;
+}
+
+/**
+ *******************************************************************************
+ * @brief pdTRUE if a block read from flash is intact
+ *******************************************************************************
+ */
+int ab_block_valid(const accelBufferStruct *block, ULONG precrc_sequence)
+{
+	if ((block->crc != ab_block_crc(block))
+		&& !ab_block_plausible(block, precrc_sequence))
+	{
+		return pdFALSE;
+	}
+
+	// Can't happen for a block we wrote, but it's cheap insurance
+	// for everything downstream that indexes by num_samples
+	return ((block->num_samples > 0)
+			&& (block->num_samples <= MAX_ACCEL_FIFO_SIZE)) ? pdTRUE : pdFALSE;
+}
+
+/* EOF */
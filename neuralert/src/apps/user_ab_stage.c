@@ -0,0 +1,219 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_ab_stage.c
+ *
+ * @brief Write-back staging of FIFO buffers in retention memory
+ *
+ * Each accelerometer wake reads one FIFO buffer.  Instead of powering up
+ * the flash to write it, the buffer is kept in retention memory and the
+ * stage is written out in one SPI session when it reaches the end of the
+ * sector being written, when it is full, or just before a transmission.
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "user_log.h"
+#include "user_ab_stage.h"
+
+/**
+ *******************************************************************************
+ * @brief Write the staged FIFO buffers to flash
+ *
+ * The flush is journaled in retention memory: stage->flushing is set
+ * before the first write and stage->flushed counts the buffers written.
+ * If we are reset part way through, or a write fails, the next call
+ * starts again at the first buffer that wasn't written.  A reset between
+ * a buffer's write and the journal update can store that buffer twice,
+ * but never loses it.
+ *
+ * A write that fails leaves the flash write location where it was, which
+ * is how it is told apart from a write that went through but whose erase
+ * of the next sector failed.  The buffers of the latter are in flash, so
+ * the flush carries on.
+ *******************************************************************************
+ */
+int ab_stage_flush(abStage *stage, const abStageFlash *flash, int *did_an_erase)
+{
+	HANDLE SPI;
+	int write_status = TRUE;
+	int erase_happened;
+	int write_index;
+	int num_blocks;
+	int stored;
+
+	*did_an_erase = pdFALSE;
+
+	if (stage->count == 0)
+	{
+		stage->flushing = pdFALSE;
+		return TRUE;
+	}
+
+	if (!stage->flushing)
+	{
+		stage->flushed = 0;
+		stage->flushing = pdTRUE;
+	}
+	else
+	{
+		ULOG_W(" Finishing earlier flash flush at buffer %d of %d\n",
+				stage->flushed, stage->count);
+		stage->replay_count++;
+	}
+
+	SPI = flash->open();
+	if (SPI == NULL)
+	{
+		// Leave the journal as it is and try again on the next wake
+		ULOG_E("\nNeuralert: [%s] MAJOR SPI ERROR: Unable to open SPI bus handle", __func__);
+		return FALSE;
+	}
+
+	while (stage->flushed < stage->count)
+	{
+		write_index = flash->write_location();
+		if (write_index < 0)
+		{
+			ULOG_E("\n Neuralert [%s] Unable to get AB write location", __func__);
+			write_status = FALSE;
+			break;
+		}
+
+		// As many buffers as fit in the rest of the page being written
+		num_blocks = AB_BLOCKS_PER_PAGE - (write_index % AB_BLOCKS_PER_PAGE);
+		if (num_blocks > (stage->count - stage->flushed))
+		{
+			num_blocks = stage->count - stage->flushed;
+		}
+
+		stored = flash->store(SPI, &stage->blocks[stage->flushed], num_blocks, &erase_happened);
+		if (erase_happened)
+		{
+			*did_an_erase = pdTRUE;
+		}
+		if (flash->write_location() == write_index)
+		{
+			// Nothing was written - leave the journal as it is and try
+			// again on the next wake
+			ULOG_W("\n Neuralert [%s] Flush stopped at buffer %d of %d", __func__,
+					stage->flushed, stage->count);
+			write_status = FALSE;
+			break;
+		}
+		if (stored != TRUE)
+		{
+			write_status = FALSE;
+		}
+		stage->flushed += num_blocks;
+	}
+
+	flash->close(SPI);
+
+	if (stage->flushed < stage->count)
+	{
+		return FALSE;
+	}
+
+	stage->count = 0;
+	stage->flushed = 0;
+	stage->flushing = pdFALSE;
+	stage->flush_count++;
+
+	return write_status;
+}
+
+/**
+ *******************************************************************************
+ * @brief Stage one FIFO buffer
+ *
+ * A flush left unfinished by an earlier wake is finished first, so the
+ * buffers stay in order.  If the flash still can't be written, the new
+ * buffer is dropped rather than staged behind the unfinished flush.
+ *******************************************************************************
+ */
+int ab_stage_block(abStage *stage, const abStageFlash *flash,
+		const accelBufferStruct *fifo_data, int *did_an_erase)
+{
+	int write_index;
+	int write_status = TRUE;
+	int erase_happened;
+
+	*did_an_erase = pdFALSE;
+
+	if (stage->flushing)
+	{
+		write_status = ab_stage_flush(stage, flash, &erase_happened);
+		if (erase_happened)
+		{
+			*did_an_erase = pdTRUE;
+		}
+		if (stage->flushing)
+		{
+			// Still can't write the flash - this buffer is lost
+			return FALSE;
+		}
+	}
+
+	write_index = flash->write_location();
+	if (write_index < 0)
+	{
+		ULOG_E("\n Neuralert [%s] Unable to get AB write location", __func__);
+		return FALSE;
+	}
+
+	memcpy(&stage->blocks[stage->count], fifo_data, sizeof(accelBufferStruct));
+	stage->count++;
+	ULOG_D(" Staged FIFO buffer %d for flash location %d\n",
+			stage->count, write_index + stage->count - 1);
+
+	// Flush once the stage reaches the end of the sector (whose pages
+	// were erased when the previous sector was filled)
+	if ((((write_index + stage->count) % AB_BLOCKS_PER_SECTOR) == 0)
+		|| (stage->count >= AB_STAGE_MAX_BLOCKS))
+	{
+		if (ab_stage_flush(stage, flash, &erase_happened) != TRUE)
+		{
+			write_status = FALSE;
+		}
+		if (erase_happened)
+		{
+			*did_an_erase = pdTRUE;
+		}
+	}
+
+	return write_status;
+}
+
+/* EOF */
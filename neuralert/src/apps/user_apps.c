@@ -77,6 +77,7 @@ static void user_wifi_disconn(void *arg);
 extern void	tcp_client_sleep2_sample(void *param);
 extern void user_start_MQTT_client();
 extern void user_terminate_transmit();
+extern void user_wifi_fast_connect_fallback(void);
 extern UINT8 check_mqtt_block();
 
 /******************************************************************************
@@ -177,6 +178,9 @@ static void user_wifi_conn_fail(void *arg)
             xEventGroupClearBits(evt_grp_wifi_conn_notify, WIFI_CONN_FAIL_STA);
 
             PRINTF("\n### User Call-back : Failed to connect Wi-Fi ( reason_code = %d ) ...\n", wifi_conn_fail_reason);
+
+            // If we were trying the cached access point, scan for another
+            user_wifi_fast_connect_fallback();
        } else if (wifi_conn_ev_bits & WIFI_CONN_FAIL_SOFTAP) {
             xEventGroupClearBits(evt_grp_wifi_conn_notify, WIFI_CONN_FAIL_SOFTAP);
 
@@ -0,0 +1,238 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_block_codec.c
+ *
+ * @brief Lossless compression of the accelerometer samples in a FIFO block
+ *
+ * Neighbouring samples from a wrist worn accelerometer are strongly
+ * correlated, so the differences between them are usually much smaller
+ * than the full 8-bit range.  See user_block_codec.h for the layout.
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "user_block_codec.h"
+
+
+/*
+ * Encode one axis.  The first pass zigzags the deltas and ORs them
+ * together to find the width, the second packs them.
+ */
+static int block_codec_encode_axis(const int8_t *value, int num_samples, UCHAR *out, int out_max)
+{
+	UCHAR zigzag[MAX_ACCEL_FIFO_SIZE];
+	UCHAR all_bits = 0;
+	int8_t delta;
+	int width;
+	int len;
+	int i;
+	ULONG bits;
+	int num_bits;
+
+	for (i = 1; i < num_samples; i++)
+	{
+		delta = (int8_t)(value[i] - value[i-1]);
+		zigzag[i] = (UCHAR)(((UCHAR)delta << 1) ^ (UCHAR)(delta >> 7));
+		all_bits |= zigzag[i];
+	}
+
+	width = 0;
+	while (all_bits != 0)
+	{
+		width++;
+		all_bits >>= 1;
+	}
+
+	len = 2 + ((((num_samples - 1) * width) + 7) / 8);
+	if (len > out_max)
+	{
+		return -1;
+	}
+
+	out[0] = (UCHAR)value[0];
+	out[1] = (UCHAR)width;
+	len = 2;
+
+	bits = 0;
+	num_bits = 0;
+	for (i = 1; i < num_samples; i++)
+	{
+		bits |= (ULONG)zigzag[i] << num_bits;
+		num_bits += width;
+		if (num_bits >= 8)
+		{
+			out[len++] = (UCHAR)bits;
+			bits >>= 8;
+			num_bits -= 8;
+		}
+	}
+	if (num_bits > 0)
+	{
+		out[len++] = (UCHAR)bits;
+	}
+
+	return len;
+}
+
+static int block_codec_decode_axis(const UCHAR *in, int in_len, int num_samples, int8_t *value)
+{
+	int width;
+	int len;
+	int i;
+	ULONG bits;
+	int num_bits;
+	UCHAR zigzag;
+	UCHAR mask;
+
+	if (in_len < 2)
+	{
+		return -1;
+	}
+	width = in[1];
+	if (width > BLOCK_CODEC_MAX_WIDTH)
+	{
+		return -1;
+	}
+	len = 2 + ((((num_samples - 1) * width) + 7) / 8);
+	if (len > in_len)
+	{
+		return -1;
+	}
+
+	mask = (UCHAR)((1 << width) - 1);
+	value[0] = (int8_t)in[0];
+	len = 2;
+
+	bits = 0;
+	num_bits = 0;
+	for (i = 1; i < num_samples; i++)
+	{
+		if (num_bits < width)
+		{
+			bits |= (ULONG)in[len++] << num_bits;
+			num_bits += 8;
+		}
+		zigzag = (UCHAR)(bits & mask);
+		bits >>= width;
+		num_bits -= width;
+
+		value[i] = (int8_t)(value[i-1] + (int8_t)((zigzag >> 1) ^ (UCHAR)(-(zigzag & 1))));
+	}
+
+	return len;
+}
+
+
+/**
+ *******************************************************************************
+ * @brief Encode the X, Y and Z samples of a FIFO block
+ *******************************************************************************
+ */
+int block_codec_encode(const accelBufferStruct *block, UCHAR *out, int out_max)
+{
+	int num_samples = block->num_samples;
+	int len = 0;
+	int axis_len;
+
+	if ((num_samples < 1) || (num_samples > MAX_ACCEL_FIFO_SIZE))
+	{
+		return -1;
+	}
+
+	axis_len = block_codec_encode_axis(block->Xvalue, num_samples, &out[len], out_max - len);
+	if (axis_len < 0)
+	{
+		return -1;
+	}
+	len += axis_len;
+
+	axis_len = block_codec_encode_axis(block->Yvalue, num_samples, &out[len], out_max - len);
+	if (axis_len < 0)
+	{
+		return -1;
+	}
+	len += axis_len;
+
+	axis_len = block_codec_encode_axis(block->Zvalue, num_samples, &out[len], out_max - len);
+	if (axis_len < 0)
+	{
+		return -1;
+	}
+	len += axis_len;
+
+	return len;
+}
+
+/**
+ *******************************************************************************
+ * @brief Decode the X, Y and Z samples written by block_codec_encode()
+ *******************************************************************************
+ */
+int block_codec_decode(const UCHAR *in, int in_len, int num_samples,
+					   int8_t *x, int8_t *y, int8_t *z)
+{
+	int len = 0;
+	int axis_len;
+
+	if ((num_samples < 1) || (num_samples > MAX_ACCEL_FIFO_SIZE))
+	{
+		return -1;
+	}
+
+	axis_len = block_codec_decode_axis(&in[len], in_len - len, num_samples, x);
+	if (axis_len < 0)
+	{
+		return -1;
+	}
+	len += axis_len;
+
+	axis_len = block_codec_decode_axis(&in[len], in_len - len, num_samples, y);
+	if (axis_len < 0)
+	{
+		return -1;
+	}
+	len += axis_len;
+
+	axis_len = block_codec_decode_axis(&in[len], in_len - len, num_samples, z);
+	if (axis_len < 0)
+	{
+		return -1;
+	}
+	len += axis_len;
+
+	return len;
+}
+
+/* EOF */
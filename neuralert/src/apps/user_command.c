@@ -49,6 +49,11 @@
 #include "Mc363x.h" //JW: The x was the wrong case previously.
 #include "user_nvram_cmd_table.h"
 #include "W25QXX.h"
+#include "user_trace.h"
+#include "user_log.h"
+#if defined (CFG_USE_RETMEM_WITHOUT_DPM)
+#include "user_retmem.h"
+#endif
 
 /* globals */
 // Timers for controlling the LED blink
@@ -100,6 +105,11 @@ void cmd_led_state(int argc, char *argv[]);
 void cmd_run(int argc, char *argv[]);
 void cmd_log(int argc, char *argv[]);
 void cmd_flash(int argc, char *argv[]);
+void cmd_trace(int argc, char *argv[]);
+void cmd_ulog(int argc, char *argv[]);
+#if defined (CFG_USE_RETMEM_WITHOUT_DPM)
+void cmd_retmem(int argc, char *argv[]);
+#endif
 
 void cmd_rf_ctl(int argc, char *argv[]); //Added command function for RF control - NJ 05/19/2022
 
@@ -154,6 +164,11 @@ const COMMAND_TREE_TYPE	cmd_user_list[] = {
 	{ "ledstate",		CMD_FUNC_NODE,	NULL,			&cmd_led_state,					"ledstate l s"	},
 	{ "log",			CMD_FUNC_NODE,	NULL,			&cmd_log,						"log read [entry #] or log info or log help"	},
 	{ "run",			CMD_FUNC_NODE,	NULL,			&cmd_run,						"run [0/1]"					},
+	{ "trace",			CMD_FUNC_NODE,	NULL,			&cmd_trace,						"trace [clear]"				},
+	{ "ulog",			CMD_FUNC_NODE,	NULL,			&cmd_ulog,						"ulog [clear]"				},
+#if defined (CFG_USE_RETMEM_WITHOUT_DPM)
+	{ "retmem",			CMD_FUNC_NODE,	NULL,			&cmd_retmem,					"retmem"					},
+#endif
     { "-------",     	CMD_FUNC_NODE,  NULL,          	NULL,             				"--------------------------------" },
     { "testcmd",     	CMD_FUNC_NODE,  NULL,           &cmd_test,        				"testcmd [option]"                 },
 #if defined(__COAP_CLIENT_SAMPLE__)
@@ -949,6 +964,7 @@ void display_FIFO_data(UCHAR *FIFO_buffer)
 
 	PRINTF(" FIFO structure contents:\n");
 	PRINTF("  Data sequence  : %d\n", fifo->data_sequence);
+	PRINTF("  CRC            : %08x\n", fifo->crc);
 	time64_string (time_string, &fifo->accelTime);
 	PRINTF("  Timestamp      : %s\n", time_string);
 	//PRINTF("  Timestamp index: %d\n", fifo->timestamp_sample); \\JW: deprecated.
@@ -966,6 +982,36 @@ void display_FIFO_data(UCHAR *FIFO_buffer)
 	}
 }
 
+/*
+ * Show the FIFO blocks in a page read from the accelerometer buffer.
+ * Each page holds AB_BLOCKS_PER_PAGE blocks in fixed slots; an unused
+ * slot reads as all 0xFF.
+ */
+static void display_FIFO_page(ULONG page_address, UCHAR *page_data)
+{
+	int slot;
+	int i;
+
+	for (slot = 0; slot < AB_BLOCKS_PER_PAGE; slot++)
+	{
+		for (i = 0; i < AB_BLOCK_SIZE; i++)
+		{
+			if (page_data[(slot * AB_BLOCK_SIZE) + i] != 0xFF)
+			{
+				break;
+			}
+		}
+		if (i == AB_BLOCK_SIZE)
+		{
+			PRINTF(" Block %d (0x%x): empty\n", slot,
+					page_address + (slot * AB_BLOCK_SIZE));
+			continue;
+		}
+		PRINTF(" Block %d (0x%x):\n", slot, page_address + (slot * AB_BLOCK_SIZE));
+		display_FIFO_data(&page_data[slot * AB_BLOCK_SIZE]);
+	}
+}
+
 
 
 /**
@@ -1011,6 +1057,8 @@ void cmd_flash(int argc, char *argv[])
 		PRINTF(" Start address    : 0x%0x  (%d)\n", AB_FLASH_BEGIN_ADDRESS, AB_FLASH_BEGIN_ADDRESS);
 		PRINTF(" Number of pages  : 0x%0x  (%d)\n", AB_FLASH_MAX_PAGES, AB_FLASH_MAX_PAGES);
 		PRINTF(" Page size (bytes): 0x%0x  (%d)\n", AB_FLASH_PAGE_SIZE, AB_FLASH_PAGE_SIZE);
+		PRINTF(" Blocks per page  : %d  (%d bytes each)\n", AB_BLOCKS_PER_PAGE, AB_BLOCK_SIZE);
+		PRINTF(" Number of blocks : 0x%0x  (%d)\n", AB_FLASH_MAX_BLOCKS, AB_FLASH_MAX_BLOCKS);
 		PRINTF(" Last page address: 0x%0x  (%d)\n", EndAddr, EndAddr);
 		PRINTF("\n");
 		EndAddr = (ULONG)USERLOG_FLASH_BEGIN_ADDRESS +
@@ -1142,7 +1190,7 @@ void cmd_flash(int argc, char *argv[])
 			else
 			{
 				PRINTF(" Page data:\n");
-				display_FIFO_data(PageData);
+				display_FIFO_page(ReadAddr, PageData);
 			}
 		}
 		else if (argc == 4)
@@ -1163,7 +1211,7 @@ void cmd_flash(int argc, char *argv[])
 				else
 				{
 					PRINTF(" Page data: 0x%0x\n", ReadAddr);
-					display_FIFO_data(PageData);
+					display_FIFO_page(ReadAddr, PageData);
 				}
 				ReadAddr += 256;
 				// reading zeroes delay
@@ -2218,6 +2266,69 @@ void cmd_run(int argc, char *argv[])
 	PRINTF("NVRam runFlag: %i\r\n",storedRunFlag);
 }
 
+/*
+ * Trace command:
+ *
+ *   trace        - dumps the event trace kept in retention memory
+ *                  (feed the output to tools/trace_decode.py)
+ *   trace clear  - discards the event trace
+ */
+void cmd_trace(int argc, char *argv[])
+{
+	if (argc == 1)
+	{
+		trace_dump();
+	}
+	else if ((argc == 2) && (strcasecmp(argv[1], "clear") == 0))
+	{
+		trace_clear();
+		PRINTF("Trace cleared\n");
+	}
+	else
+	{
+		PRINTF("Usage: trace [clear]\n");
+	}
+}
+
+/*
+ * Log command:
+ *
+ *   ulog         - prints the deferred log messages not printed yet
+ *   ulog clear   - discards the deferred log messages
+ */
+void cmd_ulog(int argc, char *argv[])
+{
+	if (argc == 1)
+	{
+		ulog_flush();
+	}
+	else if ((argc == 2) && (strcasecmp(argv[1], "clear") == 0))
+	{
+		ulog_clear();
+		PRINTF("Log cleared\n");
+	}
+	else
+	{
+		PRINTF("Usage: ulog [clear]\n");
+	}
+}
+
+#if defined (CFG_USE_RETMEM_WITHOUT_DPM)
+/*
+ * Retention memory command:
+ *
+ *   retmem       - prints the retention memory layout and which regions
+ *                  hold data created by this firmware
+ */
+void cmd_retmem(int argc, char *argv[])
+{
+	DA16X_UNUSED_ARG(argc);
+	DA16X_UNUSED_ARG(argv);
+
+	user_retmem_info();
+}
+#endif
+
 
 #if 0 //!defined (__BLE_COMBO_REF__)
 /**
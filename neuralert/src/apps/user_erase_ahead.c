@@ -0,0 +1,136 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_erase_ahead.c
+ *
+ * @brief Plans the flash erases done ahead of the AB write position
+ *
+ * The erasing itself is done by AB_erase_ahead() in neuralert.c; this
+ * only works out where and how much, from the positions kept in
+ * retention memory.
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "user_erase_ahead.h"
+
+/**
+ *******************************************************************************
+ * @brief Number of whole sectors known to be erased from sector_start
+ *******************************************************************************
+ */
+int ab_erased_sectors_from(int next_erase_position, int sector_start)
+{
+	int gap;
+
+	gap = (next_erase_position - sector_start + AB_FLASH_MAX_BLOCKS)
+			% AB_FLASH_MAX_BLOCKS;
+	if (((gap % AB_BLOCKS_PER_SECTOR) != 0)
+		|| (gap > ((AB_ERASE_AHEAD_SECTORS + 1) * AB_BLOCKS_PER_SECTOR)))
+	{
+		return -1;
+	}
+
+	return gap / AB_BLOCKS_PER_SECTOR;
+}
+
+/**
+ *******************************************************************************
+ * @brief Pick the next erase to do ahead of the write position
+ *
+ * A 64K block erase can take up to 2 seconds, longer than the time
+ * between FIFO interrupts.  Keeping the sector after the one being
+ * written out of block erases means a block erase only starts once a
+ * whole erased sector lies between it and the write position, which is
+ * at least half a minute of FIFO reads away.
+ *******************************************************************************
+ */
+int ab_erase_ahead_next(AB_INDEX_TYPE *next_erase_position, int write_index,
+		int first_op, int *num_sectors)
+{
+	int sector_start;
+	int erased_sectors;
+	int erase_pos;
+	ULONG EraseAddr;
+
+	sector_start = write_index - (write_index % AB_BLOCKS_PER_SECTOR);
+	erased_sectors = ab_erased_sectors_from(*next_erase_position, sector_start);
+	if (erased_sectors < 0)
+	{
+		// Unknown - all we can count on is the sector being written
+		*next_erase_position = (sector_start + AB_BLOCKS_PER_SECTOR) % AB_FLASH_MAX_BLOCKS;
+		erased_sectors = 1;
+	}
+
+	// erased_sectors includes the sector being written.  If that one
+	// isn't erased the accelerometer task is about to erase it itself.
+	if ((erased_sectors == 0)
+		|| (first_op && ((erased_sectors - 1) > AB_ERASE_AHEAD_LOW_WATER))
+		|| ((erased_sectors - 1) >= AB_ERASE_AHEAD_SECTORS))
+	{
+		return -1;
+	}
+
+	// Largest aligned erase that fits in what's still wanted
+	// without running off the end of the buffer region
+	erase_pos = *next_erase_position;
+	EraseAddr = AB_BLOCK_ADDRESS(erase_pos);
+	*num_sectors = (erased_sectors == 1) ? 1 : (AB_FLASH_BLOCK_64K_SIZE / AB_FLASH_SECTOR_SIZE);
+	while (*num_sectors > 1)
+	{
+		if (((EraseAddr % (*num_sectors * AB_FLASH_SECTOR_SIZE)) == 0)
+			&& (*num_sectors <= (AB_ERASE_AHEAD_SECTORS + 1 - erased_sectors))
+			&& ((erase_pos + (*num_sectors * AB_BLOCKS_PER_SECTOR)) <= AB_FLASH_MAX_BLOCKS))
+		{
+			break;
+		}
+		*num_sectors = (*num_sectors == (AB_FLASH_BLOCK_64K_SIZE / AB_FLASH_SECTOR_SIZE)) ?
+						(AB_FLASH_BLOCK_32K_SIZE / AB_FLASH_SECTOR_SIZE) : 1;
+	}
+
+	return erase_pos;
+}
+
+int ab_erase_range_covers(int start, int num_sectors, int sector_start)
+{
+	if (start < 0)
+	{
+		return pdFALSE;
+	}
+
+	return ((((sector_start - start + AB_FLASH_MAX_BLOCKS) % AB_FLASH_MAX_BLOCKS)
+				< (num_sectors * AB_BLOCKS_PER_SECTOR)) ? pdTRUE : pdFALSE);
+}
+
+/* EOF */
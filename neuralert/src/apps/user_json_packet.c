@@ -0,0 +1,225 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_json_packet.c
+ *
+ * @brief Composes the JSON accelerometer packet
+ *
+ * The packet used to be built with sprintf() into a scratch string and
+ * strcat() onto the message, which walks the whole message again for
+ * every value.  It is now appended in place with the JSON writer.
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "user_json_writer.h"
+#include "user_sample_time.h"
+#include "user_json_packet.h"
+
+
+enum { JSON_AXIS_X, JSON_AXIS_Y, JSON_AXIS_Z };
+
+/**
+ *******************************************************************************
+ * @brief Append the values of one axis of every block
+ *******************************************************************************
+ */
+static void json_put_axis(jsonWriter *json, const accelBufferStruct *blocks, int num_blocks, int axis)
+{
+	const int8_t *values;
+	int b, i;
+
+	for (b = 0; b < num_blocks; b++)
+	{
+		values = (axis == JSON_AXIS_X) ? blocks[b].Xvalue
+				: (axis == JSON_AXIS_Y) ? blocks[b].Yvalue : blocks[b].Zvalue;
+		for (i = 0; i < blocks[b].num_samples; i++)
+		{
+			json_put_int(json, values[i]);
+			json_put_char(json, ' ');
+		}
+	}
+}
+
+/**
+ *******************************************************************************
+ * @brief Compose one JSON packet from a run of FIFO blocks
+ *******************************************************************************
+ */
+int json_packet_compose(char *out, int out_max, const packetMetaStruct *meta,
+		const accelBufferStruct *blocks, int num_blocks)
+{
+	jsonWriter json;
+	sampleTimeStepper stamps;
+	int b, i;
+
+	json_writer_init(&json, out, out_max);
+
+	/*
+	 * JSON preamble
+	 */
+	json_put_str(&json, "{\r\n\t\"state\":\r\n\t{\r\n\t\t\"reported\":\r\n\t\t{\r\n");
+	/*
+	 * MAC address of device - stored in retention memory
+	 * during the bootup event
+	 */
+	json_put_str(&json, "\t\t\t\"id\": \"");
+	json_put_str(&json, meta->device_id);
+	json_put_str(&json, "\",\r\n");
+
+	/*
+	 * "timesync": "2023.01.17 12:53:55 (GMT 00:00) 0656741"
+	 *
+	 * The local date and time at the last timesync, and the msec since
+	 * power on at that moment, so that timestamps from different devices
+	 * can be aligned.
+	 */
+	json_put_str(&json, "\t\t\t\"timesync\": \"");
+	json_put_str(&json, meta->timesync_str);
+	json_put_char(&json, ' ');
+	json_put_time64(&json, meta->timesync_msec);
+	json_put_str(&json, "\",\r\n");
+
+	// Battery voltage in centivolts
+	json_put_str(&json, "\t\t\t\"bat\": ");
+	json_put_int(&json, meta->battery_cv);
+	json_put_str(&json, ",\r\n");
+
+	/*
+	 * Meta data field -- firmware version, transmission and packet
+	 * sequence, battery, fault count, free heap, and how long this
+	 * upload took to get connected (msec from the start of the upload
+	 * to Wi-Fi up, and to the MQTT broker connected)
+	 */
+	json_put_str(&json, "\t\t\t\"meta\":\r\n\t\t\t{\r\n");
+	json_put_str(&json, "\t\t\t\t\"ver\": \"");
+	json_put_str(&json, meta->version);
+	json_put_str(&json, "\",\r\n");
+	json_put_str(&json, "\t\t\t\t\"trans\": ");
+	json_put_int(&json, meta->msg_number);
+	json_put_str(&json, ",\r\n");
+	json_put_str(&json, "\t\t\t\t\"seq\": ");
+	json_put_int(&json, meta->sequence);
+	json_put_str(&json, ",\r\n");
+	json_put_str(&json, "\t\t\t\t\"bat\": ");
+	json_put_int(&json, meta->battery_cv);
+	json_put_str(&json, ",\r\n");
+	json_put_str(&json, "\t\t\t\t\"count\": ");
+	json_put_int(&json, meta->fault_count);
+	json_put_str(&json, ",\r\n");
+	json_put_str(&json, "\t\t\t\t\"mem\": ");
+	json_put_int(&json, (long)meta->free_heap);
+	json_put_str(&json, ",\r\n");
+	json_put_str(&json, "\t\t\t\t\"wifi\": ");
+	json_put_int(&json, (long)meta->wifi_connect_msec);
+	json_put_str(&json, ",\r\n");
+	json_put_str(&json, "\t\t\t\t\"conn\": ");
+	json_put_int(&json, (long)meta->connect_msec);
+	json_put_str(&json, "\r\n");
+	json_put_str(&json, "\t\t\t},\r\n");
+
+	/*
+	 *  Accelerometer values
+	 */
+	json_put_str(&json, "\t\t\t\"accX\": [");
+	json_put_axis(&json, blocks, num_blocks, JSON_AXIS_X);
+	json_put_str(&json, "],\r\n");
+	json_put_str(&json, "\t\t\t\"accY\": [");
+	json_put_axis(&json, blocks, num_blocks, JSON_AXIS_Y);
+	json_put_str(&json, "],\r\n");
+	json_put_str(&json, "\t\t\t\"accZ\": [");
+	json_put_axis(&json, blocks, num_blocks, JSON_AXIS_Z);
+	json_put_str(&json, "],\r\n");
+
+	/*
+	 *  Timestamps
+	 */
+	json_put_str(&json, "\t\t\t\"ts\": [");
+	// Note - as of 9/2/22 timestamps are in milliseconds,
+	// measured from the time the device was booted.
+	// So the largest expected timestamp will be at 5 days:
+	// 5 days x 24 hours x 60 minutes x 60 seconds x 1000 milliseconds
+	// = 432,000,000 msec
+	// which will transmit as 432000000
+	// All times are formatted the same (at least 9 digits)
+	for (b = 0; b < num_blocks; b++)
+	{
+		sample_time_begin(&stamps, blocks[b].accelTime, blocks[b].accelTime_prev, blocks[b].num_samples);
+		for (i = 0; i < blocks[b].num_samples; i++)
+		{
+			json_put_time64(&json, sample_time_next(&stamps));
+			json_put_char(&json, ' ');
+		}
+	}
+	json_put_str(&json, "]\r\n");
+
+	/*
+	 * Closing braces
+	 */
+	json_put_str(&json, "\r\n\t\t}\r\n\t}\r\n}\r\n");
+
+	return json_writer_ok(&json) ? json_writer_len(&json) : -1;
+}
+
+/**
+ *******************************************************************************
+ * @brief Format the local time part of the "timesync" field
+ *******************************************************************************
+ */
+int json_packet_timesync_str(char *out, int out_max, const char *date_time, int tzoff)
+{
+	jsonWriter str;
+	int tz_hours = tzoff / 3600;
+	int tz_rem = tzoff % 3600;
+
+	json_writer_init(&str, out, out_max);
+	json_put_str(&str, date_time);
+	json_put_str(&str, " (GMT ");
+	json_put_char(&str, (tz_hours < 0) ? '-' : '+');
+	json_put_uint_padded(&str, (ULONG)((tz_hours < 0) ? -tz_hours : tz_hours), 1);
+	json_put_char(&str, ':');
+	if (tz_rem < 0)
+	{
+		json_put_int(&str, tz_rem);
+	}
+	else
+	{
+		json_put_uint_padded(&str, (ULONG)tz_rem, 2);
+	}
+	json_put_char(&str, ')');
+
+	return json_writer_ok(&str);
+}
+
+/* EOF */
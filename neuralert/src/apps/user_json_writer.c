@@ -0,0 +1,254 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_json_writer.c
+ *
+ * @brief Bounded append-cursor text writer used to compose MQTT JSON payloads
+ *
+ * Composing a packet with sprintf into a temporary and strcat onto the
+ * message walks the whole message again for every field, so the cost of
+ * a packet grows with the square of its length.  The writer keeps an
+ * explicit cursor instead and formats integers directly, without going
+ * through sprintf (which also can't handle 64-bit values on this SDK).
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "user_json_writer.h"
+
+// Enough digits for a 64-bit value
+#define JSON_MAX_DIGITS		20
+// Largest power of ten that fits in 32 bits, used to split 64-bit values
+#define JSON_SPLIT_DIVISOR	1000000000UL
+#define JSON_SPLIT_DIGITS	9
+
+
+/**
+ *******************************************************************************
+ * @brief Start writing at the beginning of buf
+ *******************************************************************************
+ */
+void json_writer_init(jsonWriter *writer, char *buf, int max)
+{
+	writer->buf = buf;
+	writer->len = 0;
+	writer->max = max;
+	writer->overflow = pdFALSE;
+	if (max > 0)
+	{
+		buf[0] = '\0';
+	}
+	else
+	{
+		writer->overflow = pdTRUE;
+	}
+}
+
+/**
+ *******************************************************************************
+ * @brief Account for count characters (already NUL terminated) that were
+ *        written directly at the cursor by some other encoder
+ *******************************************************************************
+ */
+void json_writer_advance(jsonWriter *writer, int count)
+{
+	if (writer->overflow)
+	{
+		return;
+	}
+	if (writer->len + count >= writer->max)
+	{
+		writer->overflow = pdTRUE;
+		return;
+	}
+
+	writer->len += count;
+}
+
+/*
+ * Append len characters.  All appends come through here so this
+ * is the only place the bounds are checked.
+ */
+static void json_put_mem(jsonWriter *writer, const char *data, int len)
+{
+	if (writer->overflow)
+	{
+		return;
+	}
+	if (writer->len + len >= writer->max)
+	{
+		writer->overflow = pdTRUE;
+		return;
+	}
+
+	memcpy(&writer->buf[writer->len], data, len);
+	writer->len += len;
+	writer->buf[writer->len] = '\0';
+}
+
+void json_put_char(jsonWriter *writer, char c)
+{
+	json_put_mem(writer, &c, 1);
+}
+
+void json_put_str(jsonWriter *writer, const char *str)
+{
+	json_put_mem(writer, str, strlen(str));
+}
+
+/*
+ * Write the decimal digits of a 32-bit value, zero padded on the left
+ * to at least min_digits.  Digits are produced from the low end into
+ * a scratch area and copied out in one go.
+ */
+void json_put_uint_padded(jsonWriter *writer, unsigned long value, int min_digits)
+{
+	char digits[JSON_MAX_DIGITS];
+	int pos = JSON_MAX_DIGITS;
+
+	if (min_digits > JSON_MAX_DIGITS)
+	{
+		min_digits = JSON_MAX_DIGITS;
+	}
+
+	do
+	{
+		digits[--pos] = (char)('0' + (value % 10));
+		value /= 10;
+	} while (value != 0);
+
+	while ((JSON_MAX_DIGITS - pos) < min_digits)
+	{
+		digits[--pos] = '0';
+	}
+
+	json_put_mem(writer, &digits[pos], JSON_MAX_DIGITS - pos);
+}
+
+void json_put_int(jsonWriter *writer, long value)
+{
+	if (value < 0)
+	{
+		json_put_char(writer, '-');
+		json_put_uint_padded(writer, (unsigned long)(-(value + 1)) + 1, 1);
+	}
+	else
+	{
+		json_put_uint_padded(writer, (unsigned long)value, 1);
+	}
+}
+
+/*
+ * 64-bit values are split once into a high part and a 9 digit low part
+ * so that only one (software) 64-bit division is needed, and none at all
+ * for values that fit in 32 bits.
+ */
+static void json_put_uint64_padded(jsonWriter *writer, unsigned long long value, int min_digits)
+{
+	unsigned long long high;
+	unsigned long low;
+
+	if (value <= 0xFFFFFFFFULL)
+	{
+		json_put_uint_padded(writer, (unsigned long)value, min_digits);
+		return;
+	}
+
+	high = value / JSON_SPLIT_DIVISOR;
+	low = (unsigned long)(value - (high * JSON_SPLIT_DIVISOR));
+
+	min_digits -= JSON_SPLIT_DIGITS;
+	if (min_digits < 1)
+	{
+		min_digits = 1;
+	}
+	json_put_uint64_padded(writer, high, min_digits);
+	json_put_uint_padded(writer, low, JSON_SPLIT_DIGITS);
+}
+
+void json_put_int64(jsonWriter *writer, long long value)
+{
+	if (value < 0)
+	{
+		json_put_char(writer, '-');
+		json_put_uint64_padded(writer, (unsigned long long)(-(value + 1)) + 1, 1);
+	}
+	else
+	{
+		json_put_uint64_padded(writer, (unsigned long long)value, 1);
+	}
+}
+
+/**
+ *******************************************************************************
+ * @brief Write a timestamp in the packet "ts" format
+ *
+ * This is the format historically produced by "%03ld" of the millions
+ * followed by "%06ld" of the remainder, i.e. the decimal value zero
+ * padded to at least 9 digits (e.g. 432000000 or 000656741).
+ *******************************************************************************
+ */
+void json_put_time64(jsonWriter *writer, __time64_t value)
+{
+	if (value < 0)
+	{
+		json_put_char(writer, '-');
+		json_put_uint64_padded(writer, (unsigned long long)(-(value + 1)) + 1, 9);
+	}
+	else
+	{
+		json_put_uint64_padded(writer, (unsigned long long)value, 9);
+	}
+}
+
+/**
+ *******************************************************************************
+ * @brief Helper function to create a printable string from a long long
+ *        because printf doesn't handle long longs
+ *        Format is just digits.  No commas or anything.
+ *
+ * timestamp_str must hold TIME64_STRING_MAX_LEN characters.
+ *******************************************************************************
+ */
+void time64_string (UCHAR *timestamp_str, __time64_t *timestamp)
+{
+	jsonWriter str;
+
+	json_writer_init(&str, (char *)timestamp_str, TIME64_STRING_MAX_LEN);
+	json_put_time64(&str, *timestamp);
+
+	return;
+}
+
+/* EOF */
@@ -0,0 +1,221 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_log.c
+ *
+ * @brief Console logging with compile-time levels and deferred formatting
+ *
+ * Every byte sent to the console on the wake path keeps the processor
+ * awake while the UART drains it.  Storing a deferred message costs a
+ * few stores; the formatting and the UART time move to ulog_flush(),
+ * which runs while the device is awake anyway for an upload.
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "user_retmem.h"
+#include "user_version.h"
+#include "user_log.h"
+
+#define ULOG_RING_MASK		(ULOG_RING_SIZE - 1)
+
+extern void user_time64_msec_since_poweron(__time64_t *cur_msec);
+
+// Re-attached by ulog_init() after every wake
+static ulogRing *pLogRing = NULL;
+
+
+/*
+ * FNV-1a hash of ULOG_BUILD_ID, which tells whether the format string
+ * addresses in a ring were stored by this firmware
+ */
+static uint32_t ulog_build_hash(void)
+{
+	const char *s = ULOG_BUILD_ID;
+	uint32_t hash = 2166136261U;
+
+	while (*s != '\0')
+	{
+		hash = (hash ^ (uint8_t)*s++) * 16777619U;
+	}
+	return hash;
+}
+
+/*
+ * Look up an existing ring without creating one.  Console commands
+ * can run before the application has started, so they use this.
+ */
+static int ulog_find(void)
+{
+#if defined (CFG_USE_RETMEM_WITHOUT_DPM)
+	if (pLogRing == NULL)
+	{
+		pLogRing = (ulogRing *)user_retmem_find(USER_RETMEM_LOG, sizeof(ulogRing));
+		if ((pLogRing != NULL)
+			&& ((pLogRing->magic != ULOG_RING_MAGIC) || (pLogRing->build != ulog_build_hash())))
+		{
+			pLogRing = NULL;
+		}
+	}
+#endif
+
+	return (pLogRing != NULL) ? pdTRUE : pdFALSE;
+}
+
+
+/**
+ *******************************************************************************
+ * @brief Find (or create) the deferred message ring in retention memory
+ *******************************************************************************
+ */
+void ulog_init(void)
+{
+#if defined (CFG_USE_RETMEM_WITHOUT_DPM)
+	uint32_t build;
+
+	// Started over if left by firmware with a different ring
+	pLogRing = (ulogRing *)user_retmem_attach(USER_RETMEM_LOG, sizeof(ulogRing), NULL);
+	if (pLogRing == NULL)
+	{
+		PRINTF("\n Neuralert: [%s] No retention memory for the log", __func__);
+		return;
+	}
+	// Messages stored by another build point at its format strings
+	build = ulog_build_hash();
+	if ((pLogRing->magic != ULOG_RING_MAGIC) || (pLogRing->build != build))
+	{
+		memset(pLogRing, 0, sizeof(ulogRing));
+		pLogRing->magic = ULOG_RING_MAGIC;
+		pLogRing->build = build;
+	}
+#endif
+}
+
+/**
+ *******************************************************************************
+ * @brief Store a message to be printed by ulog_flush()
+ *
+ * Once the ring is full the oldest message not yet printed is dropped.
+ *******************************************************************************
+ */
+void ulog_deferred(const char *fmt, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+	__time64_t now;
+	ulogRecord *rec;
+
+	if (pLogRing == NULL)
+	{
+		PRINTF(fmt, a0, a1, a2, a3);
+		return;
+	}
+
+	user_time64_msec_since_poweron(&now);
+
+	taskENTER_CRITICAL();
+	rec = &pLogRing->rec[pLogRing->next & ULOG_RING_MASK];
+	pLogRing->next++;
+	rec->fmt = fmt;
+	rec->msec = (uint32_t)now;
+	rec->args[0] = a0;
+	rec->args[1] = a1;
+	rec->args[2] = a2;
+	rec->args[3] = a3;
+	taskEXIT_CRITICAL();
+}
+
+/**
+ *******************************************************************************
+ * @brief Print the deferred messages not printed yet, oldest first
+ *
+ * Each message is prefixed with the msec since power on at which it was
+ * stored, since it is no longer printed in sequence with anything else.
+ *******************************************************************************
+ */
+void ulog_flush(void)
+{
+	uint32_t n;
+	uint32_t last;
+	ulogRecord rec;
+
+	if (!ulog_find())
+	{
+		return;
+	}
+
+	taskENTER_CRITICAL();
+	last = pLogRing->next;
+	n = pLogRing->flushed;
+	taskEXIT_CRITICAL();
+
+	if ((last - n) > ULOG_RING_SIZE)
+	{
+		PRINTF("\n[ulog] %u older messages dropped\n", (last - n) - ULOG_RING_SIZE);
+		n = last - ULOG_RING_SIZE;
+	}
+
+	for ( ; n != last; n++)
+	{
+		// Copy out so a message stored meanwhile isn't printed half updated
+		taskENTER_CRITICAL();
+		rec = pLogRing->rec[n & ULOG_RING_MASK];
+		taskEXIT_CRITICAL();
+
+		PRINTF("[%u] ", rec.msec);
+		PRINTF(rec.fmt, rec.args[0], rec.args[1], rec.args[2], rec.args[3]);
+	}
+
+	taskENTER_CRITICAL();
+	// Anything stored while printing is left for the next flush
+	pLogRing->flushed = last;
+	taskEXIT_CRITICAL();
+}
+
+/**
+ *******************************************************************************
+ * @brief Discard every deferred message
+ *******************************************************************************
+ */
+void ulog_clear(void)
+{
+	if (!ulog_find())
+	{
+		return;
+	}
+
+	taskENTER_CRITICAL();
+	pLogRing->flushed = pLogRing->next;
+	taskEXIT_CRITICAL();
+}
+
+/* EOF */
@@ -0,0 +1,244 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_mqtt_publish.c
+ *
+ * @brief Publishes packets over MQTT and collects their PUBACKs
+ *
+ * This replaces a stop-and-wait send (an application-level version of
+ * mqtt_client_send_message_with_qos, which has a race condition on the
+ * inflight count in SDK 3.2.8.1 and earlier).  The PUBACK of a packet is
+ * collected when the next packet is published, so the broker round trip
+ * overlaps with reading and composing that packet.  The flash blocks of
+ * a packet are only released (by the delivered callback) once its PUBACK
+ * arrives.
+ *
+ * The SDK client refuses a publish with -2 while it has a message
+ * inflight, which includes the short time after a PUBACK before its
+ * count catches up and any retransmission of its own.  That is not an
+ * error: the publish is retried until the PUBACK timeout runs out.
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "user_log.h"
+#include "queue.h"
+#include "mqtt_client.h"
+#include "user_trace.h"
+#include "user_mqtt_publish.h"
+
+
+/**
+ *******************************************************************************
+ * @brief Set up a publisher
+ *******************************************************************************
+ */
+void mqtt_publisher_init(mqttPublisher *publisher, QueueHandle_t puback_queue,
+		mqttDeliveredFunc delivered, int timeout_msec)
+{
+	memset(publisher, 0, sizeof(*publisher));
+	publisher->puback_queue = puback_queue;
+	publisher->delivered = delivered;
+	publisher->timeout = pdMS_TO_TICKS(timeout_msec);
+}
+
+/**
+ *******************************************************************************
+ * @brief Start a new transmission
+ *******************************************************************************
+ */
+void mqtt_publisher_reset(mqttPublisher *publisher)
+{
+	publisher->inflight = pdFALSE;
+	publisher->packets_delivered = 0;
+	publisher->samples_delivered = 0;
+	publisher->busy_retries = 0;
+	publisher->puback_msec_total = 0;
+
+	if (publisher->puback_queue != NULL)
+	{
+		xQueueReset(publisher->puback_queue);
+	}
+}
+
+static void mqtt_publisher_delivered(mqttPublisher *publisher, packetDataStruct *packet)
+{
+	publisher->packets_delivered++;
+	publisher->samples_delivered += packet->num_samples;
+	publisher->delivered(packet);
+}
+
+/*
+ * Match a PUBACK to the packet inflight.  Anything else is a late
+ * PUBACK for a packet that was already given up on.
+ */
+static void mqtt_publisher_acknowledge(mqttPublisher *publisher, int mid)
+{
+	if (!publisher->inflight || (publisher->mid != mid))
+	{
+		ULOG_W("\n Neuralert: [%s] PUBACK for unknown mid %d ignored", __func__, mid);
+		return;
+	}
+
+	publisher->inflight = pdFALSE;
+	publisher->puback_msec_total += (ULONG)((xTaskGetTickCount() - publisher->sent_tick)
+											* portTICK_PERIOD_MS);
+	ULOG_D("\n Neuralert: [%s] packet %d (mid %d) acknowledged", __func__,
+			publisher->sequence, mid);
+
+	mqtt_publisher_delivered(publisher, &publisher->packet);
+}
+
+/**
+ *******************************************************************************
+ * @brief Take any PUBACK that has already arrived, without waiting
+ *******************************************************************************
+ */
+void mqtt_publisher_collect(mqttPublisher *publisher)
+{
+	int mid;
+
+	if (publisher->puback_queue == NULL)
+	{
+		return;
+	}
+
+	while (xQueueReceive(publisher->puback_queue, &mid, 0) == pdPASS)
+	{
+		mqtt_publisher_acknowledge(publisher, mid);
+	}
+}
+
+/**
+ *******************************************************************************
+ * @brief Wait for the PUBACK of the packet inflight, if any
+ *
+ * The packet must be acknowledged within the timeout of being published.
+ *
+ * Returns 0 on success, -2 on timeout, -1 on error
+ *******************************************************************************
+ */
+int mqtt_publisher_wait(mqttPublisher *publisher)
+{
+	int mid;
+	TickType_t waited;
+
+	if (publisher->puback_queue == NULL)
+	{
+		return -1;
+	}
+
+	mqtt_publisher_collect(publisher);
+
+	while (publisher->inflight)
+	{
+		waited = xTaskGetTickCount() - publisher->sent_tick;
+		if (waited >= publisher->timeout)
+		{
+			ULOG_W("\n Neuralert: [%s] no PUBACK for packet %d (mid %d)", __func__,
+					publisher->sequence, publisher->mid);
+			return -2;		/* timeout */
+		}
+
+		if (xQueueReceive(publisher->puback_queue, &mid, publisher->timeout - waited) == pdPASS)
+		{
+			mqtt_publisher_acknowledge(publisher, mid);
+		}
+	}
+
+	return 0;
+}
+
+/**
+ *******************************************************************************
+ * @brief Publish a composed packet
+ *
+ * Returns 0 on success, -2 on timeout, -1 on error
+ *******************************************************************************
+ */
+int mqtt_publisher_send(mqttPublisher *publisher, char *payload,
+		packetDataStruct *packet, int sequence, int qos)
+{
+	int status;
+	TickType_t start;
+
+	if (qos >= 1)
+	{
+		status = mqtt_publisher_wait(publisher);
+		if (status != 0)
+		{
+			return status;
+		}
+	}
+
+	start = xTaskGetTickCount();
+	status = mqtt_pub_send_msg(NULL, payload);
+	while (status == -2)
+	{
+		// The client still has a message inflight that isn't ours to
+		// wait for.  Give it time to finish, but no longer than a PUBACK.
+		if ((xTaskGetTickCount() - start) >= publisher->timeout)
+		{
+			ULOG_W("\n Neuralert: [%s] MQTT client busy, packet %d not published", __func__,
+					sequence);
+			return -2;		/* timeout */
+		}
+		vTaskDelay(pdMS_TO_TICKS(MQTT_PUBLISH_BUSY_POLL_MS));
+		publisher->busy_retries++;
+		status = mqtt_pub_send_msg(NULL, payload);
+	}
+
+	if (status)
+	{
+		return -1;		/* error */
+	}
+	TRACE_EVENT(TRACE_EV_PUBLISH, sequence, 0);
+
+	if (qos == 0)
+	{
+		// Nothing to wait for
+		mqtt_publisher_delivered(publisher, packet);
+		return 0;
+	}
+
+	publisher->mid = mqtt_client_get_pub_msg_id();
+	publisher->sequence = sequence;
+	publisher->packet = *packet;
+	publisher->sent_tick = xTaskGetTickCount();
+	publisher->inflight = pdTRUE;
+
+	return 0;
+}
+
+/* EOF */
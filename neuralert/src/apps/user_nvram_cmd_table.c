@@ -43,6 +43,7 @@
 #include "da16x_system.h"
 #include "common_def.h"
 #include "user_nvram_cmd_table.h"
+#include "user_upload_scheduler.h"
 #include "command_net.h"
 
 #if defined (__SUPPORT_MQTT__)
@@ -222,6 +223,14 @@ user_conf_int user_config_int_with_nvram_name[] = {
     /// 0 == don't auto-run; 
     /// 1 == auto-run
     { DA16X_CONF_INT_RUN_FLAG,  NVRAM_CONFIG_RUN_FLAG,  -1,  1,  -1},
+
+    /// Upload scheduler tunables, read at power on
+    { DA16X_CONF_INT_UPLOAD_MIN_FIFOS,       NVRAM_CONFIG_UPLOAD_MIN_FIFOS,       1, UPLOAD_MAX_INTERVAL_FIFOS, UPLOAD_DEFAULT_MIN_FIFOS         },
+    { DA16X_CONF_INT_UPLOAD_MAX_FIFOS,       NVRAM_CONFIG_UPLOAD_MAX_FIFOS,       1, UPLOAD_MAX_INTERVAL_FIFOS, UPLOAD_DEFAULT_MAX_FIFOS         },
+    { DA16X_CONF_INT_UPLOAD_BACKOFF,         NVRAM_CONFIG_UPLOAD_BACKOFF,         0, 1000,                      UPLOAD_DEFAULT_BACKOFF_AFTER     },
+    { DA16X_CONF_INT_UPLOAD_SLOW_CONNECT,    NVRAM_CONFIG_UPLOAD_SLOW_CONNECT,    0, 600000,                    UPLOAD_DEFAULT_SLOW_CONNECT_MSEC },
+    { DA16X_CONF_INT_UPLOAD_LOW_BATTERY,     NVRAM_CONFIG_UPLOAD_LOW_BATTERY,     0, 500,                       UPLOAD_DEFAULT_LOW_BATTERY_CV    },
+    { DA16X_CONF_INT_UPLOAD_URGENT_HEADROOM, NVRAM_CONFIG_UPLOAD_URGENT_HEADROOM, 0, AB_FLASH_MAX_BLOCKS,       UPLOAD_DEFAULT_URGENT_HEADROOM   },
     { 0, "", 0, 0, 0 }
 };
 
@@ -0,0 +1,267 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_packet_encoder.c
+ *
+ * @brief Compact binary encoding of accelerometer packets for MQTT transmission
+ *
+ * The JSON packet spends several text characters on every 8-bit sample and
+ * ten or more on every timestamp.  The binary frame described in
+ * user_packet_encoder.h carries the same information with the samples
+ * compressed by the block codec and only two timestamps per block.
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "user_block_codec.h"
+#include "user_packet_encoder.h"
+
+
+static void frame_put_byte(packetEncoder *enc, UCHAR value)
+{
+	if (enc->len < enc->max)
+	{
+		enc->buf[enc->len++] = value;
+	}
+	else
+	{
+		enc->overflow = pdTRUE;
+	}
+}
+
+static void frame_put_varint(packetEncoder *enc, unsigned long long value)
+{
+	while (value >= 0x80)
+	{
+		frame_put_byte(enc, (UCHAR)(value | 0x80));
+		value >>= 7;
+	}
+	frame_put_byte(enc, (UCHAR)value);
+}
+
+/*
+ * Zigzag maps signed values onto unsigned so that small
+ * magnitudes of either sign produce short varints:
+ * 0 -> 0, -1 -> 1, 1 -> 2, -2 -> 3 ...
+ */
+static void frame_put_svarint(packetEncoder *enc, long long value)
+{
+	frame_put_varint(enc, ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63));
+}
+
+static void frame_put_string(packetEncoder *enc, const char *str)
+{
+	int len = 0;
+
+	if (str != NULL)
+	{
+		len = strlen(str);
+	}
+	if (len > PACKET_STRING_MAX_LEN)
+	{
+		len = PACKET_STRING_MAX_LEN;
+	}
+
+	frame_put_byte(enc, (UCHAR)len);
+	if (enc->len + len <= enc->max)
+	{
+		memcpy(&enc->buf[enc->len], str, len);
+		enc->len += len;
+	}
+	else
+	{
+		enc->overflow = pdTRUE;
+	}
+}
+
+
+/**
+ *******************************************************************************
+ * @brief Start a binary frame and write the packet level information
+ *
+ * The body length in the preamble is patched in by packet_encode_end().
+ *******************************************************************************
+ */
+void packet_encode_begin(packetEncoder *enc, UCHAR *frame, int frame_max,
+						 const packetMetaStruct *meta, int count, int num_blocks)
+{
+	enc->buf = frame;
+	enc->len = 0;
+	enc->max = frame_max;
+	enc->overflow = pdFALSE;
+	enc->samples = 0;
+	enc->blocks = 0;
+
+	// Preamble - length is filled in at the end
+	frame_put_byte(enc, PACKET_FRAME_MAGIC_0);
+	frame_put_byte(enc, PACKET_FRAME_MAGIC_1);
+	frame_put_byte(enc, PACKET_FRAME_VERSION);
+	frame_put_byte(enc, 0);
+	frame_put_byte(enc, 0);
+	frame_put_byte(enc, 0);
+
+	// Packet information
+	frame_put_varint(enc, (unsigned long)meta->msg_number);
+	frame_put_varint(enc, (unsigned long)meta->sequence);
+	frame_put_byte(enc, (UCHAR)(meta->battery_cv & 0xFF));
+	frame_put_byte(enc, (UCHAR)(meta->battery_cv >> 8));
+	frame_put_byte(enc, meta->fault_count);
+	frame_put_varint(enc, meta->free_heap);
+	frame_put_varint(enc, meta->wifi_connect_msec);
+	frame_put_varint(enc, meta->connect_msec);
+	frame_put_string(enc, meta->device_id);
+	frame_put_string(enc, meta->version);
+	frame_put_string(enc, meta->timesync_str);
+	frame_put_varint(enc, (unsigned long long)meta->timesync_msec);
+	frame_put_varint(enc, (unsigned long)count);
+	frame_put_varint(enc, (unsigned long)num_blocks);
+}
+
+/**
+ *******************************************************************************
+ * @brief Append one FIFO block to the frame
+ *
+ * The samples are encoded straight into the frame.  A block that is
+ * invalid or doesn't fit marks the frame as failed.
+ *******************************************************************************
+ */
+void packet_encode_block(packetEncoder *enc, const accelBufferStruct *block)
+{
+	int codec_len;
+
+	frame_put_byte(enc, (UCHAR)block->num_samples);
+	if (enc->blocks == 0)
+	{
+		frame_put_varint(enc, (unsigned long long)block->accelTime_prev);
+	}
+	else
+	{
+		frame_put_svarint(enc, (long long)(block->accelTime_prev - enc->prev_time));
+	}
+	frame_put_svarint(enc, (long long)(block->accelTime - block->accelTime_prev));
+
+	if (!enc->overflow)
+	{
+		codec_len = block_codec_encode(block, &enc->buf[enc->len], enc->max - enc->len);
+		if (codec_len < 0)
+		{
+			enc->overflow = pdTRUE;
+		}
+		else
+		{
+			enc->len += codec_len;
+		}
+	}
+
+	enc->prev_time = block->accelTime;
+	enc->samples += block->num_samples;
+	enc->blocks++;
+}
+
+/**
+ *******************************************************************************
+ * @brief Finish the frame by filling in the body length
+ *******************************************************************************
+ */
+int packet_encode_end(packetEncoder *enc, int count, int num_blocks)
+{
+	int body_len;
+
+	if (enc->overflow || (enc->samples != count) || (enc->blocks != num_blocks))
+	{
+		return -1;
+	}
+
+	body_len = enc->len - PACKET_FRAME_PREAMBLE_SIZE;
+	if (body_len > 0xFFFF)
+	{
+		return -1;
+	}
+	enc->buf[4] = (UCHAR)(body_len & 0xFF);
+	enc->buf[5] = (UCHAR)(body_len >> 8);
+
+	return enc->len;
+}
+
+
+/**
+ *******************************************************************************
+ * @brief Base64 encode a buffer (standard alphabet, padded)
+ *
+ * The MQTT client publish API takes a NUL terminated string, so the binary
+ * frame is carried as base64 text.
+ *******************************************************************************
+ */
+int packet_base64_encode(char *dst, int dst_max, const UCHAR *src, int src_len)
+{
+	static const char alphabet[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	int out_len = PACKET_BASE64_SIZE(src_len);
+	int i;
+	char *out = dst;
+	ULONG triple;
+
+	if (out_len + 1 > dst_max)
+	{
+		return -1;
+	}
+
+	for (i = 0; i + 2 < src_len; i += 3)
+	{
+		triple = ((ULONG)src[i] << 16) | ((ULONG)src[i+1] << 8) | src[i+2];
+		*out++ = alphabet[(triple >> 18) & 0x3F];
+		*out++ = alphabet[(triple >> 12) & 0x3F];
+		*out++ = alphabet[(triple >> 6) & 0x3F];
+		*out++ = alphabet[triple & 0x3F];
+	}
+
+	if (i < src_len)
+	{
+		triple = (ULONG)src[i] << 16;
+		if (i + 1 < src_len)
+		{
+			triple |= (ULONG)src[i+1] << 8;
+		}
+		*out++ = alphabet[(triple >> 18) & 0x3F];
+		*out++ = alphabet[(triple >> 12) & 0x3F];
+		*out++ = (i + 1 < src_len) ? alphabet[(triple >> 6) & 0x3F] : '=';
+		*out++ = '=';
+	}
+
+	*out = '\0';
+
+	return out_len;
+}
+
+/* EOF */
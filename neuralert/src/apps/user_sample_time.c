@@ -0,0 +1,162 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_sample_time.c
+ *
+ * @brief Timestamps of the individual samples of a FIFO block
+ *
+ * See user_sample_time.h for the interpolation.
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "user_sample_time.h"
+
+
+/**
+ *******************************************************************************
+ * @brief calculate the timestamp for all a sample read from the accelerometer FIFO
+ *      by using it's relative position in the buffer.
+ *
+ *   FIFO_ts 			- is the timestamp assigned to the FIFO buffer when it was read
+ *   FIFO_ts_prev		- is the timestamp assigned to the previous FIFO buffer when it was read
+ *   offset         	- is the position in the FIFO
+ *   FIFO_samples		- is the total number of samples in the FIFO
+ *   adjusted_timestamp - is the calculated timestamp to be assigned to the sample
+ *                    		with this offset
+ *
+ * This is the reference for sample_time_next(), which gives the same
+ * results for a whole block without the divisions.
+ *******************************************************************************
+ */
+void calculate_timestamp_for_sample(__time64_t *FIFO_ts, __time64_t *FIFO_ts_prev, int offset, int FIFO_samples, __time64_t *adjusted_timestamp)
+{
+	__time64_t scaled_timestamp;	// times 1000 for more precise math
+	__time64_t scaled_timestamp_prev; // times 1000 for more precise math
+	__time64_t scaled_offsettime;	// the time offset of this sample * 1000
+	__time64_t adjusted_scaled_timestamp;
+	__time64_t rounded_offsettime;
+
+	scaled_timestamp = *FIFO_ts;
+	scaled_timestamp = scaled_timestamp * (__time64_t)1000;
+
+	scaled_timestamp_prev = *FIFO_ts_prev;
+	scaled_timestamp_prev = scaled_timestamp_prev * (__time64_t)1000;
+
+	scaled_offsettime = ((scaled_timestamp - scaled_timestamp_prev) * (__time64_t)(offset + 1)) / (__time64_t)FIFO_samples;
+
+	// offset time * 1000
+	adjusted_scaled_timestamp = scaled_timestamp_prev + scaled_offsettime;
+	// back to msec.  We round by adding 500 usec before dividing
+	rounded_offsettime = (adjusted_scaled_timestamp + (__time64_t)500)
+			                  / (__time64_t)1000;
+
+	*adjusted_timestamp = rounded_offsettime;
+	return;
+}
+
+/**
+ *******************************************************************************
+ * @brief Start on the timestamps of a block
+ *
+ * The additions only match the divisions while everything they divide
+ * is non-negative (C division truncates toward zero).  A block whose
+ * time went backwards, or an empty one, uses the per-sample calculation.
+ *******************************************************************************
+ */
+void sample_time_begin(sampleTimeStepper *stepper, __time64_t time, __time64_t time_prev, int num_samples)
+{
+	__time64_t span_usec;
+	__time64_t step;
+
+	stepper->time = time;
+	stepper->time_prev = time_prev;
+	stepper->num_samples = num_samples;
+	stepper->next = 0;
+	stepper->exact = (num_samples > 0) && (time_prev >= 0) && (time >= time_prev);
+	if (!stepper->exact)
+	{
+		return;
+	}
+
+	// Usec per sample as a quotient and remainder over num_samples
+	span_usec = (time - time_prev) * (__time64_t)1000;
+	step = span_usec / num_samples;
+	stepper->step_rem = (int)(span_usec - (step * num_samples));
+	stepper->step_msec = step / 1000;
+	stepper->step_usec = (int)(step - (stepper->step_msec * 1000));
+
+	// Sample -1 is at time_prev; the 500 usec is the rounding
+	stepper->msec = time_prev;
+	stepper->usec = 500;
+	stepper->rem = 0;
+}
+
+/**
+ *******************************************************************************
+ * @brief Timestamp of the next sample of the block
+ *******************************************************************************
+ */
+__time64_t sample_time_next(sampleTimeStepper *stepper)
+{
+	__time64_t timestamp;
+
+	if (!stepper->exact)
+	{
+		calculate_timestamp_for_sample(&stepper->time, &stepper->time_prev,
+				stepper->next, stepper->num_samples, &timestamp);
+		stepper->next++;
+		return timestamp;
+	}
+
+	stepper->msec += stepper->step_msec;
+	stepper->usec += stepper->step_usec;
+	stepper->rem += stepper->step_rem;
+	if (stepper->rem >= stepper->num_samples)
+	{
+		stepper->rem -= stepper->num_samples;
+		stepper->usec++;
+	}
+	if (stepper->usec >= 1000)
+	{
+		stepper->usec -= 1000;
+		stepper->msec++;
+	}
+	stepper->next++;
+
+	return stepper->msec;
+}
+
+/* EOF */
@@ -0,0 +1,211 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_trace.c
+ *
+ * @brief Binary event trace kept in retention memory
+ *
+ * PRINTF at the points being timed costs more than most of the things
+ * being timed.  A trace record is a few stores into retention memory,
+ * so it can be left in the code, and the ring survives sleep so a
+ * whole series of wake/sleep cycles can be dumped at once and turned
+ * into a timeline by tools/trace_decode.py.
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "user_log.h"
+#include "user_retmem.h"
+#include "user_trace.h"
+
+#define TRACE_RING_MASK		(TRACE_RING_SIZE - 1)
+
+extern void user_time64_msec_since_poweron(__time64_t *cur_msec);
+
+// Re-attached by trace_init() after every wake
+static traceRing *pTraceRing = NULL;
+
+static const char *trace_event_names[TRACE_EV_COUNT] =
+{
+	"?",
+	"boot",
+	"wake",
+	"sleep",
+	"fifo",
+	"wr_start",
+	"wr_end",
+	"erase_start",
+	"erase_end",
+	"upload_start",
+	"wifi_up",
+	"mqtt_connect",
+	"publish",
+	"puback",
+	"upload_end",
+};
+
+
+/*
+ * Look up an existing ring without creating one.  Console commands
+ * can run before the application has started, so they use this.
+ */
+static int trace_find(void)
+{
+#if defined (CFG_USE_RETMEM_WITHOUT_DPM)
+	if (pTraceRing == NULL)
+	{
+		pTraceRing = (traceRing *)user_retmem_find(USER_RETMEM_TRACE, sizeof(traceRing));
+		if ((pTraceRing != NULL) && (pTraceRing->magic != TRACE_RING_MAGIC))
+		{
+			pTraceRing = NULL;
+		}
+	}
+#endif
+
+	return (pTraceRing != NULL) ? pdTRUE : pdFALSE;
+}
+
+
+/**
+ *******************************************************************************
+ * @brief Find (or create) the trace ring in retention memory
+ *******************************************************************************
+ */
+void trace_init(void)
+{
+#if defined (CFG_USE_RETMEM_WITHOUT_DPM)
+	// Started over if left by firmware with a different ring
+	pTraceRing = (traceRing *)user_retmem_attach(USER_RETMEM_TRACE, sizeof(traceRing), NULL);
+	if (pTraceRing == NULL)
+	{
+		ULOG_E("\n Neuralert: [%s] No retention memory for the trace", __func__);
+		return;
+	}
+	if (pTraceRing->magic != TRACE_RING_MAGIC)
+	{
+		memset(pTraceRing, 0, sizeof(traceRing));
+		pTraceRing->magic = TRACE_RING_MAGIC;
+	}
+#endif
+}
+
+/**
+ *******************************************************************************
+ * @brief Append a record to the ring, overwriting the oldest
+ *******************************************************************************
+ */
+void trace_event(uint16_t event, uint16_t arg0, uint32_t arg1)
+{
+	__time64_t now;
+	traceRecord *rec;
+
+	if (pTraceRing == NULL)
+	{
+		return;
+	}
+
+	user_time64_msec_since_poweron(&now);
+
+	taskENTER_CRITICAL();
+	rec = &pTraceRing->rec[pTraceRing->next & TRACE_RING_MASK];
+	pTraceRing->next++;
+	rec->msec = (uint32_t)now;
+	rec->event = event;
+	rec->arg0 = arg0;
+	rec->arg1 = arg1;
+	taskEXIT_CRITICAL();
+}
+
+/**
+ *******************************************************************************
+ * @brief Print the ring, oldest record first
+ *
+ * One line per record:  T <record #> <msec> <event id> <arg0> <arg1> <name>
+ * between "TRACE BEGIN <records> <overwritten>" and "TRACE END".
+ *******************************************************************************
+ */
+void trace_dump(void)
+{
+	uint32_t first;
+	uint32_t last;
+	uint32_t n;
+	traceRecord rec;
+
+	if (!trace_find())
+	{
+		PRINTF("No trace in retention memory\n");
+		return;
+	}
+
+	taskENTER_CRITICAL();
+	last = pTraceRing->next;
+	taskEXIT_CRITICAL();
+	first = 0;
+	if (last > TRACE_RING_SIZE)
+	{
+		first = last - TRACE_RING_SIZE;
+	}
+
+	PRINTF("TRACE BEGIN %u %u\n", last - first, first);
+	for (n = first; n != last; n++)
+	{
+		// Copy out so a record written meanwhile isn't printed half updated
+		taskENTER_CRITICAL();
+		rec = pTraceRing->rec[n & TRACE_RING_MASK];
+		taskEXIT_CRITICAL();
+
+		PRINTF("T %u %u %u %u %u %s\n", n, rec.msec, rec.event, rec.arg0, rec.arg1,
+				(rec.event < TRACE_EV_COUNT) ? trace_event_names[rec.event] : "?");
+	}
+	PRINTF("TRACE END\n");
+}
+
+/**
+ *******************************************************************************
+ * @brief Discard every record in the ring
+ *******************************************************************************
+ */
+void trace_clear(void)
+{
+	if (!trace_find())
+	{
+		return;
+	}
+
+	taskENTER_CRITICAL();
+	pTraceRing->next = 0;
+	taskEXIT_CRITICAL();
+}
+
+/* EOF */
@@ -0,0 +1,323 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_transmit_map.c
+ *
+ * @brief Index over the accelerometer buffer (AB) transmit map
+ *
+ * The transmit task has to find the blocks still waiting for transmission
+ * in a map of several thousand blocks, most of which are usually clear.
+ * Looking at them one at a time (each under its own semaphore
+ * acquisition) costs thousands of operations per packet.  Here the map
+ * is scanned a word at a time, empty words are skipped using a one bit
+ * per word summary, and the highest set bit in a word is found with a
+ * count-leading-zeros instruction.
+ *
+ * The map words are only touched with atomic operations, so the
+ * accelerometer task can set bits while the MQTT task searches and clears
+ * without either of them taking a lock (see user_transmit_map.h).
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "user_transmit_map.h"
+
+
+// One bit per map word, set while the word is non-zero
+static uint32_t ab_map_summary[AB_MAP_SUMMARY_SIZE];
+
+// Bits 0 .. bit of a word
+#define MASK_UP_TO(bit)		(((bit) >= 31) ? 0xFFFFFFFFUL : ((1UL << ((bit) + 1)) - 1))
+// Index of the highest set bit of a non-zero word
+#define HIGHEST_BIT(word)	(31 - __builtin_clz(word))
+
+// Map and summary words as the other task may be changing them
+#define MAP_WORD(map, w)	__atomic_load_n(&(map)[w], __ATOMIC_ACQUIRE)
+#define SUMMARY_WORD(sw)	__atomic_load_n(&ab_map_summary[sw], __ATOMIC_ACQUIRE)
+#define SUMMARY_BIT(w)		(1UL << ((w) % 32))
+
+
+/*
+ * Highest non-zero map word at or below w, or -1
+ */
+static int ab_map_prev_word(int w)
+{
+	int sw = w / 32;
+	uint32_t bits = SUMMARY_WORD(sw) & MASK_UP_TO(w % 32);
+
+	for (;;)
+	{
+		if (bits != 0)
+		{
+			return (sw * 32) + HIGHEST_BIT(bits);
+		}
+		if (sw == 0)
+		{
+			return -1;
+		}
+		sw--;
+		bits = SUMMARY_WORD(sw);
+	}
+}
+
+/*
+ * Population count without relying on a library helper
+ */
+static int ab_map_bit_count(uint32_t bits)
+{
+	bits = bits - ((bits >> 1) & 0x55555555UL);
+	bits = (bits & 0x33333333UL) + ((bits >> 2) & 0x33333333UL);
+	bits = (bits + (bits >> 4)) & 0x0F0F0F0FUL;
+	return (int)((uint32_t)(bits * 0x01010101UL) >> 24);
+}
+
+
+/**
+ *******************************************************************************
+ * @brief Make the summary from the map
+ *******************************************************************************
+ */
+void ab_map_rebuild(const _AB_transmit_map_t *map)
+{
+	int w;
+
+	for (w = 0; w < AB_TRANSMIT_MAP_SIZE; w++)
+	{
+		if (MAP_WORD(map, w) != 0)
+		{
+			__atomic_fetch_or(&ab_map_summary[w / 32], SUMMARY_BIT(w), __ATOMIC_SEQ_CST);
+		}
+		else
+		{
+			__atomic_fetch_and(&ab_map_summary[w / 32], ~SUMMARY_BIT(w), __ATOMIC_SEQ_CST);
+		}
+	}
+}
+
+/**
+ *******************************************************************************
+ * @brief Mark a block as waiting for transmission (the producer side)
+ *
+ * The block bit goes in first, so anyone who sees the summary bit also
+ * sees the block.
+ *******************************************************************************
+ */
+void ab_map_set(_AB_transmit_map_t *map, int pos)
+{
+	int w = POS_TO_WORD(pos);
+
+	__atomic_fetch_or(&map[w], POS_TO_BIT(pos), __ATOMIC_SEQ_CST);
+	__atomic_fetch_or(&ab_map_summary[w / 32], SUMMARY_BIT(w), __ATOMIC_SEQ_CST);
+}
+
+int ab_map_test(const _AB_transmit_map_t *map, int pos)
+{
+	return ((MAP_WORD(map, POS_TO_WORD(pos)) & POS_TO_BIT(pos)) ? pdTRUE : pdFALSE);
+}
+
+/**
+ *******************************************************************************
+ * @brief Clear blocks first .. last (inclusive), a word at a time
+ *        (the consumer side)
+ *
+ * When a word ends up empty its summary bit is cleared, and then the word
+ * is looked at again: a block set in it meanwhile may have had its
+ * summary bit set before the clear, so the bit is put back.
+ *
+ * Returns the number of blocks that were set
+ *******************************************************************************
+ */
+int ab_map_clear_range(_AB_transmit_map_t *map, int first, int last)
+{
+	int w;
+	int w_last;
+	int lo;
+	int hi;
+	int cleared = 0;
+	uint32_t mask;
+	uint32_t old;
+
+	w = POS_TO_WORD(first);
+	w_last = POS_TO_WORD(last);
+	for (; w <= w_last; w++)
+	{
+		lo = (w == POS_TO_WORD(first)) ? (first % AB_MAP_POS_PER_WORD) : 0;
+		hi = (w == w_last) ? (last % AB_MAP_POS_PER_WORD) : (AB_MAP_POS_PER_WORD - 1);
+		mask = MASK_UP_TO(hi);
+		if (lo > 0)
+		{
+			mask &= ~MASK_UP_TO(lo - 1);
+		}
+
+		old = __atomic_fetch_and(&map[w], ~mask, __ATOMIC_SEQ_CST);
+		cleared += ab_map_bit_count(old & mask);
+		if ((old & ~mask) == 0)
+		{
+			__atomic_fetch_and(&ab_map_summary[w / 32], ~SUMMARY_BIT(w), __ATOMIC_SEQ_CST);
+			if (__atomic_load_n(&map[w], __ATOMIC_SEQ_CST) != 0)
+			{
+				__atomic_fetch_or(&ab_map_summary[w / 32], SUMMARY_BIT(w), __ATOMIC_SEQ_CST);
+			}
+		}
+	}
+
+	return cleared;
+}
+
+/**
+ *******************************************************************************
+ * @brief Find the nearest set block at or below start within count blocks,
+ *        wrapping below block 0 to the last block
+ *******************************************************************************
+ */
+int ab_map_find_prev(const _AB_transmit_map_t *map, int start, int count)
+{
+	int pos = start;
+	int w;
+	int bit;
+	int next_w;
+	int skipped;
+	uint32_t bits;
+
+	while (count > 0)
+	{
+		// Look at pos and the blocks below it in the same word
+		w = POS_TO_WORD(pos);
+		bit = pos % AB_MAP_POS_PER_WORD;
+		bits = MAP_WORD(map, w) & MASK_UP_TO(bit);
+		if (count <= bit)
+		{
+			// The search ends inside this word
+			bits &= ~MASK_UP_TO(bit - count);
+		}
+		if (bits != 0)
+		{
+			return (w * AB_MAP_POS_PER_WORD) + HIGHEST_BIT(bits);
+		}
+		count -= bit + 1;
+		pos -= bit + 1;
+
+		// Skip to the next non-zero word below, or wrap around
+		if (pos >= 0)
+		{
+			next_w = ab_map_prev_word(POS_TO_WORD(pos));
+			if (next_w >= 0)
+			{
+				skipped = pos - ((next_w * AB_MAP_POS_PER_WORD) + (AB_MAP_POS_PER_WORD - 1));
+				count -= skipped;
+				pos -= skipped;
+				continue;
+			}
+			count -= pos + 1;
+		}
+		pos = AB_FLASH_MAX_BLOCKS - 1;
+	}
+
+	return -1;
+}
+
+/**
+ *******************************************************************************
+ * @brief Count the consecutive set blocks at and below start, up to count,
+ *        wrapping below block 0 to the last block
+ *
+ * Runs are short (one packet's worth of blocks), so this just tests bits.
+ *******************************************************************************
+ */
+int ab_map_run_prev(const _AB_transmit_map_t *map, int start, int count)
+{
+	int pos = start;
+	int run = 0;
+
+	while ((run < count) && ab_map_test(map, pos))
+	{
+		run++;
+		pos--;
+		if (pos < 0)
+		{
+			pos = AB_FLASH_MAX_BLOCKS - 1;
+		}
+	}
+
+	return run;
+}
+
+/**
+ *******************************************************************************
+ * @brief Number of set blocks, counting only the non-zero words
+ *******************************************************************************
+ */
+int ab_map_count(const _AB_transmit_map_t *map)
+{
+	int sw;
+	int total = 0;
+	uint32_t bits;
+
+	for (sw = 0; sw < AB_MAP_SUMMARY_SIZE; sw++)
+	{
+		bits = SUMMARY_WORD(sw);
+		while (bits != 0)
+		{
+			total += ab_map_bit_count(MAP_WORD(map, (sw * 32) + HIGHEST_BIT(bits)));
+			bits &= ~(1UL << HIGHEST_BIT(bits));
+		}
+	}
+
+	return total;
+}
+
+/**
+ *******************************************************************************
+ * @brief Set the blocks of the pages waiting in a 1.10.17 transmit map
+ *******************************************************************************
+ */
+int ab_map_convert_legacy(_AB_transmit_map_t *map, const _AB_transmit_map_t *legacy_map)
+{
+	int page;
+	int pending = 0;
+
+	for (page = 0; page < AB_FLASH_MAX_PAGES; page++)
+	{
+		if (legacy_map[page / AB_LEGACY_MAP_POS_PER_WORD]
+				& (1UL << (page % AB_LEGACY_MAP_POS_PER_WORD)))
+		{
+			SET_AB_POS(map, page * AB_BLOCKS_PER_PAGE);
+			pending++;
+		}
+	}
+
+	return pending;
+}
+
+/* EOF */
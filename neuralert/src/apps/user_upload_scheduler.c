@@ -0,0 +1,192 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_upload_scheduler.c
+ *
+ * @brief Decides when the accelerometer task starts an upload
+ *
+ * Every upload pays for bringing up Wi-Fi, DHCP, TLS and MQTT before a
+ * single sample is sent, so uploading less often saves energy as long
+ * as the ring buffer doesn't overflow.  The scheduler stretches the
+ * interval when uploads are failing, when the link is slow to connect
+ * or when the battery is low, and shortens it again when the unsent
+ * data is about to be overwritten.
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "user_upload_scheduler.h"
+
+
+/**
+ *******************************************************************************
+ * @brief Fill in the built-in tunables
+ *******************************************************************************
+ */
+void upload_scheduler_defaults(uploadSchedulerConfig *config)
+{
+	config->min_fifos = UPLOAD_DEFAULT_MIN_FIFOS;
+	config->max_fifos = UPLOAD_DEFAULT_MAX_FIFOS;
+	config->backoff_after = UPLOAD_DEFAULT_BACKOFF_AFTER;
+	config->slow_connect_msec = UPLOAD_DEFAULT_SLOW_CONNECT_MSEC;
+	config->low_battery_cv = UPLOAD_DEFAULT_LOW_BATTERY_CV;
+	config->urgent_headroom = UPLOAD_DEFAULT_URGENT_HEADROOM;
+}
+
+/**
+ *******************************************************************************
+ * @brief Bring tunables read from NVRAM back into a usable range
+ *******************************************************************************
+ */
+void upload_scheduler_sanitize(uploadSchedulerConfig *config)
+{
+	if ((config->min_fifos < 1) || (config->min_fifos > UPLOAD_MAX_INTERVAL_FIFOS))
+	{
+		config->min_fifos = UPLOAD_DEFAULT_MIN_FIFOS;
+	}
+	if (config->max_fifos > UPLOAD_MAX_INTERVAL_FIFOS)
+	{
+		config->max_fifos = UPLOAD_MAX_INTERVAL_FIFOS;
+	}
+	if (config->max_fifos < config->min_fifos)
+	{
+		config->max_fifos = config->min_fifos;
+	}
+	if (config->backoff_after < 0)
+	{
+		config->backoff_after = 0;
+	}
+	if (config->slow_connect_msec < 0)
+	{
+		config->slow_connect_msec = 0;
+	}
+	if (config->low_battery_cv < 0)
+	{
+		config->low_battery_cv = 0;
+	}
+	if (config->urgent_headroom < 0)
+	{
+		config->urgent_headroom = 0;
+	}
+}
+
+/**
+ *******************************************************************************
+ * @brief Number of FIFO reads to wait between uploads in the given state
+ *
+ * Starting from min_fifos:
+ *  - after backoff_after consecutive failures the interval doubles with
+ *    every further failure, up to max_fifos, so a device out of range
+ *    stops spending energy on Wi-Fi scans but still tries regularly
+ *  - if the last connect was slow the interval is doubled, so the
+ *    connection cost is spread over more data
+ *  - on a low battery the interval is max_fifos
+ *  - if the unsent data is close to being overwritten, none of the above
+ *    applies.  The interval is min_fifos while uploads are succeeding,
+ *    and at most UPLOAD_URGENT_BACKOFF_DOUBLINGS doublings of it while
+ *    they are failing, so that the first upload after the link comes
+ *    back isn't put off while the ring overwrites unsent data.
+ *******************************************************************************
+ */
+int upload_scheduler_interval(const uploadSchedulerConfig *config, const uploadSchedulerState *state)
+{
+	int interval = config->min_fifos;
+	int doublings;
+
+	if (state->headroom_blocks <= config->urgent_headroom)
+	{
+		doublings = state->failed_attempts - config->backoff_after;
+		if (doublings > UPLOAD_URGENT_BACKOFF_DOUBLINGS)
+		{
+			doublings = UPLOAD_URGENT_BACKOFF_DOUBLINGS;
+		}
+		while ((doublings > 0) && (interval < config->max_fifos))
+		{
+			interval *= 2;
+			doublings--;
+		}
+		return (interval > config->max_fifos) ? config->max_fifos : interval;
+	}
+
+	if (state->failed_attempts > config->backoff_after)
+	{
+		doublings = state->failed_attempts - config->backoff_after;
+		while ((doublings > 0) && (interval < config->max_fifos))
+		{
+			interval *= 2;
+			doublings--;
+		}
+	}
+
+	if ((config->slow_connect_msec > 0)
+			&& (state->last_connect_msec > config->slow_connect_msec))
+	{
+		interval *= 2;
+	}
+
+	if ((config->low_battery_cv > 0) && (state->battery_cv > 0)
+			&& (state->battery_cv < config->low_battery_cv))
+	{
+		interval = config->max_fifos;
+	}
+
+	if (interval > config->max_fifos)
+	{
+		interval = config->max_fifos;
+	}
+
+	return interval;
+}
+
+/**
+ *******************************************************************************
+ * @brief Decide whether to start an upload now
+ *******************************************************************************
+ */
+int upload_scheduler_due(const uploadSchedulerConfig *config, const uploadSchedulerState *state)
+{
+	if (state->pending_blocks <= 0)
+	{
+		return pdFALSE;
+	}
+
+	if (state->fifos_since_upload >= upload_scheduler_interval(config, state))
+	{
+		return pdTRUE;
+	}
+
+	return pdFALSE;
+}
+
+/* EOF */
@@ -0,0 +1,195 @@
+/**
+ ****************************************************************************************
+ *
+ * @file user_wifi_cache.c
+ *
+ * @brief Remembers the access point of the last Wi-Fi connection
+ *
+ * A full connect scans every channel before it associates, which is a
+ * good part of the time it takes to bring the network up.  A wrist worn
+ * device is nearly always in range of the same access point, so the
+ * channel it was on last time is the one to try first.
+ *
+ *
+ * Copyright (c) 2024, Vanderbilt University
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************************
+ */
+
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "user_wifi_cache.h"
+
+
+/*
+ * Find the value of key in a "key=value" per line reply.
+ * Returns a pointer to the value, or NULL if the key isn't there.
+ */
+static const char *wifi_status_value(const char *status, const char *key)
+{
+	int key_len = strlen(key);
+	const char *line = status;
+
+	while (line != NULL && *line != '\0')
+	{
+		if ((strncmp(line, key, key_len) == 0) && (line[key_len] == '='))
+		{
+			return &line[key_len + 1];
+		}
+		line = strchr(line, '\n');
+		if (line != NULL)
+		{
+			line++;
+		}
+	}
+
+	return NULL;
+}
+
+static int wifi_hex_digit(char c)
+{
+	if (c >= '0' && c <= '9')
+	{
+		return c - '0';
+	}
+	if (c >= 'a' && c <= 'f')
+	{
+		return c - 'a' + 10;
+	}
+	if (c >= 'A' && c <= 'F')
+	{
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+// Parse "aa:bb:cc:dd:ee:ff"
+static int wifi_parse_bssid(const char *text, UCHAR *bssid)
+{
+	int i;
+	int high, low;
+
+	for (i = 0; i < WIFI_CACHE_BSSID_LEN; i++)
+	{
+		high = wifi_hex_digit(text[0]);
+		low = (high < 0) ? -1 : wifi_hex_digit(text[1]);
+		if (low < 0)
+		{
+			return pdFALSE;
+		}
+		bssid[i] = (UCHAR)((high << 4) | low);
+		text += 2;
+		if (i < WIFI_CACHE_BSSID_LEN - 1)
+		{
+			if (*text != ':')
+			{
+				return pdFALSE;
+			}
+			text++;
+		}
+	}
+
+	return pdTRUE;
+}
+
+
+/**
+ *******************************************************************************
+ * @brief Record the connection described by the supplicant "status" reply
+ *******************************************************************************
+ */
+int wifi_cache_parse_status(const char *status, wifiConnectCache *cache)
+{
+	const char *value;
+	UCHAR bssid[WIFI_CACHE_BSSID_LEN];
+	int freq;
+	int len;
+
+	value = wifi_status_value(status, "bssid");
+	if ((value == NULL) || !wifi_parse_bssid(value, bssid))
+	{
+		return pdFALSE;
+	}
+
+	value = wifi_status_value(status, "freq");
+	if (value == NULL)
+	{
+		return pdFALSE;
+	}
+	freq = strtol(value, NULL, 10);
+	if (freq <= 0)
+	{
+		return pdFALSE;
+	}
+
+	memcpy(cache->bssid, bssid, WIFI_CACHE_BSSID_LEN);
+	cache->freq_mhz = freq;
+
+	cache->ip_address[0] = '\0';
+	value = wifi_status_value(status, "ip_address");
+	if (value != NULL)
+	{
+		len = 0;
+		while ((len < WIFI_CACHE_IP_STR_LEN - 1)
+				&& (value[len] != '\0') && (value[len] != '\n') && (value[len] != '\r'))
+		{
+			cache->ip_address[len] = value[len];
+			len++;
+		}
+		cache->ip_address[len] = '\0';
+	}
+
+	cache->valid = pdTRUE;
+	return pdTRUE;
+}
+
+/**
+ *******************************************************************************
+ * @brief Build the supplicant commands for the cached access point
+ *
+ * "bssid any" and "scan_freq 0" are the supplicant's way of clearing
+ * the two settings, so a full scan for the configured SSID follows.
+ *******************************************************************************
+ */
+void wifi_cache_commands(const wifiConnectCache *cache, char *bssid_cmd, char *freq_cmd)
+{
+	if ((cache == NULL) || !cache->valid)
+	{
+		strcpy(bssid_cmd, "set_network 0 bssid any");
+		strcpy(freq_cmd, "set_network 0 scan_freq 0");
+		return;
+	}
+
+	sprintf(bssid_cmd, "set_network 0 bssid %02x:%02x:%02x:%02x:%02x:%02x",
+			cache->bssid[0], cache->bssid[1], cache->bssid[2],
+			cache->bssid[3], cache->bssid[4], cache->bssid[5]);
+	sprintf(freq_cmd, "set_network 0 scan_freq %d", cache->freq_mhz);
+}
+
+/* EOF */
@@ -48,6 +48,7 @@
 #include "sdk_type.h"
 #include "da16x_types.h"
 #include "common.h"
+#include "user_log.h"
 #include "Mc363x.h"
 #include "da16x_system.h"
 #include "app_common_util.h"
@@ -412,10 +413,22 @@ void set_fifo_Len(uint8_t len,uint8_t onoff,uint8_t readfeature)
 	i2c_data[1] = _bRegData; 			// Data..
 	status = i2cWriteStop(MC3672_ADDR, i2c_data, 2);
 //	mc_printf("0x16=%x\r\n", _bRegData);
-	PRINTF("0x16=0x%x\r\n", _bRegData);
+	ULOG_D("0x16=0x%x\r\n", _bRegData);
 //	mc_read_regs(MC36XX_REG_FEATURE_C_2, &_bRegData, 1);
 	buf[0] = MC36XX_REG_FEATURE_C_2;
-	status = i2cRead(MC3672_ADDR, &_bRegData, 1);
+	status = i2cRead(MC3672_ADDR, buf, 1);
+
+	// Select the FIFO read style: burst lets mc36xx_read_fifo() pull
+	// several samples in one transfer.  Leave the other bits alone.
+	_bRegData = buf[0] & ~MC36XX_FEATURE_C_2_FIFO_BURST;
+	if (readfeature == SIXTIMEBYTESONETIME)
+	{
+		_bRegData |= MC36XX_FEATURE_C_2_FIFO_BURST;
+	}
+	i2c_data[0] = MC36XX_REG_FEATURE_C_2;
+	i2c_data[1] = _bRegData;
+	status = i2cWriteStop(MC3672_ADDR, i2c_data, 2);
+	ULOG_D("0x0E=0x%x\r\n", _bRegData);
 
 
 	/* 																									NJ 04/26/2022 - Commented out lines 336-346 - Writing to 0x0E - already executed in set_clear_IntMethod()
@@ -423,7 +436,7 @@ void set_fifo_Len(uint8_t len,uint8_t onoff,uint8_t readfeature)
 	_bRegData = 0x00; //stream mode |0x20
 	_bRegData |=(readfeature<<1);
 //	mc_printf("0x0E=%x\r\n", _bRegData);
-	PRINTF("0x0E=0x%x\r\n", _bRegData);
+	ULOG_D("0x0E=0x%x\r\n", _bRegData);
 //	mc_write_regs(MC36XX_REG_FEATURE_C_2, &_bRegData, 1);
 	i2c_data[0] = MC36XX_REG_FEATURE_C_2; 	//Word Address to Write Data. 2 Bytes.
 	i2c_data[1] = _bRegData; 			// Data..
@@ -640,6 +653,84 @@ void clear_intstate(uint8_t* state)
 	//Printf("RESET FIFO\r\n");
 }
 
+/*
+ * mc36xx_read_fifo: Drain the FIFO into separate X, Y and Z sample arrays
+ *
+ * With the burst read style set (FEATURE_C_2 FIFO_BURST) the chip moves
+ * on to the next FIFO sample each time the register pointer wraps from
+ * ZOUT_MSB back to XOUT_LSB, so several samples come out of one I2C read.
+ * STATUS_1 tells us how many samples are certainly there: the whole FIFO
+ * when it is full, the threshold count when the threshold flag is set,
+ * otherwise at least one.  We never burst past that, since reading an
+ * empty FIFO returns stale data.  At the usual threshold interrupt this
+ * is one status read, one burst and one more status read, instead of a
+ * data read and a status read per sample.
+ *
+ * Only the LSB of each axis is kept (the chip runs at 8-bit resolution).
+ * Returns the number of samples read (at most max_samples).
+ */
+int mc36xx_read_fifo(int8_t *x, int8_t *y, int8_t *z, int max_samples)
+{
+	static uint8_t rawdata[MC36XX_FIFO_SIZE * MC36XX_FIFO_SAMPLE_BYTES];
+	uint8_t status_1;
+	int count = 0;
+	int burst;
+	int i;
+	int status;
+
+	rawdata[0] = MC36XX_REG_STATUS_1;
+	status = i2cRead(MC3672_ADDR, rawdata, 1);
+	// If the status can't be read, don't guess - treat the FIFO as empty
+	status_1 = status ? rawdata[0] : MC36XX_STATUS_1_FIFO_EMPTY;
+
+	while (((status_1 & MC36XX_STATUS_1_FIFO_EMPTY) == 0) && (count < max_samples))
+	{
+		burst = 1;
+		if (mc363X_All_Status.read_style == SIXTIMEBYTESONETIME)
+		{
+			if (status_1 & MC36XX_STATUS_1_FIFO_FULL)
+			{
+				burst = MC36XX_FIFO_SIZE;
+			}
+			else if ((status_1 & MC36XX_STATUS_1_FIFO_THRESH)
+					 && (mc363X_All_Status.filen > 0))
+			{
+				burst = mc363X_All_Status.filen;
+			}
+		}
+		if (burst > (max_samples - count))
+		{
+			burst = max_samples - count;
+		}
+		if (burst > MC36XX_FIFO_SIZE)
+		{
+			burst = MC36XX_FIFO_SIZE;
+		}
+
+		rawdata[0] = MC36XX_REG_XOUT_LSB;
+		status = i2cRead(MC3672_ADDR, rawdata, burst * MC36XX_FIFO_SAMPLE_BYTES);
+		if (!status)
+		{
+			// Leave what's left for the next read
+			break;
+		}
+
+		for (i = 0; i < burst; i++)
+		{
+			x[count] = (int8_t)rawdata[(i * MC36XX_FIFO_SAMPLE_BYTES) + 0];
+			y[count] = (int8_t)rawdata[(i * MC36XX_FIFO_SAMPLE_BYTES) + 2];
+			z[count] = (int8_t)rawdata[(i * MC36XX_FIFO_SAMPLE_BYTES) + 4];
+			count++;
+		}
+
+		rawdata[0] = MC36XX_REG_STATUS_1;
+		status = i2cRead(MC3672_ADDR, rawdata, 1);
+		status_1 = status ? rawdata[0] : MC36XX_STATUS_1_FIFO_EMPTY;
+	}
+
+	return count;
+}
+
 int mc36xx_init(void)
 {
 	unsigned char buf[2]={0};
@@ -695,10 +786,10 @@ void mc_timer_handle(void )
 		buf[0] = 0x0A; 	//Word Address to Write Data. 2 Bytes.
 		status = i2cRead(MC3672_ADDR, rawdata, 1);
 //		mc_printf(" 0x0a=%d\r\n",rawdata[0]);
-		PRINTF(" 0x0a=%d\r\n",rawdata[0]);
+		ULOG_D(" 0x0a=%d\r\n",rawdata[0]);
 		fifo_length = (rawdata[0]&0x3f);
 //		mc_printf(" fifo_length=%d\n",fifo_length);
-		PRINTF(" fifo_length=%d\n",fifo_length);
+		ULOG_D(" fifo_length=%d\n",fifo_length);
 
 		if(fifo_length>30)
 			fifo_length=30;
@@ -718,7 +809,7 @@ void mc_timer_handle(void )
 //			Xvalue = (Xvalue * 1000)/511;
 //			Yvalue = (Yvalue * 1000)/511;
 //			Zvalue = (Zvalue * 1000)/511;
-			PRINTF("X: %d Y: %d Z: %d\r\n",lastXvalue,lastYvalue,lastZvalue);
+			ULOG_D("X: %d Y: %d Z: %d\r\n",lastXvalue,lastYvalue,lastZvalue);
 			}
 
 	}
@@ -753,7 +844,7 @@ void mc_timer_handle(void )
 		Yvalue = (Yvalue * 1000)/511;
 		Zvalue = (Zvalue * 1000)/511;
 #endif
-		PRINTF("X: %d Y: %d Z: %d\r\n",lastXvalue,lastYvalue,lastZvalue);
+		ULOG_D("X: %d Y: %d Z: %d\r\n",lastXvalue,lastYvalue,lastZvalue);
 	}
 
 	return ;
@@ -837,7 +928,7 @@ void mc3672Init(void)
 	// ************************************************
 	int FIFO_threshold = AXL_FIFO_INTERRUPT_THRESHOLD;
 
-	PRINTF("----->mc3672Init called.  FIFO threshold %d\r\n", FIFO_threshold);
+	ULOG_D("----->mc3672Init called.  FIFO threshold %d\r\n", FIFO_threshold);
 
 	APRINTF_Y("mc3672Init called\r\n");
 	mc36xx_init();
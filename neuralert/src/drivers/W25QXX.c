@@ -36,6 +36,7 @@
 
 #include "da16x_system.h"
 //#include "spi_flash/spi_flash.h"
+#include "user_log.h"
 #include "W25QXX.h"
 
 
@@ -45,19 +46,19 @@ static void thread_peripheral_dump(const char *title, unsigned char *buf,
 		size_t len) {
 	size_t i;
 
-	PRINTF("%s (%d, %p)", title, len, buf);
+	ULOG_D_NOW("%s (%d, %p)", title, len, buf);
 	for (i = 0; i < len; i++) {
 		if ((i % 32) == 0) {
-			PRINTF("\n\t");
+			ULOG_D_NOW("\n\t");
 		} else if ((i % 4) == 2) {
-			PRINTF("_");
+			ULOG_D_NOW("_");
 		} else if ((i % 4) == 0) {
-			PRINTF(" ");
+			ULOG_D_NOW(" ");
 		}
-		PRINTF("%c%c", "0123456789ABCDEF"[buf[i] / 16],
+		ULOG_D_NOW("%c%c", "0123456789ABCDEF"[buf[i] / 16],
 				"0123456789ABCDEF"[buf[i] % 16]);
 	}
-	PRINTF("\n");
+	ULOG_D_NOW("\n");
 }
 
 #define GET_BIT(reg, loc)	((reg) & ((0x1) << (loc)))
@@ -77,6 +78,58 @@ static void thread_peripheral_dump(const char *title, unsigned char *buf,
 static  UINT32 _spi_instance = 0;
 SemaphoreHandle_t _spi_flash_semaphore = NULL;
 
+/*
+ * Erase suspend/resume state.  An erase only holds the SPI lock while it
+ * is being issued and while its status is polled, so a page read or page
+ * program can take the lock in the middle of an erase.  That operation
+ * suspends the erase, does its work and resumes the erase before it
+ * releases the lock.  Both flags only change with the SPI lock held.
+ *
+ * The caller must never read or program the sector being erased while
+ * the erase is suspended (the device returns garbage / ignores it).
+ */
+static volatile UINT8 _erase_in_progress = FALSE;
+static volatile UINT8 _erase_suspended = FALSE;
+static UINT32 _erase_suspend_count = 0;
+
+#define W25QXX_SR2_SUS_BIT			7		// SR2: erase/program suspended
+#define W25QXX_SUSPEND_POLLS		10		// tSUS is 20 usec max
+#define W25QXX_RESUME_GUARD_USEC	200		// erase time guaranteed between suspends
+
+/*
+ * Erase completion.  flash_erase_begin() issues the erase and returns
+ * with the bus released.  flash_erase_poll() checks for completion
+ * without blocking, and flash_erase_wait() sleeps the calling task until
+ * the erase is done.  The wait sleeps through most of the expected erase
+ * time in one go and then polls with a growing interval.  The expected
+ * time is learned from the erases seen so far, starting from the
+ * datasheet typical values.
+ */
+static volatile UINT8 _erase_kind = W25QXX_ERASE_4K;
+static volatile TickType_t _erase_start_tick = 0;
+static UINT32 _erase_poll_count = 0;
+
+static UINT32 _erase_expected_msec[W25QXX_ERASE_KINDS] = {
+	45,		// 4K sector erase: 45 msec typical, 400 msec max
+	120,	// 32K block erase: 120 msec typical, 1.6 sec max
+	150		// 64K block erase: 150 msec typical, 2 sec max
+};
+static const UINT32 _erase_limit_msec[W25QXX_ERASE_KINDS] = { 1000, 2000, 2500 };
+static const UINT8 _erase_command[W25QXX_ERASE_KINDS] = {
+	W25QXX_COMMAND_SECTOR_ERASE_4K,
+	W25QXX_COMMAND_BLOCK_ERASE_32K,
+	W25QXX_COMMAND_BLOCK_ERASE_64K
+};
+static const char * const _erase_name[W25QXX_ERASE_KINDS] = {
+	"eraseSector_4K", "eraseBlock_32K", "eraseBlock_64K"
+};
+
+#define W25QXX_ERASE_POLL_MIN_MSEC	5		// first poll interval after the long sleep
+#define W25QXX_ERASE_POLL_MAX_MSEC	40		// longest poll interval
+
+#define W25QXX_PROGRAM_TYPICAL_USEC	400		// page program: 0.4 msec typical, 3 msec max
+#define W25QXX_PROGRAM_POLL_USEC	100
+
 //PATCHED
 HANDLE flash_open(UINT32 spi_clock, UINT32 spi_cs) {
 	UINT32 ioctldata[4];
@@ -86,7 +139,7 @@ HANDLE flash_open(UINT32 spi_clock, UINT32 spi_cs) {
 	spi_flash = (spi_flash_t*) pvPortMalloc(sizeof(spi_flash_t));
 
 	if (spi_flash == NULL) {
-		PRINTF("spi_flash_open: unable to allocate handle\n");
+		ULOG_E("spi_flash_open: unable to allocate handle\n");
 		return NULL;
 	}
 
@@ -100,7 +153,7 @@ HANDLE flash_open(UINT32 spi_clock, UINT32 spi_cs) {
 	spi_flash->spi = SPI_CREATE(SPI_UNIT_0);
 
 	if (spi_flash->spi == NULL) {
-		PRINTF("spi_flash_open: unable to create handle\n");
+		ULOG_E("spi_flash_open: unable to create handle\n");
 		vPortFree(spi_flash);
 		xSemaphoreGive(_spi_flash_semaphore);
 		return NULL;
@@ -149,7 +202,7 @@ HANDLE flash_open(UINT32 spi_clock, UINT32 spi_cs) {
 			if (status == TRUE) {
 		//			PRINTF("SPI initialization succeeded.\n");
 				} else {
-					PRINTF("SPI failed to initialize.\n");
+					ULOG_E("SPI failed to initialize.\n");
 					xSemaphoreGive(_spi_flash_semaphore);
 					return NULL;
 			}
@@ -350,9 +403,119 @@ int readStatReg3(HANDLE handler, UINT8 *rx_buf) {
 	return TRUE;
 }
 
-//PATCHED
-int eraseSector_4K(HANDLE handler, UINT32 address) {
-#if 1
+/*
+ * Task delay in ticks for msec, at least one tick
+ */
+static TickType_t flash_msec_to_ticks(UINT32 msec) {
+	TickType_t ticks = (TickType_t)(msec / portTICK_PERIOD_MS);
+
+	return (ticks == 0) ? 1 : ticks;
+}
+
+/*
+ * Read one status register.  The SPI lock must be held.
+ */
+static UINT8 flash_read_status(spi_flash_t *spi_flash, UINT8 command) {
+	UINT32 busctrl[3];
+	UINT16 rsdr = 0;
+
+	busctrl[0] = SPI_SPI_TIMEOUT_EN | SPI_SPI_PHASE_CMD_1BYTE
+			| SPI_SPI_PHASE_ADDR_3BYTE | SPI_SET_SPI_DUMMY_CYCLE(0);
+	busctrl[1] = SPI_SET_SPI_BUS_TYPE(SPI_BUS_TYPE(1,0,SPI_BUS_SPI),
+			SPI_BUS_TYPE(0,0,SPI_BUS_SPI), SPI_BUS_TYPE(0,0,SPI_BUS_SPI),
+			SPI_BUS_TYPE(1,0,SPI_BUS_SPI) // DATA
+			);
+	SPI_IOCTL(spi_flash->spi, SPI_SET_BUSCONTROL, busctrl);
+	SPI_SFLASH_TRANSMIT(spi_flash->spi, command, 0x00, 0x00, NULL, 0, &rsdr, 1);
+	SPI_FLASH_PRINT("RDSR %02xh: 0x%x\n", command, rsdr);
+
+	return (UINT8)rsdr;
+}
+
+/*
+ * Send a command that has no address or data.  The SPI lock must be held.
+ */
+static void flash_send_command(spi_flash_t *spi_flash, UINT8 command) {
+	UINT32 busctrl[3];
+
+	busctrl[0] = SPI_SPI_TIMEOUT_EN | SPI_SPI_PHASE_CMD_1BYTE
+			| SPI_SPI_PHASE_ADDR_3BYTE | SPI_SET_SPI_DUMMY_CYCLE(0);
+	busctrl[1] = SPI_SET_SPI_BUS_TYPE(SPI_BUS_TYPE(1,0,SPI_BUS_SPI),
+			SPI_BUS_TYPE(0,0,SPI_BUS_SPI), SPI_BUS_TYPE(0,0,SPI_BUS_SPI),
+			SPI_BUS_TYPE(0,0,SPI_BUS_SPI) // DATA
+			);
+	SPI_IOCTL(spi_flash->spi, SPI_SET_BUSCONTROL, busctrl);
+	SPI_SFLASH_TRANSMIT(spi_flash->spi, command, 0x00, 0x00, NULL, 0, NULL, 0);
+}
+
+/*
+ * If an erase is running, suspend it (ERASE/PROGRAM SUSPEND, 75H) so
+ * the caller's read or program can go ahead.  The SPI lock must be held.
+ */
+static void flash_suspend_erase(spi_flash_t *spi_flash) {
+	UINT8 counter;
+
+	if (!_erase_in_progress || _erase_suspended) {
+		return;
+	}
+
+	// Nothing to suspend if the erase finished since it was last polled
+	if (GET_BIT(flash_read_status(spi_flash, W25QXX_COMMAND_READ_STATUS_REG1), 0) == 0x0) {
+		return;
+	}
+
+	SPI_FLASH_PRINT(">>>>>>\n[SPI  1-0-0-0] 75h, SUSPEND\n");
+	flash_send_command(spi_flash, W25QXX_COMMAND_ERASE_PROGRAM_SUSPEND);
+
+	counter = W25QXX_SUSPEND_POLLS;
+	while (counter--) {
+		if (GET_BIT(flash_read_status(spi_flash, W25QXX_COMMAND_READ_STATUS_REG1), 0) == 0x0)
+			break;
+		SYSUSLEEP(5);
+	}
+
+	// SUS is only set if the erase really was suspended - it may have
+	// completed between the status read and the suspend command
+	if (GET_BIT(flash_read_status(spi_flash, W25QXX_COMMAND_READ_STATUS_REG2), W25QXX_SR2_SUS_BIT)) {
+		_erase_suspended = TRUE;
+		_erase_suspend_count++;
+	}
+}
+
+/*
+ * Resume an erase suspended by flash_suspend_erase() (ERASE/PROGRAM
+ * RESUME, 7AH).  The SPI lock must be held.
+ */
+static void flash_resume_erase(spi_flash_t *spi_flash) {
+	if (!_erase_suspended) {
+		return;
+	}
+
+	SPI_FLASH_PRINT(">>>>>>\n[SPI  1-0-0-0] 7Ah, RESUME\n");
+	flash_send_command(spi_flash, W25QXX_COMMAND_ERASE_PROGRAM_RESUME);
+	_erase_suspended = FALSE;
+
+	// Let the erase run for a while before anyone can suspend it again,
+	// otherwise back to back page operations could starve it
+	SYSUSLEEP(W25QXX_RESUME_GUARD_USEC);
+}
+
+/*
+ * Number of times an erase has been suspended since boot
+ */
+UINT32 flash_erase_suspend_count(void) {
+	return _erase_suspend_count;
+}
+
+/*
+ * Start a 4K sector or 32K/64K block erase: wait for idle, write enable,
+ * erase command.  Returns as soon as the command is issued, with the SPI
+ * lock released so that pageRead() and pageWrite() can suspend the erase.
+ * Only one erase runs at a time; a second caller sleeps here until the
+ * first one has completed, and gets FALSE if the chip is still busy with
+ * it when its time limit runs out.
+ */
+int flash_erase_begin(HANDLE handler, UINT8 kind, UINT32 address) {
 	spi_flash_t *spi_flash;
 	UINT32 busctrl[3];
 	INT32 status;
@@ -360,14 +523,26 @@ int eraseSector_4K(HANDLE handler, UINT32 address) {
 	UINT32 addrbyte = 3;
 	UINT16 rsdr = 0;
 	UINT8 timeout;
+	UINT8 command;
+	const char *name;
 
-	if (handler == NULL) {
+	if ((handler == NULL) || (kind >= W25QXX_ERASE_KINDS)) {
 		return FALSE;
 	}
 
 	spi_flash = (spi_flash_t*) handler;
+	command = _erase_command[kind];
+	name = _erase_name[kind];
 
 	SPI_FLASH_LOCK(spi_flash, busctrl, TRUE);
+	while (_erase_in_progress) {
+		SPI_FLASH_LOCK(spi_flash, busctrl, FALSE);
+		if (!flash_erase_wait(handler)) {
+			// The chip is still busy with the last erase
+			return FALSE;
+		}
+		SPI_FLASH_LOCK(spi_flash, busctrl, TRUE);
+	}
 
 	/*
 	 * READ STATUS REGISTER OPERATION (RDSR, 05H)
@@ -407,7 +582,7 @@ int eraseSector_4K(HANDLE handler, UINT32 address) {
 
 	if(counter == 0)
 	{
-		Printf("eraseSector_4K: chip busy pre-check timeout\n");
+		Printf("%s: chip busy pre-check timeout\n", name);
 	}
 
 	/*
@@ -461,13 +636,14 @@ int eraseSector_4K(HANDLE handler, UINT32 address) {
 
 	if(counter == 0)
 	{
-		Printf("eraseSector_4K: pre-erase read status register WREN timeout\n");
+		Printf("%s: pre-erase read status register WREN timeout\n", name);
 	}
 
 	/*
 	 * SECTOR ERASE OPERATION (SER, D7H/20H)  - Erases 4K
+	 * BLOCK ERASE OPERATION (BE32K 52H, BE64K D8H) - Erases 32K/64K
 	 */
-	SPI_FLASH_PRINT(">>>>>>\n[SPI  1-1-0-0] 20h, SER\n");
+	SPI_FLASH_PRINT(">>>>>>\n[SPI  1-1-0-0] %02xh, SER\n", command);
 	busctrl[0] = SPI_SPI_TIMEOUT_EN | SPI_SPI_PHASE_CMD_1BYTE
 			| SPI_SPI_PHASE_ADDR_3BYTE | SPI_SET_SPI_DUMMY_CYCLE(0);
 	busctrl[1] = SPI_SET_SPI_BUS_TYPE(SPI_BUS_TYPE(1,0,SPI_BUS_SPI),
@@ -475,49 +651,129 @@ int eraseSector_4K(HANDLE handler, UINT32 address) {
 			SPI_BUS_TYPE(0,0,SPI_BUS_SPI) // DATA
 			);
 	SPI_IOCTL(spi_flash->spi, SPI_SET_BUSCONTROL, busctrl);
-	status = SPI_SFLASH_TRANSMIT(spi_flash->spi, W25QXX_COMMAND_SECTOR_ERASE_4K, address, 0x00, NULL, 0,
+	status = SPI_SFLASH_TRANSMIT(spi_flash->spi, command, address, 0x00, NULL, 0,
 			NULL, 0);
 	SPI_FLASH_PRINT("status: %d\n", status);
+	_erase_kind = kind;
+	_erase_start_tick = xTaskGetTickCount();
+	_erase_in_progress = TRUE;
 
+	SPI_FLASH_LOCK(spi_flash, busctrl, FALSE);
+	return TRUE;
+}
+
+/*
+ * Check whether the erase started by flash_erase_begin() is still running.
+ * Never blocks for longer than one status read.  Returns TRUE while the
+ * chip is busy with the erase, FALSE once it is done (or if there is
+ * none).  An erase that overruns its time limit still counts as running
+ * until the chip says otherwise; flash_erase_wait() gives up on it.
+ */
+int flash_erase_poll(HANDLE handler) {
+	spi_flash_t *spi_flash;
+	UINT32 busctrl[3];
+	UINT32 elapsed_msec;
+	int busy;
+
+	if (handler == NULL) {
+		return FALSE;
+	}
+
+	spi_flash = (spi_flash_t*) handler;
+
+	SPI_FLASH_LOCK(spi_flash, busctrl, TRUE);
+	if (!_erase_in_progress) {
+		SPI_FLASH_LOCK(spi_flash, busctrl, FALSE);
+		return FALSE;
+	}
 
-        // Waiting until ERASE-op is complete.
 	/*
 	 * READ STATUS REGISTER OPERATION (RDSR, 05H)
 	 */
-	SPI_FLASH_PRINT(">>>>>>\n[SPI  1-0-0-1] 03h, RDSR\n");
-	counter = 100;
-	while (counter--) {
-		busctrl[0] = SPI_SPI_TIMEOUT_EN | SPI_SPI_PHASE_CMD_1BYTE
-				| ((addrbyte == 3) ?
-						SPI_SPI_PHASE_ADDR_3BYTE : SPI_SPI_PHASE_ADDR_4BYTE)
-				| SPI_SET_SPI_DUMMY_CYCLE(0);
-		busctrl[1] = SPI_SET_SPI_BUS_TYPE(SPI_BUS_TYPE(1,0,SPI_BUS_SPI),
-				SPI_BUS_TYPE(0,0,SPI_BUS_SPI), SPI_BUS_TYPE(0,0,SPI_BUS_SPI),
-				SPI_BUS_TYPE(1,0,SPI_BUS_SPI) // DATA
-				);
-		SPI_IOCTL(spi_flash->spi, SPI_SET_BUSCONTROL, busctrl);
+	_erase_poll_count++;
+	busy = (GET_BIT(flash_read_status(spi_flash, W25QXX_COMMAND_READ_STATUS_REG1), 0) != 0x0);
+	elapsed_msec = (UINT32)(xTaskGetTickCount() - _erase_start_tick) * portTICK_PERIOD_MS;
+
+	if (!busy) {
+		// Learn the erase time.  What we see is a little late (we only
+		// look now and then) but the wait starts polling early enough
+		// that the estimate settles close to the real time.
+		_erase_expected_msec[_erase_kind] =
+				((3 * _erase_expected_msec[_erase_kind]) + elapsed_msec) / 4;
+		_erase_in_progress = FALSE;
+		SPI_FLASH_PRINT("%s Complete (%d msec)\n", _erase_name[_erase_kind], elapsed_msec);
+	}
 
-		SPI_SFLASH_TRANSMIT(spi_flash->spi, W25QXX_COMMAND_READ_STATUS_REG1, 0x00, 0x00, NULL, 0, &rsdr,
-				1);
-		SPI_FLASH_PRINT("RDSR: 0x%x\n", rsdr);
-		if (GET_BIT(rsdr, 0) == 0x0)
-			break;
+	SPI_FLASH_LOCK(spi_flash, busctrl, FALSE);
+	return busy;
+}
+
+/*
+ * Sleep the calling task until the erase started by flash_erase_begin()
+ * is done.  Sleeps through three quarters of the expected erase time,
+ * then polls, doubling the interval up to W25QXX_ERASE_POLL_MAX_MSEC.
+ * Returns TRUE once the erase is done, FALSE if the chip is still busy
+ * when the time limit for the erase runs out.
+ */
+int flash_erase_wait(HANDLE handler) {
+	UINT32 elapsed_msec;
+	UINT32 first_msec;
+	UINT32 poll_msec = W25QXX_ERASE_POLL_MIN_MSEC;
 
-		SYSUSLEEP(10000);
+	if (handler == NULL) {
+		return FALSE;
 	}
 
-	if(counter == 0)
-		{
-			Printf("eraseSector_4K: busy post-erase read status register\n");
+	if (_erase_in_progress) {
+		elapsed_msec = (UINT32)(xTaskGetTickCount() - _erase_start_tick) * portTICK_PERIOD_MS;
+		first_msec = _erase_expected_msec[_erase_kind] - (_erase_expected_msec[_erase_kind] / 4);
+		if (first_msec > elapsed_msec) {
+			vTaskDelay(flash_msec_to_ticks(first_msec - elapsed_msec));
+		}
+	}
+
+	while (flash_erase_poll(handler)) {
+		elapsed_msec = (UINT32)(xTaskGetTickCount() - _erase_start_tick) * portTICK_PERIOD_MS;
+		if (elapsed_msec > _erase_limit_msec[_erase_kind]) {
+			Printf("%s: busy post-erase read status register\n", _erase_name[_erase_kind]);
+			return FALSE;
 		}
+		vTaskDelay(flash_msec_to_ticks(poll_msec));
+		if (poll_msec < W25QXX_ERASE_POLL_MAX_MSEC) {
+			poll_msec *= 2;
+		}
+	}
 
+	return TRUE;
+}
 
+/*
+ * Number of completion polls made on erases since boot
+ */
+UINT32 flash_erase_poll_count(void) {
+	return _erase_poll_count;
+}
+
+//PATCHED
+int eraseSector_4K(HANDLE handler, UINT32 address) {
+	if (!flash_erase_begin(handler, W25QXX_ERASE_4K, address)) {
+		return FALSE;
+	}
+	return flash_erase_wait(handler);
+}
 
-	SPI_FLASH_PRINT("4K Sector Erase Complete\n");
+int eraseBlock_32K(HANDLE handler, UINT32 address) {
+	if (!flash_erase_begin(handler, W25QXX_ERASE_32K, address)) {
+		return FALSE;
+	}
+	return flash_erase_wait(handler);
+}
 
-	SPI_FLASH_LOCK(spi_flash, busctrl, FALSE);
-	return 1;
-#endif
+int eraseBlock_64K(HANDLE handler, UINT32 address) {
+	if (!flash_erase_begin(handler, W25QXX_ERASE_64K, address)) {
+		return FALSE;
+	}
+	return flash_erase_wait(handler);
 }
 
 
@@ -538,6 +794,7 @@ int pageWrite(HANDLE handler, UINT32 address, UINT8 *tx_buf,
 	spi_flash = (spi_flash_t*) handler;
 
 	SPI_FLASH_LOCK(spi_flash, busctrl, TRUE);
+	flash_suspend_erase(spi_flash);
 
 	/*
 	 * READ STATUS REGISTER OPERATION (RDSR, 05H)
@@ -639,6 +896,9 @@ int pageWrite(HANDLE handler, UINT32 address, UINT8 *tx_buf,
 
 
         // Waiting until PROGRAM-op is complete.
+	// A page program is well under a msec, so wait out the typical
+	// time and then poll in short steps rather than whole msecs
+	SYSUSLEEP(W25QXX_PROGRAM_TYPICAL_USEC);
 	/*
 	 * READ STATUS REGISTER OPERATION (RDSR, 05H)
 	 */
@@ -660,13 +920,14 @@ int pageWrite(HANDLE handler, UINT32 address, UINT8 *tx_buf,
 		if (GET_BIT(rsdr, 0) == 0x0)
 			break;
 
-		SYSUSLEEP(1000);
+		SYSUSLEEP(W25QXX_PROGRAM_POLL_USEC);
 	}
 
 	configASSERT(counter);
 	counter = 0;
 
 	SPI_FLASH_PRINT("Page write complete\n");
+	flash_resume_erase(spi_flash);
     SPI_FLASH_LOCK(spi_flash, busctrl, FALSE);
 
 	return status;
@@ -689,6 +950,7 @@ int pageRead(HANDLE handler, UINT32 address, UINT8 *rx_buf, UINT32 rx_len) {
 	spi_flash = (spi_flash_t*) handler;
 
 	SPI_FLASH_LOCK(spi_flash, busctrl, TRUE);
+	flash_suspend_erase(spi_flash);
 
 	/*
 	 * READ STATUS REGISTER OPERATION (RDSR, 05H)
@@ -769,6 +1031,69 @@ int pageRead(HANDLE handler, UINT32 address, UINT8 *rx_buf, UINT32 rx_len) {
 
 	SPI_FLASH_PRINT("Page read complete\n");
 
+	flash_resume_erase(spi_flash);
+	SPI_FLASH_LOCK(spi_flash, busctrl, FALSE);
+	return status;
+}
+
+
+/*
+ * Read rx_len bytes starting at address with a single FAST READ (0BH).
+ * The device keeps streaming across page and sector boundaries, so any
+ * number of consecutive pages costs one lock, one busy check and one
+ * command.  A read doesn't make the device busy, so unlike pageRead()
+ * there is no status poll afterwards.
+ */
+int pageReadRange(HANDLE handler, UINT32 address, UINT8 *rx_buf, UINT32 rx_len) {
+	spi_flash_t *spi_flash;
+	UINT32 busctrl[3];
+	INT32 status;
+	UINT8 counter = 0;
+	UINT16 rsdr = 0;
+
+	if (handler == NULL) {
+		return -1;
+	}
+
+	spi_flash = (spi_flash_t*) handler;
+
+	SPI_FLASH_LOCK(spi_flash, busctrl, TRUE);
+	flash_suspend_erase(spi_flash);
+
+	/*
+	 * READ STATUS REGISTER OPERATION (RDSR, 05H)
+	 */
+	SPI_FLASH_PRINT(">>>>>>\n[SPI  1-0-0-1] 05h, RDSR\n");
+	counter = 100;
+	while (counter--) {
+		rsdr = flash_read_status(spi_flash, W25QXX_COMMAND_READ_STATUS_REG1);
+		if (GET_BIT(rsdr, 0) == 0x0)
+			break;
+		SYSUSLEEP(1000);
+	}
+
+	if(counter == 0)
+	{
+		SPI_FLASH_PRINT("pageReadRange: Pre-read busy check timeout\n");
+	}
+
+	/*
+	 * FAST READ (0BH) - 3 byte address, 8 dummy clocks
+	 */
+	SPI_FLASH_PRINT(">>>>>>\n[SPI  1-1-8-1] 0Bh, addr 3B, %d bytes\n", rx_len);
+	busctrl[0] = SPI_SPI_TIMEOUT_EN | SPI_SPI_PHASE_CMD_1BYTE
+			| SPI_SPI_PHASE_ADDR_3BYTE | SPI_SET_SPI_DUMMY_CYCLE(8);
+	busctrl[1] = SPI_SET_SPI_BUS_TYPE(SPI_BUS_TYPE(1,0,SPI_BUS_SPI),
+			SPI_BUS_TYPE(1,0,SPI_BUS_SPI), SPI_BUS_TYPE(0,0,SPI_BUS_SPI),
+			SPI_BUS_TYPE(1,0,SPI_BUS_SPI) // DATA
+			);
+	SPI_IOCTL(spi_flash->spi, SPI_SET_BUSCONTROL, busctrl);
+	status = SPI_SFLASH_TRANSMIT(spi_flash->spi, W25QXX_COMMAND_FAST_READ, address, 0x00, NULL, 0,
+			rx_buf, rx_len);
+
+	SPI_FLASH_PRINT("Range read complete\n");
+
+	flash_resume_erase(spi_flash);
 	SPI_FLASH_LOCK(spi_flash, busctrl, FALSE);
 	return status;
 }
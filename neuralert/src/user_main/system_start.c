@@ -524,7 +524,6 @@ static void set_user_dpm_data_rcv_ready_timeout(void)
 
 
 #ifdef CFG_USE_SYSTEM_CONTROL
-#define USER_RTM_SYS_CTRL_TAG			"sys_ctrl"
 #define SYSTEM_CONTROL_WLAN_DEFAULT		(1)	// 0: Off, 1: On
 
 struct system_control_t {
@@ -535,19 +534,15 @@ static struct system_control_t *system_control = NULL;
 static uint8_t system_control_init(void)
 {
 #ifdef CFG_USE_RETMEM_WITHOUT_DPM
-	/* Create the user retention memory and Initialize. */
-	unsigned int result = user_retmmem_get(USER_RTM_SYS_CTRL_TAG,
-			(UCHAR **)&system_control);
-	if (result == 0) {
-		// created a memory for the user data
-		result = user_retmmem_allocate(USER_RTM_SYS_CTRL_TAG,
-				(void**)&system_control, sizeof(struct system_control_t));
-		if (result == 0) {
-			memset(system_control, 0, sizeof(struct system_control_t));
-			system_control->wlan_enabled = SYSTEM_CONTROL_WLAN_DEFAULT;
-		} else {
-			PRINTF("%s: Failed to allocate retention memory\n", __func__);
-		}
+	/* Get the user retention memory, initializing it the first time */
+	int created;
+
+	system_control = (struct system_control_t *)user_retmem_attach(USER_RETMEM_SYS_CTRL,
+			sizeof(struct system_control_t), &created);
+	if (system_control == NULL) {
+		PRINTF("%s: No retention memory\n", __func__);
+	} else if (created) {
+		system_control->wlan_enabled = SYSTEM_CONTROL_WLAN_DEFAULT;
 	}
 
 	return (system_control != NULL);
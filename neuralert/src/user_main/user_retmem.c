@@ -3,7 +3,9 @@
  *
  * @file user_retmem.c
  *
- * @brief Example for an implementation of user retention memory API.
+ * @brief User retention memory, laid out at compile time
+ *
+ * The regions and their offsets are listed in user_retmem_layout.h.
  *
  *
  * Modified from Renesas Electronics SDK example code with the same name
@@ -43,18 +45,37 @@
 #include "lwip/err.h"
 #include "rtc.h"
 #include "user_retmem.h"
+#include "user_crc32.h"
+#include "user_log.h"
 
 #if defined (CFG_USE_RETMEM_WITHOUT_DPM)
 
 extern int dpm_get_wakeup_source(void);
-extern void da16x_dpm_rtm_mem_init(void *mem_ptr, size_t mem_len);
-extern void da16x_dpm_rtm_mem_recovery(void *mem_ptr, size_t mem_len, void *lfree_ptr);
-extern void *da16x_dpm_rtm_mem_get_free_ptr();
-extern void *da16x_dpm_rtm_mem_calloc(uint16_t count, uint16_t size);
-extern void da16x_dpm_rtm_mem_free(void *rmem);
-extern void da16x_dpm_rtm_mem_status();
+
+// Longest chain of named allocations followed when converting
+#define USER_RETMEM_LEGACY_MAX_ENTRIES	16
+
+typedef struct
+{
+	const char *name;
+	uint32_t offset;				//!< of the header from RTM_USER_DATA_PTR
+	uint32_t capacity;				//!< bytes after the header
+	uint16_t version;
+} userRetmemRegionInfo;
+
+#define USER_RETMEM_REGION_INFO(id, name, capacity, version)	\
+	{ name, offsetof(userRetmemLayout, id##_header), USER_RETMEM_ALIGN(capacity), version },
+
+static const userRetmemRegionInfo user_retmem_regions[USER_RETMEM_REGION_COUNT] =
+{
+	USER_RETMEM_REGIONS(USER_RETMEM_REGION_INFO)
+};
+
+// The layout has to fit in the user retention memory
+typedef char user_retmem_layout_fits[(sizeof(userRetmemLayout) <= USER_DATA_ALLOC_SZ) ? 1 : -1];
 
 static unsigned char	user_rtm_pool_init_done	= pdFALSE;
+// Only used by firmware that allocated by name; see user_retmem_convert()
 static dpm_user_rtm_pool *user_retmem_pool = (dpm_user_rtm_pool *)RTM_USER_POOL_PTR;
 
 static void user_retmem_pool_clear(void)
@@ -71,79 +92,106 @@ static void user_retmem_clear(void)
 	return;
 }
 
-static void user_retmem_add(dpm_user_rtm *data)
+static userRetmemHeader *user_retmem_header(userRetmemRegion region)
 {
-	dpm_user_rtm *cur = NULL;
-
-	taskENTER_CRITICAL();
+	return (userRetmemHeader *)((UCHAR *)RTM_USER_DATA_PTR + user_retmem_regions[region].offset);
+}
 
-	if (user_retmem_pool->first_user_addr != NULL) {
-		//goto end of linked-list
-		for (cur = user_retmem_pool->first_user_addr;
-			cur->next_user_addr != NULL ;
-			cur = cur ->next_user_addr) {
-		}
+static uint32_t user_retmem_check(userRetmemRegion region, const userRetmemHeader *header)
+{
+	uint32_t place[3];
+	uint32_t crc;
 
-		cur->next_user_addr = data;
-	} else {
-		user_retmem_pool->first_user_addr = data;
-	}
+	place[0] = (uint32_t)region;
+	place[1] = user_retmem_regions[region].offset;
+	place[2] = user_retmem_regions[region].capacity;
 
-	taskEXIT_CRITICAL();
+	crc = crc32_update(0, (const UCHAR *)header, offsetof(userRetmemHeader, check));
+	return crc32_update(crc, (const UCHAR *)place, sizeof(place));
+}
 
-	return;
+static int user_retmem_valid(userRetmemRegion region, const userRetmemHeader *header)
+{
+	return ((header->magic == USER_RETMEM_MAGIC)
+			&& (header->size <= user_retmem_regions[region].capacity)
+			&& (header->check == user_retmem_check(region, header))) ? pdTRUE : pdFALSE;
 }
 
-static dpm_user_rtm *user_retmem_remove(char *name)
+static void user_retmem_create(userRetmemRegion region, uint16_t version, unsigned int size)
 {
-	dpm_user_rtm    *cur = NULL;
-	dpm_user_rtm    *prev = NULL;
+	userRetmemHeader *header = user_retmem_header(region);
 
-	taskENTER_CRITICAL();
-	if (user_retmem_pool->first_user_addr != NULL) {
-		cur = user_retmem_pool->first_user_addr;
+	memset(header + 1, 0x00, user_retmem_regions[region].capacity);
 
-		if (dpm_strcmp(cur->name, name) == 0) {
-			user_retmem_pool->first_user_addr = cur->next_user_addr;
-			taskEXIT_CRITICAL();
-			return cur;
-		} else {
-			do {
-				prev= cur;
-				cur= cur->next_user_addr;
-
-				if (cur != NULL && dpm_strcmp(cur->name, name) == 0) {
-					prev->next_user_addr = cur->next_user_addr;
-					taskEXIT_CRITICAL();
-					return cur;
-				}
-			} while (cur != NULL && cur->next_user_addr != NULL);
-		}
-	}
-	taskEXIT_CRITICAL();
-	return NULL;
+	header->magic = USER_RETMEM_MAGIC;
+	header->version = version;
+	header->reserved = 0;
+	header->size = size;
+	header->check = user_retmem_check(region, header);
 }
 
-static dpm_user_rtm *user_retmem_search(char *name)
+/*
+ * Firmware before the fixed layout kept a linked list of named
+ * allocations in the same memory.  Copy out the ones that match a
+ * region, lay the memory out afresh and put each back at the start of
+ * its region, marked USER_RETMEM_LEGACY_VERSION for its owner to convert.
+ */
+static void user_retmem_convert(void)
 {
-	dpm_user_rtm *cur = NULL;
-
-	taskENTER_CRITICAL();
-	if (user_retmem_pool->first_user_addr != NULL) {
-		for (cur = user_retmem_pool->first_user_addr; cur != NULL; cur = cur->next_user_addr) {
-			if (dpm_strcmp(cur->name, name) == 0) {
-				taskEXIT_CRITICAL();
-				return cur;
+	UCHAR *saved[USER_RETMEM_REGION_COUNT];
+	unsigned long saved_size[USER_RETMEM_REGION_COUNT];
+	const UCHAR *area_start = (const UCHAR *)RTM_USER_DATA_PTR;
+	const UCHAR *area_end = area_start + USER_DATA_ALLOC_SZ;
+	dpm_user_rtm *cur;
+	int entries;
+	int carried = 0;
+	int region;
+
+	memset(saved, 0x00, sizeof(saved));
+	memset(saved_size, 0x00, sizeof(saved_size));
+
+	for (cur = user_retmem_pool->first_user_addr, entries = 0;
+		 (cur != NULL) && (entries < USER_RETMEM_LEGACY_MAX_ENTRIES);
+		 cur = cur->next_user_addr, entries++) {
+		// Don't follow the list out of the retention memory
+		if (((const UCHAR *)cur < area_start)
+				|| ((const UCHAR *)(cur + 1) > area_end)
+				|| (cur->size > (unsigned long)(area_end - (const UCHAR *)(cur + 1)))) {
+			break;
+		}
+
+		for (region = 0; region < USER_RETMEM_REGION_COUNT; region++) {
+			if ((saved[region] == NULL)
+					&& (cur->size <= user_retmem_regions[region].capacity)
+					&& (dpm_strcmp(cur->name, (char *)user_retmem_regions[region].name) == 0)) {
+				saved[region] = (UCHAR *)pvPortMalloc(cur->size);
+				if (saved[region] != NULL) {
+					memcpy(saved[region], cur + 1, cur->size);
+					saved_size[region] = cur->size;
+				}
+				break;
 			}
 		}
 	}
-	taskEXIT_CRITICAL();
-	return NULL;
+
+	user_retmem_pool_clear();
+	user_retmem_clear();
+
+	for (region = 0; region < USER_RETMEM_REGION_COUNT; region++) {
+		if (saved[region] != NULL) {
+			user_retmem_create(region, USER_RETMEM_LEGACY_VERSION, saved_size[region]);
+			memcpy(user_retmem_header(region) + 1, saved[region], saved_size[region]);
+			vPortFree(saved[region]);
+			carried++;
+		}
+	}
+
+	PRINTF("User RETMEM converted to fixed layout (%d regions kept).\r\n", carried);
 }
 
 void user_retmem_init(void)
 {
-	PRINTF("\n**Neuralert: user_retmem_init()\n"); // FRSDEBUG
+	ULOG_D("\n**Neuralert: user_retmem_init()\n"); // FRSDEBUG
 
 	if (!user_rtm_pool_init_done) {
 		if (dpm_get_wakeup_source() & WAKEUP_SOURCE_POR) {
@@ -156,17 +204,10 @@ void user_retmem_init(void)
 			//to clear user rtm data
 			user_retmem_clear();
 
-			da16x_dpm_rtm_mem_init(RTM_USER_DATA_PTR, USER_DATA_ALLOC_SZ);
-
-			user_retmem_pool->free_ptr = da16x_dpm_rtm_mem_get_free_ptr();
-
-			user_retmem_pool->first_user_addr = NULL;
-
 			PRINTF("User RETMEM initialized.\r\n");
-		} else {
-			da16x_dpm_rtm_mem_recovery(RTM_USER_DATA_PTR, USER_DATA_ALLOC_SZ,
-					user_retmem_pool->free_ptr);
-			PRINTF("User RETMEM recovered.\r\n");
+		} else if (user_retmem_pool->first_user_addr != NULL) {
+			// First wake after an update from firmware that allocated by name
+			user_retmem_convert();
 		}
 
 		// Set flag to mark User RTM Initialize done ...
@@ -185,95 +226,96 @@ void user_retmem_deinit(void)
     PRINTF("User RETMEM removed.\r\n");
 }
 
-unsigned int user_retmmem_allocate(char *name,
-								   void **memory_ptr,
-								   unsigned long memory_size)
+void *user_retmem_attach(userRetmemRegion region, unsigned int size, int *created)
 {
-    dpm_user_rtm *user_memory = NULL;
-
-    //to check parameters
-    if ((name == NULL)
-            || (strlen(name) >= REG_NAME_DPM_MAX_LEN)
-            || (memory_size == 0)) {
-        return ER_INVALID_PARAMETERS;
-    }
-
-    //to check duplicated name
-    if (user_retmem_search(name) != NULL) {
-        PRINTF("[%s] Already registered user rtm(%s)\n", __func__, name);
-        return ER_DUPLICATED_ENTRY;
-    }
-
-    //to allocate memory
-	user_memory = (dpm_user_rtm *)da16x_dpm_rtm_mem_calloc((memory_size + sizeof(dpm_user_rtm)), sizeof(unsigned char));
-	if (user_memory == NULL) {
-		PRINTF("[%s] Failed to allocate memory(size:%d)\n", __func__, (memory_size + sizeof(dpm_user_rtm)));
-		return ER_NO_MEMORY;
-	}
-
-	//update lfree. It has to be called after allocate & free
-	user_retmem_pool->free_ptr = da16x_dpm_rtm_mem_get_free_ptr();
+	userRetmemHeader *header;
 
-    //to set user rtm
-    strcpy(user_memory->name, name);
-    user_memory->size = memory_size;
-    user_memory->start_user_addr = (UCHAR *)(user_memory) + sizeof(dpm_user_rtm);
-    user_memory->next_user_addr = NULL;
+	if (created != NULL) {
+		*created = pdFALSE;
+	}
 
-    //to add user rtm into chain
-    user_retmem_add(user_memory);
+	//to check parameters
+	if ((region >= USER_RETMEM_REGION_COUNT)
+			|| (size == 0)
+			|| (size > user_retmem_regions[region].capacity)) {
+		PRINTF("[%s] Region %d can't hold %d bytes\n", __func__, region, size);
+		return NULL;
+	}
 
-    //to set user memory point
-    *memory_ptr = user_memory->start_user_addr;
+	header = user_retmem_header(region);
+	if (!user_retmem_valid(region, header)
+			|| (header->version != user_retmem_regions[region].version)
+			|| (header->size != size)) {
+		// Never created, or created by firmware with another layout
+		user_retmem_create(region, user_retmem_regions[region].version, size);
+		if (created != NULL) {
+			*created = pdTRUE;
+		}
+	}
 
-    return 0;
+	return header + 1;
 }
 
-unsigned int user_retmmem_release(char *name)
+void *user_retmem_find(userRetmemRegion region, unsigned int size)
 {
-    dpm_user_rtm *cur_mem = NULL;
-
-    if ((name == NULL)
-            || (strlen(name) >= REG_NAME_DPM_MAX_LEN)) {
-        return  ER_INVALID_PARAMETERS;
-    }
-
-    cur_mem = user_retmem_remove(name);
-    if (cur_mem != NULL) {
-        da16x_dpm_rtm_mem_free(cur_mem);
+	userRetmemHeader *header;
 
-		//update lfree. It has to be called after allocate & free
-        user_retmem_pool->free_ptr = da16x_dpm_rtm_mem_get_free_ptr();
-
-        return 0;
-    }
+	if (region >= USER_RETMEM_REGION_COUNT) {
+		return NULL;
+	}
 
-    PRINTF("[%s] Not found user data(%s)\n", __func__, name);
+	header = user_retmem_header(region);
+	if (!user_retmem_valid(region, header)
+			|| (header->version != user_retmem_regions[region].version)
+			|| (header->size != size)) {
+		return NULL;
+	}
 
-    return ER_NOT_FOUND;
+	return header + 1;
 }
 
-unsigned int user_retmmem_get(char *name, unsigned char **data)
+unsigned int user_retmem_legacy_get(userRetmemRegion region, unsigned char **data)
 {
-	dpm_user_rtm *cur = NULL;
+	userRetmemHeader *header;
 
-    if ((name == NULL)
-			|| (strlen(name) >= REG_NAME_DPM_MAX_LEN)) {
-		return  0;
+	if (region >= USER_RETMEM_REGION_COUNT) {
+		return 0;
 	}
 
-	cur = user_retmem_search(name);
-	if (cur != NULL) {
-		*data = cur->start_user_addr;
-		return cur->size;
+	header = user_retmem_header(region);
+	if (!user_retmem_valid(region, header)
+			|| (header->version != USER_RETMEM_LEGACY_VERSION)) {
+		return 0;
 	}
 
-	return 0;
+	*data = (unsigned char *)(header + 1);
+	return header->size;
 }
 
-void user_retmmem_info_get(void)
+void user_retmem_info(void)
 {
-	da16x_dpm_rtm_mem_status();
+	const userRetmemHeader *header;
+	int region;
+
+	PRINTF("User RETMEM layout: %d of %d bytes\n", sizeof(userRetmemLayout), USER_DATA_ALLOC_SZ);
+	PRINTF("  %-10s %6s %6s %4s  %s\n", "region", "offset", "size", "ver", "state");
+
+	for (region = 0; region < USER_RETMEM_REGION_COUNT; region++) {
+		header = user_retmem_header(region);
+		PRINTF("  %-10s %6d %6d %4d  ",
+				user_retmem_regions[region].name,
+				user_retmem_regions[region].offset,
+				user_retmem_regions[region].capacity,
+				user_retmem_regions[region].version);
+
+		if (!user_retmem_valid(region, header)) {
+			PRINTF("not created\n");
+		} else if (header->version == user_retmem_regions[region].version) {
+			PRINTF("%d bytes used\n", header->size);
+		} else {
+			PRINTF("version %d, %d bytes\n", header->version, header->size);
+		}
+	}
 }
 
 #endif // CFG_USE_RETMEM_WITHOUT_DPM
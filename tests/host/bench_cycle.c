@@ -0,0 +1,844 @@
+/*
+ * Host benchmark of the wake/upload cycle
+ *
+ * A week of accelerometer wakes and uploads runs through the firmware's
+ * own code.  The FIFO is drained with Mc363x.c and the blocks are written,
+ * erased and read back with W25QXX.c, against models of the MC3672 and the
+ * W25Q64 that take their bus and typical data sheet times on the simulated
+ * clock (host_rtos.c).  The parts of neuralert.c that need the SDK are
+ * repeated here as shims that call the same functions in the same order:
+ *
+ *   wake()               user_process_read_data(), user_process_write_to_flash()
+ *   store_block()        AB_store_block(), AB_write_block()
+ *   prepare_sector()     AB_prepare_sector()
+ *   erase_sectors()      user_erase_flash_sector()
+ *   erase_ahead()        AB_erase_ahead()
+ *   read_blocks()        AB_read_blocks()
+ *   upload()             user_process_send_MQTT_data(), assemble_packet_data()
+ *
+ * with user_erase_ahead.c, user_transmit_map.c, user_upload_scheduler.c,
+ * user_ab_block.c and user_json_packet.c doing the rest.  Every sample has
+ * to be sent exactly once, intact.
+ *
+ * The awake msec per hour of each phase and the flash erases and page
+ * programs per day are reported.  Only what no code here decides - the
+ * boot from sleep, the Wi-Fi and broker connection and the link - is
+ * charged with the fixed times below.
+ */
+#include <math.h>
+#include <string.h>
+#include "host_test.h"
+#include "host_rtos.h"
+#include "da16x_system.h"
+#include "common.h"
+#include "W25QXX.h"
+#include "Mc363x.h"
+#include "user_transmit_map.h"
+#include "user_erase_ahead.h"
+#include "user_upload_scheduler.h"
+#include "user_ab_block.h"
+#include "user_json_packet.h"
+
+#define CYCLE_DAYS				7
+#define FIFO_MSEC				(AXL_FIFO_INTERRUPT_THRESHOLD * 1000 / AXL_SAMPLES_PER_SECOND)
+#define WAKES_PER_DAY			(86400000 / FIFO_MSEC)
+#define ACTIVE_FRACTION			0.3
+
+// Nightly outage: uploads from 02:00 to 04:00 fail
+#define OUTAGE_FIRST_WAKE		(2 * 3600000 / FIFO_MSEC)
+#define OUTAGE_LAST_WAKE		(4 * 3600000 / FIFO_MSEC)
+
+// Interrupt to user_process_read_data(), waking from sleep
+#define WAKE_BOOT_MSEC			60
+// Fast connect to the last access point
+#define UPLOAD_WIFI_MSEC		400
+// TLS and MQTT CONNECT, up to the connected callback
+#define UPLOAD_BROKER_MSEC		1500
+// Connected callback until the client can publish; erase-ahead runs here
+#define UPLOAD_READY_MSEC		2000
+// An upload that can't connect runs until the connection watchdog
+// (WATCHDOG_TIMEOUT_SECONDS in neuralert.c)
+#define UPLOAD_FAIL_MSEC		30000
+#define UPLOAD_DISCONNECT_MSEC	200
+#define LINK_KBPS				2000
+#define LINK_RTT_MSEC			60
+
+#define I2C_KHZ					400
+#define I2C_BITS_PER_BYTE		9		// with the ACK
+
+// W25Q64 data sheet, typical
+#define W25Q64_PROGRAM_USEC		400
+#define W25Q64_ERASE_4K_USEC	45000
+#define W25Q64_ERASE_32K_USEC	120000
+#define W25Q64_ERASE_64K_USEC	150000
+
+// The part of the flash the accelerometer buffer uses
+#define CHIP_SIZE				0x100000
+typedef char AB_region_fits_chip[(AB_BLOCK_ADDRESS(AB_FLASH_MAX_BLOCKS) <= CHIP_SIZE) ? 1 : -1];
+
+#define SIXTIMEBYTESONETIME		1		// as in Mc363x.c
+
+// Defined in Mc363x.c but not declared in Mc363x.h
+extern Mc363X_All_Status mc363X_All_Status;
+
+// Globals the driver shares with the application (globals.c)
+HANDLE I2C = (HANDLE)1;
+UINT8 i2c_data[AT_I2C_DATA_LENGTH + AT_I2C_LENGTH_FOR_WORD_ADDRESS];
+UINT8 sensorTypePresentAll;
+int16_t lastXvalue;
+int16_t lastYvalue;
+int16_t lastZvalue;
+
+static unsigned int seed = 1022;
+
+/*
+ * Bus transfers take their time on the simulated clock, kept in nsec so
+ * that the short ones add up
+ */
+static unsigned long long bus_nsec;
+
+static void bus_time(unsigned int bytes, unsigned int bits_per_byte, unsigned int khz)
+{
+	bus_nsec += (unsigned long long)bytes * bits_per_byte * 1000000 / khz;
+	host_rtos_usleep((unsigned int)(bus_nsec / 1000));
+	bus_nsec %= 1000;
+}
+
+/*
+ * W25Q64: status registers, write enable, page program, 4K/32K/64K erase
+ * and the two reads
+ */
+static struct
+{
+	UINT8 mem[CHIP_SIZE];
+	unsigned long long busy_until;		// host_rtos_usec() the operation ends
+	int write_enabled;
+	long programs;
+	long erases[W25QXX_ERASE_KINDS];
+	long sectors_erased;
+	long bad_programs;					// over bits that weren't erased
+	long refused;						// busy or not write enabled
+} chip;
+
+static int chip_busy(void)
+{
+	return host_rtos_usec() < chip.busy_until;
+}
+
+static void chip_erase(int kind, UINT32 address, UINT32 size, unsigned int usec)
+{
+	CHECK_EQ(address % size, 0);
+	CHECK(address + size <= CHIP_SIZE);
+	memset(&chip.mem[address], 0xFF, size);
+	chip.erases[kind]++;
+	chip.sectors_erased += size / AB_FLASH_SECTOR_SIZE;
+	chip.busy_until = host_rtos_usec() + usec;
+}
+
+int host_spi_transmit(HANDLE spi, UINT8 command, UINT32 address, UINT32 mode,
+		UINT8 *tx, UINT32 tx_len, void *rx, UINT32 rx_len)
+{
+	UINT32 i;
+	UINT8 *page;
+
+	switch (command)
+	{
+	case W25QXX_COMMAND_READ_STATUS_REG1:
+		bus_time(1 + rx_len, 8, SPI_MASTER_CLK * 1000);
+		*(UINT8 *)rx = (chip_busy() ? 0x01 : 0x00) | (chip.write_enabled ? 0x02 : 0x00);
+		return 0;
+	case W25QXX_COMMAND_READ_STATUS_REG2:
+		bus_time(1 + rx_len, 8, SPI_MASTER_CLK * 1000);
+		*(UINT8 *)rx = 0;
+		return 0;
+	case W25QXX_COMMAND_WRITE_ENABLE:
+		bus_time(1, 8, SPI_MASTER_CLK * 1000);
+		if (!chip_busy())
+		{
+			chip.write_enabled = TRUE;
+		}
+		return 0;
+	}
+
+	bus_time(1 + 3 + tx_len + rx_len + ((command == W25QXX_COMMAND_FAST_READ) ? 1 : 0),
+			8, SPI_MASTER_CLK * 1000);
+	CHECK(address + rx_len <= CHIP_SIZE);
+	if (chip_busy() || ((command != W25QXX_COMMAND_READ_DATA)
+			&& (command != W25QXX_COMMAND_FAST_READ) && !chip.write_enabled))
+	{
+		chip.refused++;
+		return -1;
+	}
+
+	switch (command)
+	{
+	case W25QXX_COMMAND_READ_DATA:
+	case W25QXX_COMMAND_FAST_READ:
+		memcpy(rx, &chip.mem[address], rx_len);
+		return 0;
+	case W25QXX_COMMAND_PAGE_PROGRAM:
+		page = &chip.mem[address - (address % AB_FLASH_PAGE_SIZE)];
+		for (i = 0; i < tx_len; i++)
+		{
+			if (chip.mem[address + i] != 0xFF)
+			{
+				chip.bad_programs++;
+			}
+			page[(address + i) % AB_FLASH_PAGE_SIZE] &= tx[i];
+		}
+		chip.programs++;
+		chip.busy_until = host_rtos_usec() + W25Q64_PROGRAM_USEC;
+		break;
+	case W25QXX_COMMAND_SECTOR_ERASE_4K:
+		chip_erase(W25QXX_ERASE_4K, address, AB_FLASH_SECTOR_SIZE, W25Q64_ERASE_4K_USEC);
+		break;
+	case W25QXX_COMMAND_BLOCK_ERASE_32K:
+		chip_erase(W25QXX_ERASE_32K, address, AB_FLASH_BLOCK_32K_SIZE, W25Q64_ERASE_32K_USEC);
+		break;
+	case W25QXX_COMMAND_BLOCK_ERASE_64K:
+		chip_erase(W25QXX_ERASE_64K, address, AB_FLASH_BLOCK_64K_SIZE, W25Q64_ERASE_64K_USEC);
+		break;
+	default:
+		CHECK_EQ(command, 0);
+		break;
+	}
+	chip.write_enabled = FALSE;
+	return 0;
+}
+
+/*
+ * MC3672: the FIFO, its STATUS_1 flags and threshold, the burst read and
+ * the interrupt status, as in test_mc36xx_fifo.c
+ */
+static struct
+{
+	UINT8 regs[256];
+	int8_t fifo[MC36XX_FIFO_SIZE][3];
+	int head;
+	int count;
+	int8_t last[3];
+} mc;
+
+static UINT8 mc_status_1(void)
+{
+	UINT8 status = 0;
+	int threshold = mc.regs[MC36XX_REG_FIFO_C] & 0x1F;
+
+	if (mc.count == 0)
+	{
+		status |= MC36XX_STATUS_1_FIFO_EMPTY;
+	}
+	if (mc.count == MC36XX_FIFO_SIZE)
+	{
+		status |= MC36XX_STATUS_1_FIFO_FULL;
+	}
+	if ((threshold > 0) && (mc.count >= threshold))
+	{
+		status |= MC36XX_STATUS_1_FIFO_THRESH;
+	}
+	return status;
+}
+
+int host_i2c_ioctl(HANDLE i2c, UINT32 cmd, void *data)
+{
+	return TRUE;
+}
+
+int host_i2c_write(HANDLE i2c, void *data, UINT32 length)
+{
+	UINT8 *bytes = data;
+	UINT32 i;
+
+	// Device address, register, data
+	bus_time(1 + length, I2C_BITS_PER_BYTE, I2C_KHZ);
+	for (i = 1; i < length; i++)
+	{
+		mc.regs[(UINT8)(bytes[0] + i - 1)] = bytes[i];
+	}
+	return TRUE;
+}
+
+int host_i2c_read(HANDLE i2c, void *data, UINT32 length)
+{
+	UINT8 *bytes = data;
+	int reg = bytes[0];
+	const int8_t *sample;
+	int axis;
+	UINT32 i;
+
+	// Device address, register, device address again, data
+	bus_time(3 + length, I2C_BITS_PER_BYTE, I2C_KHZ);
+	for (i = 0; i < length; i++)
+	{
+		if ((reg >= MC36XX_REG_XOUT_LSB) && (reg < MC36XX_REG_XOUT_LSB + MC36XX_FIFO_SAMPLE_BYTES))
+		{
+			sample = (mc.count > 0) ? mc.fifo[mc.head] : mc.last;
+			axis = (reg - MC36XX_REG_XOUT_LSB) / 2;
+			bytes[i] = (reg & 1) ? ((sample[axis] < 0) ? 0xFF : 0x00) : (UINT8)sample[axis];
+			if (reg == MC36XX_REG_XOUT_LSB + MC36XX_FIFO_SAMPLE_BYTES - 1)
+			{
+				CHECK(mc.count > 0);
+				if (mc.count > 0)
+				{
+					memcpy(mc.last, mc.fifo[mc.head], sizeof(mc.last));
+					mc.head = (mc.head + 1) % MC36XX_FIFO_SIZE;
+					mc.count--;
+				}
+				if (mc.regs[MC36XX_REG_FEATURE_C_2] & MC36XX_FEATURE_C_2_FIFO_BURST)
+				{
+					reg = MC36XX_REG_XOUT_LSB;
+					continue;
+				}
+			}
+		}
+		else if (reg == MC36XX_REG_STATUS_1)
+		{
+			bytes[i] = mc_status_1();
+		}
+		else
+		{
+			bytes[i] = mc.regs[reg];
+		}
+		reg = (reg + 1) & 0xFF;
+	}
+	return TRUE;
+}
+
+/*
+ * A wrist that is mostly still, with bouts of movement, filling the FIFO
+ * between wakes
+ */
+static struct
+{
+	double pos[3];
+	int active;
+} wrist = { { 0.0, 0.0, 64.0 }, FALSE };
+
+static double gauss(double sigma)
+{
+	double u1 = (host_rand(&seed) + 1.0) / 4294967297.0;
+	double u2 = host_rand(&seed) / 4294967296.0;
+
+	return sigma * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static void fill_fifo(void)
+{
+	double sigma, rest;
+	int i, axis, tail;
+
+	if ((host_rand(&seed) % 30) == 0)
+	{
+		wrist.active = (host_rand(&seed) % 1000) < (unsigned int)(ACTIVE_FRACTION * 1000);
+	}
+	sigma = wrist.active ? 10.0 : 0.6;
+
+	for (i = 0; i < AXL_FIFO_INTERRUPT_THRESHOLD; i++)
+	{
+		tail = (mc.head + mc.count) % MC36XX_FIFO_SIZE;
+		for (axis = 0; axis < 3; axis++)
+		{
+			rest = (axis == 2) ? 64.0 : 0.0;
+			wrist.pos[axis] += gauss(sigma) + 0.05 * (rest - wrist.pos[axis]);
+			wrist.pos[axis] = fmax(-128.0, fmin(127.0, wrist.pos[axis]));
+			mc.fifo[tail][axis] = (int8_t)lrint(wrist.pos[axis]);
+		}
+		mc.count++;
+	}
+}
+
+/*
+ * The buffer state neuralert.c keeps in retention memory
+ */
+static struct
+{
+	_AB_transmit_map_t map[AB_TRANSMIT_MAP_SIZE];
+	int write_pos;
+	AB_INDEX_TYPE next_erase;
+	ULONG read_count;
+	__time64_t last_read_time;
+} ab;
+
+static struct
+{
+	// Awake usec by phase
+	unsigned long long boot_usec;
+	unsigned long long fifo_usec;
+	unsigned long long write_usec;
+	unsigned long long erase_usec;		// on the wake path
+	unsigned long long connect_usec;
+	unsigned long long erase_ahead_usec;	// beyond UPLOAD_READY_MSEC
+	unsigned long long transmit_usec;
+	unsigned long long failed_usec;
+
+	long inline_erases;
+	long erase_ahead_sectors;
+	long erase_ahead_dropped;
+	long write_failures;
+	long samples_sent;
+	long bytes_sent;
+	long packets;
+	long uploads;
+	long failed_uploads;
+	long sent_twice;
+	long bad_blocks;
+	unsigned char sent[CYCLE_DAYS * WAKES_PER_DAY + 1];
+} stats;
+
+/*
+ * user_erase_flash_sector(): erase and check the start of the sector
+ */
+static int erase_sectors(HANDLE SPI, ULONG address, int num_sectors)
+{
+	UCHAR check_bytes[AB_ERASE_VERIFY_BYTES];
+	int erase_status = FALSE;
+	int attempt, i;
+
+	for (attempt = 0; (attempt < AB_ERASE_MAX_ATTEMPTS) && !erase_status; attempt++)
+	{
+		if (num_sectors == (AB_FLASH_BLOCK_64K_SIZE / AB_FLASH_SECTOR_SIZE))
+		{
+			erase_status = eraseBlock_64K(SPI, (UINT32)address);
+		}
+		else if (num_sectors == (AB_FLASH_BLOCK_32K_SIZE / AB_FLASH_SECTOR_SIZE))
+		{
+			erase_status = eraseBlock_32K(SPI, (UINT32)address);
+		}
+		else
+		{
+			erase_status = eraseSector_4K(SPI, (UINT32)address);
+		}
+
+		if (erase_status && (pageRead(SPI, (UINT32)address, check_bytes, AB_ERASE_VERIFY_BYTES) >= 0))
+		{
+			for (i = 0; i < AB_ERASE_VERIFY_BYTES; i++)
+			{
+				if (check_bytes[i] != 0xFF)
+				{
+					erase_status = FALSE;
+				}
+			}
+		}
+		if (!erase_status)
+		{
+			vTaskDelay(pdMS_TO_TICKS(10));
+		}
+	}
+	return erase_status;
+}
+
+/*
+ * AB_prepare_sector(): the accelerometer task only erases if erase-ahead
+ * hasn't.  Nothing runs alongside here, so there is never an erase in
+ * flight to wait for.
+ */
+static int prepare_sector(HANDLE SPI, int sector_start, int *did_an_erase)
+{
+	unsigned long long t0;
+	int erase_status;
+
+	if (ab_erased_sectors_from(ab.next_erase, sector_start) > 0)
+	{
+		return TRUE;
+	}
+
+	*did_an_erase = pdTRUE;
+	stats.inline_erases++;
+	t0 = host_rtos_usec();
+	erase_status = erase_sectors(SPI, AB_BLOCK_ADDRESS(sector_start), 1);
+	stats.erase_usec += host_rtos_usec() - t0;
+
+	if (ab_erased_sectors_from(ab.next_erase, sector_start) <= 0)
+	{
+		ab.next_erase = (sector_start + AB_BLOCKS_PER_SECTOR) % AB_FLASH_MAX_BLOCKS;
+	}
+	return erase_status;
+}
+
+/*
+ * AB_store_block() for one block: program its slot, read back the start
+ * of it, advance the write position and get the next sector ready
+ */
+static int store_block(HANDLE SPI, accelBufferStruct *block, int *did_an_erase)
+{
+	UCHAR slots[AB_BLOCKS_PER_PAGE * AB_BLOCK_SIZE];
+	UCHAR check_bytes[AB_WRITE_VERIFY_BYTES];
+	ULONG address = AB_BLOCK_ADDRESS(ab.write_pos);
+	int written = FALSE;
+	int attempt;
+
+	*did_an_erase = pdFALSE;
+	block->crc = ab_block_crc(block);
+	memset(slots, 0xFF, sizeof(slots));
+	memcpy(slots, block, sizeof(*block));
+
+	for (attempt = 0; (attempt < AB_WRITE_MAX_ATTEMPTS) && !written; attempt++)
+	{
+		written = (pageWrite(SPI, (UINT32)address, slots, AB_BLOCK_SIZE) >= 0)
+				&& (pageRead(SPI, (UINT32)address, check_bytes, AB_WRITE_VERIFY_BYTES) >= 0)
+				&& (memcmp(check_bytes, block, AB_WRITE_VERIFY_BYTES) == 0);
+		if (!written)
+		{
+			vTaskDelay(pdMS_TO_TICKS(30));
+		}
+	}
+	if (!written)
+	{
+		stats.write_failures++;
+		return FALSE;
+	}
+
+	ab_map_set(ab.map, ab.write_pos);
+	ab.write_pos = (ab.write_pos + 1) % AB_FLASH_MAX_BLOCKS;
+	if ((ab.write_pos % AB_BLOCKS_PER_SECTOR) == 0)
+	{
+		return prepare_sector(SPI, ab.write_pos, did_an_erase);
+	}
+	return TRUE;
+}
+
+/*
+ * user_process_read_data() and user_process_write_to_flash()
+ */
+static void wake(__time64_t now_msec)
+{
+	accelBufferStruct block;
+	unsigned long long t0, erase0;
+	uint8_t reason;
+	int did_an_erase;
+	HANDLE SPI;
+
+	stats.boot_usec += WAKE_BOOT_MSEC * 1000;
+
+	t0 = host_rtos_usec();
+	memset(&block, 0, sizeof(block));
+	block.num_samples = mc36xx_read_fifo(block.Xvalue, block.Yvalue, block.Zvalue, MAX_ACCEL_FIFO_SIZE);
+	clear_intstate(&reason);
+	stats.fifo_usec += host_rtos_usec() - t0;
+	CHECK_EQ(block.num_samples, AXL_FIFO_INTERRUPT_THRESHOLD);
+
+	block.data_sequence = ++ab.read_count;
+	block.accelTime = now_msec;
+	block.accelTime_prev = ab.last_read_time;
+	ab.last_read_time = now_msec;
+
+	t0 = host_rtos_usec();
+	erase0 = stats.erase_usec;
+	SPI = flash_open(SPI_MASTER_CLK, SPI_MASTER_CS);
+	CHECK(store_block(SPI, &block, &did_an_erase) == TRUE);
+	flash_close(SPI);
+	stats.write_usec += (host_rtos_usec() - t0) - (stats.erase_usec - erase0);
+}
+
+/*
+ * AB_erase_ahead()
+ */
+static void erase_ahead(HANDLE SPI)
+{
+	int erase_pos, num_sectors, ops;
+
+	for (ops = 0; ops < AB_ERASE_AHEAD_MAX_OPS; ops++)
+	{
+		erase_pos = ab_erase_ahead_next(&ab.next_erase, ab.write_pos, (ops == 0), &num_sectors);
+		if (erase_pos < 0)
+		{
+			break;
+		}
+
+		stats.erase_ahead_dropped += ab_map_clear_range(ab.map, erase_pos,
+				erase_pos + (num_sectors * AB_BLOCKS_PER_SECTOR) - 1);
+		if (!erase_sectors(SPI, AB_BLOCK_ADDRESS(erase_pos), num_sectors))
+		{
+			break;
+		}
+		if (ab.next_erase == erase_pos)
+		{
+			ab.next_erase = (erase_pos + (num_sectors * AB_BLOCKS_PER_SECTOR)) % AB_FLASH_MAX_BLOCKS;
+		}
+		stats.erase_ahead_sectors += num_sectors;
+	}
+}
+
+/*
+ * AB_read_blocks(): a run of blocks ending at last_block, newest first,
+ * in one FAST READ (two if the run wraps)
+ */
+static int read_blocks(HANDLE SPI, int last_block, int num_blocks, accelBufferStruct *blocks)
+{
+	static UCHAR slots[FIFO_BLOCKS_PER_PACKET * AB_BLOCK_SIZE];
+	int first_block = last_block - num_blocks + 1;
+	int wrapped_blocks = 0;
+	int status;
+	int i;
+
+	if (first_block < 0)
+	{
+		wrapped_blocks = -first_block;
+		first_block += AB_FLASH_MAX_BLOCKS;
+	}
+	if (wrapped_blocks > 0)
+	{
+		status = pageReadRange(SPI, AB_BLOCK_ADDRESS(first_block), slots, AB_BLOCK_SIZE * wrapped_blocks);
+		if (status >= 0)
+		{
+			status = pageReadRange(SPI, AB_BLOCK_ADDRESS(0), &slots[AB_BLOCK_SIZE * wrapped_blocks],
+					AB_BLOCK_SIZE * (num_blocks - wrapped_blocks));
+		}
+	}
+	else
+	{
+		status = pageReadRange(SPI, AB_BLOCK_ADDRESS(first_block), slots, AB_BLOCK_SIZE * num_blocks);
+	}
+	for (i = 0; i < num_blocks; i++)
+	{
+		memcpy(&blocks[i], &slots[AB_BLOCK_SIZE * (num_blocks - 1 - i)], sizeof(accelBufferStruct));
+	}
+	return status >= 0;
+}
+
+static int prev_pos(int pos)
+{
+	return (pos == 0) ? (AB_FLASH_MAX_BLOCKS - 1) : (pos - 1);
+}
+
+// Same search as find_AB_transmit_location() in neuralert.c
+static int find_transmit_location(int location, int max_run, int *run_length)
+{
+	int found = -1;
+	int search_count;
+	int skipped;
+
+	*run_length = 0;
+	search_count = (location >= ab.write_pos) ? (location - ab.write_pos)
+			: (AB_FLASH_MAX_BLOCKS - (ab.write_pos - location));
+	search_count -= AB_TRANSMIT_SAFETY_GAP;
+	if (search_count > 0)
+	{
+		found = ab_map_find_prev(ab.map, location, search_count);
+		if (found >= 0)
+		{
+			skipped = location - found;
+			if (skipped < 0)
+			{
+				skipped += AB_FLASH_MAX_BLOCKS;
+			}
+			if (max_run > search_count - skipped)
+			{
+				max_run = search_count - skipped;
+			}
+			*run_length = ab_map_run_prev(ab.map, found, max_run);
+		}
+	}
+	return found;
+}
+
+/*
+ * Everything below the write position, newest first, FIFO_BLOCKS_PER_PACKET
+ * blocks a packet.  The SDK client takes one QOS 1 packet at a time, and
+ * the next packet is read and composed while the PUBACK of the last one is
+ * on its way (see user_mqtt_publish.h).
+ */
+static void upload(void)
+{
+	static accelBufferStruct blocks[FIFO_BLOCKS_PER_PACKET];
+	static char packet[JSON_PACKET_MAX_SIZE(FIFO_BLOCKS_PER_PACKET * MAX_ACCEL_FIFO_SIZE)];
+	packetMetaStruct meta =
+	{
+		"EB345A", "1.10.17", "2023.01.17 12:53:55 (GMT +0:00)", 656741,
+		0, 0, 380, 0, 40000, UPLOAD_WIFI_MSEC, UPLOAD_WIFI_MSEC + UPLOAD_BROKER_MSEC
+	};
+	unsigned long long t0, read_usec;
+	int location, found, run, count, len, i;
+	HANDLE SPI;
+
+	meta.msg_number = (int)stats.uploads;
+	SPI = flash_open(SPI_MASTER_CLK, SPI_MASTER_CS);
+	location = prev_pos(ab.write_pos);
+	while ((found = find_transmit_location(location, FIFO_BLOCKS_PER_PACKET, &run)) >= 0)
+	{
+		t0 = host_rtos_usec();
+		CHECK(read_blocks(SPI, found, run, blocks));
+		read_usec = host_rtos_usec() - t0;
+
+		count = 0;
+		for (i = 0; i < run; i++)
+		{
+			if (!ab_block_valid(&blocks[i], 0))
+			{
+				stats.bad_blocks++;
+				continue;
+			}
+			count += blocks[i].num_samples;
+			if (stats.sent[blocks[i].data_sequence]++)
+			{
+				stats.sent_twice++;
+			}
+		}
+		len = json_packet_compose(packet, sizeof(packet), &meta, blocks, run);
+		CHECK(len > 0);
+
+		stats.transmit_usec += (unsigned long long)len * 8 * 1000 / LINK_KBPS
+				+ ((read_usec > LINK_RTT_MSEC * 1000) ? read_usec : LINK_RTT_MSEC * 1000);
+		stats.bytes_sent += len;
+		stats.samples_sent += count;
+		stats.packets++;
+		meta.sequence++;
+
+		location = (found - run + 1 + AB_FLASH_MAX_BLOCKS) % AB_FLASH_MAX_BLOCKS;
+		if (location <= found)
+		{
+			ab_map_clear_range(ab.map, location, found);
+		}
+		else
+		{
+			ab_map_clear_range(ab.map, 0, found);
+			ab_map_clear_range(ab.map, location, AB_FLASH_MAX_BLOCKS - 1);
+		}
+		location = prev_pos(location);
+	}
+	flash_close(SPI);
+	stats.transmit_usec += UPLOAD_DISCONNECT_MSEC * 1000;
+}
+
+/*
+ * user_process_send_MQTT_data(): erase ahead while the client gets ready,
+ * then send everything waiting
+ */
+static void connect_and_upload(void)
+{
+	unsigned long long t0, erase_usec;
+	HANDLE SPI;
+
+	stats.connect_usec += (UPLOAD_WIFI_MSEC + UPLOAD_BROKER_MSEC + UPLOAD_READY_MSEC) * 1000;
+
+	t0 = host_rtos_usec();
+	SPI = flash_open(SPI_MASTER_CLK, SPI_MASTER_CS);
+	erase_ahead(SPI);
+	flash_close(SPI);
+	erase_usec = host_rtos_usec() - t0;
+	if (erase_usec > UPLOAD_READY_MSEC * 1000)
+	{
+		stats.erase_ahead_usec += erase_usec - (UPLOAD_READY_MSEC * 1000);
+	}
+
+	upload();
+}
+
+static void configure_accelerometer(void)
+{
+	memset(&mc, 0, sizeof(mc));
+	// What set_fifo_Len() sets, without its console output
+	mc363X_All_Status.filen = AXL_FIFO_INTERRUPT_THRESHOLD;
+	mc363X_All_Status.fion = 1;
+	mc363X_All_Status.read_style = SIXTIMEBYTESONETIME;
+	mc.regs[MC36XX_REG_FIFO_C] = 0x40 | AXL_FIFO_INTERRUPT_THRESHOLD;
+	mc.regs[MC36XX_REG_FEATURE_C_2] = MC36XX_FEATURE_C_2_FIFO_BURST;
+}
+
+static double per_hour_msec(unsigned long long usec)
+{
+	return usec / 1000.0 / (CYCLE_DAYS * 24);
+}
+
+static void run_cycle(void)
+{
+	uploadSchedulerConfig config;
+	uploadSchedulerState state;
+	long wakes = (long)CYCLE_DAYS * WAKES_PER_DAY;
+	long w, missing, ok_uploads;
+	int of_day;
+	unsigned long long awake;
+
+	memset(chip.mem, 0xFF, sizeof(chip.mem));
+	configure_accelerometer();
+	upload_scheduler_defaults(&config);
+	memset(&state, 0, sizeof(state));
+	ab_map_rebuild(ab.map);
+	ab.next_erase = AB_BLOCKS_PER_SECTOR;		// as set up at power on
+	ab.last_read_time = 432000000LL;
+
+	for (w = 1; w <= wakes; w++)
+	{
+		fill_fifo();
+		wake(432000000LL + ((__time64_t)w * FIFO_MSEC));
+
+		state.fifos_since_upload++;
+		state.pending_blocks = ab_map_count(ab.map);
+		state.headroom_blocks = AB_FLASH_MAX_BLOCKS - AB_TRANSMIT_SAFETY_GAP - state.pending_blocks;
+		if (!upload_scheduler_due(&config, &state))
+		{
+			continue;
+		}
+
+		state.fifos_since_upload = 0;
+		stats.uploads++;
+		of_day = (int)(w % WAKES_PER_DAY);
+		if ((of_day >= OUTAGE_FIRST_WAKE) && (of_day < OUTAGE_LAST_WAKE))
+		{
+			state.failed_attempts++;
+			stats.failed_uploads++;
+			stats.failed_usec += UPLOAD_FAIL_MSEC * 1000;
+			continue;
+		}
+
+		connect_and_upload();
+		state.failed_attempts = 0;
+		state.last_connect_msec = UPLOAD_WIFI_MSEC + UPLOAD_BROKER_MSEC + UPLOAD_READY_MSEC;
+	}
+	awake = stats.boot_usec + stats.fifo_usec + stats.write_usec + stats.erase_usec
+			+ stats.connect_usec + stats.erase_ahead_usec + stats.transmit_usec + stats.failed_usec;
+
+	// The last safety gap of blocks goes once later wakes have moved the
+	// write position past it
+	ab.write_pos = (ab.write_pos + AB_TRANSMIT_SAFETY_GAP) % AB_FLASH_MAX_BLOCKS;
+	upload();
+
+	missing = 0;
+	for (w = 1; w <= wakes; w++)
+	{
+		if (!stats.sent[w])
+		{
+			missing++;
+		}
+	}
+	CHECK_EQ(missing, 0);
+	CHECK_EQ(stats.sent_twice, 0);
+	CHECK_EQ(stats.bad_blocks, 0);
+	CHECK_EQ(stats.write_failures, 0);
+	CHECK_EQ(stats.erase_ahead_dropped, 0);
+	CHECK_EQ(chip.bad_programs, 0);
+	CHECK_EQ(chip.refused, 0);
+	CHECK_EQ(ab_map_count(ab.map), 0);
+	CHECK_EQ(stats.samples_sent, wakes * AXL_FIFO_INTERRUPT_THRESHOLD);
+	CHECK_EQ(chip.programs, wakes);
+
+	ok_uploads = stats.uploads - stats.failed_uploads;
+	printf("\n%d days, %ld wakes, %.1f uploads per day (%.1f failed), %.1f packets per upload,"
+			" %.1f bytes per sample\n",
+			CYCLE_DAYS, wakes, (double)stats.uploads / CYCLE_DAYS,
+			(double)stats.failed_uploads / CYCLE_DAYS, (double)stats.packets / ok_uploads,
+			(double)stats.bytes_sent / stats.samples_sent);
+	printf("awake msec per hour %.0f: wake %.0f, fifo %.0f, flash write %.0f, flash erase %.1f,"
+			" connect %.0f, erase-ahead %.1f, transmit %.0f, failed uploads %.0f\n",
+			per_hour_msec(awake), per_hour_msec(stats.boot_usec), per_hour_msec(stats.fifo_usec),
+			per_hour_msec(stats.write_usec), per_hour_msec(stats.erase_usec),
+			per_hour_msec(stats.connect_usec), per_hour_msec(stats.erase_ahead_usec),
+			per_hour_msec(stats.transmit_usec), per_hour_msec(stats.failed_usec));
+	printf("flash per day: %.1f erases (%.1f 4K, %.1f 32K, %.1f 64K), %.1f sectors erased,"
+			" %.1f erases on the wake path, %.0f pages programmed\n",
+			(double)(chip.erases[W25QXX_ERASE_4K] + chip.erases[W25QXX_ERASE_32K]
+					+ chip.erases[W25QXX_ERASE_64K]) / CYCLE_DAYS,
+			(double)chip.erases[W25QXX_ERASE_4K] / CYCLE_DAYS,
+			(double)chip.erases[W25QXX_ERASE_32K] / CYCLE_DAYS,
+			(double)chip.erases[W25QXX_ERASE_64K] / CYCLE_DAYS,
+			(double)chip.sectors_erased / CYCLE_DAYS,
+			(double)stats.inline_erases / CYCLE_DAYS,
+			(double)chip.programs / CYCLE_DAYS);
+}
+
+int main(void)
+{
+	run_cycle();
+
+	HOST_TEST_EXIT();
+}
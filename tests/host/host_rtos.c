@@ -0,0 +1,138 @@
+/*
+ * Simulated FreeRTOS clock and queues, see host_rtos.h
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "host_rtos.h"
+
+struct hostQueue
+{
+	UBaseType_t length;
+	UBaseType_t item_size;
+	UBaseType_t count;
+	UBaseType_t head;
+	unsigned char *items;
+};
+
+static TickType_t host_tick;
+static unsigned int host_usec;
+static hostTickHook host_tick_hook;
+
+void host_rtos_set_tick_hook(hostTickHook hook)
+{
+	host_tick_hook = hook;
+}
+
+static void host_rtos_tick(void)
+{
+	host_tick++;
+	if (host_tick_hook != NULL)
+	{
+		host_tick_hook(host_tick);
+	}
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+	return host_tick;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+	while (ticks--)
+	{
+		host_rtos_tick();
+	}
+}
+
+void vTaskDelayUntil(TickType_t *previous_wake, TickType_t increment)
+{
+	TickType_t wake = *previous_wake + increment;
+
+	while ((TickType_t)(wake - host_tick) < increment)
+	{
+		host_rtos_tick();
+	}
+	*previous_wake = wake;
+}
+
+void host_rtos_usleep(unsigned int usec)
+{
+	host_usec += usec;
+	while (host_usec >= portTICK_PERIOD_MS * 1000)
+	{
+		host_usec -= portTICK_PERIOD_MS * 1000;
+		host_rtos_tick();
+	}
+}
+
+unsigned long long host_rtos_usec(void)
+{
+	return ((unsigned long long)host_tick * portTICK_PERIOD_MS * 1000) + host_usec;
+}
+
+void *pvPortMalloc(size_t size)
+{
+	return malloc(size);
+}
+
+void vPortFree(void *ptr)
+{
+	free(ptr);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+	QueueHandle_t queue = calloc(1, sizeof(*queue));
+
+	queue->length = length;
+	queue->item_size = item_size;
+	queue->items = calloc(length, item_size);
+	return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait)
+{
+	(void)wait;		// nothing else runs to make room
+	if (queue->count == queue->length)
+	{
+		return pdFAIL;
+	}
+	memcpy(&queue->items[((queue->head + queue->count) % queue->length) * queue->item_size],
+			item, queue->item_size);
+	queue->count++;
+	return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait)
+{
+	for (;;)
+	{
+		if (queue->count > 0)
+		{
+			memcpy(item, &queue->items[queue->head * queue->item_size], queue->item_size);
+			queue->head = (queue->head + 1) % queue->length;
+			queue->count--;
+			return pdPASS;
+		}
+		if (wait == 0)
+		{
+			return pdFAIL;
+		}
+		if (wait != portMAX_DELAY)
+		{
+			wait--;
+		}
+		host_rtos_tick();
+	}
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+	queue->count = 0;
+	queue->head = 0;
+	return pdPASS;
+}
@@ -0,0 +1,25 @@
+/*
+ * Simulated FreeRTOS clock and queues for the host tests.
+ *
+ * Time only moves when the code under test blocks: vTaskDelay() and a
+ * waiting xQueueReceive() advance the tick count one tick at a time and
+ * call the tick hook on every tick.  The hook is where a test runs the
+ * things that would happen concurrently on the target, such as a broker
+ * sending PUBACKs.  Everything is deterministic.
+ */
+#ifndef __HOST_RTOS_H__
+#define __HOST_RTOS_H__
+
+#include "FreeRTOS.h"
+
+typedef void (*hostTickHook)(TickType_t now);
+
+void host_rtos_set_tick_hook(hostTickHook hook);
+
+// A busy wait (SYSUSLEEP) moves the clock too, a tick per 10 msec of it
+void host_rtos_usleep(unsigned int usec);
+
+// Simulated time since the start, in usec
+unsigned long long host_rtos_usec(void);
+
+#endif
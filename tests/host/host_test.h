@@ -0,0 +1,57 @@
+/*
+ * Minimal checking for the host tests.  A failed CHECK() reports the
+ * location and the test carries on; HOST_TEST_EXIT() makes the exit
+ * status reflect whether anything failed, which is what ctest looks at.
+ */
+#ifndef __HOST_TEST_H__
+#define __HOST_TEST_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int host_test_failures;
+
+#define CHECK(cond)																\
+	do {																		\
+		if (!(cond)) {															\
+			fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);	\
+			host_test_failures++;												\
+		}																		\
+	} while (0)
+
+#define CHECK_EQ(a, b)															\
+	do {																		\
+		long long check_a_ = (long long)(a), check_b_ = (long long)(b);		\
+		if (check_a_ != check_b_) {												\
+			fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n",	\
+					__FILE__, __LINE__, #a, #b, check_a_, check_b_);			\
+			host_test_failures++;												\
+		}																		\
+	} while (0)
+
+#define HOST_TEST_EXIT()														\
+	do {																		\
+		if (host_test_failures) {												\
+			fprintf(stderr, "%d check(s) failed\n", host_test_failures);		\
+			return EXIT_FAILURE;												\
+		}																		\
+		printf("\nall checks passed\n");											\
+		return EXIT_SUCCESS;													\
+	} while (0)
+
+/*
+ * Deterministic pseudo random numbers (xorshift32), so that every run
+ * of a randomized test sees the same sequence.
+ */
+static inline unsigned int host_rand(unsigned int *state)
+{
+	unsigned int x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+#endif
@@ -0,0 +1,29 @@
+/* Host stand-in for FreeRTOS.h (see README.md) */
+#ifndef __HOST_FREERTOS_H__
+#define __HOST_FREERTOS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define pdTRUE					1
+#define pdFALSE					0
+#define pdPASS					pdTRUE
+#define pdFAIL					pdFALSE
+
+// The DA16200 runs the scheduler at 100 Hz
+#define configTICK_RATE_HZ		100
+#define portTICK_PERIOD_MS		(1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)		((TickType_t)(((TickType_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define portMAX_DELAY			((TickType_t)0xFFFFFFFF)
+#define portTICK_RATE_MS		portTICK_PERIOD_MS
+
+typedef uint32_t				TickType_t;
+typedef TickType_t				portTickType;
+typedef long					BaseType_t;
+typedef unsigned long			UBaseType_t;
+typedef void *					TaskHandle_t;
+
+void *pvPortMalloc(size_t size);
+void vPortFree(void *ptr);
+
+#endif
@@ -0,0 +1,4 @@
+/* Host stand-in for FreeRTOSConfig.h (see README.md): the tick rate is in FreeRTOS.h */
+#ifndef __HOST_FREERTOS_CONFIG_H__
+#define __HOST_FREERTOS_CONFIG_H__
+#endif
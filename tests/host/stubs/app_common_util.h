@@ -0,0 +1,4 @@
+/* Host stand-in for the SDK's app_common_util.h (see README.md) */
+#ifndef __APP_COMMON_UTIL_H__
+#define __APP_COMMON_UTIL_H__
+#endif
@@ -0,0 +1,16 @@
+/* Host stand-in for the SDK's common_def.h (see README.md) */
+#ifndef __COMMON_DEF_H__
+#define __COMMON_DEF_H__
+
+#include <stdio.h>
+#include <stddef.h>
+
+#ifndef PRINTF
+#define PRINTF				printf
+#endif
+#ifndef APRINTF_Y
+#define APRINTF_Y			printf
+#endif
+#define DA16X_UNUSED_ARG(x)	(void)(x)
+
+#endif
@@ -0,0 +1,97 @@
+/* Host stand-in for the SDK's da16x_system.h (see README.md) */
+#ifndef __DA16X_SYSTEM_H__
+#define __DA16X_SYSTEM_H__
+
+#include <assert.h>
+#include <stdio.h>
+#include "da16x_types.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "common_def.h"
+
+typedef void				VOID;
+typedef void *				SemaphoreHandle_t;
+
+#define Printf				printf
+#define configASSERT(x)		assert(x)
+
+// One task at a time on the host: the flash semaphore is always free
+static inline BaseType_t host_semaphore(SemaphoreHandle_t sem)
+{
+	(void)sem;
+	return pdTRUE;
+}
+#define vSemaphoreCreateBinary(sem)		((sem) = (SemaphoreHandle_t)1)
+#define xSemaphoreTake(sem, wait)		host_semaphore(sem)
+#define xSemaphoreGive(sem)				host_semaphore(sem)
+
+// Busy waits advance the simulated clock, see host_rtos.c
+void host_rtos_usleep(unsigned int usec);
+#define SYSUSLEEP(usec)		host_rtos_usleep(usec)
+
+/*
+ * The SPI controller.  Configuration is ignored; every transfer goes to
+ * host_spi_transmit(), which the test provides as a model of the chip.
+ */
+int host_spi_transmit(HANDLE spi, UINT8 command, UINT32 address, UINT32 mode,
+		UINT8 *tx, UINT32 tx_len, void *rx, UINT32 rx_len);
+
+#define SPI_SFLASH_TRANSMIT	host_spi_transmit
+#define SPI_CREATE(unit)	((HANDLE)1)
+#define SPI_INIT(spi)		TRUE
+#define SPI_CLOSE(spi)		((void)(spi))
+static inline int host_spi_ioctl(HANDLE spi, UINT32 cmd, void *data)
+{
+	(void)spi; (void)cmd; (void)data;
+	return TRUE;
+}
+#define SPI_IOCTL(spi, cmd, data)	host_spi_ioctl(spi, cmd, data)
+#define _sys_clock_read(data, len)	((data)[0] = 120 * MHz)
+
+/*
+ * The I2C controller.  Transfers go to host_i2c_read() and
+ * host_i2c_write(), which the test provides as a model of the device at
+ * the address set last with I2C_SET_CHIPADDR.
+ */
+int host_i2c_read(HANDLE i2c, void *data, UINT32 length);
+int host_i2c_write(HANDLE i2c, void *data, UINT32 length);
+int host_i2c_ioctl(HANDLE i2c, UINT32 cmd, void *data);
+
+#define I2C_SET_CHIPADDR	1
+#define DRV_I2C_IOCTL(i2c, cmd, data)	host_i2c_ioctl(i2c, cmd, data)
+#define DRV_I2C_READ(i2c, data, length, addr_len, dummy)	host_i2c_read(i2c, data, length)
+#define DRV_I2C_WRITE(i2c, data, length, stop, dummy)		host_i2c_write(i2c, data, length)
+
+#define MBYTE				0x100000
+#define MHz					1000000
+#define XHSIZE_DWORD		0
+
+#define SPI_UNIT_0			0
+#define SPI_SET_LOCK		0
+#define SPI_SET_BUSCONTROL	0
+#define SPI_SET_MAX_LENGTH	0
+#define SPI_SET_CORECLOCK	0
+#define SPI_SET_SPEED		0
+#define SPI_GET_SPEED		0
+#define SPI_SET_FORMAT		0
+#define SPI_SET_DMA_CFG		0
+#define SPI_SET_DMAMODE		0
+#define SPI_SET_WIRE		0
+#define SPI_SET_DELAY_INDEX	0
+#define SPI_DELAY_INDEX_LOW	0
+#define SPI_TYPE_MOTOROLA_O0H0	0
+#define SPI_ADDR_INCR		0
+#define SPI_BUS_SPI			0
+#define SPI_SPI_TIMEOUT_EN			0
+#define SPI_SPI_PHASE_CMD_1BYTE		0
+#define SPI_SPI_PHASE_ADDR_3BYTE	0
+#define SPI_SPI_PHASE_ADDR_4BYTE	0
+#define SPI_SET_SPI_DUMMY_CYCLE(n)	0
+#define SPI_BUS_TYPE(a, b, c)		0
+#define SPI_SET_SPI_BUS_TYPE(cmd, addr, dummy, data)	0
+#define SPI_DMA_MP0_BST(n)			0
+#define SPI_DMA_MP0_IDLE(n)			0
+#define SPI_DMA_MP0_HSIZE(n)		0
+#define SPI_DMA_MP0_AI(n)			0
+
+#endif
@@ -0,0 +1,4 @@
+/* Host stand-in for the SDK's da16x_time.h (see README.md) */
+#ifndef __DA16X_TIME_H__
+#define __DA16X_TIME_H__
+#endif
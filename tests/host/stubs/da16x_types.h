@@ -0,0 +1,27 @@
+/* Host stand-in for the SDK's da16x_types.h (see README.md) */
+#ifndef __DA16X_TYPES_H__
+#define __DA16X_TYPES_H__
+
+#include <stdint.h>
+
+typedef unsigned char		UCHAR;
+typedef uint32_t			ULONG;		// 32 bits, as on the target
+typedef long long			__time64_t;
+#define __time64_t			__time64_t
+#define __TIME64__
+typedef void *				HANDLE;
+typedef uint8_t				UINT8;
+typedef uint16_t			UINT16;
+typedef uint32_t			UINT32;
+typedef int32_t				INT32;
+typedef int32_t				LONG;
+typedef unsigned long long	ULONGLONG;
+
+#ifndef TRUE
+#define TRUE				1
+#endif
+#ifndef FALSE
+#define FALSE				0
+#endif
+
+#endif
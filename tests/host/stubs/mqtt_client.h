@@ -0,0 +1,11 @@
+/* Host stand-in for the MQTT client API (see README.md) */
+#ifndef __HOST_MQTT_CLIENT_H__
+#define __HOST_MQTT_CLIENT_H__
+
+// Provided by the test, usually as a fake broker
+int mqtt_client_send_message(char *top, char *publish);
+int mqtt_client_get_pub_msg_id(void);
+
+#define mqtt_pub_send_msg				mqtt_client_send_message
+
+#endif
@@ -0,0 +1,4 @@
+/* Host stand-in for the SDK's sdk_type.h (see README.md) */
+#ifndef __SDK_TYPE_H__
+#define __SDK_TYPE_H__
+#endif
@@ -0,0 +1,17 @@
+/* Host stand-in for FreeRTOS task.h (see README.md) */
+#ifndef __HOST_TASK_H__
+#define __HOST_TASK_H__
+
+#include "FreeRTOS.h"
+
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+#define vTaskNotifyGiveFromISR(task, woken)	((void)(task), (void)(woken))
+#define portYIELD_FROM_ISR(woken)			((void)(woken))
+
+// Simulated clock, see host_rtos.c
+TickType_t xTaskGetTickCount(void);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t *previous_wake, TickType_t increment);
+
+#endif
@@ -0,0 +1,208 @@
+/*
+ * Host test and benchmark for user_crc32.c and user_ab_block.c
+ *
+ * The table driven CRC is checked against a bit at a time reference and
+ * timed against it.  Block checks must catch every single bit error, an
+ * erased or zeroed page, and must accept the blocks without a CRC left by
+ * 1.10.17 (but only those) after an update.
+ */
+#include <string.h>
+#include <time.h>
+#include "host_test.h"
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "user_crc32.h"
+#include "user_ab_block.h"
+
+static unsigned int seed = 14;
+
+static uint32_t crc32_bitwise(uint32_t crc, const UCHAR *data, int len)
+{
+	int k;
+
+	crc = ~crc;
+	while (len--)
+	{
+		crc ^= *data++;
+		for (k = 0; k < 8; k++)
+		{
+			crc = (crc >> 1) ^ (0xEDB88320UL & -(crc & 1));
+		}
+	}
+	return ~crc;
+}
+
+static void check_crc32(void)
+{
+	UCHAR buf[300];
+	int len, split, i, j;
+
+	CHECK_EQ(crc32_update(0, (const UCHAR *)"123456789", 9), 0xCBF43926UL);
+
+	for (i = 0; i < 2000; i++)
+	{
+		len = host_rand(&seed) % sizeof(buf);
+		split = len ? (host_rand(&seed) % len) : 0;
+		for (j = 0; j < len; j++)
+		{
+			buf[j] = (UCHAR)host_rand(&seed);
+		}
+		CHECK_EQ(crc32_update(0, buf, len), crc32_bitwise(0, buf, len));
+		CHECK_EQ(crc32_update(crc32_update(0, buf, split), buf + split, len - split),
+				crc32_bitwise(0, buf, len));
+	}
+}
+
+// A block as the accelerometer task writes it
+static void make_block(accelBufferStruct *block, ULONG sequence)
+{
+	int i;
+
+	memset(block, 0, sizeof(*block));
+	block->data_sequence = sequence;
+	block->accelTime = 1700000000000LL + (sequence * 2286);
+	block->accelTime_prev = block->accelTime - 2286;
+	block->num_samples = 32;
+	for (i = 0; i < MAX_ACCEL_FIFO_SIZE; i++)
+	{
+		block->Xvalue[i] = (int8_t)host_rand(&seed);
+		block->Yvalue[i] = (int8_t)host_rand(&seed);
+		block->Zvalue[i] = (int8_t)host_rand(&seed);
+	}
+	block->crc = ab_block_crc(block);
+}
+
+static void check_blocks(void)
+{
+	accelBufferStruct block;
+	UCHAR *bytes = (UCHAR *)&block;
+	size_t end = offsetof(accelBufferStruct, Zvalue) + MAX_ACCEL_FIFO_SIZE;
+	size_t off;
+	int bit, missed = 0;
+
+	make_block(&block, 1234);
+	CHECK(ab_block_valid(&block, 0));
+
+	// Every single bit error outside the CRC field itself is caught
+	for (off = 0; off < end; off++)
+	{
+		if ((off >= offsetof(accelBufferStruct, crc))
+			&& (off < offsetof(accelBufferStruct, crc) + sizeof(block.crc)))
+		{
+			continue;
+		}
+		for (bit = 0; bit < 8; bit++)
+		{
+			bytes[off] ^= (UCHAR)(1 << bit);
+			missed += ab_block_valid(&block, 0);
+			bytes[off] ^= (UCHAR)(1 << bit);
+		}
+	}
+	CHECK_EQ(missed, 0);
+
+	// A good CRC over a bad sample count is still refused
+	block.num_samples = 0;
+	block.crc = ab_block_crc(&block);
+	CHECK(!ab_block_valid(&block, 0));
+
+	// Erased and zeroed pages
+	memset(&block, 0xFF, sizeof(block));
+	CHECK(!ab_block_valid(&block, 0));
+	CHECK(!ab_block_valid(&block, 0xFFFFFFFFUL));
+	memset(&block, 0, sizeof(block));
+	CHECK(!ab_block_valid(&block, 0));
+	CHECK(!ab_block_valid(&block, 5000));
+}
+
+/*
+ * After an update from 1.10.17: blocks below the recorded sequence were
+ * written without a CRC (the field was padding, so it holds anything).
+ */
+static void check_precrc_blocks(void)
+{
+	const ULONG precrc_sequence = 5001;
+	accelBufferStruct block;
+	ULONG sequence;
+	int accepted = 0;
+
+	for (sequence = 4000; sequence < precrc_sequence; sequence++)
+	{
+		make_block(&block, sequence);
+		block.num_samples = 1 + (host_rand(&seed) % MAX_ACCEL_FIFO_SIZE);
+		block.crc = host_rand(&seed);
+		accepted += ab_block_valid(&block, precrc_sequence);
+		// Before the conversion nothing without a CRC is accepted
+		CHECK(!ab_block_valid(&block, 0));
+	}
+	CHECK_EQ(accepted, precrc_sequence - 4000);
+
+	// Still sanity checked
+	make_block(&block, 4500);
+	block.crc ^= 1;
+	block.num_samples = 0;
+	CHECK(!ab_block_valid(&block, precrc_sequence));
+	block.num_samples = MAX_ACCEL_FIFO_SIZE + 1;
+	CHECK(!ab_block_valid(&block, precrc_sequence));
+	block.num_samples = 10;
+	block.accelTime_prev = block.accelTime + 1;
+	CHECK(!ab_block_valid(&block, precrc_sequence));
+
+	// A block written after the update with a bad CRC is refused
+	make_block(&block, precrc_sequence);
+	block.Xvalue[3] ^= 0x10;
+	CHECK(!ab_block_valid(&block, precrc_sequence));
+	make_block(&block, precrc_sequence + 1000);
+	block.crc ^= 0x80000000UL;
+	CHECK(!ab_block_valid(&block, precrc_sequence));
+}
+
+static double now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void benchmark(void)
+{
+	accelBufferStruct block;
+	volatile uint32_t sink = 0;
+	const int reps = 500000;
+	double t0, t_table, t_bitwise;
+	int i;
+
+	make_block(&block, 1);
+
+	t0 = now_sec();
+	for (i = 0; i < reps; i++)
+	{
+		block.data_sequence = i;
+		sink ^= ab_block_crc(&block);
+	}
+	t_table = (now_sec() - t0) / reps;
+
+	t0 = now_sec();
+	for (i = 0; i < reps / 8; i++)
+	{
+		block.data_sequence = i;
+		sink ^= crc32_bitwise(0, (const UCHAR *)&block, sizeof(block) - sizeof(block.crc));
+	}
+	t_bitwise = (now_sec() - t0) / (reps / 8);
+
+	(void)sink;
+	printf("CRC of one %d byte block: table %.0f nsec (%.0f MB/s), bitwise %.0f nsec (host)\n",
+			(int)sizeof(block), t_table * 1e9, sizeof(block) / t_table / 1e6, t_bitwise * 1e9);
+}
+
+int main(void)
+{
+	check_crc32();
+	check_blocks();
+	check_precrc_blocks();
+	benchmark();
+
+	HOST_TEST_EXIT();
+}
@@ -0,0 +1,338 @@
+/*
+ * Host test and wake-cycle simulation for user_ab_stage.c
+ *
+ * The stage runs against a simulated flash that records the sequence
+ * numbers it is given.  Failed writes, failed SPI opens and resets in the
+ * middle of a flush are injected at random, and every buffer the stage
+ * accepted must end up in flash, in order.  Then an hour of wakes is run
+ * with the stage and with a write on every wake (AB_STAGE_WRITE_BACK
+ * commented out), and the awake time of each is reported.
+ */
+#include <setjmp.h>
+#include <string.h>
+#include "host_test.h"
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "user_ab_stage.h"
+#include "user_upload_scheduler.h"
+
+// W25Q64 data sheet (typical) and the wake cost from a trace capture, as
+// in bench_cycle.c, in msec
+#define WAKE_MSEC				60.0
+#define FLASH_POWER_MSEC		1.0
+#define PAGE_PROGRAM_MSEC		0.4
+#define SECTOR_ERASE_MSEC		45.0
+#define WAKES_PER_HOUR			(3600 * 14 / AXL_FIFO_INTERRUPT_THRESHOLD)
+
+#define LOG_MAX					20000
+
+static struct
+{
+	int write_pos;
+	ULONG log[LOG_MAX];			// sequence numbers in the order written
+	int log_len;
+	ULONG max_logged;
+	double msec;				// time the flash kept us awake
+
+	// Faults, as percentages
+	int open_fail;
+	int write_fail;
+	int erase_fail;				// block written, next sector erase failed
+	int reset;					// reset after a write, before the journal update
+	int faults;					// faults injected
+	int resets;
+	unsigned int seed;
+} fake;
+
+static abStage stage;			// retention memory: survives the resets
+static jmp_buf reset_jmp;
+
+static int fake_roll(int percent)
+{
+	return (percent > 0) && ((int)(host_rand(&fake.seed) % 100) < percent);
+}
+
+static HANDLE fake_open(void)
+{
+	if (fake_roll(fake.open_fail))
+	{
+		fake.faults++;
+		return NULL;
+	}
+	fake.msec += FLASH_POWER_MSEC;
+	return (HANDLE)&fake;
+}
+
+static void fake_close(HANDLE spi)
+{
+	CHECK(spi == (HANDLE)&fake);
+}
+
+static int fake_write_location(void)
+{
+	return fake.write_pos;
+}
+
+// Behaves like AB_store_block(): a failed write leaves the position alone
+static int fake_store(HANDLE spi, accelBufferStruct *blocks, int num_blocks, int *did_an_erase)
+{
+	int i;
+
+	*did_an_erase = pdFALSE;
+	CHECK(spi == (HANDLE)&fake);
+	CHECK(num_blocks > 0);
+	CHECK(num_blocks <= AB_BLOCKS_PER_PAGE - (fake.write_pos % AB_BLOCKS_PER_PAGE));
+
+	fake.msec += PAGE_PROGRAM_MSEC;
+	if (fake_roll(fake.write_fail))
+	{
+		fake.faults++;
+		return FALSE;
+	}
+
+	for (i = 0; i < num_blocks; i++)
+	{
+		if (fake.log_len < LOG_MAX)
+		{
+			fake.log[fake.log_len++] = blocks[i].data_sequence;
+		}
+		if (blocks[i].data_sequence > fake.max_logged)
+		{
+			fake.max_logged = blocks[i].data_sequence;
+		}
+	}
+	fake.write_pos = (fake.write_pos + num_blocks) % AB_FLASH_MAX_BLOCKS;
+
+	if (fake_roll(fake.reset))
+	{
+		fake.resets++;
+		longjmp(reset_jmp, 1);
+	}
+
+	if ((fake.write_pos % AB_BLOCKS_PER_SECTOR) == 0)
+	{
+		fake.msec += SECTOR_ERASE_MSEC;
+		*did_an_erase = pdTRUE;
+		if (fake_roll(fake.erase_fail))
+		{
+			fake.faults++;
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+static const abStageFlash fake_flash =
+{
+	fake_open,
+	fake_close,
+	fake_write_location,
+	fake_store
+};
+
+static void fake_reset(unsigned int seed)
+{
+	memset(&fake, 0, sizeof(fake));
+	memset(&stage, 0, sizeof(stage));
+	fake.seed = seed;
+}
+
+static void make_block(accelBufferStruct *block, ULONG sequence)
+{
+	memset(block, 0, sizeof(*block));
+	block->data_sequence = sequence;
+	block->num_samples = AXL_FIFO_INTERRUPT_THRESHOLD;
+}
+
+/*
+ * A write that doesn't go through stops the flush and keeps the journal;
+ * a write whose sector erase failed is still counted as written
+ */
+static void check_failed_flush(void)
+{
+	accelBufferStruct block;
+	int erased;
+	ULONG seq;
+
+	fake_reset(1);
+	for (seq = 1; seq <= 5; seq++)
+	{
+		make_block(&block, seq);
+		CHECK(ab_stage_block(&stage, &fake_flash, &block, &erased) == TRUE);
+	}
+	CHECK_EQ(fake.log_len, 0);
+
+	fake.write_fail = 100;
+	CHECK(ab_stage_flush(&stage, &fake_flash, &erased) == FALSE);
+	CHECK_EQ(stage.count, 5);
+	CHECK_EQ(stage.flushed, 0);
+	CHECK(stage.flushing);
+	CHECK_EQ(fake.log_len, 0);
+
+	// Still failing: the new buffer can't be staged behind the journal
+	make_block(&block, 6);
+	CHECK(ab_stage_block(&stage, &fake_flash, &block, &erased) == FALSE);
+	CHECK_EQ(stage.count, 5);
+
+	fake.write_fail = 0;
+	make_block(&block, 7);
+	CHECK(ab_stage_block(&stage, &fake_flash, &block, &erased) == TRUE);
+	CHECK_EQ(stage.replay_count, 2);
+	CHECK_EQ(stage.count, 1);
+	CHECK_EQ(fake.log_len, 5);
+	CHECK(ab_stage_flush(&stage, &fake_flash, &erased) == TRUE);
+	CHECK(!stage.flushing);
+	CHECK_EQ(fake.log_len, 6);
+	CHECK_EQ(fake.log[4], 5);
+	CHECK_EQ(fake.log[5], 7);
+
+	// The erase of the next sector fails after the last page is written
+	fake_reset(1);
+	fake.write_pos = AB_BLOCKS_PER_SECTOR - 2;
+	fake.erase_fail = 100;
+	for (seq = 1; seq <= 2; seq++)
+	{
+		make_block(&block, seq);
+		CHECK(ab_stage_block(&stage, &fake_flash, &block, &erased) == (seq == 1));
+	}
+	CHECK(erased);
+	CHECK(!stage.flushing);
+	CHECK_EQ(stage.count, 0);
+	CHECK_EQ(fake.log_len, 2);
+}
+
+/*
+ * Run wakes with random faults; every buffer that was staged must reach
+ * flash, in order, and duplicates only come from resets
+ */
+static void check_faults(void)
+{
+	accelBufferStruct block;
+	volatile ULONG seq;
+	volatile int lost = 0;
+	ULONG accepted[LOG_MAX];
+	volatile int num_accepted = 0;
+	int erased;
+	int i, j;
+	ULONG last;
+
+	fake_reset(2024);
+	fake.open_fail = 2;
+	fake.write_fail = 3;
+	fake.erase_fail = 2;
+	fake.reset = 1;
+
+	for (seq = 1; seq <= 10000; seq++)
+	{
+		make_block(&block, seq);
+		if (setjmp(reset_jmp) == 0)
+		{
+			ab_stage_block(&stage, &fake_flash, &block, &erased);
+		}
+		if (((stage.count > 0) && (stage.blocks[stage.count - 1].data_sequence == seq))
+			|| (fake.max_logged >= seq))
+		{
+			accepted[num_accepted++] = seq;
+		}
+		else
+		{
+			lost++;
+		}
+	}
+
+	// No more faults: whatever is left goes out
+	fake.open_fail = fake.write_fail = fake.erase_fail = fake.reset = 0;
+	CHECK(ab_stage_flush(&stage, &fake_flash, &erased) == TRUE);
+	CHECK_EQ(stage.count, 0);
+
+	// Drop the copies a replay wrote again, then compare
+	last = 0;
+	j = 0;
+	for (i = 0; i < fake.log_len; i++)
+	{
+		if (fake.log[i] <= last)
+		{
+			continue;
+		}
+		last = fake.log[i];
+		CHECK(j < num_accepted);
+		if (j < num_accepted)
+		{
+			CHECK_EQ(fake.log[i], accepted[j]);
+		}
+		j++;
+	}
+	CHECK_EQ(j, num_accepted);
+	CHECK(lost <= fake.faults + fake.resets);
+	CHECK(fake.resets > 0);
+	CHECK(stage.replay_count > 0);
+	printf("\n10000 wakes, %d faults, %d resets: %d buffers lost, %d written twice, %u flushes finished later\n",
+			fake.faults, fake.resets, lost, fake.log_len - num_accepted, stage.replay_count);
+}
+
+/*
+ * One hour of wakes with an upload every upload_fifos reads, which
+ * flushes the stage first.  Returns the awake msec, flash included.
+ */
+static double simulate_hour(int staged, int upload_fifos, double *flash_msec)
+{
+	accelBufferStruct block;
+	HANDLE spi;
+	int erased;
+	int wake;
+	double msec = 0.0;
+
+	fake_reset(7);
+	for (wake = 1; wake <= WAKES_PER_HOUR; wake++)
+	{
+		msec += WAKE_MSEC;
+		make_block(&block, wake);
+		if (staged)
+		{
+			CHECK(ab_stage_block(&stage, &fake_flash, &block, &erased) == TRUE);
+			if ((wake % upload_fifos) == 0)
+			{
+				CHECK(ab_stage_flush(&stage, &fake_flash, &erased) == TRUE);
+			}
+		}
+		else
+		{
+			// user_process_write_to_flash()
+			spi = fake_open();
+			CHECK(fake_store(spi, &block, 1, &erased) == TRUE);
+			fake_close(spi);
+		}
+	}
+	CHECK_EQ(fake.log_len + stage.count, WAKES_PER_HOUR);
+
+	*flash_msec = fake.msec;
+	return msec + fake.msec;
+}
+
+static void wake_cycle_report(void)
+{
+	static const int uploads[] = { UPLOAD_DEFAULT_MIN_FIFOS, UPLOAD_DEFAULT_MAX_FIFOS };
+	double direct, direct_flash, staged, staged_flash;
+	int i;
+
+	for (i = 0; i < (int)(sizeof(uploads) / sizeof(uploads[0])); i++)
+	{
+		direct = simulate_hour(pdFALSE, uploads[i], &direct_flash);
+		staged = simulate_hour(pdTRUE, uploads[i], &staged_flash);
+		CHECK(staged_flash < direct_flash);
+		printf("\nupload every %d FIFOs: awake msec/hour write-through %.0f (flash %.0f),"
+				" staged %.0f (flash %.0f)\n",
+				uploads[i], direct, direct_flash, staged, staged_flash);
+	}
+}
+
+int main(void)
+{
+	check_failed_flush();
+	check_faults();
+	wake_cycle_report();
+
+	HOST_TEST_EXIT();
+}
@@ -0,0 +1,353 @@
+/*
+ * Host test and benchmark for user_block_codec.c and user_packet_encoder.c
+ *
+ * Synthetic wrist-like blocks (a slowly turning gravity vector with
+ * sensor noise, then with movement, then random data) must come back
+ * exactly from the codec, within the worst case size.  A binary frame
+ * is then decoded here the way the receiver does it, and the samples
+ * and the sample timestamps must match the blocks that went in.  The
+ * compression ratio and the encode time are reported.
+ */
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include "host_test.h"
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "user_block_codec.h"
+#include "user_packet_encoder.h"
+#include "user_sample_time.h"
+
+#define CORPUS_BLOCKS			20000
+#define FIFO_MSEC				2286		// 32 samples at 14 Hz
+
+enum { CORPUS_STILL, CORPUS_MOVING, CORPUS_RANDOM, CORPUS_KINDS };
+static const char * const corpus_name[CORPUS_KINDS] = { "still wrist", "moving wrist", "random" };
+
+static unsigned int seed = 1016;
+static double phase;
+
+static int8_t clamp_sample(double value)
+{
+	if (value > 127.0)
+	{
+		return 127;
+	}
+	if (value < -128.0)
+	{
+		return -128;
+	}
+	return (int8_t)lrint(value);
+}
+
+static int noise(int amplitude)
+{
+	return (int)(host_rand(&seed) % (2 * amplitude + 1)) - amplitude;
+}
+
+static void make_block(accelBufferStruct *block, int k, int kind)
+{
+	double movement;
+	int i;
+
+	memset(block, 0, sizeof(*block));
+	block->num_samples = MAX_ACCEL_FIFO_SIZE - (((k % 7) == 0) ? 1 : 0);
+	for (i = 0; i < block->num_samples; i++)
+	{
+		phase += 0.002;
+		movement = 0.0;
+		if (kind == CORPUS_MOVING)
+		{
+			movement = 30.0 * sin(phase * 200.0);
+		}
+		else if (kind == CORPUS_RANDOM)
+		{
+			movement = (double)noise(128);
+		}
+		block->Xvalue[i] = clamp_sample(64.0 * sin(phase) + movement + noise(2));
+		block->Yvalue[i] = clamp_sample(64.0 * cos(phase) + (movement / 2) + noise(2));
+		block->Zvalue[i] = clamp_sample(20.0 - movement + noise(1));
+	}
+	block->accelTime_prev = 432000000LL + ((__time64_t)k * FIFO_MSEC);
+	block->accelTime = block->accelTime_prev + FIFO_MSEC + (k % 3);
+}
+
+static int same_samples(const accelBufferStruct *block, const int8_t *x, const int8_t *y, const int8_t *z)
+{
+	return (memcmp(x, block->Xvalue, block->num_samples) == 0)
+		&& (memcmp(y, block->Yvalue, block->num_samples) == 0)
+		&& (memcmp(z, block->Zvalue, block->num_samples) == 0);
+}
+
+static void check_corpus(void)
+{
+	accelBufferStruct block;
+	UCHAR out[BLOCK_CODEC_MAX_SIZE(MAX_ACCEL_FIFO_SIZE)];
+	int8_t x[MAX_ACCEL_FIFO_SIZE], y[MAX_ACCEL_FIFO_SIZE], z[MAX_ACCEL_FIFO_SIZE];
+	long encoded, raw;
+	int kind, k, len;
+
+	for (kind = 0; kind < CORPUS_KINDS; kind++)
+	{
+		encoded = raw = 0;
+		for (k = 0; k < CORPUS_BLOCKS; k++)
+		{
+			make_block(&block, k, kind);
+			len = block_codec_encode(&block, out, sizeof(out));
+			CHECK(len > 0);
+			CHECK(len <= BLOCK_CODEC_MAX_SIZE(block.num_samples));
+			if (len <= 0)
+			{
+				continue;
+			}
+			CHECK_EQ(block_codec_decode(out, len, block.num_samples, x, y, z), len);
+			CHECK(same_samples(&block, x, y, z));
+
+			// Short buffers are refused rather than overrun
+			CHECK_EQ(block_codec_encode(&block, out, len - 1), -1);
+			CHECK_EQ(block_codec_decode(out, len - 1, block.num_samples, x, y, z), -1);
+
+			encoded += len;
+			raw += 3 * block.num_samples;
+		}
+		printf("\n%s: %.1f bytes/block against %.1f raw (%.2fx)", corpus_name[kind],
+				(double)encoded / CORPUS_BLOCKS, (double)raw / CORPUS_BLOCKS,
+				(double)raw / encoded);
+	}
+	printf("\n");
+}
+
+static void check_edges(void)
+{
+	accelBufferStruct block;
+	UCHAR out[BLOCK_CODEC_MAX_SIZE(MAX_ACCEL_FIFO_SIZE)];
+	int8_t x[MAX_ACCEL_FIFO_SIZE], y[MAX_ACCEL_FIFO_SIZE], z[MAX_ACCEL_FIFO_SIZE];
+	int i, len;
+
+	// Full range swings need the full 8 bits
+	memset(&block, 0, sizeof(block));
+	block.num_samples = MAX_ACCEL_FIFO_SIZE;
+	for (i = 0; i < MAX_ACCEL_FIFO_SIZE; i++)
+	{
+		block.Xvalue[i] = (i & 1) ? 127 : -128;
+		block.Yvalue[i] = -128;
+		block.Zvalue[i] = (int8_t)(i * 37);
+	}
+	len = block_codec_encode(&block, out, sizeof(out));
+	CHECK(len > 0);
+	CHECK(len <= BLOCK_CODEC_MAX_SIZE(MAX_ACCEL_FIFO_SIZE));
+	CHECK_EQ(block_codec_decode(out, len, block.num_samples, x, y, z), len);
+	CHECK(same_samples(&block, x, y, z));
+
+	// One sample: just the first values and zero widths
+	block.num_samples = 1;
+	len = block_codec_encode(&block, out, sizeof(out));
+	CHECK_EQ(len, 6);
+	CHECK_EQ(block_codec_decode(out, len, 1, x, y, z), len);
+	CHECK(same_samples(&block, x, y, z));
+
+	// Sample counts the FIFO can't produce
+	block.num_samples = 0;
+	CHECK_EQ(block_codec_encode(&block, out, sizeof(out)), -1);
+	block.num_samples = MAX_ACCEL_FIFO_SIZE + 1;
+	CHECK_EQ(block_codec_encode(&block, out, sizeof(out)), -1);
+
+	// A width over 8 bits can't have come from the encoder
+	block.num_samples = 4;
+	len = block_codec_encode(&block, out, sizeof(out));
+	CHECK(len > 0);
+	out[1] = BLOCK_CODEC_MAX_WIDTH + 1;
+	CHECK_EQ(block_codec_decode(out, len, block.num_samples, x, y, z), -1);
+}
+
+/*
+ * Frame decoding, as done by the receiver
+ */
+static unsigned long long get_varint(const UCHAR *frame, int *pos)
+{
+	unsigned long long value = 0;
+	int shift = 0;
+	UCHAR c;
+
+	do
+	{
+		c = frame[(*pos)++];
+		value |= (unsigned long long)(c & 0x7F) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	return value;
+}
+
+static long long get_svarint(const UCHAR *frame, int *pos)
+{
+	unsigned long long value = get_varint(frame, pos);
+
+	return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+static void skip_string(const UCHAR *frame, int *pos)
+{
+	*pos += 1 + frame[*pos];
+}
+
+#define FRAME_BLOCKS			14
+
+static void check_frame(void)
+{
+	static accelBufferStruct blocks[FRAME_BLOCKS];
+	static UCHAR frame[PACKET_FRAME_MAX_SIZE(FRAME_BLOCKS)];
+	static char text[PACKET_BASE64_SIZE(sizeof(frame)) + 1];
+	packetMetaStruct meta =
+	{
+		"EB345A", "1.10.17", "2023.01.17 12:53:55", 656741,
+		3, 1, 380, 0, 40000, 2100, 3400
+	};
+	packetEncoder enc;
+	sampleTimeStepper stepper;
+	int8_t x[MAX_ACCEL_FIFO_SIZE], y[MAX_ACCEL_FIFO_SIZE], z[MAX_ACCEL_FIFO_SIZE];
+	__time64_t time, time_prev, prev, expect;
+	int count = 0;
+	int len, pos, k, i, n, used;
+
+	for (k = 0; k < FRAME_BLOCKS; k++)
+	{
+		make_block(&blocks[k], k + 100, CORPUS_MOVING);
+		count += blocks[k].num_samples;
+	}
+
+	packet_encode_begin(&enc, frame, sizeof(frame), &meta, count, FRAME_BLOCKS);
+	for (k = 0; k < FRAME_BLOCKS; k++)
+	{
+		packet_encode_block(&enc, &blocks[k]);
+	}
+	len = packet_encode_end(&enc, count, FRAME_BLOCKS);
+	CHECK(len > 0);
+	if (len <= 0)
+	{
+		return;
+	}
+
+	CHECK_EQ(frame[0], PACKET_FRAME_MAGIC_0);
+	CHECK_EQ(frame[1], PACKET_FRAME_MAGIC_1);
+	CHECK_EQ(frame[2], PACKET_FRAME_VERSION);
+	CHECK_EQ(frame[4] | (frame[5] << 8), len - PACKET_FRAME_PREAMBLE_SIZE);
+
+	pos = PACKET_FRAME_PREAMBLE_SIZE;
+	CHECK_EQ(get_varint(frame, &pos), meta.msg_number);
+	CHECK_EQ(get_varint(frame, &pos), meta.sequence);
+	CHECK_EQ(frame[pos] | (frame[pos + 1] << 8), meta.battery_cv);
+	pos += 3;
+	CHECK_EQ(get_varint(frame, &pos), meta.free_heap);
+	CHECK_EQ(get_varint(frame, &pos), meta.wifi_connect_msec);
+	CHECK_EQ(get_varint(frame, &pos), meta.connect_msec);
+	CHECK(memcmp(&frame[pos + 1], meta.device_id, frame[pos]) == 0);
+	skip_string(frame, &pos);
+	skip_string(frame, &pos);
+	skip_string(frame, &pos);
+	CHECK_EQ(get_varint(frame, &pos), meta.timesync_msec);
+	CHECK_EQ(get_varint(frame, &pos), count);
+	CHECK_EQ(get_varint(frame, &pos), FRAME_BLOCKS);
+
+	prev = 0;
+	for (k = 0; k < FRAME_BLOCKS; k++)
+	{
+		n = frame[pos++];
+		time_prev = (k == 0) ? (__time64_t)get_varint(frame, &pos) : prev + get_svarint(frame, &pos);
+		time = time_prev + get_svarint(frame, &pos);
+		used = block_codec_decode(&frame[pos], len - pos, n, x, y, z);
+		CHECK(used > 0);
+		if (used <= 0)
+		{
+			return;
+		}
+		pos += used;
+
+		CHECK_EQ(n, blocks[k].num_samples);
+		CHECK_EQ(time_prev, blocks[k].accelTime_prev);
+		CHECK_EQ(time, blocks[k].accelTime);
+		CHECK(same_samples(&blocks[k], x, y, z));
+
+		// The receiver's timestamps are the ones the JSON packet carries
+		sample_time_begin(&stepper, time, time_prev, n);
+		for (i = 0; i < n; i++)
+		{
+			calculate_timestamp_for_sample(&blocks[k].accelTime, &blocks[k].accelTime_prev,
+					i, blocks[k].num_samples, &expect);
+			CHECK_EQ(sample_time_next(&stepper), expect);
+		}
+		prev = time;
+	}
+	CHECK_EQ(pos, len);
+
+	CHECK_EQ(packet_base64_encode(text, sizeof(text), frame, len), PACKET_BASE64_SIZE(len));
+	printf("\n%d samples in %d blocks: frame %d bytes, %d as base64\n",
+			count, FRAME_BLOCKS, len, PACKET_BASE64_SIZE(len));
+
+	// A frame that doesn't fit is refused, not truncated
+	packet_encode_begin(&enc, frame, len - 1, &meta, count, FRAME_BLOCKS);
+	for (k = 0; k < FRAME_BLOCKS; k++)
+	{
+		packet_encode_block(&enc, &blocks[k]);
+	}
+	CHECK_EQ(packet_encode_end(&enc, count, FRAME_BLOCKS), -1);
+
+	// So is one with fewer blocks than announced
+	packet_encode_begin(&enc, frame, sizeof(frame), &meta, count, FRAME_BLOCKS);
+	packet_encode_block(&enc, &blocks[0]);
+	CHECK_EQ(packet_encode_end(&enc, count, FRAME_BLOCKS), -1);
+}
+
+static void check_base64(void)
+{
+	char text[16];
+
+	CHECK_EQ(packet_base64_encode(text, sizeof(text), (const UCHAR *)"Man", 3), 4);
+	CHECK(strcmp(text, "TWFu") == 0);
+	CHECK_EQ(packet_base64_encode(text, sizeof(text), (const UCHAR *)"Ma", 2), 4);
+	CHECK(strcmp(text, "TWE=") == 0);
+	CHECK_EQ(packet_base64_encode(text, sizeof(text), (const UCHAR *)"M", 1), 4);
+	CHECK(strcmp(text, "TQ==") == 0);
+	CHECK_EQ(packet_base64_encode(text, 4, (const UCHAR *)"Man", 3), -1);
+}
+
+static double now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void benchmark(void)
+{
+	accelBufferStruct block;
+	UCHAR out[BLOCK_CODEC_MAX_SIZE(MAX_ACCEL_FIFO_SIZE)];
+	volatile int total = 0;
+	const int reps = 500000;
+	double t0;
+	int rep;
+
+	make_block(&block, 1, CORPUS_MOVING);
+	t0 = now_sec();
+	for (rep = 0; rep < reps; rep++)
+	{
+		block.Xvalue[0] = (int8_t)rep;
+		total += block_codec_encode(&block, out, sizeof(out));
+	}
+	printf("\nencode %.0f nsec per %d sample block (host)\n",
+			(now_sec() - t0) / reps * 1e9, block.num_samples);
+	CHECK(total > 0);
+}
+
+int main(void)
+{
+	check_corpus();
+	check_edges();
+	check_frame();
+	check_base64();
+	benchmark();
+
+	HOST_TEST_EXIT();
+}
@@ -0,0 +1,351 @@
+/*
+ * Host test for user_erase_ahead.c
+ *
+ * Checks the erase planning directly, then runs ten hours of wakes and
+ * uploads against a simulated flash, in 10 msec steps, with every erase
+ * taking its data sheet maximum.  The accelerometer task must never write
+ * to a sector that isn't erased, never wait for an erase-ahead longer
+ * than AB_ERASE_AHEAD_WAIT_POLLS, and the blocks the erase-ahead destroys
+ * must be the ones whose transmit map bits it clears.
+ */
+#include <string.h>
+#include "host_test.h"
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "user_erase_ahead.h"
+#include "user_transmit_map.h"
+#include "user_upload_scheduler.h"
+
+#define NUM_SECTORS			(AB_FLASH_MAX_BLOCKS / AB_BLOCKS_PER_SECTOR)
+#define SECTOR_OF(pos)		((pos) / AB_BLOCKS_PER_SECTOR)
+
+// W25Q64 data sheet maximums, msec
+#define ERASE_4K_MAX_MSEC	400
+#define ERASE_32K_MAX_MSEC	1600
+#define ERASE_64K_MAX_MSEC	2000
+#define STEP_MSEC			10
+#define FIFO_MSEC			(1000 * AXL_FIFO_INTERRUPT_THRESHOLD / 14)
+// Time from a FIFO interrupt until the FIFO overflows, and the rest of a
+// wake (as in bench_cycle.c)
+#define FIFO_BUDGET_MSEC	(1000 * MAX_ACCEL_FIFO_SIZE / 14)
+#define WAKE_MSEC			60
+
+static int erase_msec(int num_sectors)
+{
+	return (num_sectors == 1) ? ERASE_4K_MAX_MSEC :
+			(num_sectors == 8) ? ERASE_32K_MAX_MSEC : ERASE_64K_MAX_MSEC;
+}
+
+static void check_plan(void)
+{
+	AB_INDEX_TYPE next;
+	int write_index;
+	int sector_start;
+	int erased;
+	int pos;
+	int n;
+	int ops;
+	ULONG addr;
+
+	CHECK_EQ(ab_erased_sectors_from(AB_BLOCKS_PER_SECTOR, 0), 1);
+	CHECK_EQ(ab_erased_sectors_from(0, 0), 0);
+	CHECK_EQ(ab_erased_sectors_from(5, 0), -1);
+	CHECK_EQ(ab_erased_sectors_from(AB_BLOCKS_PER_SECTOR, AB_FLASH_MAX_BLOCKS - AB_BLOCKS_PER_SECTOR), 2);
+	CHECK_EQ(ab_erased_sectors_from((AB_ERASE_AHEAD_SECTORS + 2) * AB_BLOCKS_PER_SECTOR, 0), -1);
+
+	CHECK(!ab_erase_range_covers(INVALID_AB_ADDRESS, 16, 0));
+	CHECK(ab_erase_range_covers(64, 1, 64));
+	CHECK(!ab_erase_range_covers(64, 1, 96));
+	CHECK(ab_erase_range_covers(64, 8, 64 + 7 * AB_BLOCKS_PER_SECTOR));
+	CHECK(!ab_erase_range_covers(64, 8, 64 + 8 * AB_BLOCKS_PER_SECTOR));
+	CHECK(!ab_erase_range_covers(64, 8, 32));
+	CHECK(ab_erase_range_covers(AB_FLASH_MAX_BLOCKS - AB_BLOCKS_PER_SECTOR, 2, 0));
+
+	// An unknown erase position falls back to the sector after the write position
+	next = 5;
+	CHECK_EQ(ab_erase_ahead_next(&next, 40, pdTRUE, &n), 2 * AB_BLOCKS_PER_SECTOR);
+	CHECK_EQ(next, 2 * AB_BLOCKS_PER_SECTOR);
+	CHECK_EQ(n, 1);
+
+	// Nothing to do while the sector being written isn't erased, nor
+	// above the low water mark on the first operation
+	next = 0;
+	CHECK_EQ(ab_erase_ahead_next(&next, 3, pdTRUE, &n), -1);
+	next = (AB_ERASE_AHEAD_LOW_WATER + 2) * AB_BLOCKS_PER_SECTOR;
+	CHECK_EQ(ab_erase_ahead_next(&next, 0, pdTRUE, &n), -1);
+	CHECK(ab_erase_ahead_next(&next, 0, pdFALSE, &n) >= 0);
+
+	// From every write position, refill the way AB_erase_ahead() does
+	for (write_index = 0; write_index < AB_FLASH_MAX_BLOCKS; write_index += 7)
+	{
+		sector_start = write_index - (write_index % AB_BLOCKS_PER_SECTOR);
+		next = (sector_start + AB_BLOCKS_PER_SECTOR) % AB_FLASH_MAX_BLOCKS;
+		for (ops = 0; ops < 64; ops++)
+		{
+			erased = ab_erased_sectors_from(next, sector_start);
+			pos = ab_erase_ahead_next(&next, write_index, (ops == 0), &n);
+			if (pos < 0)
+			{
+				break;
+			}
+			addr = AB_BLOCK_ADDRESS(pos);
+			CHECK_EQ(pos, next);
+			CHECK(n == 1 || n == 8 || n == 16);
+			CHECK_EQ(addr % (n * AB_FLASH_SECTOR_SIZE), 0);
+			CHECK(pos + n * AB_BLOCKS_PER_SECTOR <= AB_FLASH_MAX_BLOCKS);
+			CHECK(erased + n <= AB_ERASE_AHEAD_SECTORS + 1);
+			// The sector after the write sector never shares a block erase
+			if (erased == 1)
+			{
+				CHECK_EQ(n, 1);
+			}
+			next = (pos + n * AB_BLOCKS_PER_SECTOR) % AB_FLASH_MAX_BLOCKS;
+		}
+		CHECK_EQ(ab_erased_sectors_from(next, sector_start), AB_ERASE_AHEAD_SECTORS + 1);
+	}
+}
+
+/*
+ * The device, as seen by the simulation
+ */
+static struct
+{
+	int msec;
+	unsigned char erased[NUM_SECTORS];	// flash state of each sector
+	unsigned char written[AB_FLASH_MAX_BLOCKS];	// holds data not yet erased
+
+	// Accelerometer task
+	int write_pos;
+	AB_INDEX_TYPE next_erase;
+	int next_wake;
+	int waiting;					// for the sector at write_pos, since
+	int wait_polls;
+	int max_stall;
+	int inline_erases;
+
+	// MQTT task
+	int reserved;
+	int reserved_sectors;
+	int erase_done;					// msec the erase in flight ends
+	int ops_left;
+	int next_upload;
+	int dropped;
+	int destroyed;					// written blocks the erases destroyed
+	int sectors_erased;
+} sim;
+
+static _AB_transmit_map_t map[AB_TRANSMIT_MAP_SIZE];
+
+static void sim_erase(int pos, int num_sectors)
+{
+	int i;
+
+	for (i = 0; i < num_sectors * AB_BLOCKS_PER_SECTOR; i++)
+	{
+		sim.destroyed += sim.written[pos + i];
+		sim.written[pos + i] = 0;
+	}
+	for (i = 0; i < num_sectors; i++)
+	{
+		sim.erased[SECTOR_OF(pos) + i] = 1;
+	}
+}
+
+// AB_erase_ahead(), one operation per call
+static void sim_mqtt_step(void)
+{
+	int pos;
+	int n;
+	int i;
+
+	if (sim.reserved >= 0)
+	{
+		if (sim.msec < sim.erase_done)
+		{
+			return;
+		}
+		sim_erase(sim.reserved, sim.reserved_sectors);
+		sim.sectors_erased += sim.reserved_sectors;
+		if (sim.next_erase == sim.reserved)
+		{
+			sim.next_erase = (sim.reserved + sim.reserved_sectors * AB_BLOCKS_PER_SECTOR)
+								% AB_FLASH_MAX_BLOCKS;
+		}
+		sim.reserved = INVALID_AB_ADDRESS;
+		sim.reserved_sectors = 0;
+	}
+
+	if (sim.ops_left == 0)
+	{
+		return;
+	}
+
+	pos = ab_erase_ahead_next(&sim.next_erase, sim.write_pos,
+							(sim.ops_left == AB_ERASE_AHEAD_MAX_OPS), &n);
+	if (pos < 0)
+	{
+		sim.ops_left = 0;
+		return;
+	}
+	sim.ops_left--;
+	sim.reserved = pos;
+	sim.reserved_sectors = n;
+	sim.dropped += ab_map_clear_range(map, pos, pos + n * AB_BLOCKS_PER_SECTOR - 1);
+	for (i = 0; i < n; i++)
+	{
+		// Contents are gone as soon as the erase starts
+		sim.erased[SECTOR_OF(pos) + i] = 0;
+	}
+	sim.erase_done = sim.msec + erase_msec(n);
+}
+
+// AB_prepare_sector() for the sector at the write position; pdTRUE once ready
+static int sim_prepare_step(void)
+{
+	int sector_start = sim.write_pos;
+	int erased;
+	int in_flight;
+
+	erased = ab_erased_sectors_from(sim.next_erase, sector_start);
+	in_flight = ab_erase_range_covers(sim.reserved, sim.reserved_sectors, sector_start);
+	if (erased > 0)
+	{
+		return pdTRUE;
+	}
+	if (in_flight && (sim.wait_polls++ < AB_ERASE_AHEAD_WAIT_POLLS))
+	{
+		return pdFALSE;
+	}
+
+	// Erase it ourselves, after whatever the chip is busy with
+	sim.inline_erases++;
+	if ((sim.reserved >= 0) && (sim.erase_done > sim.msec))
+	{
+		sim.msec = sim.erase_done;
+	}
+	sim.msec += ERASE_4K_MAX_MSEC;
+	sim_erase(sector_start, 1);
+	if (ab_erased_sectors_from(sim.next_erase, sector_start) <= 0)
+	{
+		sim.next_erase = (sector_start + AB_BLOCKS_PER_SECTOR) % AB_FLASH_MAX_BLOCKS;
+	}
+	return pdTRUE;
+}
+
+static void sim_write_block(void)
+{
+	CHECK(sim.erased[SECTOR_OF(sim.write_pos)]);
+	CHECK(!ab_erase_range_covers(sim.reserved, sim.reserved_sectors,
+			sim.write_pos - (sim.write_pos % AB_BLOCKS_PER_SECTOR)));
+	sim.written[sim.write_pos] = 1;
+	ab_map_set(map, sim.write_pos);
+	sim.write_pos = (sim.write_pos + 1) % AB_FLASH_MAX_BLOCKS;
+	if ((sim.write_pos % AB_BLOCKS_PER_SECTOR) == 0)
+	{
+		sim.waiting = sim.msec;
+		sim.wait_polls = 0;
+	}
+}
+
+/*
+ * Wakes write from start_pos, one block at a time or in bursts the way
+ * the stage flushes, and uploads come every UPLOAD_DEFAULT_MIN_FIFOS to
+ * UPLOAD_DEFAULT_MAX_FIFOS reads from first_upload msec
+ */
+static void simulate(int hours, int burst, int start_pos, int first_upload)
+{
+	unsigned int seed = 99;
+	int wake = 0;
+	int staged = 0;
+	int stall;
+	int set;
+	int i;
+
+	memset(&sim, 0, sizeof(sim));
+	memset(map, 0, sizeof(map));
+	ab_map_rebuild(map);
+	sim.write_pos = start_pos;
+	sim.erased[SECTOR_OF(start_pos)] = 1;
+	sim.next_erase = (start_pos - (start_pos % AB_BLOCKS_PER_SECTOR) + AB_BLOCKS_PER_SECTOR)
+						% AB_FLASH_MAX_BLOCKS;
+	sim.reserved = INVALID_AB_ADDRESS;
+	sim.waiting = -1;
+	sim.next_wake = FIFO_MSEC;
+	sim.next_upload = first_upload;
+
+	while (sim.msec < hours * 3600 * 1000)
+	{
+		if ((sim.ops_left == 0) && (sim.reserved < 0) && (sim.msec >= sim.next_upload))
+		{
+			sim.ops_left = AB_ERASE_AHEAD_MAX_OPS;
+			sim.next_upload += (UPLOAD_DEFAULT_MIN_FIFOS
+					+ host_rand(&seed) % (UPLOAD_DEFAULT_MAX_FIFOS - UPLOAD_DEFAULT_MIN_FIFOS + 1))
+					* FIFO_MSEC + (host_rand(&seed) % 100) * STEP_MSEC;
+		}
+		sim_mqtt_step();
+
+		if (sim.waiting >= 0)
+		{
+			if (sim_prepare_step())
+			{
+				stall = sim.msec - sim.waiting;
+				if (stall > sim.max_stall)
+				{
+					sim.max_stall = stall;
+				}
+				sim.waiting = -1;
+			}
+		}
+		else if (sim.msec >= sim.next_wake)
+		{
+			wake++;
+			staged++;
+			sim.next_wake += FIFO_MSEC;
+			if ((staged >= burst) || ((sim.write_pos + staged) % AB_BLOCKS_PER_SECTOR) == 0)
+			{
+				for (i = 0; (i < staged) && (sim.waiting < 0); i++)
+				{
+					sim_write_block();
+				}
+				staged -= i;
+			}
+		}
+		sim.msec += STEP_MSEC;
+	}
+
+	// What the erases destroyed is exactly what was dropped from the map
+	set = 0;
+	for (i = 0; i < AB_FLASH_MAX_BLOCKS; i++)
+	{
+		set += sim.written[i];
+		CHECK_EQ(ab_map_test(map, i), sim.written[i]);
+	}
+	CHECK_EQ(ab_map_count(map), set);
+	CHECK_EQ(sim.dropped, sim.destroyed);
+	CHECK_EQ(sim.inline_erases, 0);
+	CHECK(sim.max_stall <= AB_ERASE_AHEAD_WAIT_POLLS * STEP_MSEC);
+	CHECK(sim.max_stall + WAKE_MSEC < FIFO_BUDGET_MSEC);
+	printf("\n%d hours, %d block writes: %d wakes, %d sectors erased ahead, %d unsent blocks dropped,"
+			" %d inline erases, longest wait %d msec\n",
+			hours, burst, wake, sim.sectors_erased, sim.dropped, sim.inline_erases, sim.max_stall);
+}
+
+int main(void)
+{
+	check_plan();
+
+	// Long enough to wrap the buffer, with nothing ever sent
+	simulate(10, 1, 0, UPLOAD_DEFAULT_MIN_FIFOS * FIFO_MSEC);
+	CHECK(sim.dropped > 0);
+	simulate(10, AB_BLOCKS_PER_SECTOR / 2, 0, UPLOAD_DEFAULT_MIN_FIFOS * FIFO_MSEC);
+	CHECK(sim.dropped > 0);
+
+	// An upload starts just before the write that fills the only erased
+	// sector: the accelerometer task waits for the 4K erase of the next one
+	simulate(1, 1, AB_BLOCKS_PER_SECTOR - 1, FIFO_MSEC - 100);
+	CHECK(sim.max_stall > 0);
+
+	HOST_TEST_EXIT();
+}
@@ -0,0 +1,383 @@
+/*
+ * Host test and benchmark for user_json_writer.c and user_json_packet.c
+ *
+ * Checks every formatter, time64_string() and the timesync string against
+ * the printf output they replaced, checks the overflow handling, and
+ * times json_packet_compose() on a FIFO_BLOCKS_PER_PACKET packet against
+ * the sprintf/strcat composition of send_json_packet() it replaced.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "host_test.h"
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "user_json_writer.h"
+#include "user_json_packet.h"
+#include "user_sample_time.h"
+
+static void check_formatters(void)
+{
+	char out[64];
+	char expect[64];
+	jsonWriter w;
+	unsigned int seed = 12345;
+	long long v64;
+	long v32;
+	int i;
+
+	for (i = 0; i < 200000; i++)
+	{
+		v32 = (long)(int32_t)host_rand(&seed);
+		json_writer_init(&w, out, sizeof(out));
+		json_put_int(&w, v32);
+		snprintf(expect, sizeof(expect), "%ld", v32);
+		CHECK(strcmp(out, expect) == 0);
+
+		v64 = ((long long)host_rand(&seed) << 32) | host_rand(&seed);
+		v64 >>= host_rand(&seed) % 64;
+		if (host_rand(&seed) & 1)
+		{
+			v64 = -v64;
+		}
+		json_writer_init(&w, out, sizeof(out));
+		json_put_int64(&w, v64);
+		snprintf(expect, sizeof(expect), "%lld", v64);
+		CHECK(strcmp(out, expect) == 0);
+
+		// The "ts" format: millions with %03, remainder with %06
+		if (v64 < 0)
+		{
+			v64 = -v64;
+		}
+		json_writer_init(&w, out, sizeof(out));
+		json_put_time64(&w, v64);
+		snprintf(expect, sizeof(expect), "%03lld%06lld", v64 / 1000000, v64 % 1000000);
+		CHECK(strcmp(out, expect) == 0);
+	}
+
+	// Edges
+	json_writer_init(&w, out, sizeof(out));
+	json_put_int64(&w, INT64_MIN);
+	CHECK(strcmp(out, "-9223372036854775808") == 0);
+	json_writer_init(&w, out, sizeof(out));
+	json_put_int(&w, INT32_MIN);
+	CHECK(strcmp(out, "-2147483648") == 0);
+	json_writer_init(&w, out, sizeof(out));
+	json_put_uint_padded(&w, 7, 3);
+	json_put_char(&w, ',');
+	json_put_uint_padded(&w, 0, 1);
+	json_put_str(&w, "\"x\"");
+	CHECK(strcmp(out, "007,0\"x\"") == 0);
+	CHECK_EQ(json_writer_len(&w), 8);
+	CHECK(json_writer_ok(&w));
+}
+
+static void check_overflow(void)
+{
+	char out[8];
+	jsonWriter w;
+
+	memset(out, 'z', sizeof(out));
+	json_writer_init(&w, out, sizeof(out));
+	json_put_str(&w, "abcdef");			// 6 + terminator fits
+	CHECK(json_writer_ok(&w));
+	json_put_str(&w, "gh");				// doesn't fit: nothing appended
+	CHECK(!json_writer_ok(&w));
+	CHECK(strcmp(out, "abcdef") == 0);
+	json_put_char(&w, 'i');				// still nothing, even though it would fit
+	CHECK(strcmp(out, "abcdef") == 0);
+	CHECK_EQ(json_writer_len(&w), 6);
+
+	json_writer_init(&w, out, sizeof(out));
+	json_put_int64(&w, 123456789012LL);	// 12 digits into 8 bytes
+	CHECK(!json_writer_ok(&w));
+	CHECK(strlen(out) < sizeof(out));
+
+	// advance() is for text written in place, and is bounded the same way
+	json_writer_init(&w, out, sizeof(out));
+	json_writer_advance(&w, 8);
+	CHECK(!json_writer_ok(&w));
+	json_writer_init(&w, out, sizeof(out));
+	json_writer_advance(&w, 7);
+	CHECK(json_writer_ok(&w));
+}
+
+/*
+ * time64_string() and the timesync string, against the sprintf code of
+ * time64_string() and timesync_snapshot() they replaced
+ */
+static void baseline_time64_string(char *timestamp_str, __time64_t timestamp)
+{
+	char nowStr[20];
+	char str2[20];
+	uint64_t num1 = ((timestamp / 1000000) * 1000000);	// millions
+	uint32_t num3 = (uint32_t)(timestamp - num1);
+
+	sprintf(nowStr, "%03ld", (long)(uint32_t)(timestamp / 1000000));
+	sprintf(str2, "%06ld", (long)num3);
+	strcat(nowStr, str2);
+	strcpy(timestamp_str, nowStr);
+}
+
+static void check_time_helpers(void)
+{
+	static const int tzoffs[] = { 0, 3600, -3600, 5 * 3600 + 1800, -(9 * 3600 + 1800), -1800, 14 * 3600 };
+	char out[TIME64_STRING_MAX_LEN];
+	char expect[128];
+	char timesync[128];
+	unsigned int seed = 54321;
+	__time64_t t;
+	int i;
+
+	for (i = 0; i < 100000; i++)
+	{
+		// Up to the 5 days the packet format was designed for, and beyond
+		t = (__time64_t)(host_rand(&seed) % 4000000000U);
+		time64_string((UCHAR *)out, &t);
+		baseline_time64_string(expect, t);
+		CHECK(strcmp(out, expect) == 0);
+	}
+
+	for (i = 0; i < (int)(sizeof(tzoffs) / sizeof(tzoffs[0])); i++)
+	{
+		CHECK(json_packet_timesync_str(timesync, sizeof(timesync), "2023.01.17 12:53:55", tzoffs[i]));
+		snprintf(expect, sizeof(expect), "%s (GMT %+02d:%02d)",
+				"2023.01.17 12:53:55", tzoffs[i] / 3600, tzoffs[i] % 3600);
+		CHECK(strcmp(timesync, expect) == 0);
+	}
+	CHECK(!json_packet_timesync_str(timesync, 20, "2023.01.17 12:53:55", 0));
+}
+
+/*
+ * One FIFO_BLOCKS_PER_PACKET packet, composed by json_packet_compose()
+ * and by the code of send_json_packet() it replaced: sprintf into a
+ * scratch string and strcat onto the message for every value, and a
+ * strlen of the whole message after each section.  The old code took the
+ * samples from a table with the timestamps already worked out, so the
+ * baseline is given one; the timestamp calculation is only timed on the
+ * new side.
+ */
+#define BENCH_SAMPLES			(FIFO_BLOCKS_PER_PACKET * AXL_FIFO_INTERRUPT_THRESHOLD)
+#define BENCH_PACKET_MAX		JSON_PACKET_MAX_SIZE(BENCH_SAMPLES)
+
+static accelBufferStruct bench_blocks[FIFO_BLOCKS_PER_PACKET];
+static accelDataStruct bench_samples[BENCH_SAMPLES];
+static const packetMetaStruct bench_meta =
+{
+	"EB345A", "1.10.17", "2023.01.17 12:53:55 (GMT +0:00)", 656741,
+	3, 1, 380, 0, 40000, 2100, 3400
+};
+
+static void bench_setup(void)
+{
+	unsigned int seed = 2002;
+	__time64_t time = 432000000LL;
+	int b, i, n = 0;
+
+	for (b = 0; b < FIFO_BLOCKS_PER_PACKET; b++)
+	{
+		memset(&bench_blocks[b], 0, sizeof(bench_blocks[b]));
+		bench_blocks[b].num_samples = AXL_FIFO_INTERRUPT_THRESHOLD;
+		bench_blocks[b].accelTime_prev = time;
+		time += 2000 + (host_rand(&seed) % 5);
+		bench_blocks[b].accelTime = time;
+		for (i = 0; i < AXL_FIFO_INTERRUPT_THRESHOLD; i++)
+		{
+			bench_blocks[b].Xvalue[i] = (int8_t)host_rand(&seed);
+			bench_blocks[b].Yvalue[i] = (int8_t)host_rand(&seed);
+			bench_blocks[b].Zvalue[i] = (int8_t)host_rand(&seed);
+			bench_samples[n].Xvalue = bench_blocks[b].Xvalue[i];
+			bench_samples[n].Yvalue = bench_blocks[b].Yvalue[i];
+			bench_samples[n].Zvalue = bench_blocks[b].Zvalue[i];
+			calculate_timestamp_for_sample(&bench_blocks[b].accelTime, &bench_blocks[b].accelTime_prev,
+					i, AXL_FIFO_INTERRUPT_THRESHOLD, &bench_samples[n].accelTime);
+			n++;
+		}
+	}
+}
+
+static int baseline_compose(char *mqttMessage, const packetMetaStruct *meta)
+{
+	char str[80];		// was 50, which the timesync line overran
+	char nowStr[20];
+	char str2[20];
+	char buf[20];
+	__time64_t now;
+	__time64_t timesync_msec = meta->timesync_msec;
+	int packet_len;
+	int i;
+
+	strcpy(mqttMessage, "{\r\n\t\"state\":\r\n\t{\r\n\t\t\"reported\":\r\n\t\t{\r\n");
+	sprintf(str, "\t\t\t\"id\": \"%s\",\r\n", meta->device_id);
+	strcat(mqttMessage, str);
+	baseline_time64_string(buf, timesync_msec);
+	sprintf(str, "\t\t\t\"timesync\": \"%s %s\",\r\n", meta->timesync_str, buf);
+	strcat(mqttMessage, str);
+	sprintf(str, "\t\t\t\"bat\": %d,\r\n", meta->battery_cv);
+	strcat(mqttMessage, str);
+	strcat(mqttMessage, "\t\t\t\"meta\":\r\n\t\t\t{\r\n");
+	sprintf(str, "\t\t\t\t\"ver\": \"%s\",\r\n", meta->version);
+	strcat(mqttMessage, str);
+	sprintf(str, "\t\t\t\t\"trans\": %d,\r\n", meta->msg_number);
+	strcat(mqttMessage, str);
+	sprintf(str, "\t\t\t\t\"seq\": %d,\r\n", meta->sequence);
+	strcat(mqttMessage, str);
+	sprintf(str, "\t\t\t\t\"bat\": %d,\r\n", meta->battery_cv);
+	strcat(mqttMessage, str);
+	sprintf(str, "\t\t\t\t\"count\": %d,\r\n", meta->fault_count);
+	strcat(mqttMessage, str);
+	sprintf(str, "\t\t\t\t\"mem\": %d\r\n", (int)meta->free_heap);
+	strcat(mqttMessage, str);
+	strcat(mqttMessage, "\t\t\t},\r\n");
+
+	sprintf(str, "\t\t\t\"accX\": [");
+	strcat(mqttMessage, str);
+	for (i = 0; i < BENCH_SAMPLES; i++)
+	{
+		sprintf(str, "%d ", bench_samples[i].Xvalue);
+		strcat(mqttMessage, str);
+	}
+	sprintf(str, "],\r\n");
+	strcat(mqttMessage, str);
+	packet_len = strlen(mqttMessage);
+
+	sprintf(str, "\t\t\t\"accY\": [");
+	strcat(mqttMessage, str);
+	for (i = 0; i < BENCH_SAMPLES; i++)
+	{
+		sprintf(str, "%d ", bench_samples[i].Yvalue);
+		strcat(mqttMessage, str);
+	}
+	sprintf(str, "],\r\n");
+	strcat(mqttMessage, str);
+	packet_len = strlen(mqttMessage);
+
+	sprintf(str, "\t\t\t\"accZ\": [");
+	strcat(mqttMessage, str);
+	for (i = 0; i < BENCH_SAMPLES; i++)
+	{
+		sprintf(str, "%d ", bench_samples[i].Zvalue);
+		strcat(mqttMessage, str);
+	}
+	sprintf(str, "],\r\n");
+	strcat(mqttMessage, str);
+	packet_len = strlen(mqttMessage);
+
+	sprintf(str, "\t\t\t\"ts\": [");
+	strcat(mqttMessage, str);
+	for (i = 0; i < BENCH_SAMPLES; i++)
+	{
+		now = bench_samples[i].accelTime;
+		uint64_t num1 = ((now / 1000000) * 1000000);
+		uint64_t num2 = now - num1;
+		uint32_t num3 = num2;
+		sprintf(nowStr, "%03ld", (long)(now / 1000000));
+		sprintf(str2, "%06ld ", (long)num3);
+		strcat(nowStr, str2);
+		strcat(mqttMessage, nowStr);
+	}
+	sprintf(str, "]\r\n");
+	strcat(mqttMessage, str);
+	packet_len = strlen(mqttMessage);
+
+	strcat(mqttMessage, "\r\n\t\t}\r\n\t}\r\n}\r\n");
+	packet_len = strlen(mqttMessage);
+	return packet_len;
+}
+
+static void check_packet(void)
+{
+	static char packet[BENCH_PACKET_MAX];
+	static char expect[BENCH_PACKET_MAX];
+	int len;
+
+	bench_setup();
+	len = json_packet_compose(packet, sizeof(packet), &bench_meta, bench_blocks, FIFO_BLOCKS_PER_PACKET);
+	CHECK(len > 0);
+	CHECK_EQ(len, (int)strlen(packet));
+	baseline_compose(expect, &bench_meta);
+
+	// The same up to "mem", which is no longer the last meta field, and
+	// the same from the samples on
+	CHECK(strncmp(packet, expect, strstr(expect, "\t\t\t\t\"mem\"") - expect) == 0);
+	CHECK(strstr(packet, "\t\t\t\t\"mem\": 40000,\r\n\t\t\t\t\"wifi\": 2100,\r\n\t\t\t\t\"conn\": 3400\r\n\t\t\t},\r\n") != NULL);
+	CHECK(strcmp(strstr(packet, "\t\t\t\"accX\""), strstr(expect, "\t\t\t\"accX\"")) == 0);
+
+	// Too small by one: refused, and still terminated
+	CHECK_EQ(json_packet_compose(packet, len, &bench_meta, bench_blocks, FIFO_BLOCKS_PER_PACKET), -1);
+	CHECK((int)strlen(packet) < len);
+}
+
+static double now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned long long now_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static void benchmark(void)
+{
+	static char packet_writer[BENCH_PACKET_MAX];
+	static char packet_sprintf[BENCH_PACKET_MAX];
+	double t0, ns_writer, ns_sprintf;
+	unsigned long long c0, cyc_writer, cyc_sprintf;
+	int len = 0, rep;
+	const int reps = 2000;
+
+	bench_setup();
+
+	t0 = now_sec();
+	c0 = now_cycles();
+	for (rep = 0; rep < reps; rep++)
+	{
+		len = json_packet_compose(packet_writer, sizeof(packet_writer), &bench_meta,
+				bench_blocks, FIFO_BLOCKS_PER_PACKET);
+	}
+	cyc_writer = (now_cycles() - c0) / reps;
+	ns_writer = (now_sec() - t0) * 1e9 / reps;
+
+	t0 = now_sec();
+	c0 = now_cycles();
+	for (rep = 0; rep < reps; rep++)
+	{
+		baseline_compose(packet_sprintf, &bench_meta);
+	}
+	cyc_sprintf = (now_cycles() - c0) / reps;
+	ns_sprintf = (now_sec() - t0) * 1e9 / reps;
+
+	CHECK(len > 0);
+	CHECK(ns_writer < ns_sprintf);
+	printf("\n%d blocks, %d samples, %d bytes per packet (host):\n"
+			"  json_packet_compose  %8.0f ns  %9llu TSC cycles\n"
+			"  sprintf/strcat       %8.0f ns  %9llu TSC cycles\n"
+			"  (TSC cycles are 0 where there is no TSC; ns x MHz / 1000 gives cycles at a clock)\n",
+			FIFO_BLOCKS_PER_PACKET, BENCH_SAMPLES, len,
+			ns_writer, cyc_writer, ns_sprintf, cyc_sprintf);
+}
+
+int main(void)
+{
+	check_formatters();
+	check_overflow();
+	check_time_helpers();
+	check_packet();
+	benchmark();
+
+	HOST_TEST_EXIT();
+}
@@ -0,0 +1,298 @@
+/*
+ * Host test for the FIFO drain in Mc363x.c
+ *
+ * The driver runs against a register model of the MC3672: the 32 sample
+ * FIFO, the STATUS_1 flags, the FIFO threshold in FIFO_C and the burst
+ * read that FEATURE_C_2 FIFO_BURST turns on.  Random fills, sample
+ * limits and I2C failures are thrown at mc36xx_read_fifo(); every sample
+ * must come out once, in order, and the FIFO must never be read empty.
+ */
+#include <string.h>
+#include "host_test.h"
+#include "da16x_system.h"
+#include "common.h"
+#include "Mc363x.h"
+
+#define SIXBYTESONETIME			0		// as in Mc363x.c
+#define SIXTIMEBYTESONETIME		1
+
+#define MODEL_FIFO_DEPTH		MC36XX_FIFO_SIZE
+
+// Defined in Mc363x.c but not declared in Mc363x.h
+extern Mc363X_All_Status mc363X_All_Status;
+void set_fifo_Len(uint8_t len, uint8_t onoff, uint8_t readfeature);
+
+// Globals the driver shares with the application (globals.c)
+HANDLE I2C = (HANDLE)1;
+UINT8 i2c_data[AT_I2C_DATA_LENGTH + AT_I2C_LENGTH_FOR_WORD_ADDRESS];
+UINT8 sensorTypePresentAll;
+int16_t lastXvalue;
+int16_t lastYvalue;
+int16_t lastZvalue;
+
+static struct
+{
+	UINT8 regs[256];
+	int8_t fifo[MODEL_FIFO_DEPTH][3];
+	int head;
+	int count;
+	int8_t last[3];				// what an empty FIFO reads back
+	int chip_address;
+	int transactions;
+	int fail_at;				// transaction number that fails, 0 for none
+	int empty_reads;			// sample reads with the FIFO empty
+} mc;
+
+static void model_reset(void)
+{
+	memset(&mc, 0, sizeof(mc));
+}
+
+static void model_push(int sample)
+{
+	int tail;
+
+	if (mc.count < MODEL_FIFO_DEPTH)
+	{
+		tail = (mc.head + mc.count) % MODEL_FIFO_DEPTH;
+		mc.fifo[tail][0] = (int8_t)sample;
+		mc.fifo[tail][1] = (int8_t)-sample;
+		mc.fifo[tail][2] = (int8_t)(sample * 3);
+		mc.count++;
+	}
+}
+
+static UINT8 model_status_1(void)
+{
+	UINT8 status = 0;
+	int threshold = mc.regs[MC36XX_REG_FIFO_C] & 0x1F;
+
+	if (mc.count == 0)
+	{
+		status |= MC36XX_STATUS_1_FIFO_EMPTY;
+	}
+	if (mc.count == MODEL_FIFO_DEPTH)
+	{
+		status |= MC36XX_STATUS_1_FIFO_FULL;
+	}
+	if ((threshold > 0) && (mc.count >= threshold))
+	{
+		status |= MC36XX_STATUS_1_FIFO_THRESH;
+	}
+	return status;
+}
+
+int host_i2c_ioctl(HANDLE i2c, UINT32 cmd, void *data)
+{
+	CHECK(i2c == I2C);
+	if (cmd == I2C_SET_CHIPADDR)
+	{
+		mc.chip_address = *(int *)data;
+	}
+	return TRUE;
+}
+
+int host_i2c_write(HANDLE i2c, void *data, UINT32 length)
+{
+	UINT8 *bytes = data;
+	UINT32 i;
+
+	CHECK_EQ(mc.chip_address, MC3672_ADDR);
+	mc.transactions++;
+	if (mc.transactions == mc.fail_at)
+	{
+		return FALSE;
+	}
+	for (i = 1; i < length; i++)
+	{
+		mc.regs[(UINT8)(bytes[0] + i - 1)] = bytes[i];
+	}
+	return TRUE;
+}
+
+/*
+ * The register address goes out in data[0], then length bytes are read
+ * back into data.  XOUT_LSB..ZOUT_MSB present the FIFO head; reading
+ * ZOUT_MSB pops it and, in burst mode, wraps back to XOUT_LSB.
+ */
+int host_i2c_read(HANDLE i2c, void *data, UINT32 length)
+{
+	UINT8 *bytes = data;
+	int reg = bytes[0];
+	const int8_t *sample;
+	int axis;
+	UINT32 i;
+
+	CHECK_EQ(mc.chip_address, MC3672_ADDR);
+	mc.transactions++;
+	if (mc.transactions == mc.fail_at)
+	{
+		return FALSE;
+	}
+
+	for (i = 0; i < length; i++)
+	{
+		if ((reg >= MC36XX_REG_XOUT_LSB) && (reg < MC36XX_REG_XOUT_LSB + MC36XX_FIFO_SAMPLE_BYTES))
+		{
+			sample = (mc.count > 0) ? mc.fifo[mc.head] : mc.last;
+			axis = (reg - MC36XX_REG_XOUT_LSB) / 2;
+			bytes[i] = (reg & 1) ? ((sample[axis] < 0) ? 0xFF : 0x00) : (UINT8)sample[axis];
+			if (reg == MC36XX_REG_XOUT_LSB + MC36XX_FIFO_SAMPLE_BYTES - 1)
+			{
+				if (mc.count > 0)
+				{
+					memcpy(mc.last, mc.fifo[mc.head], sizeof(mc.last));
+					mc.head = (mc.head + 1) % MODEL_FIFO_DEPTH;
+					mc.count--;
+				}
+				else
+				{
+					mc.empty_reads++;
+				}
+				if (mc.regs[MC36XX_REG_FEATURE_C_2] & MC36XX_FEATURE_C_2_FIFO_BURST)
+				{
+					reg = MC36XX_REG_XOUT_LSB;
+					continue;
+				}
+			}
+		}
+		else if (reg == MC36XX_REG_STATUS_1)
+		{
+			bytes[i] = model_status_1();
+		}
+		else
+		{
+			bytes[i] = mc.regs[reg];
+		}
+		reg = (reg + 1) & 0xFF;
+	}
+	return TRUE;
+}
+
+static void configure(int threshold, int read_style)
+{
+	mc363X_All_Status.filen = threshold;
+	mc363X_All_Status.fion = 1;
+	mc363X_All_Status.read_style = read_style;
+	set_fifo_Len(mc363X_All_Status.filen, mc363X_All_Status.fion, mc363X_All_Status.read_style);
+}
+
+/*
+ * set_fifo_Len() selects the read style in FEATURE_C_2 and leaves the
+ * other bits of the register alone
+ */
+static void check_read_style(void)
+{
+	model_reset();
+	mc.regs[MC36XX_REG_FEATURE_C_2] = 0x81;
+	configure(28, SIXTIMEBYTESONETIME);
+	CHECK_EQ(mc.regs[MC36XX_REG_FIFO_C], 0x40 | 28);
+	CHECK_EQ(mc.regs[MC36XX_REG_FEATURE_C_2], 0x81 | MC36XX_FEATURE_C_2_FIFO_BURST);
+
+	configure(28, SIXBYTESONETIME);
+	CHECK_EQ(mc.regs[MC36XX_REG_FEATURE_C_2], 0x81);
+}
+
+/*
+ * The usual threshold wake: one status read, one burst, one status read
+ */
+static void check_threshold_wake(void)
+{
+	int8_t x[MC36XX_FIFO_SIZE], y[MC36XX_FIFO_SIZE], z[MC36XX_FIFO_SIZE];
+	int burst_transactions;
+	int i;
+
+	model_reset();
+	configure(28, SIXTIMEBYTESONETIME);
+	for (i = 0; i < 28; i++)
+	{
+		model_push(i);
+	}
+	mc.transactions = 0;
+	CHECK_EQ(mc36xx_read_fifo(x, y, z, MC36XX_FIFO_SIZE), 28);
+	CHECK_EQ(mc.transactions, 3);
+	burst_transactions = mc.transactions;
+	for (i = 0; i < 28; i++)
+	{
+		CHECK_EQ(x[i], i);
+		CHECK_EQ(y[i], -i);
+		CHECK_EQ(z[i], i * 3);
+	}
+
+	// The same wake one sample at a time, as before the burst read
+	model_reset();
+	configure(28, SIXBYTESONETIME);
+	for (i = 0; i < 28; i++)
+	{
+		model_push(i);
+	}
+	mc.transactions = 0;
+	CHECK_EQ(mc36xx_read_fifo(x, y, z, MC36XX_FIFO_SIZE), 28);
+	CHECK_EQ(mc.transactions, 57);
+	CHECK_EQ(mc.empty_reads, 0);
+
+	printf("\n28 sample threshold wake: %d I2C transactions in bursts, %d one sample at a time\n",
+			burst_transactions, mc.transactions);
+}
+
+/*
+ * Random fills, limits and I2C failures.  Whatever isn't read is left in
+ * the FIFO for next time, so the samples read plus the samples left
+ * always add up to the samples there were.
+ */
+static void check_random_drains(void)
+{
+	int8_t x[MC36XX_FIFO_SIZE], y[MC36XX_FIFO_SIZE], z[MC36XX_FIFO_SIZE];
+	unsigned int seed = 2022;
+	int trial, i;
+	int filled, limit, got, expect;
+	int read_style;
+
+	for (trial = 0; trial < 20000; trial++)
+	{
+		read_style = (trial & 1) ? SIXTIMEBYTESONETIME : SIXBYTESONETIME;
+		model_reset();
+		// What configure() would set, without its console output
+		mc363X_All_Status.filen = 1 + (host_rand(&seed) % (MC36XX_FIFO_SIZE - 1));
+		mc363X_All_Status.read_style = read_style;
+		mc.regs[MC36XX_REG_FIFO_C] = 0x40 | mc363X_All_Status.filen;
+		mc.regs[MC36XX_REG_FEATURE_C_2] = (read_style == SIXTIMEBYTESONETIME) ?
+				MC36XX_FEATURE_C_2_FIFO_BURST : 0;
+		filled = host_rand(&seed) % (MC36XX_FIFO_SIZE + 1);
+		for (i = 0; i < filled; i++)
+		{
+			model_push(i);
+		}
+		limit = ((trial % 5) == 0) ? (int)(host_rand(&seed) % (MC36XX_FIFO_SIZE + 1)) : MC36XX_FIFO_SIZE;
+		mc.transactions = 0;
+		mc.fail_at = ((trial % 7) == 0) ? 1 + (host_rand(&seed) % 5) : 0;
+
+		got = mc36xx_read_fifo(x, y, z, limit);
+
+		CHECK(got <= limit);
+		CHECK_EQ(got + mc.count, filled);
+		if (mc.fail_at == 0)
+		{
+			expect = (filled < limit) ? filled : limit;
+			CHECK_EQ(got, expect);
+		}
+		for (i = 0; i < got; i++)
+		{
+			if ((x[i] != i) || (y[i] != (int8_t)-i) || (z[i] != (int8_t)(i * 3)))
+			{
+				CHECK_EQ(x[i], i);
+				break;
+			}
+		}
+		CHECK_EQ(mc.empty_reads, 0);
+	}
+}
+
+int main(void)
+{
+	check_read_style();
+	check_threshold_wake();
+	check_random_drains();
+
+	HOST_TEST_EXIT();
+}
@@ -0,0 +1,278 @@
+/*
+ * Fake broker simulation for user_mqtt_publish.c
+ *
+ * The fake MQTT client behaves like the SDK one: a new publish is refused
+ * with -2 while a message is inflight, its inflight count is only cleared
+ * a few ticks after the PUBACK callback, PUBACKs are sometimes lost (the
+ * client then retransmits and stays busy), and now and then it is busy
+ * with a message the application never published.  Transmissions are run
+ * the way user_process_send_MQTT_data() runs them until every packet is
+ * delivered, and each packet must be reported delivered exactly once.
+ */
+#include <string.h>
+#include "host_test.h"
+#include "host_rtos.h"
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "queue.h"
+#include "task.h"
+#include "user_mqtt_publish.h"
+
+#define SIM_PACKETS				400
+#define SIM_TIMEOUT_MS			2000
+#define SIM_MAX_ATTEMPTS		1000
+
+static unsigned int seed = 2024;
+static QueueHandle_t puback_queue;
+
+/*
+ * Fake client and broker
+ */
+static struct
+{
+	int connected;
+	int inflight;				// client has a message awaiting its PUBACK
+	int mid;					// ... and its message ID
+	int next_mid;
+	TickType_t puback_tick;		// when the PUBACK for mid arrives
+	TickType_t clear_tick;		// when the client then clears inflight
+	TickType_t busy_until;		// busy with something of its own
+	int loss_percent;
+	int busy_percent;
+	int max_latency;			// ticks
+	int received[SIM_PACKETS];	// PUBLISHes the broker got, per packet
+	int lost;
+	int busy_events;
+} broker;
+
+static void broker_reset(int loss_percent, int busy_percent, int max_latency)
+{
+	memset(&broker, 0, sizeof(broker));
+	broker.connected = 1;
+	broker.loss_percent = loss_percent;
+	broker.busy_percent = busy_percent;
+	broker.max_latency = max_latency;
+}
+
+static void broker_tick(TickType_t now)
+{
+	int mid;
+
+	if (broker.inflight && (broker.puback_tick != 0) && (now >= broker.puback_tick))
+	{
+		// user_mqtt_pub_cb()
+		mid = broker.mid;
+		xQueueSend(puback_queue, &mid, 0);
+		broker.puback_tick = 0;
+		broker.clear_tick = now + (host_rand(&seed) % 4);
+	}
+	if (broker.inflight && (broker.puback_tick == 0) && (now >= broker.clear_tick))
+	{
+		broker.inflight = 0;
+	}
+}
+
+int mqtt_client_send_message(char *top, char *publish)
+{
+	TickType_t now = xTaskGetTickCount();
+	int sequence;
+
+	(void)top;
+	if (!broker.connected)
+	{
+		return -1;
+	}
+	if (broker.inflight || (now < broker.busy_until))
+	{
+		return -2;
+	}
+	if ((int)(host_rand(&seed) % 100) < broker.busy_percent)
+	{
+		// A retransmission or keepalive the application doesn't know about
+		broker.busy_until = now + 1 + (host_rand(&seed) % 60);
+		broker.busy_events++;
+		return -2;
+	}
+
+	sequence = atoi(publish);
+	CHECK((sequence >= 0) && (sequence < SIM_PACKETS));
+	broker.received[sequence]++;
+
+	broker.mid = ++broker.next_mid;
+	broker.inflight = 1;
+	if ((int)(host_rand(&seed) % 100) < broker.loss_percent)
+	{
+		// PUBACK lost: the client retransmits well after our timeout
+		broker.puback_tick = now + pdMS_TO_TICKS(SIM_TIMEOUT_MS) + 50
+							 + (host_rand(&seed) % 100);
+		broker.lost++;
+	}
+	else
+	{
+		broker.puback_tick = now + 1 + (host_rand(&seed) % broker.max_latency);
+	}
+	return 0;
+}
+
+int mqtt_client_get_pub_msg_id(void)
+{
+	return broker.mid;
+}
+
+void trace_event(uint16_t event, uint16_t arg0, uint32_t arg1)
+{
+	(void)event;
+	(void)arg0;
+	(void)arg1;
+}
+
+/*
+ * The transmit map: a packet stays pending until it is delivered
+ */
+static int delivered_count[SIM_PACKETS];
+
+static void packet_delivered(packetDataStruct *packet)
+{
+	CHECK_EQ(delivered_count[packet->start_block], 0);
+	delivered_count[packet->start_block]++;
+}
+
+static int all_delivered(void)
+{
+	int i;
+
+	for (i = 0; i < SIM_PACKETS; i++)
+	{
+		if (delivered_count[i] == 0)
+		{
+			return pdFALSE;
+		}
+	}
+	return pdTRUE;
+}
+
+/*
+ * One transmission: publish every pending packet, then collect the last
+ * PUBACK.  Returns pdTRUE if the transmission completed.
+ */
+static int transmission(mqttPublisher *publisher, int qos)
+{
+	char payload[32];
+	packetDataStruct packet;
+	int i;
+
+	mqtt_publisher_reset(publisher);
+	for (i = 0; i < SIM_PACKETS; i++)
+	{
+		if (delivered_count[i])
+		{
+			continue;
+		}
+		memset(&packet, 0, sizeof(packet));
+		packet.start_block = i;
+		packet.num_samples = MAX_ACCEL_FIFO_SIZE;
+		snprintf(payload, sizeof(payload), "%d", i);
+		if (mqtt_publisher_send(publisher, payload, &packet, i, qos) != 0)
+		{
+			mqtt_publisher_collect(publisher);
+			return pdFALSE;
+		}
+		// Reading and composing the next packet
+		vTaskDelay(1 + (host_rand(&seed) % 3));
+	}
+	if (mqtt_publisher_wait(publisher) != 0)
+	{
+		mqtt_publisher_collect(publisher);
+		return pdFALSE;
+	}
+	return pdTRUE;
+}
+
+static void simulate(const char *name, int qos, int loss_percent, int busy_percent, int max_latency)
+{
+	mqttPublisher publisher;
+	TickType_t start = xTaskGetTickCount();
+	int attempts = 0;
+	int busy_retries = 0;
+	int duplicates = 0;
+	int i;
+
+	broker_reset(loss_percent, busy_percent, max_latency);
+	memset(delivered_count, 0, sizeof(delivered_count));
+	mqtt_publisher_init(&publisher, puback_queue, packet_delivered, SIM_TIMEOUT_MS);
+
+	while (!all_delivered() && (attempts < SIM_MAX_ATTEMPTS))
+	{
+		attempts++;
+		transmission(&publisher, qos);
+		busy_retries += publisher.busy_retries;
+	}
+
+	CHECK(all_delivered());
+	for (i = 0; i < SIM_PACKETS; i++)
+	{
+		CHECK_EQ(delivered_count[i], 1);
+		CHECK(broker.received[i] >= 1);
+		duplicates += broker.received[i] - 1;
+	}
+	printf("\n%-22s %d packets in %d transmissions, %.1f s simulated: "
+			"%d PUBACKs lost, %d client busy events, %d busy retries, %d resent\n",
+			name, SIM_PACKETS, attempts,
+			(xTaskGetTickCount() - start) / (double)configTICK_RATE_HZ,
+			broker.lost, broker.busy_events, busy_retries, duplicates);
+}
+
+/*
+ * The cases the old window code got wrong: the client refusing a publish
+ * while nothing of ours is inflight must be retried, not treated as an
+ * error, and only given up on (as a timeout) after the PUBACK timeout.
+ */
+static void check_busy_client(void)
+{
+	mqttPublisher publisher;
+	packetDataStruct packet;
+	char payload[] = "0";
+
+	memset(&packet, 0, sizeof(packet));
+	memset(delivered_count, 0, sizeof(delivered_count));
+	broker_reset(0, 0, 5);
+	mqtt_publisher_init(&publisher, puback_queue, packet_delivered, SIM_TIMEOUT_MS);
+	mqtt_publisher_reset(&publisher);
+
+	broker.busy_until = xTaskGetTickCount() + 30;
+	CHECK_EQ(mqtt_publisher_send(&publisher, payload, &packet, 0, 1), 0);
+	CHECK(publisher.busy_retries > 0);
+	CHECK_EQ(mqtt_publisher_wait(&publisher), 0);
+	CHECK_EQ(delivered_count[0], 1);
+
+	broker.busy_until = xTaskGetTickCount() + pdMS_TO_TICKS(SIM_TIMEOUT_MS) + 10;
+	CHECK_EQ(mqtt_publisher_send(&publisher, payload, &packet, 0, 1), -2);
+
+	broker.busy_until = 0;
+	broker.connected = 0;
+	CHECK_EQ(mqtt_publisher_send(&publisher, payload, &packet, 0, 1), -1);
+
+	// QOS 0: delivered as soon as it is published
+	broker.connected = 1;
+	packet.start_block = 1;
+	CHECK_EQ(mqtt_publisher_send(&publisher, payload, &packet, 1, 0), 0);
+	CHECK_EQ(delivered_count[1], 1);
+	CHECK(!publisher.inflight);
+}
+
+int main(void)
+{
+	puback_queue = xQueueCreate(4, sizeof(int));
+	host_rtos_set_tick_hook(broker_tick);
+
+	check_busy_client();
+
+	simulate("clean link", 1, 0, 0, 20);
+	simulate("slow broker", 1, 0, 0, 150);
+	simulate("lossy, busy client", 1, 3, 5, 60);
+	simulate("very lossy", 1, 15, 10, 100);
+
+	HOST_TEST_EXIT();
+}
@@ -0,0 +1,176 @@
+/*
+ * Host test and benchmark for user_sample_time.c
+ *
+ * sample_time_next() must give exactly what calculate_timestamp_for_sample()
+ * gives, for every sample: random blocks with long gaps, zero spans,
+ * backwards and negative times and up to 300 samples, then every
+ * combination of a small range.  The time per sample of both is reported.
+ */
+#include <time.h>
+#include "host_test.h"
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "user_sample_time.h"
+
+static long mismatches;
+
+static void check_block(__time64_t time, __time64_t time_prev, int num_samples)
+{
+	sampleTimeStepper stepper;
+	__time64_t expect;
+	__time64_t got;
+	int i;
+
+	sample_time_begin(&stepper, time, time_prev, num_samples);
+	for (i = 0; i < num_samples; i++)
+	{
+		calculate_timestamp_for_sample(&time, &time_prev, i, num_samples, &expect);
+		got = sample_time_next(&stepper);
+		if (got != expect)
+		{
+			if (mismatches++ < 10)
+			{
+				fprintf(stderr, "prev %lld time %lld sample %d of %d: %lld, expected %lld\n",
+						time_prev, time, i, num_samples, got, expect);
+			}
+		}
+	}
+}
+
+/*
+ * The reference is the formula in user_sample_time.h
+ */
+static void check_reference(void)
+{
+	__time64_t time = 432002286LL;
+	__time64_t time_prev = 432000000LL;
+	__time64_t expect;
+	int i;
+
+	for (i = 0; i < 32; i++)
+	{
+		calculate_timestamp_for_sample(&time, &time_prev, i, 32, &expect);
+		CHECK_EQ(expect, (time_prev * 1000 + ((time - time_prev) * 1000 * (i + 1)) / 32 + 500) / 1000);
+	}
+	calculate_timestamp_for_sample(&time, &time_prev, 31, 32, &expect);
+	CHECK_EQ(expect, time);
+}
+
+static void check_random(void)
+{
+	unsigned int seed = 23;
+	__time64_t time_prev, span;
+	int block, num_samples;
+	long samples = 0;
+
+	for (block = 0; block < 200000; block++)
+	{
+		time_prev = ((__time64_t)host_rand(&seed) << 12) | (host_rand(&seed) & 0xFFF);
+		switch (block % 5)
+		{
+		case 0:		// a FIFO interval, give or take
+			span = 2000 + (host_rand(&seed) % 1000);
+			break;
+		case 1:		// a long gap (sleep, lost interrupt)
+			span = host_rand(&seed);
+			break;
+		case 2:		// nothing, or time went backwards
+			span = -(__time64_t)(host_rand(&seed) % 5000);
+			break;
+		case 3:		// before the clock was set
+			time_prev = -(__time64_t)(host_rand(&seed) % 100000);
+			span = host_rand(&seed) % 5000;
+			break;
+		default:
+			span = host_rand(&seed) % 100;
+			break;
+		}
+		num_samples = 1 + (host_rand(&seed) % 300);
+		check_block(time_prev + span, time_prev, num_samples);
+		samples += num_samples;
+	}
+	CHECK_EQ(mismatches, 0);
+	printf("\n%ld random samples compared\n", samples);
+}
+
+static void check_exhaustive(void)
+{
+	__time64_t time_prev, span;
+	int num_samples;
+	long samples = 0;
+
+	for (time_prev = -3; time_prev < 60; time_prev++)
+	{
+		for (span = -5; span < 400; span++)
+		{
+			for (num_samples = 0; num_samples <= 40; num_samples++)
+			{
+				check_block(time_prev + span, time_prev, num_samples);
+				samples += num_samples;
+			}
+		}
+	}
+	CHECK_EQ(mismatches, 0);
+	printf("\n%ld samples compared over every small block\n", samples);
+}
+
+static double now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void benchmark(void)
+{
+	sampleTimeStepper stepper;
+	__time64_t time, time_prev, timestamp;
+	volatile __time64_t sink = 0;
+	const int blocks = 200000;
+	const int num_samples = 28;
+	double t0, t_reference, t_stepper;
+	int block, i;
+
+	t0 = now_sec();
+	for (block = 0; block < blocks; block++)
+	{
+		time_prev = 432000000LL + (__time64_t)block * 2286;
+		time = time_prev + 2286 + (block % 3);
+		for (i = 0; i < num_samples; i++)
+		{
+			calculate_timestamp_for_sample(&time, &time_prev, i, num_samples, &timestamp);
+			sink += timestamp;
+		}
+	}
+	t_reference = now_sec() - t0;
+
+	t0 = now_sec();
+	for (block = 0; block < blocks; block++)
+	{
+		time_prev = 432000000LL + (__time64_t)block * 2286;
+		time = time_prev + 2286 + (block % 3);
+		sample_time_begin(&stepper, time, time_prev, num_samples);
+		for (i = 0; i < num_samples; i++)
+		{
+			sink -= sample_time_next(&stepper);
+		}
+	}
+	t_stepper = now_sec() - t0;
+
+	CHECK_EQ(sink, 0);
+	printf("\n%d sample blocks: per sample %.1f nsec, stepper %.1f nsec (host)\n", num_samples,
+			t_reference / blocks / num_samples * 1e9, t_stepper / blocks / num_samples * 1e9);
+}
+
+int main(void)
+{
+	check_reference();
+	check_random();
+	check_exhaustive();
+	benchmark();
+
+	HOST_TEST_EXIT();
+}
@@ -0,0 +1,292 @@
+/*
+ * Host test and benchmark for user_transmit_map.c
+ *
+ * Random fills and clears of the map, checked after every step against a
+ * plain array of flags, then the searches timed against the block by
+ * block scan they replaced.  A map left by 1.10.17 must convert to the
+ * same pending pages, and stay equivalent as pages are sent.
+ */
+#include <string.h>
+#include <time.h>
+#include "host_test.h"
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "user_transmit_map.h"
+
+static _AB_transmit_map_t map[AB_TRANSMIT_MAP_SIZE];
+static unsigned char ref[AB_FLASH_MAX_BLOCKS];
+static unsigned int seed = 6;
+
+static int prev_pos(int pos)
+{
+	return (pos == 0) ? (AB_FLASH_MAX_BLOCKS - 1) : (pos - 1);
+}
+
+// The block by block scans the map searches replaced
+static int ref_find_prev(int start, int count)
+{
+	int pos = start;
+
+	while (count-- > 0)
+	{
+		if (ref[pos])
+		{
+			return pos;
+		}
+		pos = prev_pos(pos);
+	}
+	return -1;
+}
+
+static int ref_run_prev(int start, int count)
+{
+	int pos = start;
+	int run = 0;
+
+	while ((run < count) && ref[pos])
+	{
+		run++;
+		pos = prev_pos(pos);
+	}
+	return run;
+}
+
+static int ref_count(void)
+{
+	int n = 0;
+	int i;
+
+	for (i = 0; i < AB_FLASH_MAX_BLOCKS; i++)
+	{
+		n += ref[i];
+	}
+	return n;
+}
+
+static void set_range(int first, int last)
+{
+	int i;
+
+	for (i = first; i <= last; i++)
+	{
+		ab_map_set(map, i);
+		ref[i] = 1;
+	}
+}
+
+static void clear_range(int first, int last)
+{
+	int was_set = 0;
+	int i;
+
+	for (i = first; i <= last; i++)
+	{
+		was_set += ref[i];
+	}
+	CHECK_EQ(ab_map_clear_range(map, first, last), was_set);
+	memset(&ref[first], 0, last - first + 1);
+}
+
+static void check_queries(void)
+{
+	int start = host_rand(&seed) % AB_FLASH_MAX_BLOCKS;
+	int count = host_rand(&seed) % (AB_FLASH_MAX_BLOCKS + 1);
+
+	CHECK_EQ(ab_map_find_prev(map, start, count), ref_find_prev(start, count));
+	CHECK_EQ(ab_map_run_prev(map, start, count), ref_run_prev(start, count));
+	CHECK_EQ(ab_map_test(map, start), ref[start]);
+}
+
+static void check_random(void)
+{
+	int step, first, last, i;
+
+	for (step = 0; step < 200000; step++)
+	{
+		first = host_rand(&seed) % AB_FLASH_MAX_BLOCKS;
+		// Mostly short runs like packets and FIFO writes, sometimes long ones
+		last = first + ((host_rand(&seed) % 8) ? (host_rand(&seed) % 40)
+											   : (host_rand(&seed) % 3000));
+		if (last >= AB_FLASH_MAX_BLOCKS)
+		{
+			last = AB_FLASH_MAX_BLOCKS - 1;
+		}
+
+		switch (host_rand(&seed) % 3)
+		{
+		case 0:
+			set_range(first, last);
+			break;
+		case 1:
+			clear_range(first, last);
+			break;
+		default:
+			ab_map_set(map, first);
+			ref[first] = 1;
+			break;
+		}
+
+		check_queries();
+		if ((step % 1000) == 0)
+		{
+			CHECK_EQ(ab_map_count(map), ref_count());
+		}
+		if ((step % 20000) == 0)
+		{
+			// As after a reboot: the summary comes back from the map alone
+			ab_map_rebuild(map);
+		}
+	}
+
+	for (i = 0; i < AB_FLASH_MAX_BLOCKS; i++)
+	{
+		CHECK_EQ(ab_map_test(map, i), ref[i]);
+	}
+}
+
+static void check_edges(void)
+{
+	memset(map, 0, sizeof(map));
+	memset(ref, 0, sizeof(ref));
+	ab_map_rebuild(map);
+
+	CHECK_EQ(ab_map_count(map), 0);
+	CHECK_EQ(ab_map_find_prev(map, AB_FLASH_MAX_BLOCKS - 1, AB_FLASH_MAX_BLOCKS), -1);
+
+	// Searches wrap from block 0 to the last block
+	set_range(AB_FLASH_MAX_BLOCKS - 3, AB_FLASH_MAX_BLOCKS - 1);
+	set_range(0, 1);
+	CHECK_EQ(ab_map_find_prev(map, 10, AB_FLASH_MAX_BLOCKS), 1);
+	CHECK_EQ(ab_map_run_prev(map, 1, AB_FLASH_MAX_BLOCKS), 5);
+	CHECK_EQ(ab_map_run_prev(map, 1, 4), 4);
+	CHECK_EQ(ab_map_find_prev(map, 10, 9), -1);
+
+	// Clears on word boundaries
+	clear_range(0, 31);
+	clear_range(AB_FLASH_MAX_BLOCKS - 3, AB_FLASH_MAX_BLOCKS - 1);
+	CHECK_EQ(ab_map_count(map), 0);
+	set_range(31, 64);
+	clear_range(32, 63);
+	CHECK_EQ(ab_map_count(map), 2);
+	CHECK_EQ(ab_map_find_prev(map, 63, AB_FLASH_MAX_BLOCKS), 31);
+	clear_range(0, AB_FLASH_MAX_BLOCKS - 1);
+	CHECK_EQ(ab_map_count(map), 0);
+}
+
+/*
+ * The 1.10.17 map, with its own macros
+ */
+#define LEGACY_POS_TO_BIT(pos)		(1 << ((pos) % sizeof(_AB_transmit_map_t)))
+#define LEGACY_SET(src, pos)		((src)[(pos) / sizeof(_AB_transmit_map_t)] |= LEGACY_POS_TO_BIT(pos))
+#define LEGACY_CLR(src, pos)		((src)[(pos) / sizeof(_AB_transmit_map_t)] &= ~LEGACY_POS_TO_BIT(pos))
+#define LEGACY_TEST(src, pos)		(((src)[(pos) / sizeof(_AB_transmit_map_t)] & LEGACY_POS_TO_BIT(pos)) != 0)
+
+static void check_legacy_conversion(void)
+{
+	static _AB_transmit_map_t legacy[AB_LEGACY_TRANSMIT_MAP_SIZE];
+	int round, page, first, last, pending, i;
+
+	for (round = 0; round < 50; round++)
+	{
+		memset(legacy, 0, sizeof(legacy));
+		memset(map, 0, sizeof(map));
+		pending = 0;
+		for (page = 0; page < AB_FLASH_MAX_PAGES; page++)
+		{
+			// Runs of pending pages, denser in some rounds than others
+			if ((int)(host_rand(&seed) % 100) < (round * 2))
+			{
+				LEGACY_SET(legacy, page);
+				pending++;
+			}
+		}
+
+		CHECK_EQ(ab_map_convert_legacy(map, legacy), pending);
+		ab_map_rebuild(map);
+		CHECK_EQ(ab_map_count(map), pending);
+
+		// Then send a few runs of pages, each page in both maps
+		for (i = 0; i < 20; i++)
+		{
+			first = host_rand(&seed) % AB_FLASH_MAX_PAGES;
+			last = first + (host_rand(&seed) % 100);
+			if (last >= AB_FLASH_MAX_PAGES)
+			{
+				last = AB_FLASH_MAX_PAGES - 1;
+			}
+			for (page = first; page <= last; page++)
+			{
+				LEGACY_CLR(legacy, page);
+			}
+			ab_map_clear_range(map, first * AB_BLOCKS_PER_PAGE,
+					(last * AB_BLOCKS_PER_PAGE) + AB_BLOCKS_PER_PAGE - 1);
+		}
+
+		for (page = 0; page < AB_FLASH_MAX_PAGES; page++)
+		{
+			CHECK_EQ(ab_map_test(map, page * AB_BLOCKS_PER_PAGE), LEGACY_TEST(legacy, page));
+			for (i = 1; i < AB_BLOCKS_PER_PAGE; i++)
+			{
+				CHECK(!ab_map_test(map, (page * AB_BLOCKS_PER_PAGE) + i));
+			}
+		}
+	}
+}
+
+static double now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * A typical upload: a few hundred pending blocks somewhere in a mostly
+ * empty ring, found by searching down from the write position
+ */
+static void benchmark(void)
+{
+	const int reps = 2000;
+	volatile int sink = 0;
+	double t0, t_map, t_ref;
+	int rep, start;
+
+	memset(map, 0, sizeof(map));
+	memset(ref, 0, sizeof(ref));
+	ab_map_rebuild(map);
+	set_range(1000, 1300);
+	start = AB_FLASH_MAX_BLOCKS - 1;
+
+	t0 = now_sec();
+	for (rep = 0; rep < reps; rep++)
+	{
+		sink += ab_map_find_prev(map, start, AB_FLASH_MAX_BLOCKS);
+		sink += ab_map_count(map);
+	}
+	t_map = (now_sec() - t0) / reps;
+
+	t0 = now_sec();
+	for (rep = 0; rep < reps; rep++)
+	{
+		sink += ref_find_prev(start, AB_FLASH_MAX_BLOCKS);
+		sink += ref_count();
+	}
+	t_ref = (now_sec() - t0) / reps;
+
+	(void)sink;
+	printf("find + count over %d blocks: map %.2f usec, block by block %.2f usec (host)\n",
+			AB_FLASH_MAX_BLOCKS, t_map * 1e6, t_ref * 1e6);
+}
+
+int main(void)
+{
+	check_edges();
+	check_random();
+	check_legacy_conversion();
+	benchmark();
+
+	HOST_TEST_EXIT();
+}
@@ -0,0 +1,202 @@
+/*
+ * Two-thread stress test for the lock-free sharing of the transmit map
+ *
+ * A producer thread plays the accelerometer task: it writes a sequence
+ * number into each block, sets its map bit and publishes the new write
+ * position.  A consumer thread plays the MQTT task: it searches the map
+ * below the write position the way find_AB_transmit_location() does,
+ * "sends" the runs it finds and clears them.  Every block produced must
+ * be sent exactly once, and the map must be empty at the end.
+ *
+ * Run it under ThreadSanitizer with
+ *   cmake -S tests/host -B build-tsan -DCMAKE_C_FLAGS=-fsanitize=thread
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include "host_test.h"
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "user_transmit_map.h"
+
+#define TOTAL_BLOCKS			2000000
+#define MAX_RUN					5		// FIFO_BLOCKS_PER_PACKET
+
+static _AB_transmit_map_t map[AB_TRANSMIT_MAP_SIZE];
+static int write_position;
+static uint32_t data[AB_FLASH_MAX_BLOCKS];
+static unsigned char *sent;
+static int producer_done;
+
+// Results, only looked at once both threads have finished
+static long consumed;
+static long sent_twice;
+static long overwritten;
+static long producer_waits;
+
+static int prev_pos(int pos)
+{
+	return (pos == 0) ? (AB_FLASH_MAX_BLOCKS - 1) : (pos - 1);
+}
+
+// Same as AB_buffer_gap() and find_AB_transmit_location() in neuralert.c
+static int buffer_gap(int location, int write_location)
+{
+	return (location >= write_location) ? (location - write_location)
+			: (AB_FLASH_MAX_BLOCKS - (write_location - location));
+}
+
+static int find_transmit_location(int location, int max_run, int *run_length)
+{
+	int found = -1;
+	int write_location;
+	int search_count;
+	int skipped;
+
+	*run_length = 0;
+	write_location = AB_POSITION_LOAD(&write_position);
+	search_count = buffer_gap(location, write_location) - AB_TRANSMIT_SAFETY_GAP;
+	if (search_count > 0)
+	{
+		found = ab_map_find_prev(map, location, search_count);
+		if (found >= 0)
+		{
+			skipped = location - found;
+			if (skipped < 0)
+			{
+				skipped += AB_FLASH_MAX_BLOCKS;
+			}
+			if (max_run > search_count - skipped)
+			{
+				max_run = search_count - skipped;
+			}
+			*run_length = ab_map_run_prev(map, found, max_run);
+		}
+	}
+	return found;
+}
+
+static void *producer(void *arg)
+{
+	uint32_t seq;
+	int pos;
+
+	(void)arg;
+	for (seq = 0; seq < TOTAL_BLOCKS; seq++)
+	{
+		pos = write_position;
+
+		// Moving on takes the block a safety gap ahead out of the
+		// consumer's reach.  The device lets it go; here the producer
+		// waits, so that every block has to be delivered.
+		while (ab_map_test(map, (pos + 1 + AB_TRANSMIT_SAFETY_GAP) % AB_FLASH_MAX_BLOCKS))
+		{
+			producer_waits++;
+			sched_yield();
+		}
+		if (ab_map_test(map, pos))
+		{
+			overwritten++;
+		}
+
+		__atomic_store_n(&data[pos], seq, __ATOMIC_RELAXED);
+		ab_map_set(map, pos);
+		AB_POSITION_STORE(&write_position, (pos + 1) % AB_FLASH_MAX_BLOCKS);
+		if ((seq & 0x3FF) == 0)
+		{
+			sched_yield();
+		}
+	}
+	AB_POSITION_STORE(&producer_done, TRUE);
+	return NULL;
+}
+
+static void *consumer(void *arg)
+{
+	uint32_t seq;
+	int location, found, end, run, i;
+	int done, found_any;
+
+	(void)arg;
+	for (;;)
+	{
+		done = AB_POSITION_LOAD(&producer_done);
+		location = prev_pos(AB_POSITION_LOAD(&write_position));
+		found_any = FALSE;
+		while ((found = find_transmit_location(location, MAX_RUN, &run)) >= 0)
+		{
+			end = found;
+			for (i = 0; i < run; i++)
+			{
+				seq = __atomic_load_n(&data[end], __ATOMIC_RELAXED);
+				if (sent[seq]++)
+				{
+					sent_twice++;
+				}
+				consumed++;
+				if (i + 1 < run)
+				{
+					end = prev_pos(end);
+				}
+			}
+
+			// The run wraps from block 0 to the last block
+			if (end <= found)
+			{
+				ab_map_clear_range(map, end, found);
+			}
+			else
+			{
+				ab_map_clear_range(map, 0, found);
+				ab_map_clear_range(map, end, AB_FLASH_MAX_BLOCKS - 1);
+			}
+			location = prev_pos(end);
+			found_any = TRUE;
+		}
+		if (done && !found_any)
+		{
+			break;
+		}
+	}
+	return NULL;
+}
+
+int main(void)
+{
+	pthread_t producer_thread, consumer_thread;
+	long missing = 0;
+	long i;
+
+	sent = calloc(TOTAL_BLOCKS, 1);
+	CHECK(sent != NULL);
+	if (sent == NULL)
+	{
+		HOST_TEST_EXIT();
+	}
+	ab_map_rebuild(map);
+
+	CHECK_EQ(pthread_create(&consumer_thread, NULL, consumer, NULL), 0);
+	CHECK_EQ(pthread_create(&producer_thread, NULL, producer, NULL), 0);
+	pthread_join(producer_thread, NULL);
+	pthread_join(consumer_thread, NULL);
+
+	for (i = 0; i < TOTAL_BLOCKS; i++)
+	{
+		if (!sent[i])
+		{
+			missing++;
+		}
+	}
+	CHECK_EQ(missing, 0);
+	CHECK_EQ(sent_twice, 0);
+	CHECK_EQ(overwritten, 0);
+	CHECK_EQ(consumed, TOTAL_BLOCKS);
+	CHECK_EQ(ab_map_count(map), 0);
+	printf("\n%d blocks produced, %ld sent, %ld missing, %ld sent twice, %ld producer waits\n",
+			TOTAL_BLOCKS, consumed, missing, sent_twice, producer_waits);
+
+	free(sent);
+	HOST_TEST_EXIT();
+}
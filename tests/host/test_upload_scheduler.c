@@ -0,0 +1,327 @@
+/*
+ * Host test and link simulation for user_upload_scheduler.c
+ *
+ * Checks each rule of the interval and the NVRAM sanitizing, then runs
+ * a week of FIFO reads against a few link traces with the scheduler and
+ * with the fixed 16/80 triggers it replaced.  The radio time per 1000
+ * delivered samples and the blocks lost to the ring wrapping are
+ * reported for both, and so is the worst loss over single outages of
+ * lengths around what the ring holds.
+ */
+#include <string.h>
+#include "host_test.h"
+#include "sdk_type.h"
+#include "common_def.h"
+#include "da16x_types.h"
+#include "common.h"
+#include "user_upload_scheduler.h"
+
+static void check_rules(void)
+{
+	uploadSchedulerConfig config;
+	uploadSchedulerState state;
+
+	upload_scheduler_defaults(&config);
+	memset(&state, 0, sizeof(state));
+	state.pending_blocks = 100;
+	state.headroom_blocks = AB_FLASH_MAX_BLOCKS;
+
+	// A healthy link
+	CHECK_EQ(upload_scheduler_interval(&config, &state), UPLOAD_DEFAULT_MIN_FIFOS);
+	state.fifos_since_upload = UPLOAD_DEFAULT_MIN_FIFOS - 1;
+	CHECK(!upload_scheduler_due(&config, &state));
+	state.fifos_since_upload = UPLOAD_DEFAULT_MIN_FIFOS;
+	CHECK(upload_scheduler_due(&config, &state));
+
+	// Nothing to send, nothing to do
+	state.pending_blocks = 0;
+	CHECK(!upload_scheduler_due(&config, &state));
+	state.pending_blocks = 100;
+
+	// Failures: unchanged up to backoff_after, then doubling to max_fifos
+	state.failed_attempts = UPLOAD_DEFAULT_BACKOFF_AFTER;
+	CHECK_EQ(upload_scheduler_interval(&config, &state), 16);
+	state.failed_attempts++;
+	CHECK_EQ(upload_scheduler_interval(&config, &state), 32);
+	state.failed_attempts++;
+	CHECK_EQ(upload_scheduler_interval(&config, &state), 64);
+	state.failed_attempts++;
+	CHECK_EQ(upload_scheduler_interval(&config, &state), 80);
+	state.failed_attempts = 1000;
+	CHECK_EQ(upload_scheduler_interval(&config, &state), 80);
+
+	// Failing uploads back off less when the ring is nearly full
+	state.headroom_blocks = 0;
+	CHECK_EQ(upload_scheduler_interval(&config, &state), 16 << UPLOAD_URGENT_BACKOFF_DOUBLINGS);
+	state.failed_attempts = UPLOAD_DEFAULT_BACKOFF_AFTER;
+	CHECK_EQ(upload_scheduler_interval(&config, &state), 16);
+
+	// Succeeding uploads with the ring nearly full go back to min_fifos
+	state.failed_attempts = 0;
+	state.last_connect_msec = UPLOAD_DEFAULT_SLOW_CONNECT_MSEC + 1;
+	CHECK_EQ(upload_scheduler_interval(&config, &state), 16);
+	state.headroom_blocks = AB_FLASH_MAX_BLOCKS;
+
+	// A slow connect doubles the interval
+	CHECK_EQ(upload_scheduler_interval(&config, &state), 32);
+	state.last_connect_msec = UPLOAD_DEFAULT_SLOW_CONNECT_MSEC;
+	CHECK_EQ(upload_scheduler_interval(&config, &state), 16);
+
+	// Low battery: off by default, max_fifos once set
+	state.battery_cv = 330;
+	CHECK_EQ(upload_scheduler_interval(&config, &state), 16);
+	config.low_battery_cv = 340;
+	CHECK_EQ(upload_scheduler_interval(&config, &state), 80);
+	state.battery_cv = 0;		// not known yet
+	CHECK_EQ(upload_scheduler_interval(&config, &state), 16);
+}
+
+static void check_sanitize(void)
+{
+	uploadSchedulerConfig config;
+
+	memset(&config, 0, sizeof(config));
+	upload_scheduler_sanitize(&config);
+	CHECK_EQ(config.min_fifos, UPLOAD_DEFAULT_MIN_FIFOS);
+	CHECK_EQ(config.max_fifos, UPLOAD_DEFAULT_MIN_FIFOS);
+
+	config.min_fifos = UPLOAD_MAX_INTERVAL_FIFOS + 1;
+	config.max_fifos = UPLOAD_MAX_INTERVAL_FIFOS * 2;
+	config.backoff_after = -1;
+	config.slow_connect_msec = -1;
+	config.low_battery_cv = -1;
+	config.urgent_headroom = -1;
+	upload_scheduler_sanitize(&config);
+	CHECK_EQ(config.min_fifos, UPLOAD_DEFAULT_MIN_FIFOS);
+	CHECK_EQ(config.max_fifos, UPLOAD_MAX_INTERVAL_FIFOS);
+	CHECK_EQ(config.backoff_after, 0);
+	CHECK_EQ(config.slow_connect_msec, 0);
+	CHECK_EQ(config.low_battery_cv, 0);
+	CHECK_EQ(config.urgent_headroom, 0);
+
+	upload_scheduler_defaults(&config);
+	upload_scheduler_sanitize(&config);
+	CHECK_EQ(config.min_fifos, UPLOAD_DEFAULT_MIN_FIFOS);
+	CHECK_EQ(config.max_fifos, UPLOAD_DEFAULT_MAX_FIFOS);
+	CHECK_EQ(config.urgent_headroom, UPLOAD_DEFAULT_URGENT_HEADROOM);
+}
+
+/*
+ * Link simulation.  One step is one FIFO read; a failed attempt costs
+ * FAILED_ATTEMPT_SEC of radio time, a successful one its connect time
+ * plus the time to send what was pending.
+ */
+#define FIFO_SEC				(AXL_FIFO_INTERRUPT_THRESHOLD / 14.0)	// 14 Hz
+#define SIM_DAYS				7
+#define SIM_STEPS				((int)(SIM_DAYS * 24 * 3600 / FIFO_SEC))
+#define FAILED_ATTEMPT_SEC		30.0
+#define SEND_SEC_PER_BLOCK		0.05
+#define RING_BLOCKS				(AB_FLASH_MAX_BLOCKS - AB_TRANSMIT_SAFETY_GAP)
+
+enum { TRACE_UP, TRACE_SLOW, TRACE_LOW_BATTERY, TRACE_NIGHTLY_OUTAGE, TRACE_FLAKY, TRACE_KINDS };
+static const char * const trace_name[TRACE_KINDS] =
+{
+	"always up", "slow connect", "low battery", "nightly 10 h outage", "flaky link"
+};
+
+typedef struct
+{
+	uploadSchedulerConfig config;
+	uploadSchedulerState state;
+	int use_scheduler;
+	double radio_sec;
+	long delivered;
+	long lost;
+} simDevice;
+
+static void sim_init(simDevice *dev, int use_scheduler)
+{
+	memset(dev, 0, sizeof(*dev));
+	upload_scheduler_defaults(&dev->config);
+	dev->config.low_battery_cv = 340;
+	dev->use_scheduler = use_scheduler;
+}
+
+// The triggers the scheduler replaced
+static int fixed_due(int fifos_since_upload, int failed_attempts)
+{
+	return fifos_since_upload >= ((failed_attempts > 10) ? 80 : 16);
+}
+
+// One FIFO read; returns TRUE if it ended with a delivered upload
+static int sim_step(simDevice *dev, int link_up, int connect_msec, int battery_cv)
+{
+	uploadSchedulerState *state = &dev->state;
+	int due;
+
+	state->fifos_since_upload++;
+	state->pending_blocks++;
+	if (state->pending_blocks > RING_BLOCKS)
+	{
+		state->pending_blocks--;
+		dev->lost++;
+	}
+	state->headroom_blocks = RING_BLOCKS - state->pending_blocks;
+	state->battery_cv = battery_cv;
+
+	due = dev->use_scheduler ? upload_scheduler_due(&dev->config, state)
+			: fixed_due(state->fifos_since_upload, state->failed_attempts);
+	if (!due)
+	{
+		return FALSE;
+	}
+
+	state->fifos_since_upload = 0;
+	if (!link_up)
+	{
+		dev->radio_sec += FAILED_ATTEMPT_SEC;
+		state->failed_attempts++;
+		return FALSE;
+	}
+	state->last_connect_msec = connect_msec;
+	dev->radio_sec += (connect_msec / 1000.0) + (state->pending_blocks * SEND_SEC_PER_BLOCK);
+	dev->delivered += state->pending_blocks;
+	state->pending_blocks = 0;
+	state->failed_attempts = 0;
+	return TRUE;
+}
+
+static int trace_link_up(int trace, int step, unsigned int *seed)
+{
+	double hour = (step * FIFO_SEC / 3600.0);
+
+	switch (trace)
+	{
+	case TRACE_NIGHTLY_OUTAGE:
+		return ((int)hour % 24) < 14;
+	case TRACE_FLAKY:
+		return (host_rand(seed) % 2) == 0;
+	default:
+		return TRUE;
+	}
+}
+
+static int trace_connect_msec(int trace)
+{
+	return (trace == TRACE_SLOW) ? 20000 : 8000;
+}
+
+static int trace_battery_cv(int trace, int step)
+{
+	// Sinks through the cut-off half way through the week
+	return (trace == TRACE_LOW_BATTERY) ? 360 - (40 * step / SIM_STEPS) : 380;
+}
+
+static void simulate(simDevice *dev, int trace)
+{
+	unsigned int seed = 17;
+	int step;
+
+	for (step = 0; step < SIM_STEPS; step++)
+	{
+		sim_step(dev, trace_link_up(trace, step, &seed), trace_connect_msec(trace),
+				trace_battery_cv(trace, step));
+	}
+}
+
+/*
+ * Single outages of every length from OUTAGE_SWEEP_BLOCKS short of what
+ * the ring holds to as much over it.  Returns the most blocks lost on
+ * top of the ones the ring couldn't have held, which is down to how late
+ * the first upload after the outage comes.
+ */
+#define OUTAGE_SWEEP_BLOCKS		(4 * UPLOAD_DEFAULT_MAX_FIFOS)
+
+static long worst_outage_loss(int use_scheduler)
+{
+	simDevice dev;
+	long worst = 0;
+	long excess;
+	int outage, step;
+
+	for (outage = RING_BLOCKS - OUTAGE_SWEEP_BLOCKS; outage <= RING_BLOCKS + OUTAGE_SWEEP_BLOCKS; outage++)
+	{
+		sim_init(&dev, use_scheduler);
+		for (step = 0; step < 1000; step++)
+		{
+			sim_step(&dev, TRUE, 8000, 380);
+		}
+		for (step = 0; step < outage; step++)
+		{
+			sim_step(&dev, FALSE, 8000, 380);
+		}
+		while (!sim_step(&dev, TRUE, 8000, 380))
+		{
+		}
+
+		excess = dev.lost - ((outage > RING_BLOCKS) ? (outage - RING_BLOCKS) : 0);
+		if (excess > worst)
+		{
+			worst = excess;
+		}
+	}
+	return worst;
+}
+
+static void link_simulation(void)
+{
+	simDevice fixed, sched;
+	double fixed_cost, sched_cost;
+	long fixed_worst, sched_worst;
+	int trace;
+
+	printf("\n%d days, radio sec per 1000 delivered samples (blocks lost), fixed -> scheduler:",
+			SIM_DAYS);
+	for (trace = 0; trace < TRACE_KINDS; trace++)
+	{
+		sim_init(&fixed, FALSE);
+		sim_init(&sched, TRUE);
+		simulate(&fixed, trace);
+		simulate(&sched, trace);
+		fixed_cost = fixed.radio_sec * 1000.0 / (fixed.delivered * AXL_FIFO_INTERRUPT_THRESHOLD);
+		sched_cost = sched.radio_sec * 1000.0 / (sched.delivered * AXL_FIFO_INTERRUPT_THRESHOLD);
+		printf("\n  %-20s %6.2f (%ld) -> %6.2f (%ld)", trace_name[trace],
+				fixed_cost, fixed.lost, sched_cost, sched.lost);
+
+		if (trace == TRACE_NIGHTLY_OUTAGE)
+		{
+			// Longer than the ring holds (about 4 hours), so both lose
+			// data.  Once the ring is nearly full the scheduler retries
+			// more often than the fixed triggers, and pays for it in
+			// radio time for the rest of the outage.
+			CHECK(sched_cost <= fixed_cost * 1.35);
+		}
+		else
+		{
+			// Never worse than the fixed triggers by more than noise
+			CHECK(sched_cost <= fixed_cost * 1.01);
+			CHECK_EQ(fixed.lost, 0);
+			CHECK_EQ(sched.lost, 0);
+		}
+		if ((trace == TRACE_SLOW) || (trace == TRACE_LOW_BATTERY))
+		{
+			CHECK(sched_cost < fixed_cost * 0.9);
+		}
+	}
+
+	// The first upload after an outage is at most one interval late:
+	// max_fifos with the fixed triggers, the shortened backoff with the
+	// scheduler.  The upload before it was at most min_fifos early.
+	fixed_worst = worst_outage_loss(FALSE);
+	sched_worst = worst_outage_loss(TRUE);
+	printf("\n  worst loss per outage beyond the ring, %d to %d blocks: %ld -> %ld\n",
+			RING_BLOCKS - OUTAGE_SWEEP_BLOCKS, RING_BLOCKS + OUTAGE_SWEEP_BLOCKS,
+			fixed_worst, sched_worst);
+	CHECK(sched_worst < fixed_worst);
+	CHECK(sched_worst <= UPLOAD_DEFAULT_MIN_FIFOS
+			+ (UPLOAD_DEFAULT_MIN_FIFOS << UPLOAD_URGENT_BACKOFF_DOUBLINGS));
+}
+
+int main(void)
+{
+	check_rules();
+	check_sanitize();
+	link_simulation();
+
+	HOST_TEST_EXIT();
+}
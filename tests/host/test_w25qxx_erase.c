@@ -0,0 +1,152 @@
+/*
+ * Host test for the erase completion in W25QXX.c
+ *
+ * The driver runs against a model of the chip's status register.  An
+ * erase that takes its normal time completes; one that runs past its
+ * time limit makes flash_erase_wait() fail, stays in progress, and keeps
+ * the next flash_erase_begin() from issuing an erase until the chip is
+ * idle again.
+ */
+#include <string.h>
+#include "host_test.h"
+#include "host_rtos.h"
+#include "da16x_system.h"
+#include "W25QXX.h"
+
+#define CHIP_STUCK				((TickType_t)0xFFFFFFFF)
+
+static struct
+{
+	TickType_t busy_until;		// tick the running erase finishes on
+	TickType_t erase_ticks;		// how long the next erase takes
+	int write_enabled;
+	int erases;					// erase commands accepted
+	int rejected;				// erase commands sent while busy
+} chip;
+
+static int chip_busy(void)
+{
+	return xTaskGetTickCount() < chip.busy_until;
+}
+
+int host_spi_transmit(HANDLE spi, UINT8 command, UINT32 address, UINT32 mode,
+		UINT8 *tx, UINT32 tx_len, void *rx, UINT32 rx_len)
+{
+	switch (command)
+	{
+	case W25QXX_COMMAND_READ_STATUS_REG1:
+		*(UINT8 *)rx = (chip_busy() ? 0x01 : 0x00) | (chip.write_enabled ? 0x02 : 0x00);
+		break;
+	case W25QXX_COMMAND_READ_STATUS_REG2:
+		*(UINT8 *)rx = 0;
+		break;
+	case W25QXX_COMMAND_WRITE_ENABLE:
+		if (!chip_busy())
+		{
+			chip.write_enabled = TRUE;
+		}
+		break;
+	case W25QXX_COMMAND_SECTOR_ERASE_4K:
+	case W25QXX_COMMAND_BLOCK_ERASE_32K:
+	case W25QXX_COMMAND_BLOCK_ERASE_64K:
+		if (chip_busy() || !chip.write_enabled)
+		{
+			chip.rejected++;
+		}
+		else
+		{
+			chip.erases++;
+			chip.busy_until = (chip.erase_ticks == CHIP_STUCK) ?
+					CHIP_STUCK : xTaskGetTickCount() + chip.erase_ticks;
+		}
+		chip.write_enabled = FALSE;
+		break;
+	}
+	return 0;
+}
+
+static void check_normal_erase(HANDLE flash)
+{
+	TickType_t start;
+
+	chip.erase_ticks = pdMS_TO_TICKS(60);
+	start = xTaskGetTickCount();
+	CHECK(flash_erase_begin(flash, W25QXX_ERASE_4K, 0x1000) == TRUE);
+	CHECK(flash_erase_poll(flash) == TRUE);
+	CHECK(flash_erase_wait(flash) == TRUE);
+	CHECK(!chip_busy());
+	CHECK(flash_erase_poll(flash) == FALSE);
+	CHECK((xTaskGetTickCount() - start) * portTICK_PERIOD_MS < 60 + 80);
+
+	chip.erase_ticks = pdMS_TO_TICKS(900);
+	CHECK(eraseBlock_64K(flash, 0x10000) == TRUE);
+	CHECK_EQ(chip.erases, 2);
+	CHECK_EQ(chip.rejected, 0);
+}
+
+/*
+ * A 4K erase that doesn't finish within its 1 sec limit
+ */
+static void check_overrun(HANDLE flash)
+{
+	TickType_t start;
+	UINT32 waited_msec;
+
+	chip.erase_ticks = CHIP_STUCK;
+	start = xTaskGetTickCount();
+	CHECK(flash_erase_begin(flash, W25QXX_ERASE_4K, 0x2000) == TRUE);
+	CHECK(flash_erase_wait(flash) == FALSE);
+	waited_msec = (xTaskGetTickCount() - start) * portTICK_PERIOD_MS;
+	CHECK(waited_msec > 1000);
+	CHECK(waited_msec <= 1000 + 80);
+
+	// Still running as far as the driver is concerned
+	CHECK(flash_erase_poll(flash) == TRUE);
+	CHECK(flash_erase_wait(flash) == FALSE);
+
+	// Another erase is refused without touching the chip
+	CHECK(flash_erase_begin(flash, W25QXX_ERASE_4K, 0x3000) == FALSE);
+	CHECK(eraseSector_4K(flash, 0x3000) == FALSE);
+	CHECK_EQ(chip.erases, 3);
+	CHECK_EQ(chip.rejected, 0);
+
+	// The chip comes back: the erase completes and the next one goes
+	chip.busy_until = xTaskGetTickCount() + pdMS_TO_TICKS(200);
+	vTaskDelay(pdMS_TO_TICKS(250));
+	CHECK(flash_erase_poll(flash) == FALSE);
+	chip.erase_ticks = pdMS_TO_TICKS(60);
+	CHECK(eraseSector_4K(flash, 0x3000) == TRUE);
+	CHECK_EQ(chip.erases, 4);
+	CHECK_EQ(chip.rejected, 0);
+}
+
+/*
+ * The chip gives up late: the waiting begin gets it as soon as it's done
+ */
+static void check_late_finish(HANDLE flash)
+{
+	chip.erase_ticks = pdMS_TO_TICKS(800);
+	CHECK(flash_erase_begin(flash, W25QXX_ERASE_4K, 0x4000) == TRUE);
+	chip.erase_ticks = pdMS_TO_TICKS(60);
+	CHECK(flash_erase_begin(flash, W25QXX_ERASE_4K, 0x5000) == TRUE);
+	CHECK(flash_erase_wait(flash) == TRUE);
+	CHECK_EQ(chip.erases, 6);
+	CHECK_EQ(chip.rejected, 0);
+}
+
+int main(void)
+{
+	HANDLE flash;
+
+	memset(&chip, 0, sizeof(chip));
+	flash = flash_open(20, 0);
+	CHECK(flash != NULL);
+
+	check_normal_erase(flash);
+	check_overrun(flash);
+	check_late_finish(flash);
+	printf("\n%u erase polls\n", (unsigned int)flash_erase_poll_count());
+
+	flash_close(flash);
+	HOST_TEST_EXIT();
+}
@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""
+Decode the Neuralert event trace.
+
+Capture the output of the "user.trace" console command (one or more
+dumps, with any other console output mixed in) and run:
+
+    python3 tools/trace_decode.py console.log
+    python3 tools/trace_decode.py --timeline console.log
+
+Prints a histogram of how long each phase took and, with --timeline,
+every event with the time since the previous one.  The record format and
+event ids are defined in neuralert/include/apps/user_trace.h.
+"""
+
+import argparse
+import re
+import sys
+
+# Must match TRACE_EV_* in user_trace.h
+EVENT_NAMES = {
+    1: "boot",
+    2: "wake",
+    3: "sleep",
+    4: "fifo",
+    5: "wr_start",
+    6: "wr_end",
+    7: "erase_start",
+    8: "erase_end",
+    9: "upload_start",
+    10: "wifi_up",
+    11: "mqtt_connect",
+    12: "publish",
+    13: "puback",
+    14: "upload_end",
+}
+
+# (phase name, start events, end event)
+PHASES = [
+    ("awake", ("boot", "wake"), "sleep"),
+    ("flash write", ("wr_start",), "wr_end"),
+    ("flash erase", ("erase_start",), "erase_end"),
+    ("wifi up", ("upload_start",), "wifi_up"),
+    ("mqtt connect", ("upload_start",), "mqtt_connect"),
+    ("upload", ("upload_start",), "upload_end"),
+]
+
+RECORD = re.compile(r"^\s*T (\d+) (\d+) (\d+) (\d+) (\d+)")
+
+
+def read_records(lines):
+    """Return the records sorted by record number, duplicates removed."""
+    records = {}
+    for line in lines:
+        match = RECORD.match(line)
+        if match:
+            seq, msec, event, arg0, arg1 = (int(v) for v in match.groups())
+            records[seq] = (msec, EVENT_NAMES.get(event, "ev%d" % event), arg0, arg1)
+    return [records[seq] for seq in sorted(records)]
+
+
+def unwrap(records):
+    """The device keeps the low 32 bits of the msec counter."""
+    result = []
+    offset = 0
+    prev = None
+    for msec, name, arg0, arg1 in records:
+        if name == "boot":
+            offset = 0
+        elif prev is not None and msec + offset < prev:
+            offset += 1 << 32
+        prev = msec + offset
+        result.append((prev, name, arg0, arg1))
+    return result
+
+
+def phase_durations(records):
+    durations = {name: [] for name, _, _ in PHASES}
+    for phase, starts, end in PHASES:
+        start = None
+        for msec, name, _, _ in records:
+            if name in starts:
+                start = msec
+            elif name == end and start is not None:
+                durations[phase].append(msec - start)
+                start = None
+            elif name == "boot":
+                start = None
+
+    # A PUBACK answers the oldest publish still waiting
+    durations["puback"] = []
+    waiting = []
+    for msec, name, _, _ in records:
+        if name == "publish":
+            waiting.append(msec)
+        elif name == "puback" and waiting:
+            durations["puback"].append(msec - waiting.pop(0))
+        elif name in ("upload_end", "boot"):
+            waiting = []
+    return durations
+
+
+def print_histogram(phase, values):
+    print("%s: %d samples" % (phase, len(values)))
+    if not values:
+        return
+    values = sorted(values)
+    print("  min %d  median %d  p90 %d  max %d msec" % (
+        values[0], values[len(values) // 2],
+        values[min(len(values) - 1, (len(values) * 9) // 10)], values[-1]))
+
+    # Power of two buckets
+    buckets = {}
+    for value in values:
+        bucket = 0
+        while (1 << bucket) <= value:
+            bucket += 1
+        buckets[bucket] = buckets.get(bucket, 0) + 1
+    widest = max(buckets.values())
+    for bucket in range(min(buckets), max(buckets) + 1):
+        count = buckets.get(bucket, 0)
+        low = 0 if bucket == 0 else 1 << (bucket - 1)
+        high = (1 << bucket) - 1
+        bar = "#" * ((count * 40 + widest - 1) // widest)
+        print("  %7d..%-7d %5d %s" % (low, high, count, bar))
+
+
+def print_timeline(records):
+    if not records:
+        return
+    first = records[0][0]
+    prev = first
+    print("%10s %8s  %-13s %6s %10s" % ("msec", "+delta", "event", "arg0", "arg1"))
+    for msec, name, arg0, arg1 in records:
+        print("%10d %+8d  %-13s %6d %10d" % (msec - first, msec - prev, name, arg0, arg1))
+        prev = msec
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("files", nargs="*", help="console captures (default stdin)")
+    parser.add_argument("--timeline", action="store_true", help="also list every event")
+    args = parser.parse_args()
+
+    lines = []
+    if args.files:
+        for path in args.files:
+            with open(path, errors="replace") as capture:
+                lines.extend(capture)
+    else:
+        lines = sys.stdin.readlines()
+
+    records = unwrap(read_records(lines))
+    if not records:
+        print("No trace records found")
+        return 1
+
+    if args.timeline:
+        print_timeline(records)
+        print()
+
+    durations = phase_durations(records)
+    for phase, _, _ in PHASES:
+        print_histogram(phase, durations[phase])
+    print_histogram("puback", durations["puback"])
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())